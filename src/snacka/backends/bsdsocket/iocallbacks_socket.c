@@ -56,6 +56,32 @@ snError snSocketConnectCallback(void* userData,
     return SN_NO_ERROR;
 }
 
+snError snSocketConnectWithDataCallback(void* userData,
+                                        const char* host,
+                                        int port,
+                                        const char* data,
+                                        int numBytes)
+{
+    stfSocket* socket = (stfSocket*)userData;
+    int result = stfSocket_connectWithData(socket, host, port, data, numBytes);
+    if (result == 0)
+    {
+        return SN_SOCKET_FAILED_TO_CONNECT;
+    }
+    return SN_NO_ERROR;
+}
+
+snError snSocketAcceptCallback(void* userData, int descriptor)
+{
+    stfSocket* socket = (stfSocket*)userData;
+    int result = stfSocket_adopt(socket, descriptor);
+    if (result == 0)
+    {
+        return SN_SOCKET_FAILED_TO_CONNECT;
+    }
+    return SN_NO_ERROR;
+}
+
 snError snSocketIsOpenCallback(void* userData, int* isOpen)
 {
     stfSocket* socket = (stfSocket*)userData;
@@ -103,3 +129,62 @@ snError snSocketWriteCallback(void* userData,
     
     return success ? SN_NO_ERROR : SN_SOCKET_IO_ERROR;
 }
+
+snError snSocketWriteVectorCallback(void* userData,
+                                    const snIOBuffer* buffers,
+                                    int numBuffers,
+                                    int* numBytesWritten)
+{
+    stfSocket* socket = (stfSocket*)userData;
+    const char* bufferPointers[STF_SOCKET_MAX_NUM_BUFFERS];
+    int bufferSizes[STF_SOCKET_MAX_NUM_BUFFERS];
+    int firstBuffer = 0;
+    
+    *numBytesWritten = 0;
+    
+    /*send at most STF_SOCKET_MAX_NUM_BUFFERS buffers at a time*/
+    while (firstBuffer < numBuffers)
+    {
+        const int numBuffersLeft = numBuffers - firstBuffer;
+        const int batchSize = numBuffersLeft < STF_SOCKET_MAX_NUM_BUFFERS ? numBuffersLeft : STF_SOCKET_MAX_NUM_BUFFERS;
+        int numBatchBytes = 0;
+        int numBatchBytesWritten = 0;
+        int i;
+        
+        for (i = 0; i < batchSize; i++)
+        {
+            bufferPointers[i] = buffers[firstBuffer + i].bytes;
+            bufferSizes[i] = buffers[firstBuffer + i].numBytes;
+            numBatchBytes += bufferSizes[i];
+        }
+        
+        const int success = stfSocket_sendDataVector(socket,
+                                                     bufferPointers,
+                                                     bufferSizes,
+                                                     batchSize,
+                                                     &numBatchBytesWritten);
+        if (!success)
+        {
+            return SN_SOCKET_IO_ERROR;
+        }
+        
+        *numBytesWritten += numBatchBytesWritten;
+        
+        if (numBatchBytesWritten < numBatchBytes)
+        {
+            /*the socket would block*/
+            break;
+        }
+        
+        firstBuffer += batchSize;
+    }
+    
+    return SN_NO_ERROR;
+}
+
+snError snSocketGetDescriptorCallback(void* userData, int* descriptor)
+{
+    stfSocket* socket = (stfSocket*)userData;
+    *descriptor = stfSocket_getDescriptor(socket);
+    return SN_NO_ERROR;
+}
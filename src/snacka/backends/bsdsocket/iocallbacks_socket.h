@@ -47,6 +47,14 @@ extern "C"
                                     const char* url,
                                     int port);
     
+    snError snSocketConnectWithDataCallback(void* socket,
+                                            const char* url,
+                                            int port,
+                                            const char* data,
+                                            int numBytes);
+    
+    snError snSocketAcceptCallback(void* socket, int descriptor);
+    
     snError snSocketIsOpenCallback(void* socket, int* isOpen);
     
     snError snSocketDisconnectCallback(void* socket);
@@ -61,6 +69,13 @@ extern "C"
                                   int bufferSize,
                                   int* numBytesWritten);
     
+    snError snSocketWriteVectorCallback(void* socket,
+                                        const snIOBuffer* buffers,
+                                        int numBuffers,
+                                        int* numBytesWritten);
+    
+    snError snSocketGetDescriptorCallback(void* socket, int* descriptor);
+    
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -38,12 +38,17 @@ extern "C"
 {
 #endif /* __cplusplus */
     
+    /** The maximum number of buffers passed to \c stfSocket_sendDataVector. */
+#define STF_SOCKET_MAX_NUM_BUFFERS 16
+    
     typedef enum stfSocketConnectionState
     {
         STF_SOCKET_NOT_CONNECTED = 0,
         STF_SOCKET_CONNECTED,
         STF_SOCKET_CONNECTING,
-        STF_SOCKET_CONNECTION_FAILED
+        STF_SOCKET_CONNECTION_FAILED,
+        /** Waiting for the host name to be resolved before connecting. */
+        STF_SOCKET_RESOLVING
     } stfSocketConnectionState;
     
     /** */
@@ -57,7 +62,8 @@ extern "C"
     
     /** 
      * Starts connecting a socket to a given host and port. This function returns
-     * immediately. Call \c stfSocket_getConnectionState to see if the connection
+     * immediately, resolving the host in the background if it's not cached.
+     * Call \c stfSocket_getConnectionState to see if the connection
      * failed, succeeded or is still in progress.
      * @param s The socket to connect.
      * @param host The host to connect to.
@@ -65,16 +71,74 @@ extern "C"
      */
     int stfSocket_connect(stfSocket* s, const char* host, int port);
     
+    /**
+     * Like \c stfSocket_connect, but also sends some data as early as possible.
+     * Where TCP Fast Open is supported and the host has handed out a cookie
+     * on an earlier connection, the data is sent in the SYN, saving a round trip.
+     * Otherwise, the data is sent as soon as the connection is established.
+     * @param s The socket to connect.
+     * @param host The host to connect to.
+     * @param port The port to connect to.
+     * @param data The data to send. Copied by the socket.
+     * @param numBytes The number of bytes to send, small enough to fit in
+     * the send buffer of a new socket, e.g. an HTTP request.
+     */
+    int stfSocket_connectWithData(stfSocket* s, const char* host, int port,
+                                  const char* data, int numBytes);
+    
+    /**
+     * Makes a socket take ownership of a connected descriptor, e.g. one
+     * returned by \c accept, and sets it up like the descriptors of
+     * sockets connected using \c stfSocket_connect.
+     * @param s The socket, which must not be connected.
+     * @param descriptor The descriptor. On success, it is closed when the
+     * socket is disconnected.
+     * @return Zero on failure, non-zero on success.
+     */
+    int stfSocket_adopt(stfSocket* s, int descriptor);
+    
     /** */
     void stfSocket_disconnect(stfSocket* socket);
     
     /** */
     stfSocketConnectionState stfSocket_poll(stfSocket* socket);
     
-    /** */
+    /**
+     * @param socket The socket.
+     * @return The socket's file descriptor, or -1 if it is not connected. While
+     * the host name is being resolved, a descriptor that becomes readable when
+     * the socket is ready to be polled again.
+     */
+    int stfSocket_getDescriptor(stfSocket* socket);
+    
+    /**
+     * Sends as much data as the socket's send buffer has room for, without blocking.
+     * @param socket The socket to send data on.
+     * @param data The data to send.
+     * @param numBytes The number of bytes to send.
+     * @param numSentBytes Set to the number of bytes sent, which may be less than \c numBytes.
+     * @return Zero on failure, non-zero on success.
+     */
     int stfSocket_sendData(stfSocket* socket, const char* data, int numBytes,
                            int* numSentBytes);
 
+    /**
+     * Sends the contents of several buffers, in order, without blocking. Uses a single
+     * system call if the socket's send buffer has room for all of them.
+     * @param s The socket to send data on.
+     * @param buffers The buffers to send.
+     * @param bufferSizes The size of each buffer in bytes.
+     * @param numBuffers The number of buffers. At most \c STF_SOCKET_MAX_NUM_BUFFERS.
+     * @param numSentBytes Set to the total number of bytes sent, which may be
+     * less than the total size of the buffers.
+     * @return Zero on failure, non-zero on success.
+     */
+    int stfSocket_sendDataVector(stfSocket* s,
+                                 const char** buffers,
+                                 const int* bufferSizes,
+                                 int numBuffers,
+                                 int* numSentBytes);
+
     /** */    
     int stfSocket_receiveData(stfSocket* s, char* data, int maxNumBytes, int* numBytesReceived);
     
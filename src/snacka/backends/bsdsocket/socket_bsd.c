@@ -28,6 +28,11 @@
  * either expressed or implied, of the copyright holders.
  */
 
+#ifdef __linux__
+/*for timerfd, CLOCK_MONOTONIC and the Linux socket options*/
+#define _GNU_SOURCE
+#endif
+
 #include <assert.h>
 #include <arpa/inet.h>
 #include <errno.h>
@@ -37,6 +42,7 @@
 #include <string.h>
 #include <sys/poll.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
 #include <string.h>
@@ -45,7 +51,25 @@
 #include <unistd.h>
 #include <netdb.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif /*__linux__*/
+
 #include "socket.h"
+#include "../../resolver.h"
+#include "../../timerwheel.h"
+
+/**
+ * The time in milliseconds to wait for a connection attempt before
+ * starting one to the next address, as recommended by RFC 8305.
+ */
+#define STF_SOCKET_CONNECTION_ATTEMPT_DELAY 250
+
+#ifndef MSG_NOSIGNAL
+/** Platforms without this flag disable SIGPIPE per socket using SO_NOSIGPIPE. */
+#define MSG_NOSIGNAL 0
+#endif /*MSG_NOSIGNAL*/
 
 struct stfSocket
 {
@@ -54,6 +78,33 @@ struct stfSocket
     int port;
     int logErrors;
     stfSocketConnectionState connectionState;
+    /** The pending host name lookup while resolving, otherwise NULL. */
+    snResolveRequest* resolveRequest;
+    /** The addresses to try connecting to, alternating between address families. */
+    snResolvedAddress addresses[SN_RESOLVER_MAX_ADDRESSES];
+    /** */
+    int numAddresses;
+    /** The index of the address to try next. */
+    int nextAddress;
+    /** Sockets with connection attempts in progress. */
+    int attemptDescriptors[SN_RESOLVER_MAX_ADDRESSES];
+    /** */
+    int numAttempts;
+    /** The number of bytes of \c earlyData each attempt has sent in its SYN. */
+    int attemptNumEarlyBytesSent[SN_RESOLVER_MAX_ADDRESSES];
+    /** Data to send when connecting, using TCP Fast Open if possible, or NULL. */
+    char* earlyData;
+    /** */
+    int numEarlyBytes;
+    /** The monotonic time in milliseconds to start the next attempt, unless one succeeds. */
+    long long nextAttemptTime;
+    /**
+     * An epoll instance watching the attempts and \c timerDescriptor, so that
+     * they can be waited for with a single descriptor, or -1.
+     */
+    int waitDescriptor;
+    /** A timerfd expiring at \c nextAttemptTime, or -1. */
+    int timerDescriptor;
 };
 
 static void log(stfSocket* s, const char* fmt, ...)
@@ -200,6 +251,8 @@ stfSocket* stfSocket_new()
     newSocket->connectionState = STF_SOCKET_NOT_CONNECTED;
     newSocket->logErrors = 1;
     newSocket->fileDescriptor = -1;
+    newSocket->waitDescriptor = -1;
+    newSocket->timerDescriptor = -1;
     return newSocket;
 }
 
@@ -218,94 +271,360 @@ void stfSocket_delete(stfSocket* socket)
     }
 }
 
-int stfSocket_connect(stfSocket* s,
-                      const char* host,
-                      int port)
+/**
+ * Copies resolved addresses to a socket, in the order recommended by RFC 8305:
+ * alternating between the family of the first address and the other family.
+ */
+static void setAddresses(stfSocket* s, snResolveRequest* request)
 {
-    errno = 0;
+    int numAddresses = 0;
+    const snResolvedAddress* addresses = snResolveRequest_getAddresses(request, &numAddresses);
+    const int firstFamily = addresses[0].address.ss_family;
+    int nextOfFamily[2] = {0, 0};
+    int i;
+    
+    s->numAddresses = 0;
+    s->nextAddress = 0;
     
-    if (s->fileDescriptor != -1)
+    while (s->numAddresses < numAddresses)
     {
-        /*shut down existing connection*/
-        stfSocket_disconnect(s);
+        /*take the next address of the family whose turn it is, or of the other one*/
+        for (i = 0; i < 2; i++)
+        {
+            const int isFirstFamily = (s->numAddresses + i) % 2 == 0;
+            int* next = &nextOfFamily[isFirstFamily ? 0 : 1];
+            
+            while (*next < numAddresses &&
+                   (addresses[*next].address.ss_family == firstFamily) != isFirstFamily)
+            {
+                (*next)++;
+            }
+            
+            if (*next < numAddresses)
+            {
+                memcpy(&s->addresses[s->numAddresses], &addresses[*next], sizeof(snResolvedAddress));
+                s->numAddresses++;
+                (*next)++;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Wakes up whoever waits for \c waitDescriptor when the next attempt is due.
+ */
+static void setAttemptTimer(stfSocket* s, int delayMs)
+{
+#ifdef __linux__
+    if (s->timerDescriptor >= 0)
+    {
+        struct itimerspec t;
+        memset(&t, 0, sizeof(t));
+        t.it_value.tv_sec = delayMs / 1000;
+        t.it_value.tv_nsec = (delayMs % 1000) * 1000000L + (delayMs == 0);
+        timerfd_settime(s->timerDescriptor, 0, &t, NULL);
+    }
+#endif /*__linux__*/
+}
+
+static void closeAttempt(stfSocket* s, int index)
+{
+    close(s->attemptDescriptors[index]);
+    s->numAttempts--;
+    s->attemptDescriptors[index] = s->attemptDescriptors[s->numAttempts];
+    s->attemptNumEarlyBytesSent[index] = s->attemptNumEarlyBytesSent[s->numAttempts];
+}
+
+/**
+ * Closes all connection attempts except, optionally, one that succeeded.
+ */
+static void closeAttempts(stfSocket* s, int keptDescriptor)
+{
+    int i;
+    
+    for (i = 0; i < s->numAttempts; i++)
+    {
+        if (s->attemptDescriptors[i] != keptDescriptor)
+        {
+            close(s->attemptDescriptors[i]);
+        }
     }
+    s->numAttempts = 0;
     
-    /* Create hints for getaddrinfo */
-    struct addrinfo* addrinfoResult;
-    struct addrinfo hints;
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
-    char service[256];
-    sprintf(service, "%d", port);
-    
-    /* Get address to connect to. TODO: this call is blocking...*/
-    int error = getaddrinfo(host, service, &hints, &addrinfoResult);
-    if (error != 0)
+    if (s->waitDescriptor >= 0)
     {
-        return 0;
+        close(s->waitDescriptor);
+        close(s->timerDescriptor);
     }
+    s->waitDescriptor = -1;
+    s->timerDescriptor = -1;
+}
+
+/**
+ * Starts a non-blocking connect on a socket. If there is early data, it is
+ * put in the SYN using TCP Fast Open if the kernel has a cookie for the address.
+ * Without a cookie, no data is sent and the kernel asks the host for one.
+ * @return Zero if the connection attempt failed right away, non-zero otherwise.
+ */
+static int connectAttempt(stfSocket* s,
+                          int descriptor,
+                          const struct sockaddr_storage* address,
+                          socklen_t addressSize,
+                          int* numEarlyBytesSent)
+{
+    *numEarlyBytesSent = 0;
     
-    /* create the socket */
-    struct addrinfo* p = addrinfoResult;
-    for(p = addrinfoResult; p != NULL; p = p->ai_next)
+#ifdef MSG_FASTOPEN
+    if (s->earlyData)
     {
-        s->fileDescriptor = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (s->fileDescriptor == -1)
+        errno = 0;
+        const ssize_t ret = sendto(descriptor, s->earlyData, s->numEarlyBytes, MSG_FASTOPEN,
+                                   (const struct sockaddr*)address, addressSize);
+        if (ret >= 0)
         {
-            
-            continue;
+            *numEarlyBytesSent = (int)ret;
+            return 1;
         }
-        else
+        
+        if (errno == EINPROGRESS)
         {
-            break;
+            return 1;
         }
+        
+        /*e.g. TCP Fast Open is disabled. fall back to a plain connect.*/
     }
+#endif /*MSG_FASTOPEN*/
     
-    if (s->fileDescriptor == -1)
+    return connect(descriptor, (const struct sockaddr*)address, addressSize) == 0 || errno == EINPROGRESS;
+}
+
+/**
+ * Starts a non-blocking connect to the next address that a socket can be created for.
+ * @return Zero if there are no addresses left, non-zero otherwise.
+ */
+static int startNextAttempt(stfSocket* s)
+{
+    while (s->nextAddress < s->numAddresses)
     {
+        const snResolvedAddress* resolvedAddress = &s->addresses[s->nextAddress];
+        struct sockaddr_storage address;
+        s->nextAddress++;
+        
+        /* create the socket */
+        const int descriptor = socket(resolvedAddress->address.ss_family, SOCK_STREAM, IPPROTO_TCP);
+        if (descriptor == -1)
+        {
+            continue;
+        }
+        
+        memcpy(&address, &resolvedAddress->address, resolvedAddress->addressSize);
+        if (address.ss_family == AF_INET6)
+        {
+            ((struct sockaddr_in6*)&address)->sin6_port = htons(s->port);
+        }
+        else
+        {
+            ((struct sockaddr_in*)&address)->sin_port = htons(s->port);
+        }
+        
+        /*set socket to non-blocking*/
+        int flags = fcntl(descriptor, F_GETFL, 0);
+        fcntl(descriptor, F_SETFL, flags | O_NONBLOCK);
+        
+        /*disable nagle's algrithm*/
+        int flag = 1;
+        setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof flag);
+        
+#ifdef SO_NOSIGPIPE
+        /*disable sigpipe. where this is not available, sends pass MSG_NOSIGNAL instead.*/
+        int set = 1;
+        setsockopt(descriptor, SOL_SOCKET, SO_NOSIGPIPE, (void *)&set, sizeof(int));
+#endif /*SO_NOSIGPIPE*/
+        
+        /*attempt async connect. if it completes right away, the socket is
+          writable and stfSocket_poll says so.*/
+        int numEarlyBytesSent = 0;
+        if (!connectAttempt(s, descriptor, &address, resolvedAddress->addressSize, &numEarlyBytesSent))
+        {
+            /*e.g. no route to the host. move on right away.*/
+            close(descriptor);
+            continue;
+        }
+        
+        s->attemptDescriptors[s->numAttempts] = descriptor;
+        s->attemptNumEarlyBytesSent[s->numAttempts] = numEarlyBytesSent;
+        s->numAttempts++;
+        
+#ifdef __linux__
+        if (s->waitDescriptor >= 0)
+        {
+            struct epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLOUT;
+            epoll_ctl(s->waitDescriptor, EPOLL_CTL_ADD, descriptor, &event);
+        }
+#endif /*__linux__*/
+        
+        s->nextAttemptTime = snTimerWheel_getMonotonicTime() + STF_SOCKET_CONNECTION_ATTEMPT_DELAY;
+        if (s->nextAddress < s->numAddresses)
+        {
+            setAttemptTimer(s, STF_SOCKET_CONNECTION_ATTEMPT_DELAY);
+        }
+        
         return 1;
     }
     
-    /*set socket to non-blocking*/
-    int flags = fcntl(s->fileDescriptor, F_GETFL, 0);
-    fcntl(s->fileDescriptor, F_SETFL, flags | O_NONBLOCK);
+    return 0;
+}
+
+/**
+ * Starts connecting to resolved addresses, one at a time until one succeeds
+ * or until an attempt has been in progress for a while, in which case the
+ * next one is started in parallel (Happy Eyeballs, RFC 8305).
+ * @return Zero on failure, non-zero on success.
+ */
+static int connectToResolvedAddresses(stfSocket* s, snResolveRequest* request)
+{
+    setAddresses(s, request);
+    s->numAttempts = 0;
     
-    /*attempt async connect. call stfSocket_getConnectionState to see how it went. */
-    const int connectResult = connect(s->fileDescriptor, p->ai_addr, p->ai_addrlen);
+#ifdef __linux__
+    if (s->numAddresses > 1)
+    {
+        s->waitDescriptor = epoll_create1(0);
+        s->timerDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        
+        if (s->waitDescriptor < 0 || s->timerDescriptor < 0 ||
+            epoll_ctl(s->waitDescriptor, EPOLL_CTL_ADD, s->timerDescriptor, &event) != 0)
+        {
+            if (s->waitDescriptor >= 0)
+            {
+                close(s->waitDescriptor);
+            }
+            if (s->timerDescriptor >= 0)
+            {
+                close(s->timerDescriptor);
+            }
+            s->waitDescriptor = -1;
+            s->timerDescriptor = -1;
+        }
+    }
+#endif /*__linux__*/
     
-    if (connectResult != -1)
+    if (!startNextAttempt(s))
     {
+        closeAttempts(s, -1);
         return 0;
     }
+    
+    s->connectionState = STF_SOCKET_CONNECTING;
+    
+    return 1;
+}
+
+int stfSocket_connect(stfSocket* s,
+                      const char* host,
+                      int port)
+{
+    return stfSocket_connectWithData(s, host, port, NULL, 0);
+}
+
+int stfSocket_connectWithData(stfSocket* s,
+                              const char* host,
+                              int port,
+                              const char* data,
+                              int numBytes)
+{
+    errno = 0;
+    
+    if (s->fileDescriptor != -1 || s->resolveRequest)
+    {
+        /*shut down existing connection*/
+        stfSocket_disconnect(s);
+    }
+    
+    s->port = port;
+    
+    free(s->earlyData);
+    s->earlyData = NULL;
+    s->numEarlyBytes = 0;
+    
+    if (numBytes > 0)
+    {
+        s->earlyData = malloc(numBytes);
+        memcpy(s->earlyData, data, numBytes);
+        s->numEarlyBytes = numBytes;
+    }
+    
+    /*resolve the host on a resolver thread, unless it's cached*/
+    snResolveRequest* request = snResolver_resolve(host);
+    const snResolveStatus status = snResolveRequest_getStatus(request);
+    
+    if (status == SN_RESOLVE_PENDING)
+    {
+        /*finish connecting in stfSocket_poll*/
+        s->resolveRequest = request;
+        s->connectionState = STF_SOCKET_RESOLVING;
+        return 1;
+    }
+    
+    const int result = status == SN_RESOLVE_SUCCEEDED && connectToResolvedAddresses(s, request);
+    snResolveRequest_delete(request);
+    
+    return result;
+}
 
+int stfSocket_adopt(stfSocket* s, int descriptor)
+{
+    if (descriptor < 0)
+    {
+        return 0;
+    }
     
-    freeaddrinfo(addrinfoResult);
+    stfSocket_disconnect(s);
     
-    if (s->fileDescriptor < 0)
+    /*set socket to non-blocking*/
+    int flags = fcntl(descriptor, F_GETFL, 0);
+    if (flags < 0 || fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) < 0)
     {
         return 0;
     }
     
     /*disable nagle's algrithm*/
     int flag = 1;
-    int result = setsockopt(s->fileDescriptor, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof flag);
-    //assert(result == 0);
+    setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof flag);
     
+#ifdef SO_NOSIGPIPE
     /*disable sigpipe*/
     int set = 1;
-    result = setsockopt(s->fileDescriptor, SOL_SOCKET, SO_NOSIGPIPE, (void *)&set, sizeof(int));
-    //assert(result == 0);
+    setsockopt(descriptor, SOL_SOCKET, SO_NOSIGPIPE, (void *)&set, sizeof(int));
+#endif /*SO_NOSIGPIPE*/
     
-    s->connectionState = STF_SOCKET_CONNECTING;
+    s->fileDescriptor = descriptor;
+    s->connectionState = STF_SOCKET_CONNECTED;
     
     return 1;
-   
 }
 
 void stfSocket_disconnect(stfSocket* socket)
 {
+    if (socket->resolveRequest)
+    {
+        snResolveRequest_delete(socket->resolveRequest);
+        socket->resolveRequest = NULL;
+    }
+    
+    closeAttempts(socket, -1);
+    
+    free(socket->earlyData);
+    socket->earlyData = NULL;
+    socket->numEarlyBytes = 0;
+    
     free(socket->host);
     socket->host = 0;
     socket->port = 0;
@@ -316,90 +635,194 @@ void stfSocket_disconnect(stfSocket* socket)
     socket->connectionState = STF_SOCKET_NOT_CONNECTED;
 }
 
+/**
+ * Sends the early data that did not fit in the SYN of the attempt that
+ * connected, which is all of it unless TCP Fast Open was used.
+ * @return Zero on failure, non-zero on success.
+ */
+static int sendRemainingEarlyData(stfSocket* s, int numEarlyBytesSent)
+{
+    if (!s->earlyData)
+    {
+        return 1;
+    }
+    
+    int numSentBytes = 0;
+    const int numBytesLeft = s->numEarlyBytes - numEarlyBytesSent;
+    const int success = numBytesLeft <= 0 ||
+                        (stfSocket_sendData(s, &s->earlyData[numEarlyBytesSent], numBytesLeft, &numSentBytes) &&
+                         numSentBytes == numBytesLeft);
+    
+    if (success)
+    {
+        free(s->earlyData);
+        s->earlyData = NULL;
+        s->numEarlyBytes = 0;
+    }
+    
+    return success;
+}
+
 stfSocketConnectionState stfSocket_poll(stfSocket* socket)
 {
-    if (socket->fileDescriptor == -1)
+    if (socket->connectionState == STF_SOCKET_RESOLVING)
     {
-        return STF_SOCKET_NOT_CONNECTED;
+        snResolveRequest* request = socket->resolveRequest;
+        const snResolveStatus status = snResolveRequest_getStatus(request);
+        
+        if (status == SN_RESOLVE_PENDING)
+        {
+            return STF_SOCKET_RESOLVING;
+        }
+        
+        /*the request is deleted after creating the socket, so that the socket
+          does not get the number of the descriptor that was being watched.*/
+        const int result = status == SN_RESOLVE_SUCCEEDED && connectToResolvedAddresses(socket, request);
+        snResolveRequest_delete(request);
+        socket->resolveRequest = NULL;
+        
+        if (!result)
+        {
+            stfSocket_disconnect(socket);
+            return STF_SOCKET_CONNECTION_FAILED;
+        }
     }
     
     if (socket->connectionState == STF_SOCKET_CONNECTING)
     {
-        struct fd_set fdset;
-        FD_ZERO(&fdset);
-        FD_SET(socket->fileDescriptor, &fdset);
-        assert(FD_ISSET(socket->fileDescriptor, &fdset));
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 1000; //1 ms
-        int selRes = select(socket->fileDescriptor + 1, NULL, &fdset, NULL, &timeout);
-        assert(selRes >= 0);
-        
-        if (selRes > 0)
-        {
-            socklen_t len = sizeof(errno);
+        /*don't wait. the sockets becoming writable can be waited for
+          by the caller, e.g using an event loop. poll is used rather than
+          select since descriptors may exceed FD_SETSIZE.*/
+        struct pollfd pfds[SN_RESOLVER_MAX_ADDRESSES];
+        int hasFailedAttempt = 0;
+        int i;
+        
+        for (i = 0; i < socket->numAttempts; i++)
+        {
+            pfds[i].fd = socket->attemptDescriptors[i];
+            pfds[i].events = POLLOUT;
+            pfds[i].revents = 0;
+        }
+        
+        if (poll(pfds, socket->numAttempts, 0) < 0)
+        {
+            stfSocket_disconnect(socket);
+            return STF_SOCKET_CONNECTION_FAILED;
+        }
+        
+        /*iterate backwards, since failed attempts are replaced by the last one*/
+        for (i = socket->numAttempts - 1; i >= 0; i--)
+        {
+            if (pfds[i].revents == 0)
+            {
+                continue;
+            }
             
-            getsockopt(socket->fileDescriptor, SOL_SOCKET, SO_ERROR, &errno, &len);
+            int error = 0;
+            socklen_t len = sizeof(error);
+            getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &error, &len);
             
-            if (errno == 0)
+            if (error == 0)
             {
-                /*connected*/
-                //connected = 1;
+                /*connected. the other attempts are abandoned.*/
+                const int numEarlyBytesSent = socket->attemptNumEarlyBytesSent[i];
+                socket->fileDescriptor = pfds[i].fd;
+                closeAttempts(socket, socket->fileDescriptor);
                 socket->connectionState = STF_SOCKET_CONNECTED;
+                
+                if (!sendRemainingEarlyData(socket, numEarlyBytesSent))
+                {
+                    stfSocket_disconnect(socket);
+                    return STF_SOCKET_CONNECTION_FAILED;
+                }
+                return socket->connectionState;
             }
-            else
+            
+            /*log(s, "poll() following non blocking connect() failed, errno %d\n", error);*/
+            closeAttempt(socket, i);
+            hasFailedAttempt = 1;
+        }
+        
+#ifdef __linux__
+        if (socket->timerDescriptor >= 0)
+        {
+            uint64_t numExpirations;
+            if (read(socket->timerDescriptor, &numExpirations, sizeof(numExpirations)) < 0)
             {
-                /*log(s, "select() following non blocking connect() failed, errno %d\n", errno);*/
-                stfSocket_disconnect(socket);
-                return STF_SOCKET_CONNECTION_FAILED;
+                /*the timer has not expired*/
             }
         }
-        else if (selRes < 0)
+#endif /*__linux__*/
+        
+        /*start the next attempt when one has failed or when the others are slow*/
+        if (hasFailedAttempt ||
+            snTimerWheel_getMonotonicTime() >= socket->nextAttemptTime)
+        {
+            startNextAttempt(socket);
+        }
+        
+        if (socket->numAttempts == 0)
         {
             stfSocket_disconnect(socket);
             return STF_SOCKET_CONNECTION_FAILED;
         }
+        
+        if (socket->nextAddress < socket->numAddresses)
+        {
+            const long long delay = socket->nextAttemptTime - snTimerWheel_getMonotonicTime();
+            setAttemptTimer(socket, delay > 0 ? (int)delay : 0);
+        }
+        
+        return socket->connectionState;
+    }
+    
+    if (socket->fileDescriptor == -1)
+    {
+        return STF_SOCKET_NOT_CONNECTED;
     }
     
     return socket->connectionState;
 }
 
+int stfSocket_getDescriptor(stfSocket* socket)
+{
+    if (socket->resolveRequest)
+    {
+        return snResolveRequest_getDescriptor(socket->resolveRequest);
+    }
+    
+    if (socket->connectionState == STF_SOCKET_CONNECTING)
+    {
+        /*without a wait descriptor, there is only the latest attempt to wait for*/
+        if (socket->waitDescriptor >= 0)
+        {
+            return socket->waitDescriptor;
+        }
+        return socket->numAttempts > 0 ? socket->attemptDescriptors[socket->numAttempts - 1] : -1;
+    }
+    
+    return socket->fileDescriptor;
+}
+
 int stfSocket_sendData(stfSocket* s, const char* data, int numBytes, int* numSentBytes)
 {
     int numBytesSentTot = 0;
     while (numBytesSentTot < numBytes)
     {
         errno = 0;
-        /*wait for the socket to become availalbe for writing*/
-        fd_set rfds;
-        FD_ZERO(&rfds);
-        FD_SET(s->fileDescriptor, &rfds);
-        
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 10000; /*10 ms*/
-        
-        int selRet = select(s->fileDescriptor + 1, NULL, &rfds, NULL, &tv);
-        
-        if (selRet == -1)
-        {
-            return 0;
-        }
-        else if (selRet == 0)
-        {
-            /*printf("no data yet\n");*/
-        }
-        else
-        {
-            /*printf("new data available\n");*/
-        }
         
         /*try to send all the bytes we have left*/
         const int chunkSize = numBytes - numBytesSentTot;
         ssize_t ret = send(s->fileDescriptor,
                            (const void*)(&data[numBytesSentTot]),
                            chunkSize,
-                           0);
+                           MSG_NOSIGNAL);
+        
+        if (ret >= 0)
+        {
+            numBytesSentTot += ret;
+            continue;
+        }
         
         /*check errors*/
         int ignores[2] = {EAGAIN, EWOULDBLOCK};
@@ -409,14 +832,78 @@ int stfSocket_sendData(stfSocket* s, const char* data, int numBytes, int* numSen
             return 0;
         }
         
+        /*the send buffer is full. leave the rest for later.*/
+        break;
+    }
+    
+    *numSentBytes = numBytesSentTot;
+    
+    return 1;
+}
+
+int stfSocket_sendDataVector(stfSocket* s,
+                             const char** buffers,
+                             const int* bufferSizes,
+                             int numBuffers,
+                             int* numSentBytes)
+{
+    struct iovec iov[STF_SOCKET_MAX_NUM_BUFFERS];
+    int numBytesSentTot = 0;
+    int firstBuffer = 0;
+    int i;
+    
+    assert(numBuffers <= STF_SOCKET_MAX_NUM_BUFFERS);
+    
+    for (i = 0; i < numBuffers; i++)
+    {
+        iov[i].iov_base = (void*)buffers[i];
+        iov[i].iov_len = bufferSizes[i];
+    }
+    
+    while (firstBuffer < numBuffers)
+    {
+        errno = 0;
+        
+        /*try to send all the buffers we have left. unlike writev, sendmsg can suppress sigpipe.*/
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov[firstBuffer];
+        message.msg_iovlen = numBuffers - firstBuffer;
+        ssize_t ret = sendmsg(s->fileDescriptor, &message, MSG_NOSIGNAL);
+        
         if (ret >= 0)
         {
             numBytesSentTot += ret;
+            
+            /*skip past the bytes that were sent*/
+            while (firstBuffer < numBuffers && ret >= (ssize_t)iov[firstBuffer].iov_len)
+            {
+                ret -= iov[firstBuffer].iov_len;
+                firstBuffer++;
+            }
+            
+            if (firstBuffer < numBuffers)
+            {
+                iov[firstBuffer].iov_base = (char*)iov[firstBuffer].iov_base + ret;
+                iov[firstBuffer].iov_len -= ret;
+            }
+            continue;
+        }
+        
+        /*check errors*/
+        int ignores[2] = {EAGAIN, EWOULDBLOCK};
+        if (shouldStopOnError(s, errno, ignores, 2))
+        {
+            stfSocket_disconnect(s);
+            return 0;
         }
         
-        /*printf("sent %d/%d\n", numBytesSentTot, numBytes);*/
+        /*the send buffer is full. leave the rest for later.*/
+        break;
     }
     
+    *numSentBytes = numBytesSentTot;
+    
     return 1;
 }
 
@@ -436,6 +923,13 @@ int stfSocket_receiveData(stfSocket* s, char* data, int maxNumBytes, int* numByt
         stfSocket_disconnect(s);
         success = 0;
     }
+    else if (bytesRecvd == 0 && maxNumBytes > 0)
+    {
+        /*the peer has closed the connection. report it right away
+         instead of waiting for a write or a keepalive ping to fail*/
+        stfSocket_disconnect(s);
+        success = 0;
+    }
     
     *numBytesReceived = bytesRecvd < 0 ? 0 : bytesRecvd;
     
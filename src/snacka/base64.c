@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#include "base64.h"
+
+static const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int snBase64Encode(const unsigned char* bytes, int numBytes, char* encoded)
+{
+    int numChars = 0;
+    int i;
+    
+    for (i = 0; i + 3 <= numBytes; i += 3)
+    {
+        const unsigned int group = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+        encoded[numChars++] = base64Alphabet[(group >> 18) & 0x3f];
+        encoded[numChars++] = base64Alphabet[(group >> 12) & 0x3f];
+        encoded[numChars++] = base64Alphabet[(group >> 6) & 0x3f];
+        encoded[numChars++] = base64Alphabet[group & 0x3f];
+    }
+    
+    /*pad the last group*/
+    if (i < numBytes)
+    {
+        const int hasSecondByte = i + 1 < numBytes;
+        const unsigned int group = (bytes[i] << 16) | (hasSecondByte ? bytes[i + 1] << 8 : 0);
+        encoded[numChars++] = base64Alphabet[(group >> 18) & 0x3f];
+        encoded[numChars++] = base64Alphabet[(group >> 12) & 0x3f];
+        encoded[numChars++] = hasSecondByte ? base64Alphabet[(group >> 6) & 0x3f] : '=';
+        encoded[numChars++] = '=';
+    }
+    
+    encoded[numChars] = '\0';
+    
+    return numChars;
+}
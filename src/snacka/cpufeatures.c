@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#include "cpufeatures.h"
+
+int snGetCPUFeatures(void)
+{
+#ifdef SN_HAS_X86_SIMD_KERNELS
+    /*concurrent first calls compute the same value, so no locking is needed*/
+    static int features = -1;
+    
+    if (features < 0)
+    {
+        int detectedFeatures = 0;
+        
+        __builtin_cpu_init();
+        
+        if (__builtin_cpu_supports("sse2"))
+        {
+            detectedFeatures |= SN_CPU_FEATURE_SSE2;
+        }
+        
+        if (__builtin_cpu_supports("sse4.1"))
+        {
+            detectedFeatures |= SN_CPU_FEATURE_SSE41;
+        }
+        
+        if (__builtin_cpu_supports("avx2"))
+        {
+            detectedFeatures |= SN_CPU_FEATURE_AVX2;
+        }
+        
+        features = detectedFeatures;
+    }
+    
+    return features;
+#else
+    return 0;
+#endif
+}
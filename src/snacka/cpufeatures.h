@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_CPU_FEATURES_H
+#define SN_CPU_FEATURES_H
+
+/*! \file */
+
+/**
+ * Defined if the compiler can generate code for x86 instruction set
+ * extensions on a per function basis, i.e if SIMD kernels can be built
+ * without special compiler flags and selected at runtime.
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SN_HAS_X86_SIMD_KERNELS 1
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * CPU features that SIMD kernels may depend on.
+     */
+    typedef enum snCPUFeature
+    {
+        /** */
+        SN_CPU_FEATURE_SSE2 = 1 << 0,
+        /** */
+        SN_CPU_FEATURE_SSE41 = 1 << 1,
+        /** */
+        SN_CPU_FEATURE_AVX2 = 1 << 2
+    } snCPUFeature;
+    
+    /**
+     * Detects the features of the CPU the code is running on.
+     * The result is cached after the first call.
+     * @return A combination of \c snCPUFeature flags.
+     */
+    int snGetCPUFeatures(void);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_CPU_FEATURES_H*/
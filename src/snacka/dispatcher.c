@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dispatcher.h"
+
+/**
+ * The maximum number of tasks a worker runs from a queue before
+ * moving on, so that one busy queue can't hold up the others.
+ */
+#define SN_DISPATCHER_BATCH_SIZE 16
+
+/** A worker thread and the queues it is about to run. */
+typedef struct snDispatcherWorker
+{
+    /** */
+    snDispatcher* dispatcher;
+    /** */
+    pthread_t thread;
+    /** Protects \c firstQueue and \c lastQueue. */
+    pthread_mutex_t mutex;
+    /** The next queue to run. */
+    snSerialQueue* firstQueue;
+    /** */
+    snSerialQueue* lastQueue;
+    /** Keeps the workers on separate cache lines. */
+    char padding[64];
+} snDispatcherWorker;
+
+struct snDispatcher
+{
+    /** */
+    snDispatcherWorker* workers;
+    /** */
+    int numWorkers;
+    /** The number of queues scheduled from outside the workers, used for round robin. */
+    unsigned int numScheduledQueues;
+    /** Protects \c isStopped and the sleeping workers. */
+    pthread_mutex_t sleepMutex;
+    /** */
+    pthread_cond_t wakeUpCondition;
+    /** */
+    int numSleepingWorkers;
+    /** */
+    int isStopped;
+};
+
+struct snSerialQueue
+{
+    /** */
+    snDispatcher* dispatcher;
+    /** */
+    snTaskQueue tasks;
+    /**
+     * The number of posted tasks that have not been run. The queue
+     * is scheduled on a worker whenever this is non-zero.
+     */
+    int numPendingTasks;
+    /** Set by the last task, posted by \c snSerialQueue_delete. */
+    int isDeleted;
+    /** The next queue in the list of the worker it is scheduled on. */
+    snSerialQueue* nextScheduledQueue;
+};
+
+/** A message copied by \c snSerialQueue_postMessage. */
+typedef struct snDispatchedMessage
+{
+    /** */
+    snMessageCallback callback;
+    /** */
+    void* callbackData;
+    /** */
+    snOpcode opcode;
+    /** */
+    int numBytes;
+    /** The payload follows the struct. */
+} snDispatchedMessage;
+
+static void appendQueue(snDispatcherWorker* worker, snSerialQueue* queue)
+{
+    queue->nextScheduledQueue = NULL;
+    
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->lastQueue)
+    {
+        worker->lastQueue->nextScheduledQueue = queue;
+    }
+    else
+    {
+        worker->firstQueue = queue;
+    }
+    worker->lastQueue = queue;
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+static snSerialQueue* removeFirstQueue(snDispatcherWorker* worker)
+{
+    snSerialQueue* queue;
+    
+    pthread_mutex_lock(&worker->mutex);
+    queue = worker->firstQueue;
+    if (queue)
+    {
+        worker->firstQueue = queue->nextScheduledQueue;
+        if (worker->firstQueue == NULL)
+        {
+            worker->lastQueue = NULL;
+        }
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    
+    return queue;
+}
+
+/**
+ * Adds a queue with pending tasks to the list of a worker and wakes up
+ * a sleeping worker, if any.
+ * @param worker The worker to schedule the queue on, or NULL to pick one.
+ */
+static void scheduleQueue(snDispatcher* dispatcher, snDispatcherWorker* worker, snSerialQueue* queue)
+{
+    if (worker == NULL)
+    {
+        const unsigned int index = __atomic_fetch_add(&dispatcher->numScheduledQueues, 1, __ATOMIC_RELAXED);
+        worker = &dispatcher->workers[index % dispatcher->numWorkers];
+    }
+    
+    appendQueue(worker, queue);
+    
+    /*either this sees a sleeping worker, or the worker sees the queue
+      when it checks for work before going to sleep*/
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&dispatcher->numSleepingWorkers, __ATOMIC_RELAXED) > 0)
+    {
+        pthread_mutex_lock(&dispatcher->sleepMutex);
+        pthread_cond_signal(&dispatcher->wakeUpCondition);
+        pthread_mutex_unlock(&dispatcher->sleepMutex);
+    }
+}
+
+/**
+ * Takes the next queue from the worker's own list, or from the
+ * list of another worker if its own is empty.
+ */
+static snSerialQueue* findQueue(snDispatcherWorker* worker)
+{
+    snDispatcher* dispatcher = worker->dispatcher;
+    const int index = (int)(worker - dispatcher->workers);
+    int i;
+    
+    for (i = 0; i < dispatcher->numWorkers; i++)
+    {
+        snSerialQueue* queue = removeFirstQueue(&dispatcher->workers[(index + i) % dispatcher->numWorkers]);
+        if (queue)
+        {
+            return queue;
+        }
+    }
+    
+    return NULL;
+}
+
+static void runQueue(snDispatcherWorker* worker, snSerialQueue* queue)
+{
+    const int numTasks = snTaskQueue_runAtMost(&queue->tasks, SN_DISPATCHER_BATCH_SIZE);
+    
+    if (queue->isDeleted)
+    {
+        snTaskQueue_deinit(&queue->tasks);
+        free(queue);
+        return;
+    }
+    
+    /*if tasks were posted meanwhile, the poster left scheduling to this worker*/
+    if (__atomic_sub_fetch(&queue->numPendingTasks, numTasks, __ATOMIC_ACQ_REL) > 0)
+    {
+        scheduleQueue(worker->dispatcher, worker, queue);
+    }
+}
+
+static void* workerThreadFunction(void* userData)
+{
+    snDispatcherWorker* worker = (snDispatcherWorker*)userData;
+    snDispatcher* dispatcher = worker->dispatcher;
+    
+    while (1)
+    {
+        snSerialQueue* queue = findQueue(worker);
+        
+        if (queue == NULL)
+        {
+            pthread_mutex_lock(&dispatcher->sleepMutex);
+            __atomic_add_fetch(&dispatcher->numSleepingWorkers, 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            
+            queue = findQueue(worker);
+            if (queue == NULL && dispatcher->isStopped)
+            {
+                __atomic_sub_fetch(&dispatcher->numSleepingWorkers, 1, __ATOMIC_RELAXED);
+                pthread_mutex_unlock(&dispatcher->sleepMutex);
+                break;
+            }
+            
+            if (queue == NULL)
+            {
+                pthread_cond_wait(&dispatcher->wakeUpCondition, &dispatcher->sleepMutex);
+            }
+            
+            __atomic_sub_fetch(&dispatcher->numSleepingWorkers, 1, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&dispatcher->sleepMutex);
+            
+            if (queue == NULL)
+            {
+                continue;
+            }
+        }
+        
+        runQueue(worker, queue);
+    }
+    
+    return NULL;
+}
+
+snDispatcher* snDispatcher_create(int numThreads)
+{
+    int i;
+    
+    if (numThreads <= 0)
+    {
+        const long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = numCPUs > 0 ? (int)numCPUs : 1;
+    }
+    
+    snDispatcher* dispatcher = malloc(sizeof(snDispatcher));
+    memset(dispatcher, 0, sizeof(snDispatcher));
+    pthread_mutex_init(&dispatcher->sleepMutex, NULL);
+    pthread_cond_init(&dispatcher->wakeUpCondition, NULL);
+    
+    dispatcher->numWorkers = numThreads;
+    dispatcher->workers = malloc(numThreads * sizeof(snDispatcherWorker));
+    memset(dispatcher->workers, 0, numThreads * sizeof(snDispatcherWorker));
+    
+    for (i = 0; i < numThreads; i++)
+    {
+        dispatcher->workers[i].dispatcher = dispatcher;
+        pthread_mutex_init(&dispatcher->workers[i].mutex, NULL);
+    }
+    
+    /*start the threads once all workers can be stolen from*/
+    for (i = 0; i < numThreads; i++)
+    {
+        pthread_create(&dispatcher->workers[i].thread, NULL, workerThreadFunction, &dispatcher->workers[i]);
+    }
+    
+    return dispatcher;
+}
+
+void snDispatcher_delete(snDispatcher* dispatcher)
+{
+    int i;
+    
+    /*workers exit once they find no more queues to run*/
+    pthread_mutex_lock(&dispatcher->sleepMutex);
+    dispatcher->isStopped = 1;
+    pthread_cond_broadcast(&dispatcher->wakeUpCondition);
+    pthread_mutex_unlock(&dispatcher->sleepMutex);
+    
+    for (i = 0; i < dispatcher->numWorkers; i++)
+    {
+        pthread_join(dispatcher->workers[i].thread, NULL);
+    }
+    
+    /*workers steal from each other until they exit*/
+    for (i = 0; i < dispatcher->numWorkers; i++)
+    {
+        pthread_mutex_destroy(&dispatcher->workers[i].mutex);
+    }
+    
+    pthread_cond_destroy(&dispatcher->wakeUpCondition);
+    pthread_mutex_destroy(&dispatcher->sleepMutex);
+    free(dispatcher->workers);
+    free(dispatcher);
+}
+
+int snDispatcher_getNumThreads(snDispatcher* dispatcher)
+{
+    return dispatcher->numWorkers;
+}
+
+snSerialQueue* snSerialQueue_create(snDispatcher* dispatcher)
+{
+    snSerialQueue* queue = malloc(sizeof(snSerialQueue));
+    memset(queue, 0, sizeof(snSerialQueue));
+    queue->dispatcher = dispatcher;
+    snTaskQueue_init(&queue->tasks);
+    
+    return queue;
+}
+
+static void markQueueDeleted(void* userData)
+{
+    /*the worker running the queue frees it*/
+    ((snSerialQueue*)userData)->isDeleted = 1;
+}
+
+void snSerialQueue_delete(snSerialQueue* queue)
+{
+    snSerialQueue_post(queue, markQueueDeleted, queue);
+}
+
+void snSerialQueue_post(snSerialQueue* queue, snTask task, void* userData)
+{
+    snTaskQueue_push(&queue->tasks, task, userData);
+    
+    /*only the first pending task schedules the queue. while it is
+      scheduled, the worker running it takes care of rescheduling*/
+    if (__atomic_fetch_add(&queue->numPendingTasks, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        scheduleQueue(queue->dispatcher, NULL, queue);
+    }
+}
+
+static void runDispatchedMessage(void* userData)
+{
+    snDispatchedMessage* message = (snDispatchedMessage*)userData;
+    
+    message->callback(message->callbackData,
+                      message->opcode,
+                      (const char*)(message + 1),
+                      message->numBytes);
+    
+    free(message);
+}
+
+void snSerialQueue_postMessage(snSerialQueue* queue,
+                               snMessageCallback callback,
+                               void* callbackData,
+                               snOpcode opcode,
+                               const char* bytes,
+                               int numBytes)
+{
+    /*the payload is stored right after the message struct*/
+    snDispatchedMessage* message = malloc(sizeof(snDispatchedMessage) + numBytes + 1);
+    char* payload = (char*)(message + 1);
+    
+    message->callback = callback;
+    message->callbackData = callbackData;
+    message->opcode = opcode;
+    message->numBytes = numBytes;
+    if (numBytes > 0)
+    {
+        memcpy(payload, bytes, numBytes);
+    }
+    payload[numBytes] = '\0';
+    
+    snSerialQueue_post(queue, runDispatchedMessage, message);
+}
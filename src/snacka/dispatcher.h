@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_DISPATCHER_H
+#define SN_DISPATCHER_H
+
+#include "taskqueue.h"
+#include "websocket.h"
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * A pool of worker threads running tasks from serial queues. Each worker
+     * has its own list of queues with tasks to run and takes queues from the
+     * other workers when it runs out. A queue is only ever run by one worker
+     * at a time, so its tasks run one after the other, in the order they were
+     * posted, while tasks from different queues run in parallel.
+     *
+     * This is used to move expensive message handling, like decompression or
+     * parsing, off the thread polling the websockets, giving each
+     * connection its own serial queue so that its messages stay in order.
+     */
+    typedef struct snDispatcher snDispatcher;
+    
+    /**
+     * An ordered queue of tasks run by the workers of a dispatcher.
+     */
+    typedef struct snSerialQueue snSerialQueue;
+    
+    /**
+     * Creates a dispatcher and starts its worker threads.
+     * @param numThreads The number of worker threads, or 0 for one
+     * per online CPU.
+     * @return The new dispatcher.
+     */
+    snDispatcher* snDispatcher_create(int numThreads);
+    
+    /**
+     * Waits for all posted tasks to run, then stops the worker threads and
+     * deletes the dispatcher. All serial queues must have been deleted.
+     * @param dispatcher The dispatcher to delete.
+     */
+    void snDispatcher_delete(snDispatcher* dispatcher);
+    
+    /**
+     * @param dispatcher The dispatcher.
+     * @return The number of worker threads.
+     */
+    int snDispatcher_getNumThreads(snDispatcher* dispatcher);
+    
+    /**
+     * Creates a serial queue, typically one per websocket.
+     * @param dispatcher The dispatcher whose workers run the tasks.
+     * @return The new queue.
+     */
+    snSerialQueue* snSerialQueue_create(snDispatcher* dispatcher);
+    
+    /**
+     * Deletes a serial queue once the tasks posted to it have been run.
+     * Returns immediately. No tasks may be posted to the queue afterwards.
+     * @param queue The queue to delete.
+     */
+    void snSerialQueue_delete(snSerialQueue* queue);
+    
+    /**
+     * Posts a task to a serial queue. The task runs on a worker thread after
+     * all tasks previously posted to the queue have finished.
+     * @param queue The queue.
+     * @param task The function to run.
+     * @param userData A pointer to pass to \c task.
+     */
+    void snSerialQueue_post(snSerialQueue* queue, snTask task, void* userData);
+    
+    /**
+     * Posts a copy of a message to a serial queue, to be passed to a
+     * message callback on a worker thread. The copy stays valid until the
+     * callback returns and is null terminated, like messages passed to
+     * message callbacks by websockets.
+     * @param queue The queue.
+     * @param callback The function to pass the message to.
+     * @param callbackData A pointer to pass to \c callback.
+     * @param opcode The opcode of the message.
+     * @param bytes The message payload.
+     * @param numBytes The size of the payload in bytes.
+     */
+    void snSerialQueue_postMessage(snSerialQueue* queue,
+                                   snMessageCallback callback,
+                                   void* callbackData,
+                                   snOpcode opcode,
+                                   const char* bytes,
+                                   int numBytes);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_DISPATCHER_H*/
@@ -101,6 +101,58 @@ const char* snErrorToString(snError error)
         {
             return "Failed to parse opening handshake HTTP response";
         }
+        case SN_EXCEEDED_MAX_MESSAGE_SIZE:
+        {
+            return "Message too large";
+        }
+        case SN_EVENT_LOOP_ERROR:
+        {
+            return "Event loop error";
+        }
+        case SN_RING_BUFFER_FULL:
+        {
+            return "Ring buffer full";
+        }
+        case SN_CONNECT_TIMED_OUT:
+        {
+            return "Connect timed out";
+        }
+        case SN_OPENING_HANDSHAKE_TIMED_OUT:
+        {
+            return "Opening handshake timed out";
+        }
+        case SN_KEEPALIVE_TIMED_OUT:
+        {
+            return "Keepalive timed out";
+        }
+        case SN_NAME_RESOLUTION_FAILED:
+        {
+            return "Failed to resolve host name";
+        }
+        case SN_EXTENSION_NEGOTIATION_FAILED:
+        {
+            return "Extension negotiation failed";
+        }
+        case SN_COMPRESSION_FAILED:
+        {
+            return "Failed to compress message";
+        }
+        case SN_DECOMPRESSION_FAILED:
+        {
+            return "Failed to decompress message";
+        }
+        case SN_UNMASKED_CLIENT_FRAME:
+        {
+            return "Received unmasked frame from client";
+        }
+        case SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_REQUEST:
+        {
+            return "Failed to parse opening handshake request";
+        }
+        case SN_FAILED_TO_LISTEN:
+        {
+            return "Failed to listen for connections";
+        }
         default:
             break;
     }
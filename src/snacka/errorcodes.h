@@ -76,7 +76,33 @@ extern "C"
         /** .*/
         SN_INVALID_OPENING_HANDSHAKE_HTTP_STATUS,
         /** */
-        SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_RESPONSE        
+        SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_RESPONSE,
+        /** Received a fragmented message exceeding the maximum message size. */
+        SN_EXCEEDED_MAX_MESSAGE_SIZE,
+        /** An event loop could not watch or stop watching a websocket. */
+        SN_EVENT_LOOP_ERROR,
+        /** There was no room in a ring buffer shared with another thread. */
+        SN_RING_BUFFER_FULL,
+        /** The socket did not connect within the connect timeout. */
+        SN_CONNECT_TIMED_OUT,
+        /** No valid opening handshake response arrived within the opening handshake timeout. */
+        SN_OPENING_HANDSHAKE_TIMED_OUT,
+        /** Too many keepalive pings in a row went unanswered. */
+        SN_KEEPALIVE_TIMED_OUT,
+        /** The host name could not be resolved. */
+        SN_NAME_RESOLUTION_FAILED,
+        /** The server did not accept the offered extensions with valid parameters. */
+        SN_EXTENSION_NEGOTIATION_FAILED,
+        /** A message could not be compressed. */
+        SN_COMPRESSION_FAILED,
+        /** A received compressed message could not be decompressed. */
+        SN_DECOMPRESSION_FAILED,
+        /** A server received a frame that was not masked by the client. */
+        SN_UNMASKED_CLIENT_FRAME,
+        /** Failed to parse an opening handshake request. */
+        SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_REQUEST,
+        /** A server could not listen for incoming connections. */
+        SN_FAILED_TO_LISTEN
     } snError;
     
     const char* snErrorToString(snError error);
@@ -0,0 +1,711 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eventloop.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/** The maximum number of events handled per epoll_wait call. */
+#define SN_EVENT_LOOP_MAX_EVENTS 256
+
+/** Lists that a loop entry can be in. */
+enum
+{
+    /** Every websocket driven by the loop. */
+    SN_ENTRY_LIST_ALL = 0,
+    /** Websockets to poll without waiting for events. */
+    SN_ENTRY_LIST_PENDING,
+    /** */
+    SN_NUM_ENTRY_LISTS
+};
+
+/**
+ * The loop's bookkeeping for a websocket or a watched descriptor. Entries
+ * are registered with epoll, so removed entries are kept until the end of
+ * the current \c snEventLoop_runOnce call, in case they have pending events.
+ */
+typedef struct snEventLoopEntry
+{
+    /** The websocket, or NULL if it has been removed or the entry is a descriptor watch. */
+    snWebsocket* websocket;
+    /** Invoked when a watched descriptor is readable, or NULL. */
+    snTask descriptorCallback;
+    /** */
+    void* descriptorCallbackData;
+    /** The registered descriptor, or -1. */
+    int descriptor;
+    /** The index of the entry in each list, or -1 if it's not in the list. */
+    int listIndices[SN_NUM_ENTRY_LISTS];
+    /** */
+    struct snEventLoopEntry* nextRemovedEntry;
+} snEventLoopEntry;
+
+/** An unordered array of entries. */
+typedef struct snEntryList
+{
+    /** */
+    snEventLoopEntry** entries;
+    /** */
+    int size;
+    /** */
+    int capacity;
+} snEntryList;
+
+struct snEventLoop
+{
+    /** */
+    int epollDescriptor;
+    /** An eventfd used to wake up the loop from other threads. */
+    int wakeUpDescriptor;
+    /** Set from any thread. */
+    int isStopped;
+    /** Non-zero while in \c snEventLoop_runOnce. */
+    int isRunning;
+    /** Non-zero while waiting for events, meaning posting tasks requires a wake up. */
+    int isWaiting;
+    /** Tasks posted to the loop thread. */
+    snTaskQueue tasks;
+    /** The thread that first ran the loop. */
+    pthread_t thread;
+    /** Non-zero once \c thread has been set. */
+    int hasThread;
+    /** The size of the SN_ENTRY_LIST_ALL list, readable from any thread. */
+    int numWebsockets;
+    /** */
+    snEntryList lists[SN_NUM_ENTRY_LISTS];
+    /** A copy of a list that is safe to iterate while invoking callbacks. */
+    snEventLoopEntry** snapshot;
+    /** */
+    int snapshotCapacity;
+    /** Entries to free at the end of \c snEventLoop_runOnce. */
+    snEventLoopEntry* removedEntries;
+    /** Drives the timeouts of all websockets in the loop. */
+    snTimerWheel timerWheel;
+    /** */
+    struct epoll_event events[SN_EVENT_LOOP_MAX_EVENTS];
+};
+
+static void addToList(snEventLoop* loop, int listId, snEventLoopEntry* entry)
+{
+    snEntryList* list = &loop->lists[listId];
+    
+    if (entry->listIndices[listId] >= 0)
+    {
+        return;
+    }
+    
+    if (list->size == list->capacity)
+    {
+        list->capacity = list->capacity == 0 ? 64 : 2 * list->capacity;
+        list->entries = realloc(list->entries, list->capacity * sizeof(snEventLoopEntry*));
+    }
+    
+    entry->listIndices[listId] = list->size;
+    list->entries[list->size] = entry;
+    list->size++;
+}
+
+static void removeFromList(snEventLoop* loop, int listId, snEventLoopEntry* entry)
+{
+    snEntryList* list = &loop->lists[listId];
+    const int index = entry->listIndices[listId];
+    
+    if (index < 0)
+    {
+        return;
+    }
+    
+    /*move the last entry into the gap*/
+    snEventLoopEntry* lastEntry = list->entries[list->size - 1];
+    list->entries[index] = lastEntry;
+    lastEntry->listIndices[listId] = index;
+    list->size--;
+    entry->listIndices[listId] = -1;
+}
+
+/**
+ * Copies a list to the snapshot array, so that the list may change
+ * while polling the websockets in it.
+ * @return The number of entries in the snapshot.
+ */
+static int takeSnapshot(snEventLoop* loop, int listId)
+{
+    snEntryList* list = &loop->lists[listId];
+    
+    if (list->size == 0)
+    {
+        /*the snapshot and the entries may not have been allocated yet*/
+        return 0;
+    }
+    
+    if (list->size > loop->snapshotCapacity)
+    {
+        loop->snapshotCapacity = list->capacity;
+        loop->snapshot = realloc(loop->snapshot, loop->snapshotCapacity * sizeof(snEventLoopEntry*));
+    }
+    
+    memcpy(loop->snapshot, list->entries, list->size * sizeof(snEventLoopEntry*));
+    
+    return list->size;
+}
+
+static void freeRemovedEntries(snEventLoop* loop)
+{
+    while (loop->removedEntries)
+    {
+        snEventLoopEntry* next = loop->removedEntries->nextRemovedEntry;
+        free(loop->removedEntries);
+        loop->removedEntries = next;
+    }
+}
+
+/**
+ * Polls the websocket of an entry, unless it has been removed.
+ * @return 1 if the websocket was polled, 0 otherwise.
+ */
+static int pollEntry(snEventLoop* loop, snEventLoopEntry* entry)
+{
+    if (entry->websocket == NULL)
+    {
+        return 0;
+    }
+    
+    removeFromList(loop, SN_ENTRY_LIST_PENDING, entry);
+    
+    snWebsocket_poll(entry->websocket);
+    
+    /*the websocket may have been removed or deleted by a callback*/
+    if (entry->websocket && snWebsocket_needsPoll(entry->websocket))
+    {
+        /*edge triggered epoll won't report data that was left unread*/
+        addToList(loop, SN_ENTRY_LIST_PENDING, entry);
+    }
+    
+    return 1;
+}
+
+snEventLoop* snEventLoop_create(void)
+{
+    const int epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (epollDescriptor < 0)
+    {
+        return NULL;
+    }
+    
+    const int wakeUpDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeUpDescriptor < 0)
+    {
+        close(epollDescriptor);
+        return NULL;
+    }
+    
+    /*wake up events are recognized by their NULL entry*/
+    struct epoll_event event;
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, wakeUpDescriptor, &event) != 0)
+    {
+        close(wakeUpDescriptor);
+        close(epollDescriptor);
+        return NULL;
+    }
+    
+    snEventLoop* loop = malloc(sizeof(snEventLoop));
+    memset(loop, 0, sizeof(snEventLoop));
+    loop->epollDescriptor = epollDescriptor;
+    loop->wakeUpDescriptor = wakeUpDescriptor;
+    snTaskQueue_init(&loop->tasks);
+    snTimerWheel_init(&loop->timerWheel);
+    
+    return loop;
+}
+
+void snEventLoop_delete(snEventLoop* loop)
+{
+    if (loop == NULL)
+    {
+        return;
+    }
+    
+    /*the loop thread is gone. run the remaining tasks here*/
+    snTaskQueue_deinit(&loop->tasks);
+    
+    while (loop->lists[SN_ENTRY_LIST_ALL].size > 0)
+    {
+        snEventLoop_removeWebsocket(loop, loop->lists[SN_ENTRY_LIST_ALL].entries[0]->websocket);
+    }
+    
+    freeRemovedEntries(loop);
+    snTimerWheel_deinit(&loop->timerWheel);
+    
+    int i;
+    for (i = 0; i < SN_NUM_ENTRY_LISTS; i++)
+    {
+        free(loop->lists[i].entries);
+    }
+    free(loop->snapshot);
+    
+    close(loop->wakeUpDescriptor);
+    close(loop->epollDescriptor);
+    free(loop);
+}
+
+snError snEventLoop_addWebsocket(snEventLoop* loop, snWebsocket* ws)
+{
+    if (snWebsocket_getEventLoopEntry(ws) != NULL)
+    {
+        return SN_EVENT_LOOP_ERROR;
+    }
+    
+    snEventLoopEntry* entry = malloc(sizeof(snEventLoopEntry));
+    memset(entry, 0, sizeof(snEventLoopEntry));
+    entry->websocket = ws;
+    entry->descriptor = -1;
+    
+    int i;
+    for (i = 0; i < SN_NUM_ENTRY_LISTS; i++)
+    {
+        entry->listIndices[i] = -1;
+    }
+    
+    addToList(loop, SN_ENTRY_LIST_ALL, entry);
+    __atomic_store_n(&loop->numWebsockets, loop->lists[SN_ENTRY_LIST_ALL].size, __ATOMIC_RELAXED);
+    snWebsocket_setEventLoop(ws, loop, entry);
+    snWebsocket_setTimerWheel(ws, &loop->timerWheel);
+    snEventLoop_updateWebsocket(loop, ws);
+    
+    return SN_NO_ERROR;
+}
+
+void snEventLoop_removeWebsocket(snEventLoop* loop, snWebsocket* ws)
+{
+    snEventLoopEntry* entry = (snEventLoopEntry*)snWebsocket_getEventLoopEntry(ws);
+    
+    if (entry == NULL)
+    {
+        return;
+    }
+    
+    const int descriptor = snWebsocket_getDescriptor(ws);
+    if (descriptor >= 0)
+    {
+        epoll_ctl(loop->epollDescriptor, EPOLL_CTL_DEL, descriptor, NULL);
+    }
+    
+    int i;
+    for (i = 0; i < SN_NUM_ENTRY_LISTS; i++)
+    {
+        removeFromList(loop, i, entry);
+    }
+    __atomic_store_n(&loop->numWebsockets, loop->lists[SN_ENTRY_LIST_ALL].size, __ATOMIC_RELAXED);
+    
+    snWebsocket_setEventLoop(ws, NULL, NULL);
+    snWebsocket_setTimerWheel(ws, NULL);
+    
+    /*events already returned by epoll_wait may refer to the entry*/
+    entry->websocket = NULL;
+    entry->nextRemovedEntry = loop->removedEntries;
+    loop->removedEntries = entry;
+    
+    if (!loop->isRunning)
+    {
+        freeRemovedEntries(loop);
+    }
+}
+
+void snEventLoop_updateWebsocket(snEventLoop* loop, snWebsocket* ws)
+{
+    snEventLoopEntry* entry = (snEventLoopEntry*)snWebsocket_getEventLoopEntry(ws);
+    assert(entry != NULL);
+    
+    const snReadyState state = snWebsocket_getState(ws);
+    
+    /*register new descriptors. closed descriptors leave the epoll set by
+      themselves. when connecting, the old descriptor may have been closed
+      and its number reused, so register even if the number is unchanged.
+      this fails with EEXIST if it actually is the same descriptor.*/
+    const int descriptor = snWebsocket_getDescriptor(ws);
+    if (descriptor >= 0 && (descriptor != entry->descriptor || state == SN_STATE_CONNECTING))
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(struct epoll_event));
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = entry;
+        
+        if (epoll_ctl(loop->epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) != 0 &&
+            errno == EEXIST)
+        {
+            epoll_ctl(loop->epollDescriptor, EPOLL_CTL_MOD, descriptor, &event);
+        }
+    }
+    entry->descriptor = descriptor;
+}
+
+int snEventLoop_runOnce(snEventLoop* loop, int timeoutMs)
+{
+    int numPolls = 0;
+    int i;
+    
+    loop->isRunning = 1;
+    
+    if (!loop->hasThread)
+    {
+        loop->thread = pthread_self();
+        __atomic_store_n(&loop->hasThread, 1, __ATOMIC_RELEASE);
+    }
+    
+    /*posting threads wake the loop up if they see isWaiting set. if they
+      pushed their task before it was set, the queue is not empty here.*/
+    __atomic_store_n(&loop->isWaiting, 1, __ATOMIC_SEQ_CST);
+    
+    if (loop->lists[SN_ENTRY_LIST_PENDING].size > 0 || !snTaskQueue_isEmpty(&loop->tasks))
+    {
+        timeoutMs = 0;
+    }
+    else
+    {
+        const int timeUntilNextTimer = snTimerWheel_getTimeUntilNextTimer(&loop->timerWheel);
+        if (timeUntilNextTimer >= 0 && (timeoutMs < 0 || timeUntilNextTimer < timeoutMs))
+        {
+            timeoutMs = timeUntilNextTimer;
+        }
+    }
+    
+    const int numEvents = epoll_wait(loop->epollDescriptor,
+                                     loop->events,
+                                     SN_EVENT_LOOP_MAX_EVENTS,
+                                     timeoutMs);
+    
+    __atomic_store_n(&loop->isWaiting, 0, __ATOMIC_SEQ_CST);
+    
+    snTaskQueue_run(&loop->tasks);
+    
+    for (i = 0; i < numEvents; i++)
+    {
+        snEventLoopEntry* entry = (snEventLoopEntry*)loop->events[i].data.ptr;
+        
+        if (entry == NULL)
+        {
+            uint64_t value;
+            ssize_t result = read(loop->wakeUpDescriptor, &value, sizeof(value));
+            (void)result;
+            continue;
+        }
+        
+        if (entry->descriptorCallback)
+        {
+            entry->descriptorCallback(entry->descriptorCallbackData);
+            continue;
+        }
+        
+        numPolls += pollEntry(loop, entry);
+    }
+    
+    /*websockets that stopped reading at the per poll limits*/
+    const int numPending = takeSnapshot(loop, SN_ENTRY_LIST_PENDING);
+    for (i = 0; i < numPending; i++)
+    {
+        if (loop->snapshot[i]->listIndices[SN_ENTRY_LIST_PENDING] >= 0)
+        {
+            numPolls += pollEntry(loop, loop->snapshot[i]);
+        }
+    }
+    
+    /*connect, handshake and user timeouts. one clock reading for all websockets*/
+    snTimerWheel_advance(&loop->timerWheel);
+    
+    loop->isRunning = 0;
+    freeRemovedEntries(loop);
+    
+    return numPolls;
+}
+
+void snEventLoop_run(snEventLoop* loop)
+{
+    while (!__atomic_load_n(&loop->isStopped, __ATOMIC_ACQUIRE))
+    {
+        snEventLoop_runOnce(loop, -1);
+    }
+    
+    __atomic_store_n(&loop->isStopped, 0, __ATOMIC_RELEASE);
+}
+
+void snEventLoop_stop(snEventLoop* loop)
+{
+    __atomic_store_n(&loop->isStopped, 1, __ATOMIC_RELEASE);
+    snEventLoop_wakeUp(loop);
+}
+
+void snEventLoop_wakeUp(snEventLoop* loop)
+{
+    uint64_t value = 1;
+    ssize_t result = write(loop->wakeUpDescriptor, &value, sizeof(value));
+    (void)result;
+}
+
+void snEventLoop_post(snEventLoop* loop, snTask task, void* userData)
+{
+    snTaskQueue_push(&loop->tasks, task, userData);
+    
+    /*only the first thread to see the loop waiting needs to wake it up*/
+    if (__atomic_exchange_n(&loop->isWaiting, 0, __ATOMIC_SEQ_CST))
+    {
+        snEventLoop_wakeUp(loop);
+    }
+}
+
+int snEventLoop_isInLoopThread(snEventLoop* loop)
+{
+    return __atomic_load_n(&loop->hasThread, __ATOMIC_ACQUIRE) &&
+           pthread_equal(loop->thread, pthread_self());
+}
+
+/** A frame to send on the loop thread. */
+typedef struct snForwardedFrame
+{
+    /** */
+    snWebsocket* websocket;
+    /** */
+    snOpcode opcode;
+    /** */
+    int payloadSize;
+    /** The payload follows the struct. */
+    char payload[1];
+} snForwardedFrame;
+
+static void sendForwardedFrame(void* userData)
+{
+    snForwardedFrame* frame = (snForwardedFrame*)userData;
+    snWebsocket_sendFrame(frame->websocket, frame->opcode, frame->payloadSize, frame->payload);
+    free(frame);
+}
+
+snError snEventLoop_sendFrame(snEventLoop* loop,
+                              snWebsocket* ws,
+                              snOpcode opcode,
+                              int payloadSize,
+                              const char* payload)
+{
+    if (snEventLoop_isInLoopThread(loop))
+    {
+        return snWebsocket_sendFrame(ws, opcode, payloadSize, payload);
+    }
+    
+    snForwardedFrame* frame = malloc(sizeof(snForwardedFrame) + payloadSize);
+    frame->websocket = ws;
+    frame->opcode = opcode;
+    frame->payloadSize = payloadSize;
+    memcpy(frame->payload, payload, payloadSize);
+    /*text payloads are null terminated*/
+    frame->payload[payloadSize] = '\0';
+    
+    snEventLoop_post(loop, sendForwardedFrame, frame);
+    
+    return SN_NO_ERROR;
+}
+
+static void deleteWebsocket(void* userData)
+{
+    snWebsocket_delete((snWebsocket*)userData);
+}
+
+void snEventLoop_deleteWebsocket(snEventLoop* loop, snWebsocket* ws)
+{
+    if (snEventLoop_isInLoopThread(loop))
+    {
+        snWebsocket_delete(ws);
+        return;
+    }
+    
+    snEventLoop_post(loop, deleteWebsocket, ws);
+}
+
+int snEventLoop_getNumWebsockets(snEventLoop* loop)
+{
+    return __atomic_load_n(&loop->numWebsockets, __ATOMIC_RELAXED);
+}
+
+void* snEventLoop_watchDescriptor(snEventLoop* loop, int descriptor, snTask callback, void* userData)
+{
+    snEventLoopEntry* entry = malloc(sizeof(snEventLoopEntry));
+    memset(entry, 0, sizeof(snEventLoopEntry));
+    entry->descriptor = descriptor;
+    entry->descriptorCallback = callback;
+    entry->descriptorCallbackData = userData;
+    
+    int i;
+    for (i = 0; i < SN_NUM_ENTRY_LISTS; i++)
+    {
+        entry->listIndices[i] = -1;
+    }
+    
+    /*level triggered, so that descriptors that are not drained are reported again*/
+    struct epoll_event event;
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.events = EPOLLIN;
+    event.data.ptr = entry;
+    
+    if (epoll_ctl(loop->epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) != 0)
+    {
+        free(entry);
+        return NULL;
+    }
+    
+    return entry;
+}
+
+void snEventLoop_unwatchDescriptor(snEventLoop* loop, void* watch)
+{
+    snEventLoopEntry* entry = (snEventLoopEntry*)watch;
+    
+    epoll_ctl(loop->epollDescriptor, EPOLL_CTL_DEL, entry->descriptor, NULL);
+    
+    /*events already returned by epoll_wait may refer to the entry*/
+    entry->descriptorCallback = NULL;
+    entry->nextRemovedEntry = loop->removedEntries;
+    loop->removedEntries = entry;
+    
+    if (!loop->isRunning)
+    {
+        freeRemovedEntries(loop);
+    }
+}
+
+snTimerWheel* snEventLoop_getTimerWheel(snEventLoop* loop)
+{
+    return &loop->timerWheel;
+}
+
+int snEventLoop_getTimeUntilNextTimer(snEventLoop* loop)
+{
+    return snTimerWheel_getTimeUntilNextTimer(&loop->timerWheel);
+}
+
+#else /*__linux__*/
+
+snEventLoop* snEventLoop_create(void)
+{
+    /*event loops are implemented with epoll only. callers
+      get an error and poll their websockets themselves.*/
+    return NULL;
+}
+
+void snEventLoop_delete(snEventLoop* loop)
+{
+}
+
+snError snEventLoop_addWebsocket(snEventLoop* loop, snWebsocket* ws)
+{
+    return SN_EVENT_LOOP_ERROR;
+}
+
+void snEventLoop_removeWebsocket(snEventLoop* loop, snWebsocket* ws)
+{
+}
+
+int snEventLoop_runOnce(snEventLoop* loop, int timeoutMs)
+{
+    return 0;
+}
+
+void snEventLoop_run(snEventLoop* loop)
+{
+}
+
+void snEventLoop_stop(snEventLoop* loop)
+{
+}
+
+void snEventLoop_wakeUp(snEventLoop* loop)
+{
+}
+
+void snEventLoop_updateWebsocket(snEventLoop* loop, snWebsocket* ws)
+{
+}
+
+void snEventLoop_post(snEventLoop* loop, snTask task, void* userData)
+{
+}
+
+int snEventLoop_isInLoopThread(snEventLoop* loop)
+{
+    return 0;
+}
+
+snError snEventLoop_sendFrame(snEventLoop* loop,
+                              snWebsocket* ws,
+                              snOpcode opcode,
+                              int payloadSize,
+                              const char* payload)
+{
+    return SN_EVENT_LOOP_ERROR;
+}
+
+void snEventLoop_deleteWebsocket(snEventLoop* loop, snWebsocket* ws)
+{
+}
+
+int snEventLoop_getNumWebsockets(snEventLoop* loop)
+{
+    return 0;
+}
+
+void* snEventLoop_watchDescriptor(snEventLoop* loop, int descriptor, snTask callback, void* userData)
+{
+    return NULL;
+}
+
+void snEventLoop_unwatchDescriptor(snEventLoop* loop, void* watch)
+{
+}
+
+snTimerWheel* snEventLoop_getTimerWheel(snEventLoop* loop)
+{
+    return NULL;
+}
+
+int snEventLoop_getTimeUntilNextTimer(snEventLoop* loop)
+{
+    return -1;
+}
+
+#endif /*__linux__*/
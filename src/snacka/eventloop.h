@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_EVENT_LOOP_H
+#define SN_EVENT_LOOP_H
+
+#include "errorcodes.h"
+#include "taskqueue.h"
+#include "websocket.h"
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * Drives many websockets on a single thread. Sockets are watched using
+     * edge triggered epoll and only websockets with pending I/O are polled,
+     * so idle connections cost nothing. The timeouts of all websockets in the
+     * loop are scheduled on a timer wheel owned by the loop, which is advanced
+     * once per iteration. Only available on Linux.
+     *
+     * Websockets driven by a loop must only be used from the thread running
+     * the loop. Other threads can use \c snEventLoop_post, \c snEventLoop_sendFrame
+     * and \c snEventLoop_deleteWebsocket to have the loop thread do the work.
+     */
+    typedef struct snEventLoop snEventLoop;
+    
+    /**
+     * Creates an event loop.
+     * @return The new event loop, or NULL if event loops are not supported
+     * on this platform or the loop could not be created.
+     */
+    snEventLoop* snEventLoop_create(void);
+    
+    /**
+     * Deletes an event loop. Websockets driven by the loop are removed
+     * from it but not deleted.
+     * @param loop The loop to delete.
+     */
+    void snEventLoop_delete(snEventLoop* loop);
+    
+    /**
+     * Makes an event loop drive a websocket. The websocket may be connected
+     * before or after being added. Its callbacks are invoked from
+     * \c snEventLoop_runOnce, and it must only be used from the thread
+     * running the loop.
+     * @param loop The loop.
+     * @param ws The websocket to add.
+     * @return An error code. Fails if the websocket is already driven by a loop.
+     */
+    snError snEventLoop_addWebsocket(snEventLoop* loop, snWebsocket* ws);
+    
+    /**
+     * Stops driving a websocket. Websockets are removed automatically when deleted.
+     * It is safe to call this from the websocket callbacks.
+     * @param loop The loop.
+     * @param ws The websocket to remove.
+     */
+    void snEventLoop_removeWebsocket(snEventLoop* loop, snWebsocket* ws);
+    
+    /**
+     * Waits for I/O on the websockets driven by the loop and polls the ones
+     * that are ready, then fires expired timers. Never waits past the
+     * expiry of the next timer.
+     * @param loop The loop.
+     * @param timeoutMs The maximum time to wait for events in milliseconds,
+     * 0 to not wait or -1 to wait until there is something to do.
+     * @return The number of websocket polls.
+     */
+    int snEventLoop_runOnce(snEventLoop* loop, int timeoutMs);
+    
+    /**
+     * Runs the loop until \c snEventLoop_stop is called.
+     * @param loop The loop.
+     */
+    void snEventLoop_run(snEventLoop* loop);
+    
+    /**
+     * Makes \c snEventLoop_run return. May be called from any thread.
+     * @param loop The loop.
+     */
+    void snEventLoop_stop(snEventLoop* loop);
+    
+    /**
+     * Makes a call to \c snEventLoop_runOnce that is waiting for events
+     * return early. May be called from any thread.
+     * @param loop The loop.
+     */
+    void snEventLoop_wakeUp(snEventLoop* loop);
+    
+    /**
+     * Runs a task on the loop thread, in \c snEventLoop_runOnce. Tasks
+     * posted by the same thread are run in order. May be called from any thread.
+     * Tasks still queued when the loop is deleted are run by \c snEventLoop_delete.
+     * @param loop The loop.
+     * @param task The function to run.
+     * @param userData A pointer to pass to \c task.
+     */
+    void snEventLoop_post(snEventLoop* loop, snTask task, void* userData);
+    
+    /**
+     * @param loop The loop.
+     * @return Non-zero if called from the thread running the loop.
+     */
+    int snEventLoop_isInLoopThread(snEventLoop* loop);
+    
+    /**
+     * Sends a frame on a websocket driven by the loop. May be called from any
+     * thread. If called from a thread other than the loop thread, the payload
+     * is copied and the frame is sent later by the loop thread.
+     * @param loop The loop driving \c ws.
+     * @param ws The websocket.
+     * @param opcode The opcode of the frame to send.
+     * @param payloadSize The size of the payload in bytes.
+     * @param payload The payload data.
+     * @return An error code. Errors that occur when sending a forwarded
+     * frame are reported through the websocket's error callback.
+     */
+    snError snEventLoop_sendFrame(snEventLoop* loop,
+                                  snWebsocket* ws,
+                                  snOpcode opcode,
+                                  int payloadSize,
+                                  const char* payload);
+    
+    /**
+     * Deletes a websocket driven by the loop, on the loop thread.
+     * May be called from any thread.
+     * @param loop The loop driving \c ws.
+     * @param ws The websocket to delete.
+     */
+    void snEventLoop_deleteWebsocket(snEventLoop* loop, snWebsocket* ws);
+    
+    /**
+     * May be called from any thread.
+     * @param loop The loop.
+     * @return The number of websockets driven by the loop.
+     */
+    int snEventLoop_getNumWebsockets(snEventLoop* loop);
+    
+    /**
+     * Gets the timer wheel driving the timeouts of the websockets in the loop.
+     * Timers of the application scheduled on it fire on the loop thread.
+     * @param loop The loop.
+     * @return The wheel.
+     */
+    snTimerWheel* snEventLoop_getTimerWheel(snEventLoop* loop);
+    
+    /**
+     * For loops embedded in other event loops.
+     * @param loop The loop.
+     * @return The time in milliseconds until the next timer of the loop
+     * expires, or -1 if there are no timers.
+     */
+    int snEventLoop_getTimeUntilNextTimer(snEventLoop* loop);
+    
+    /**
+     * Invokes a callback on the loop thread whenever a descriptor is readable,
+     * e.g. a listening socket with connections waiting to be accepted. Unlike
+     * websocket descriptors, watched descriptors are level triggered, so the
+     * callback does not have to drain the descriptor. May be called from any thread.
+     * @param loop The loop.
+     * @param descriptor The descriptor to watch.
+     * @param callback The function to invoke when \c descriptor is readable.
+     * @param userData A pointer to pass to \c callback.
+     * @return A handle to pass to \c snEventLoop_unwatchDescriptor, or NULL on failure.
+     */
+    void* snEventLoop_watchDescriptor(snEventLoop* loop, int descriptor, snTask callback, void* userData);
+    
+    /**
+     * Stops watching a descriptor. Must be called before the descriptor is
+     * closed and the loop is deleted, from the loop thread or while the loop
+     * is not running. It is safe to call this from the watch callback.
+     * @param loop The loop.
+     * @param watch The handle returned by \c snEventLoop_watchDescriptor.
+     */
+    void snEventLoop_unwatchDescriptor(snEventLoop* loop, void* watch);
+    
+    /**
+     * Called by websockets driven by the loop when their descriptor or
+     * state changes. Applications don't need to call this.
+     * @param loop The loop.
+     * @param ws The websocket.
+     */
+    void snEventLoop_updateWebsocket(snEventLoop* loop, snWebsocket* ws);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_EVENT_LOOP_H*/
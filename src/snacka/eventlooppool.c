@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifdef __linux__
+/*for pthread_setaffinity_np*/
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "eventlooppool.h"
+
+/** A loop and the thread running it. */
+typedef struct snEventLoopPoolThread
+{
+    /** */
+    snEventLoopPool* pool;
+    /** */
+    int index;
+    /** */
+    snEventLoop* loop;
+    /** */
+    pthread_t thread;
+    /** Websockets assigned to the loop but not added yet. */
+    int numPendingWebsockets;
+} snEventLoopPoolThread;
+
+struct snEventLoopPool
+{
+    /** */
+    snEventLoopPoolThread* threads;
+    /** */
+    int numThreads;
+    /** */
+    snLoadBalancing loadBalancing;
+    /** */
+    int pinThreads;
+    /** The number of websockets assigned so far, used for round robin. */
+    unsigned int numAssignedWebsockets;
+};
+
+/** A websocket to add to a loop on its thread. */
+typedef struct snPendingWebsocket
+{
+    /** */
+    snEventLoopPoolThread* thread;
+    /** */
+    snWebsocket* websocket;
+    /** The URL to connect to, or NULL. */
+    char* url;
+} snPendingWebsocket;
+
+static void* threadFunction(void* userData)
+{
+    snEventLoopPoolThread* thread = (snEventLoopPoolThread*)userData;
+    
+#ifdef __linux__
+    if (thread->pool->pinThreads)
+    {
+        const long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(thread->index % (numCPUs > 0 ? numCPUs : 1), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    }
+#endif
+    
+    snEventLoop_run(thread->loop);
+    
+    return NULL;
+}
+
+static void addPendingWebsocket(void* userData)
+{
+    snPendingWebsocket* pending = (snPendingWebsocket*)userData;
+    snEventLoopPoolThread* thread = pending->thread;
+    
+    snEventLoop_addWebsocket(thread->loop, pending->websocket);
+    __atomic_sub_fetch(&thread->numPendingWebsockets, 1, __ATOMIC_RELAXED);
+    
+    if (pending->url)
+    {
+        /*failures are reported by the close callback*/
+        snWebsocket_connect(pending->websocket, pending->url);
+        free(pending->url);
+    }
+    
+    free(pending);
+}
+
+static snEventLoopPoolThread* pickThread(snEventLoopPool* pool)
+{
+    if (pool->loadBalancing == SN_LOAD_BALANCING_LEAST_LOADED)
+    {
+        snEventLoopPoolThread* leastLoaded = NULL;
+        int minLoad = 0;
+        int i;
+        
+        for (i = 0; i < pool->numThreads; i++)
+        {
+            snEventLoopPoolThread* thread = &pool->threads[i];
+            const int load = snEventLoop_getNumWebsockets(thread->loop) +
+                             __atomic_load_n(&thread->numPendingWebsockets, __ATOMIC_RELAXED);
+            
+            if (leastLoaded == NULL || load < minLoad)
+            {
+                leastLoaded = thread;
+                minLoad = load;
+            }
+        }
+        
+        return leastLoaded;
+    }
+    
+    const unsigned int index = __atomic_fetch_add(&pool->numAssignedWebsockets, 1, __ATOMIC_RELAXED);
+    return &pool->threads[index % pool->numThreads];
+}
+
+snEventLoopPool* snEventLoopPool_create(int numThreads,
+                                        snLoadBalancing loadBalancing,
+                                        int pinThreads)
+{
+    int i;
+    
+    if (numThreads <= 0)
+    {
+        const long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = numCPUs > 0 ? (int)numCPUs : 1;
+    }
+    
+    snEventLoopPool* pool = malloc(sizeof(snEventLoopPool));
+    memset(pool, 0, sizeof(snEventLoopPool));
+    pool->loadBalancing = loadBalancing;
+    pool->pinThreads = pinThreads;
+    pool->threads = malloc(numThreads * sizeof(snEventLoopPoolThread));
+    memset(pool->threads, 0, numThreads * sizeof(snEventLoopPoolThread));
+    
+    for (i = 0; i < numThreads; i++)
+    {
+        snEventLoopPoolThread* thread = &pool->threads[i];
+        thread->pool = pool;
+        thread->index = i;
+        thread->loop = snEventLoop_create();
+        
+        if (thread->loop == NULL)
+        {
+            snEventLoopPool_delete(pool);
+            return NULL;
+        }
+        
+        pool->numThreads++;
+        pthread_create(&thread->thread, NULL, threadFunction, thread);
+    }
+    
+    return pool;
+}
+
+void snEventLoopPool_delete(snEventLoopPool* pool)
+{
+    int i;
+    
+    for (i = 0; i < pool->numThreads; i++)
+    {
+        snEventLoop_stop(pool->threads[i].loop);
+    }
+    
+    for (i = 0; i < pool->numThreads; i++)
+    {
+        pthread_join(pool->threads[i].thread, NULL);
+        snEventLoop_delete(pool->threads[i].loop);
+    }
+    
+    free(pool->threads);
+    free(pool);
+}
+
+int snEventLoopPool_getNumLoops(snEventLoopPool* pool)
+{
+    return pool->numThreads;
+}
+
+snEventLoop* snEventLoopPool_getLoop(snEventLoopPool* pool, int index)
+{
+    return pool->threads[index].loop;
+}
+
+snEventLoop* snEventLoopPool_addWebsocket(snEventLoopPool* pool, snWebsocket* ws, const char* url)
+{
+    snEventLoopPoolThread* thread = pickThread(pool);
+    
+    snPendingWebsocket* pending = malloc(sizeof(snPendingWebsocket));
+    pending->thread = thread;
+    pending->websocket = ws;
+    pending->url = NULL;
+    
+    if (url)
+    {
+        pending->url = malloc(strlen(url) + 1);
+        strcpy(pending->url, url);
+    }
+    
+    __atomic_add_fetch(&thread->numPendingWebsockets, 1, __ATOMIC_RELAXED);
+    snEventLoop_post(thread->loop, addPendingWebsocket, pending);
+    
+    return thread->loop;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_EVENT_LOOP_POOL_H
+#define SN_EVENT_LOOP_POOL_H
+
+#include "eventloop.h"
+#include "websocket.h"
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * How an event loop pool picks a loop for a new websocket.
+     */
+    typedef enum snLoadBalancing
+    {
+        /** Loops are picked in turn. */
+        SN_LOAD_BALANCING_ROUND_ROBIN = 0,
+        /** The loop driving the fewest websockets is picked. */
+        SN_LOAD_BALANCING_LEAST_LOADED
+    } snLoadBalancing;
+    
+    /**
+     * Spreads websockets across a number of event loops, each running on its own
+     * thread. Loops share nothing, and each websocket is owned by the thread of
+     * the loop it was assigned to, so its buffers, timers and random number
+     * generator are only ever touched by that thread.
+     */
+    typedef struct snEventLoopPool snEventLoopPool;
+    
+    /**
+     * Creates an event loop pool and starts its threads.
+     * @param numThreads The number of loops and threads, or 0 for one
+     * per online CPU.
+     * @param loadBalancing How loops are picked for new websockets.
+     * @param pinThreads If non-zero, thread i only runs on CPU i modulo the
+     * number of CPUs. Ignored on platforms without thread affinity.
+     * @return The new pool, or NULL if event loops are not supported.
+     */
+    snEventLoopPool* snEventLoopPool_create(int numThreads,
+                                            snLoadBalancing loadBalancing,
+                                            int pinThreads);
+    
+    /**
+     * Stops the threads of a pool and deletes its loops. Websockets still
+     * driven by the loops are removed from them but not deleted.
+     * @param pool The pool to delete.
+     */
+    void snEventLoopPool_delete(snEventLoopPool* pool);
+    
+    /**
+     * @param pool The pool.
+     * @return The number of loops in the pool.
+     */
+    int snEventLoopPool_getNumLoops(snEventLoopPool* pool);
+    
+    /**
+     * @param pool The pool.
+     * @param index The index of the loop.
+     * @return The loop.
+     */
+    snEventLoop* snEventLoopPool_getLoop(snEventLoopPool* pool, int index);
+    
+    /**
+     * Assigns a websocket to one of the pool's loops, which adds it and
+     * optionally connects it on its thread. From then on, the websocket
+     * must only be used through the returned loop, e.g using
+     * \c snEventLoop_sendFrame and \c snEventLoop_deleteWebsocket,
+     * or from its callbacks.
+     * @param pool The pool.
+     * @param ws The websocket to add. Must not be driven by a loop.
+     * @param url The URL to connect to, or NULL to not connect.
+     * @return The loop driving the websocket.
+     */
+    snEventLoop* snEventLoopPool_addWebsocket(snEventLoopPool* pool, snWebsocket* ws, const char* url);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_EVENT_LOOP_POOL_H*/
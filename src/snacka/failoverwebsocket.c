@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "failoverwebsocket.h"
+
+/**
+ * One of the two websockets of a failover websocket.
+ */
+typedef struct snFailoverSlot
+{
+    /** */
+    snFailoverWebsocket* fws;
+    /** */
+    snWebsocket* websocket;
+    /** The URL to (re)connect to. */
+    char* url;
+    /** Fires when it's time to reconnect. */
+    snTimer reconnectTimer;
+    /** Non-zero if the websocket was open at the end of the previous poll. */
+    int isOpen;
+    /** Non-zero if the websocket has opened since it last started connecting. */
+    int wasOpen;
+} snFailoverSlot;
+
+struct snFailoverWebsocket
+{
+    /** */
+    snOpenCallback openCallback;
+    /** */
+    snMessageCallback messageCallback;
+    /** */
+    snCloseCallback closeCallback;
+    /** */
+    snErrorCallback errorCallback;
+    /** */
+    snFailoverCallback standbyOpenCallback;
+    /** */
+    snFailoverCallback failoverCallback;
+    /** */
+    void* callbackData;
+    /** Shared by both websockets. */
+    snTimerWheel timerWheel;
+    /** */
+    snFailoverSlot slots[2];
+    /** The index of the active slot. */
+    int activeSlot;
+    /** Non-zero if the application has been told that the connection is open. */
+    int isOpen;
+    /** Non-zero between connecting and disconnecting, while lost connections are reestablished. */
+    int isConnected;
+    /** */
+    int numFailovers;
+};
+
+static int isActiveSlot(snFailoverSlot* slot)
+{
+    return slot == &slot->fws->slots[slot->fws->activeSlot];
+}
+
+static void slotOpenCallback(void* userData)
+{
+    ((snFailoverSlot*)userData)->wasOpen = 1;
+}
+
+static void slotMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    snFailoverSlot* slot = (snFailoverSlot*)userData;
+    
+    /*the standby only receives what the active websocket already delivers*/
+    if (isActiveSlot(slot) && slot->fws->messageCallback)
+    {
+        slot->fws->messageCallback(slot->fws->callbackData, opcode, bytes, numBytes);
+    }
+}
+
+static void slotErrorCallback(void* userData, snError error)
+{
+    snFailoverSlot* slot = (snFailoverSlot*)userData;
+    
+    if (isActiveSlot(slot) && slot->fws->errorCallback)
+    {
+        slot->fws->errorCallback(slot->fws->callbackData, error);
+    }
+}
+
+static void reconnectTimerFired(void* userData)
+{
+    snFailoverSlot* slot = (snFailoverSlot*)userData;
+    
+    /*a failure to start connecting leaves the websocket closed and is retried later*/
+    slot->wasOpen = 0;
+    snWebsocket_connect(slot->websocket, slot->url);
+}
+
+static void setUrl(snFailoverSlot* slot, const char* url)
+{
+    free(slot->url);
+    slot->url = malloc(strlen(url) + 1);
+    strcpy(slot->url, url);
+}
+
+static void updateConnections(snFailoverWebsocket* fws)
+{
+    snFailoverSlot* active = &fws->slots[fws->activeSlot];
+    snFailoverSlot* standby = &fws->slots[1 - fws->activeSlot];
+    const int isActiveOpen = snWebsocket_getState(active->websocket) == SN_STATE_OPEN;
+    const int isStandbyOpen = snWebsocket_getState(standby->websocket) == SN_STATE_OPEN;
+    
+    if (!isActiveOpen && isStandbyOpen)
+    {
+        /*switch over to the standby right away*/
+        if (active->wasOpen)
+        {
+            /*the connection has been lost. reestablish it as the new standby.*/
+            if (snWebsocket_getState(active->websocket) != SN_STATE_CLOSED)
+            {
+                snWebsocket_disconnect(active->websocket, 1);
+            }
+            
+            if (fws->isConnected)
+            {
+                snTimerWheel_schedule(&fws->timerWheel, &active->reconnectTimer, 0);
+            }
+        }
+        /*otherwise, the standby opened first. a connect in progress carries on as the new standby.*/
+        
+        fws->activeSlot = 1 - fws->activeSlot;
+        active->isOpen = 0;
+        standby->isOpen = 1;
+        
+        if (fws->isOpen)
+        {
+            fws->numFailovers++;
+            if (fws->failoverCallback)
+            {
+                fws->failoverCallback(fws->callbackData, standby->websocket);
+            }
+        }
+        else
+        {
+            fws->isOpen = 1;
+            if (fws->openCallback)
+            {
+                fws->openCallback(fws->callbackData);
+            }
+        }
+        return;
+    }
+    
+    if (isActiveOpen && !fws->isOpen)
+    {
+        fws->isOpen = 1;
+        if (fws->openCallback)
+        {
+            fws->openCallback(fws->callbackData);
+        }
+    }
+    else if (!isActiveOpen && fws->isOpen)
+    {
+        /*there is no standby to switch to*/
+        fws->isOpen = 0;
+        if (fws->closeCallback)
+        {
+            fws->closeCallback(fws->callbackData, SN_STATUS_ENDPOINT_GOING_AWAY);
+        }
+    }
+    active->isOpen = isActiveOpen;
+    
+    if (isStandbyOpen && !standby->isOpen && fws->standbyOpenCallback)
+    {
+        fws->standbyOpenCallback(fws->callbackData, standby->websocket);
+    }
+    standby->isOpen = isStandbyOpen;
+    
+    /*retry connections that have failed or been lost*/
+    int i;
+    for (i = 0; i < 2 && fws->isConnected; i++)
+    {
+        snFailoverSlot* slot = &fws->slots[i];
+        if (snWebsocket_getState(slot->websocket) == SN_STATE_CLOSED &&
+            !snTimer_isScheduled(&slot->reconnectTimer))
+        {
+            snTimerWheel_schedule(&fws->timerWheel, &slot->reconnectTimer, SN_FAILOVER_RECONNECT_DELAY);
+        }
+    }
+}
+
+snFailoverWebsocket* snFailoverWebsocket_create(snOpenCallback openCallback,
+                                                snMessageCallback messageCallback,
+                                                snCloseCallback closeCallback,
+                                                snErrorCallback errorCallback,
+                                                snFailoverCallback standbyOpenCallback,
+                                                snFailoverCallback failoverCallback,
+                                                void* callbackData,
+                                                snWebsocketOptions* options)
+{
+    snFailoverWebsocket* fws = malloc(sizeof(snFailoverWebsocket));
+    memset(fws, 0, sizeof(snFailoverWebsocket));
+    
+    fws->openCallback = openCallback;
+    fws->messageCallback = messageCallback;
+    fws->closeCallback = closeCallback;
+    fws->errorCallback = errorCallback;
+    fws->standbyOpenCallback = standbyOpenCallback;
+    fws->failoverCallback = failoverCallback;
+    fws->callbackData = callbackData;
+    snTimerWheel_init(&fws->timerWheel);
+    
+    snWebsocketOptions websocketOptions;
+    if (options)
+    {
+        websocketOptions = *options;
+    }
+    else
+    {
+        memset(&websocketOptions, 0, sizeof(snWebsocketOptions));
+    }
+    
+    /*callbacks that would bypass the active slot check*/
+    websocketOptions.frameCallback = NULL;
+    websocketOptions.messageStreamCallbacks = NULL;
+    websocketOptions.messageQueue = NULL;
+    websocketOptions.autoReconnect = 0;
+    websocketOptions.timerWheel = &fws->timerWheel;
+    if (websocketOptions.keepaliveInterval == 0)
+    {
+        websocketOptions.keepaliveInterval = SN_FAILOVER_DEFAULT_KEEPALIVE_INTERVAL;
+    }
+    
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        snFailoverSlot* slot = &fws->slots[i];
+        slot->fws = fws;
+        snTimer_init(&slot->reconnectTimer, reconnectTimerFired, slot);
+        slot->websocket = snWebsocket_createWithSettings(slotOpenCallback,
+                                                         slotMessageCallback,
+                                                         NULL,
+                                                         slotErrorCallback,
+                                                         slot,
+                                                         &websocketOptions);
+    }
+    
+    return fws;
+}
+
+void snFailoverWebsocket_delete(snFailoverWebsocket* fws)
+{
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        snTimer_cancel(&fws->slots[i].reconnectTimer);
+        snWebsocket_delete(fws->slots[i].websocket);
+        free(fws->slots[i].url);
+    }
+    
+    snTimerWheel_deinit(&fws->timerWheel);
+    free(fws);
+}
+
+snError snFailoverWebsocket_connect(snFailoverWebsocket* fws,
+                                    const char* primaryUrl,
+                                    const char* standbyUrl)
+{
+    snFailoverWebsocket_disconnect(fws);
+    
+    fws->activeSlot = 0;
+    fws->slots[0].wasOpen = 0;
+    fws->slots[1].wasOpen = 0;
+    setUrl(&fws->slots[0], primaryUrl);
+    setUrl(&fws->slots[1], standbyUrl);
+    
+    snError e = snWebsocket_connect(fws->slots[0].websocket, primaryUrl);
+    if (e == SN_NO_ERROR)
+    {
+        e = snWebsocket_connect(fws->slots[1].websocket, standbyUrl);
+    }
+    
+    if (e != SN_NO_ERROR)
+    {
+        snFailoverWebsocket_disconnect(fws);
+        return e;
+    }
+    
+    fws->isConnected = 1;
+    return SN_NO_ERROR;
+}
+
+void snFailoverWebsocket_disconnect(snFailoverWebsocket* fws)
+{
+    fws->isConnected = 0;
+    fws->isOpen = 0;
+    
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        snFailoverSlot* slot = &fws->slots[i];
+        snTimer_cancel(&slot->reconnectTimer);
+        slot->isOpen = 0;
+        if (snWebsocket_getState(slot->websocket) != SN_STATE_CLOSED)
+        {
+            snWebsocket_disconnect(slot->websocket, 1);
+        }
+    }
+}
+
+void snFailoverWebsocket_poll(snFailoverWebsocket* fws)
+{
+    snTimerWheel_advance(&fws->timerWheel);
+    
+    snWebsocket_poll(fws->slots[0].websocket);
+    snWebsocket_poll(fws->slots[1].websocket);
+    
+    updateConnections(fws);
+}
+
+void snFailoverWebsocket_waitForEvents(snFailoverWebsocket* fws, int timeoutMs)
+{
+    const int timeUntilNextTimer = snTimerWheel_getTimeUntilNextTimer(&fws->timerWheel);
+    
+    /*wake up in time to fire the next timer*/
+    if (timeUntilNextTimer >= 0 && (timeoutMs < 0 || timeUntilNextTimer < timeoutMs))
+    {
+        timeoutMs = timeUntilNextTimer;
+    }
+    
+    snWebsocket* websockets[2];
+    websockets[0] = fws->slots[0].websocket;
+    websockets[1] = fws->slots[1].websocket;
+    snWebsocket_waitForAnyEvents(websockets, 2, timeoutMs);
+}
+
+snReadyState snFailoverWebsocket_getState(snFailoverWebsocket* fws)
+{
+    return snWebsocket_getState(fws->slots[fws->activeSlot].websocket);
+}
+
+snWebsocket* snFailoverWebsocket_getActiveWebsocket(snFailoverWebsocket* fws)
+{
+    return fws->slots[fws->activeSlot].websocket;
+}
+
+snWebsocket* snFailoverWebsocket_getStandbyWebsocket(snFailoverWebsocket* fws)
+{
+    return fws->slots[1 - fws->activeSlot].websocket;
+}
+
+int snFailoverWebsocket_getNumFailovers(snFailoverWebsocket* fws)
+{
+    return fws->numFailovers;
+}
+
+snError snFailoverWebsocket_sendTextData(snFailoverWebsocket* fws, const char* payload)
+{
+    return snWebsocket_sendTextData(snFailoverWebsocket_getActiveWebsocket(fws), payload);
+}
+
+snError snFailoverWebsocket_sendBinaryData(snFailoverWebsocket* fws, int payloadSize, const char* payload)
+{
+    return snWebsocket_sendBinaryData(snFailoverWebsocket_getActiveWebsocket(fws), payloadSize, payload);
+}
+
+snError snFailoverWebsocket_sendFrame(snFailoverWebsocket* fws, snOpcode opcode, int payloadSize, const char* payload)
+{
+    return snWebsocket_sendFrame(snFailoverWebsocket_getActiveWebsocket(fws), opcode, payloadSize, payload);
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_FAILOVER_WEBSOCKET_H
+#define SN_FAILOVER_WEBSOCKET_H
+
+#include "errorcodes.h"
+#include "websocket.h"
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * The time in milliseconds to wait before reconnecting a websocket whose
+     * connection has failed or been lost.
+     */
+#define SN_FAILOVER_RECONNECT_DELAY 1000
+    
+    /**
+     * The keepalive interval in milliseconds used if the options
+     * don't specify one.
+     */
+#define SN_FAILOVER_DEFAULT_KEEPALIVE_INTERVAL 1000
+    
+    /**
+     * A pair of websockets connected to two different URLs, presenting a single
+     * connection to the application. One websocket is active and the other is
+     * kept as a hot standby: fully handshaked and kept alive with pings, but
+     * with any messages it receives dropped. When the active connection is lost,
+     * the application is switched over to the standby in the same call to
+     * \c snFailoverWebsocket_poll that noticed it, and the lost connection
+     * is reestablished in the background as the new standby.
+     *
+     * Both websockets share a timer wheel owned by the failover websocket.
+     */
+    typedef struct snFailoverWebsocket snFailoverWebsocket;
+    
+    /**
+     * A callback invoked with one of the websockets of a failover websocket.
+     * @param userData The callback data passed to \c snFailoverWebsocket_create.
+     * @param websocket The websocket.
+     */
+    typedef void (*snFailoverCallback)(void* userData, snWebsocket* websocket);
+    
+    /**
+     * Creates a failover websocket.
+     * @param openCallback A function to call when the connection first opens, or opens
+     * again after having been closed with no standby to switch to. Ignored if NULL.
+     * @param messageCallback A function to call when the active websocket receives pings, pongs or
+     * full text or binary messages. Ignored if NULL.
+     * @param closeCallback A function to call when the active connection is lost
+     * with no standby to switch to. Ignored if NULL.
+     * @param errorCallback A function to call when an error occurs on the active websocket. Ignored if NULL.
+     * @param standbyOpenCallback A function to call when the standby websocket has completed
+     * its opening handshake, for example to subscribe to the same data as the active one
+     * so that failing over doesn't require a round trip. Ignored if NULL.
+     * @param failoverCallback A function to call with the new active websocket when the
+     * application has been switched over to the standby. Ignored if NULL.
+     * @param callbackData A pointer passed to the callbacks.
+     * @param options Options for both websockets, or NULL to use the defaults. \c timerWheel,
+     * \c frameCallback, \c messageStreamCallbacks, \c messageQueue and \c autoReconnect
+     * are ignored. If
+     * \c keepaliveInterval is 0, \c SN_FAILOVER_DEFAULT_KEEPALIVE_INTERVAL is used.
+     * @return The created failover websocket.
+     */
+    snFailoverWebsocket* snFailoverWebsocket_create(snOpenCallback openCallback,
+                                                    snMessageCallback messageCallback,
+                                                    snCloseCallback closeCallback,
+                                                    snErrorCallback errorCallback,
+                                                    snFailoverCallback standbyOpenCallback,
+                                                    snFailoverCallback failoverCallback,
+                                                    void* callbackData,
+                                                    snWebsocketOptions* options);
+    
+    /**
+     * Closes both connections and deletes a failover websocket.
+     * @param fws The failover websocket to delete.
+     */
+    void snFailoverWebsocket_delete(snFailoverWebsocket* fws);
+    
+    /**
+     * Starts connecting the active websocket to one URL and the standby
+     * to another. Whichever completes its opening handshake first becomes
+     * the active one.
+     * @param fws The failover websocket.
+     * @param primaryUrl The URL to connect the active websocket to.
+     * @param standbyUrl The URL to connect the standby websocket to.
+     * @return An error code.
+     */
+    snError snFailoverWebsocket_connect(snFailoverWebsocket* fws,
+                                        const char* primaryUrl,
+                                        const char* standbyUrl);
+    
+    /**
+     * Closes both connections immediately and stops reconnecting.
+     * @param fws The failover websocket.
+     */
+    void snFailoverWebsocket_disconnect(snFailoverWebsocket* fws);
+    
+    /**
+     * Advances the shared timer wheel, polls both websockets and switches
+     * over to the standby if the active connection has been lost.
+     * @param fws The failover websocket.
+     */
+    void snFailoverWebsocket_poll(snFailoverWebsocket* fws);
+    
+    /**
+     * Blocks until either websocket has I/O to handle, the next timer is due
+     * or a timeout expires.
+     * @param fws The failover websocket.
+     * @param timeoutMs The maximum time to wait in milliseconds, or -1 to wait indefinitely.
+     * While neither websocket has a descriptor, waiting indefinitely blocks for a short interval.
+     */
+    void snFailoverWebsocket_waitForEvents(snFailoverWebsocket* fws, int timeoutMs);
+    
+    /**
+     * @param fws The failover websocket.
+     * @return \c SN_STATE_OPEN if the active websocket is open, otherwise its state.
+     */
+    snReadyState snFailoverWebsocket_getState(snFailoverWebsocket* fws);
+    
+    /**
+     * @param fws The failover websocket.
+     * @return The websocket whose messages are passed to the application.
+     */
+    snWebsocket* snFailoverWebsocket_getActiveWebsocket(snFailoverWebsocket* fws);
+    
+    /**
+     * @param fws The failover websocket.
+     * @return The websocket kept as a standby.
+     */
+    snWebsocket* snFailoverWebsocket_getStandbyWebsocket(snFailoverWebsocket* fws);
+    
+    /**
+     * @param fws The failover websocket.
+     * @return The number of times the application has been switched over to the standby.
+     */
+    int snFailoverWebsocket_getNumFailovers(snFailoverWebsocket* fws);
+    
+    /**
+     * Sends a text message on the active websocket.
+     * @param fws The failover websocket.
+     * @param payload A null terminated string.
+     * @return An error code.
+     */
+    snError snFailoverWebsocket_sendTextData(snFailoverWebsocket* fws, const char* payload);
+    
+    /**
+     * Sends a binary message on the active websocket.
+     * @param fws The failover websocket.
+     * @param payloadSize The size of the payload in bytes.
+     * @param payload The payload.
+     * @return An error code.
+     */
+    snError snFailoverWebsocket_sendBinaryData(snFailoverWebsocket* fws, int payloadSize, const char* payload);
+    
+    /**
+     * Sends a frame on the active websocket.
+     * @param fws The failover websocket.
+     * @param opcode The frame opcode.
+     * @param payloadSize The size of the payload in bytes.
+     * @param payload The payload.
+     * @return An error code.
+     */
+    snError snFailoverWebsocket_sendFrame(snFailoverWebsocket* fws, snOpcode opcode, int payloadSize, const char* payload);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_FAILOVER_WEBSOCKET_H*/
@@ -0,0 +1,639 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+/*for clock_gettime*/
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fastestwebsocket.h"
+
+/**
+ * A websocket connected to one of the endpoints, either probing it
+ * or used by the application.
+ */
+typedef struct snEndpointConnection
+{
+    /** */
+    snFastestWebsocket* fws;
+    /** */
+    snWebsocket* websocket;
+    /** The index of the endpoint in the URL list. */
+    int endpointIndex;
+    /** The time in microseconds when the probe started connecting. */
+    long long connectTime;
+    /** Non-zero while the probe is waiting for the opening handshake to complete. */
+    int isProbing;
+} snEndpointConnection;
+
+/**
+ * A candidate endpoint.
+ */
+typedef struct snEndpoint
+{
+    /** */
+    char* url;
+    /** The endpoint's probe websocket, or NULL if there is none. */
+    snEndpointConnection* probe;
+    /** The duration of the latest completed probe in milliseconds, or -1. */
+    double probeTime;
+} snEndpoint;
+
+struct snFastestWebsocket
+{
+    /** */
+    snOpenCallback openCallback;
+    /** */
+    snMessageCallback messageCallback;
+    /** */
+    snCloseCallback closeCallback;
+    /** */
+    snErrorCallback errorCallback;
+    /** */
+    snMigrationCallback migrationCallback;
+    /** */
+    void* callbackData;
+    /** Used to create all websockets. */
+    snWebsocketOptions websocketOptions;
+    /** */
+    int probeTimeout;
+    /** */
+    int reprobeInterval;
+    /** */
+    double migrationThreshold;
+    /** */
+    int numRoundsToMigrate;
+    /** Shared by all websockets. */
+    snTimerWheel timerWheel;
+    /** Ends a probe round that is taking too long. */
+    snTimer probeTimeoutTimer;
+    /** Starts the next probe round. */
+    snTimer reprobeTimer;
+    /** */
+    snEndpoint* endpoints;
+    /** */
+    int numEndpoints;
+    /** The websocket used by the application, or NULL. */
+    snEndpointConnection* connection;
+    /** The websocket of the previous endpoint after migrating, until it has closed. */
+    snEndpointConnection* closingConnection;
+    /** Non-zero if the application has been told that the connection is open. */
+    int isOpen;
+    /** Non-zero while a probe round is in progress. */
+    int isProbing;
+    /** Non-zero if the current probe round started while connected. */
+    int isReprobing;
+    /** The endpoint that has been faster than the current one in the latest rounds, or -1. */
+    int fasterEndpointIndex;
+    /** The number of rounds in a row \c fasterEndpointIndex has been faster. */
+    int numFasterRounds;
+    /** */
+    int numMigrations;
+};
+
+static long long getTimeMicroseconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void connectionMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    snEndpointConnection* c = (snEndpointConnection*)userData;
+    
+    /*probes only exist to be timed*/
+    if (c == c->fws->connection && c->fws->messageCallback)
+    {
+        c->fws->messageCallback(c->fws->callbackData, opcode, bytes, numBytes);
+    }
+}
+
+static void connectionErrorCallback(void* userData, snError error)
+{
+    snEndpointConnection* c = (snEndpointConnection*)userData;
+    
+    if (c == c->fws->connection && c->fws->errorCallback)
+    {
+        c->fws->errorCallback(c->fws->callbackData, error);
+    }
+}
+
+static snEndpointConnection* createConnection(snFastestWebsocket* fws, int endpointIndex)
+{
+    snEndpointConnection* c = malloc(sizeof(snEndpointConnection));
+    memset(c, 0, sizeof(snEndpointConnection));
+    c->fws = fws;
+    c->endpointIndex = endpointIndex;
+    c->websocket = snWebsocket_createWithSettings(NULL,
+                                                  connectionMessageCallback,
+                                                  NULL,
+                                                  connectionErrorCallback,
+                                                  c,
+                                                  &fws->websocketOptions);
+    return c;
+}
+
+static void deleteConnection(snEndpointConnection* c)
+{
+    if (c)
+    {
+        snWebsocket_delete(c->websocket);
+        free(c);
+    }
+}
+
+static void closeProbes(snFastestWebsocket* fws)
+{
+    int i;
+    for (i = 0; i < fws->numEndpoints; i++)
+    {
+        snEndpointConnection* probe = fws->endpoints[i].probe;
+        if (probe)
+        {
+            probe->isProbing = 0;
+            if (snWebsocket_getState(probe->websocket) != SN_STATE_CLOSED)
+            {
+                snWebsocket_disconnect(probe->websocket, 1);
+            }
+        }
+    }
+}
+
+static void startProbeRound(snFastestWebsocket* fws)
+{
+    const long long now = getTimeMicroseconds();
+    int i;
+    
+    fws->isProbing = 1;
+    fws->isReprobing = fws->connection != NULL;
+    
+    for (i = 0; i < fws->numEndpoints; i++)
+    {
+        snEndpoint* endpoint = &fws->endpoints[i];
+        if (endpoint->probe == NULL)
+        {
+            endpoint->probe = createConnection(fws, i);
+        }
+        
+        endpoint->probe->connectTime = now;
+        endpoint->probe->isProbing = 1;
+        if (snWebsocket_connect(endpoint->probe->websocket, endpoint->url) != SN_NO_ERROR)
+        {
+            endpoint->probe->isProbing = 0;
+            endpoint->probeTime = -1;
+        }
+    }
+    
+    snTimerWheel_schedule(&fws->timerWheel, &fws->probeTimeoutTimer, fws->probeTimeout);
+}
+
+static void migrate(snFastestWebsocket* fws, int endpointIndex)
+{
+    snEndpointConnection* previous = fws->connection;
+    
+    deleteConnection(fws->closingConnection);
+    snWebsocket_disconnect(previous->websocket, 0);
+    fws->closingConnection = previous;
+    
+    /*the probe is already open, so there is no gap*/
+    fws->connection = fws->endpoints[endpointIndex].probe;
+    fws->endpoints[endpointIndex].probe = NULL;
+    fws->fasterEndpointIndex = -1;
+    fws->numFasterRounds = 0;
+    fws->numMigrations++;
+    
+    if (fws->migrationCallback)
+    {
+        fws->migrationCallback(fws->callbackData, fws->connection->websocket);
+    }
+}
+
+/**
+ * Compares the endpoints probed in a round with the current one
+ * and migrates if another one has been faster for long enough.
+ */
+static void evaluateProbeRound(snFastestWebsocket* fws)
+{
+    const double currentProbeTime = fws->endpoints[fws->connection->endpointIndex].probeTime;
+    int fastestIndex = -1;
+    int i;
+    
+    for (i = 0; i < fws->numEndpoints; i++)
+    {
+        const double probeTime = fws->endpoints[i].probeTime;
+        if (probeTime >= 0 &&
+            (fastestIndex < 0 || probeTime < fws->endpoints[fastestIndex].probeTime))
+        {
+            fastestIndex = i;
+        }
+    }
+    
+    if (fastestIndex < 0 ||
+        fastestIndex == fws->connection->endpointIndex ||
+        (currentProbeTime >= 0 &&
+         fws->endpoints[fastestIndex].probeTime >= currentProbeTime * (1.0 - fws->migrationThreshold)))
+    {
+        fws->fasterEndpointIndex = -1;
+        fws->numFasterRounds = 0;
+        return;
+    }
+    
+    if (fastestIndex == fws->fasterEndpointIndex)
+    {
+        fws->numFasterRounds++;
+    }
+    else
+    {
+        fws->fasterEndpointIndex = fastestIndex;
+        fws->numFasterRounds = 1;
+    }
+    
+    if (fws->numFasterRounds >= fws->numRoundsToMigrate)
+    {
+        migrate(fws, fastestIndex);
+    }
+}
+
+static void endProbeRound(snFastestWebsocket* fws)
+{
+    int i;
+    
+    snTimer_cancel(&fws->probeTimeoutTimer);
+    fws->isProbing = 0;
+    
+    for (i = 0; i < fws->numEndpoints; i++)
+    {
+        snEndpointConnection* probe = fws->endpoints[i].probe;
+        if (probe && probe->isProbing)
+        {
+            /*timed out*/
+            fws->endpoints[i].probeTime = -1;
+        }
+    }
+    
+    if (fws->isReprobing && fws->isOpen)
+    {
+        evaluateProbeRound(fws);
+    }
+    closeProbes(fws);
+    
+    if (fws->connection == NULL)
+    {
+        if (fws->errorCallback)
+        {
+            fws->errorCallback(fws->callbackData, SN_SOCKET_FAILED_TO_CONNECT);
+        }
+    }
+    else if (fws->isOpen && fws->reprobeInterval > 0)
+    {
+        snTimerWheel_schedule(&fws->timerWheel, &fws->reprobeTimer, fws->reprobeInterval);
+    }
+}
+
+static void probeTimeoutTimerFired(void* userData)
+{
+    endProbeRound((snFastestWebsocket*)userData);
+}
+
+static void reprobeTimerFired(void* userData)
+{
+    snFastestWebsocket* fws = (snFastestWebsocket*)userData;
+    if (fws->isOpen)
+    {
+        startProbeRound(fws);
+    }
+}
+
+static void updateProbes(snFastestWebsocket* fws)
+{
+    const long long now = getTimeMicroseconds();
+    int isProbing = 0;
+    int i;
+    
+    for (i = 0; i < fws->numEndpoints; i++)
+    {
+        snEndpoint* endpoint = &fws->endpoints[i];
+        snEndpointConnection* probe = endpoint->probe;
+        if (probe == NULL || !probe->isProbing)
+        {
+            continue;
+        }
+        
+        const snReadyState state = snWebsocket_getState(probe->websocket);
+        if (state == SN_STATE_OPEN)
+        {
+            probe->isProbing = 0;
+            endpoint->probeTime = (now - probe->connectTime) / 1000.0;
+            
+            if (fws->connection == NULL)
+            {
+                /*the first endpoint to open is the fastest. use it right away*/
+                fws->connection = probe;
+                endpoint->probe = NULL;
+                fws->isOpen = 1;
+                if (fws->openCallback)
+                {
+                    fws->openCallback(fws->callbackData);
+                }
+            }
+        }
+        else if (state == SN_STATE_CLOSED)
+        {
+            probe->isProbing = 0;
+            endpoint->probeTime = -1;
+        }
+        else
+        {
+            isProbing = 1;
+        }
+    }
+    
+    if (fws->isProbing && !isProbing)
+    {
+        endProbeRound(fws);
+    }
+}
+
+snFastestWebsocket* snFastestWebsocket_create(snOpenCallback openCallback,
+                                              snMessageCallback messageCallback,
+                                              snCloseCallback closeCallback,
+                                              snErrorCallback errorCallback,
+                                              snMigrationCallback migrationCallback,
+                                              void* callbackData,
+                                              const snFastestWebsocketOptions* options)
+{
+    snFastestWebsocket* fws = malloc(sizeof(snFastestWebsocket));
+    memset(fws, 0, sizeof(snFastestWebsocket));
+    
+    fws->openCallback = openCallback;
+    fws->messageCallback = messageCallback;
+    fws->closeCallback = closeCallback;
+    fws->errorCallback = errorCallback;
+    fws->migrationCallback = migrationCallback;
+    fws->callbackData = callbackData;
+    fws->fasterEndpointIndex = -1;
+    
+    if (options)
+    {
+        if (options->websocketOptions)
+        {
+            fws->websocketOptions = *options->websocketOptions;
+        }
+        fws->probeTimeout = options->probeTimeout;
+        fws->reprobeInterval = options->reprobeInterval;
+        fws->migrationThreshold = options->migrationThreshold;
+        fws->numRoundsToMigrate = options->numRoundsToMigrate;
+    }
+    
+    if (fws->probeTimeout <= 0)
+    {
+        fws->probeTimeout = SN_FASTEST_DEFAULT_PROBE_TIMEOUT;
+    }
+    if (fws->migrationThreshold <= 0)
+    {
+        fws->migrationThreshold = SN_FASTEST_DEFAULT_MIGRATION_THRESHOLD;
+    }
+    if (fws->numRoundsToMigrate <= 0)
+    {
+        fws->numRoundsToMigrate = SN_FASTEST_DEFAULT_NUM_ROUNDS_TO_MIGRATE;
+    }
+    
+    /*callbacks that would bypass the connection check*/
+    fws->websocketOptions.frameCallback = NULL;
+    fws->websocketOptions.messageStreamCallbacks = NULL;
+    fws->websocketOptions.messageQueue = NULL;
+    fws->websocketOptions.autoReconnect = 0;
+    fws->websocketOptions.timerWheel = &fws->timerWheel;
+    
+    snTimerWheel_init(&fws->timerWheel);
+    snTimer_init(&fws->probeTimeoutTimer, probeTimeoutTimerFired, fws);
+    snTimer_init(&fws->reprobeTimer, reprobeTimerFired, fws);
+    
+    return fws;
+}
+
+static void deleteEndpoints(snFastestWebsocket* fws)
+{
+    int i;
+    for (i = 0; i < fws->numEndpoints; i++)
+    {
+        deleteConnection(fws->endpoints[i].probe);
+        free(fws->endpoints[i].url);
+    }
+    free(fws->endpoints);
+    fws->endpoints = NULL;
+    fws->numEndpoints = 0;
+}
+
+void snFastestWebsocket_delete(snFastestWebsocket* fws)
+{
+    snFastestWebsocket_disconnect(fws);
+    deleteEndpoints(fws);
+    snTimerWheel_deinit(&fws->timerWheel);
+    free(fws);
+}
+
+snError snFastestWebsocket_connect(snFastestWebsocket* fws, const char** urls, int numUrls)
+{
+    int i;
+    
+    if (numUrls <= 0)
+    {
+        return SN_INVALID_URL;
+    }
+    
+    snFastestWebsocket_disconnect(fws);
+    deleteEndpoints(fws);
+    
+    fws->endpoints = malloc(numUrls * sizeof(snEndpoint));
+    memset(fws->endpoints, 0, numUrls * sizeof(snEndpoint));
+    fws->numEndpoints = numUrls;
+    for (i = 0; i < numUrls; i++)
+    {
+        fws->endpoints[i].url = malloc(strlen(urls[i]) + 1);
+        strcpy(fws->endpoints[i].url, urls[i]);
+        fws->endpoints[i].probeTime = -1;
+    }
+    
+    startProbeRound(fws);
+    
+    return SN_NO_ERROR;
+}
+
+void snFastestWebsocket_disconnect(snFastestWebsocket* fws)
+{
+    snTimer_cancel(&fws->probeTimeoutTimer);
+    snTimer_cancel(&fws->reprobeTimer);
+    closeProbes(fws);
+    
+    deleteConnection(fws->connection);
+    deleteConnection(fws->closingConnection);
+    fws->connection = NULL;
+    fws->closingConnection = NULL;
+    
+    fws->isOpen = 0;
+    fws->isProbing = 0;
+    fws->fasterEndpointIndex = -1;
+    fws->numFasterRounds = 0;
+}
+
+void snFastestWebsocket_poll(snFastestWebsocket* fws)
+{
+    int i;
+    
+    snTimerWheel_advance(&fws->timerWheel);
+    
+    if (fws->connection)
+    {
+        snWebsocket_poll(fws->connection->websocket);
+    }
+    
+    if (fws->closingConnection)
+    {
+        snWebsocket_poll(fws->closingConnection->websocket);
+        if (snWebsocket_getState(fws->closingConnection->websocket) == SN_STATE_CLOSED)
+        {
+            deleteConnection(fws->closingConnection);
+            fws->closingConnection = NULL;
+        }
+    }
+    
+    for (i = 0; i < fws->numEndpoints; i++)
+    {
+        if (fws->endpoints[i].probe && fws->endpoints[i].probe->isProbing)
+        {
+            snWebsocket_poll(fws->endpoints[i].probe->websocket);
+        }
+    }
+    
+    updateProbes(fws);
+    
+    if (fws->isOpen && snWebsocket_getState(fws->connection->websocket) != SN_STATE_OPEN)
+    {
+        /*the connection has been lost. stop probing*/
+        fws->isOpen = 0;
+        snTimer_cancel(&fws->reprobeTimer);
+        snTimer_cancel(&fws->probeTimeoutTimer);
+        fws->isProbing = 0;
+        closeProbes(fws);
+        if (fws->closeCallback)
+        {
+            fws->closeCallback(fws->callbackData, SN_STATUS_ENDPOINT_GOING_AWAY);
+        }
+    }
+}
+
+void snFastestWebsocket_waitForEvents(snFastestWebsocket* fws, int timeoutMs)
+{
+    const int timeUntilNextTimer = snTimerWheel_getTimeUntilNextTimer(&fws->timerWheel);
+    snWebsocket** websockets = malloc((fws->numEndpoints + 2) * sizeof(snWebsocket*));
+    int i;
+    
+    /*wake up in time to fire the next timer*/
+    if (timeUntilNextTimer >= 0 && (timeoutMs < 0 || timeUntilNextTimer < timeoutMs))
+    {
+        timeoutMs = timeUntilNextTimer;
+    }
+    
+    websockets[0] = fws->connection ? fws->connection->websocket : NULL;
+    websockets[1] = fws->closingConnection ? fws->closingConnection->websocket : NULL;
+    
+    for (i = 0; i < fws->numEndpoints; i++)
+    {
+        const snEndpointConnection* probe = fws->endpoints[i].probe;
+        websockets[i + 2] = (probe && probe->isProbing) ? probe->websocket : NULL;
+    }
+    
+    snWebsocket_waitForAnyEvents(websockets, fws->numEndpoints + 2, timeoutMs);
+    
+    free(websockets);
+}
+
+snReadyState snFastestWebsocket_getState(snFastestWebsocket* fws)
+{
+    if (fws->connection)
+    {
+        return snWebsocket_getState(fws->connection->websocket);
+    }
+    return fws->isProbing ? SN_STATE_CONNECTING : SN_STATE_CLOSED;
+}
+
+snWebsocket* snFastestWebsocket_getWebsocket(snFastestWebsocket* fws)
+{
+    return fws->connection ? fws->connection->websocket : NULL;
+}
+
+int snFastestWebsocket_getEndpointIndex(snFastestWebsocket* fws)
+{
+    return fws->connection ? fws->connection->endpointIndex : -1;
+}
+
+double snFastestWebsocket_getEndpointProbeTime(snFastestWebsocket* fws, int endpointIndex)
+{
+    if (endpointIndex < 0 || endpointIndex >= fws->numEndpoints)
+    {
+        return -1;
+    }
+    return fws->endpoints[endpointIndex].probeTime;
+}
+
+int snFastestWebsocket_getNumMigrations(snFastestWebsocket* fws)
+{
+    return fws->numMigrations;
+}
+
+snError snFastestWebsocket_sendTextData(snFastestWebsocket* fws, const char* payload)
+{
+    if (fws->connection == NULL)
+    {
+        return SN_WEBSOCKET_CONNECTION_IS_NOT_OPEN;
+    }
+    return snWebsocket_sendTextData(fws->connection->websocket, payload);
+}
+
+snError snFastestWebsocket_sendBinaryData(snFastestWebsocket* fws, int payloadSize, const char* payload)
+{
+    if (fws->connection == NULL)
+    {
+        return SN_WEBSOCKET_CONNECTION_IS_NOT_OPEN;
+    }
+    return snWebsocket_sendBinaryData(fws->connection->websocket, payloadSize, payload);
+}
+
+snError snFastestWebsocket_sendFrame(snFastestWebsocket* fws, snOpcode opcode, int payloadSize, const char* payload)
+{
+    if (fws->connection == NULL)
+    {
+        return SN_WEBSOCKET_CONNECTION_IS_NOT_OPEN;
+    }
+    return snWebsocket_sendFrame(fws->connection->websocket, opcode, payloadSize, payload);
+}
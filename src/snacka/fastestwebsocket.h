@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_FASTEST_WEBSOCKET_H
+#define SN_FASTEST_WEBSOCKET_H
+
+#include "errorcodes.h"
+#include "websocket.h"
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /** The default maximum time in milliseconds to wait for a probe to complete. */
+#define SN_FASTEST_DEFAULT_PROBE_TIMEOUT 2000
+    
+    /** The default value of \c snFastestWebsocketOptions.migrationThreshold. */
+#define SN_FASTEST_DEFAULT_MIGRATION_THRESHOLD 0.2
+    
+    /** The default value of \c snFastestWebsocketOptions.numRoundsToMigrate. */
+#define SN_FASTEST_DEFAULT_NUM_ROUNDS_TO_MIGRATE 3
+    
+    /**
+     * A websocket connected to the fastest of a list of candidate endpoints.
+     * Connecting starts a probe round, connecting a websocket to each endpoint
+     * at the same time and measuring the time from starting to connect until
+     * the opening handshake completes, which includes the TCP handshake and
+     * one request round trip. The first websocket to open is the fastest, and
+     * becomes the connection used by the application, without connecting again.
+     * The others are closed once they have been measured.
+     *
+     * Optionally, the endpoints are probed again periodically, including the
+     * current one, and the connection migrates to another endpoint if it has
+     * been faster by a given fraction for a number of rounds in a row. Like
+     * initially, the probe websocket that was measured becomes the connection.
+     * Messages sent before migrating are not moved to the new connection.
+     * The previous websocket closes normally, sending what is queued on it
+     * within its \c closeDrainTimeout. Whatever the socket does not accept by
+     * then is dropped without being reported, and so is anything still queued
+     * when migrating again or disconnecting before the previous websocket has closed.
+     *
+     * All websockets share a timer wheel owned by the fastest websocket.
+     */
+    typedef struct snFastestWebsocket snFastestWebsocket;
+    
+    /**
+     * A callback invoked when the connection has migrated to another endpoint.
+     * @param userData The callback data passed to \c snFastestWebsocket_create.
+     * @param websocket The websocket connected to the new endpoint.
+     */
+    typedef void (*snMigrationCallback)(void* userData, snWebsocket* websocket);
+    
+    /**
+     * Fastest websocket creation options.
+     */
+    typedef struct snFastestWebsocketOptions
+    {
+        /**
+         * Options for all websockets, or NULL to use the defaults. \c timerWheel,
+         * \c frameCallback, \c messageStreamCallbacks, \c messageQueue and
+         * \c autoReconnect are ignored. Pointers in the options must outlive the fastest websocket.
+         */
+        snWebsocketOptions* websocketOptions;
+        /**
+         * The maximum time in milliseconds to wait for a probe. Endpoints that
+         * don't complete the opening handshake in time are considered unreachable.
+         * If 0, \c SN_FASTEST_DEFAULT_PROBE_TIMEOUT is used.
+         */
+        int probeTimeout;
+        /**
+         * If positive, the time in milliseconds from the end of one probe round
+         * to the start of the next while connected. If 0, endpoints are only
+         * probed when connecting.
+         */
+        int reprobeInterval;
+        /**
+         * The fraction by which another endpoint's probe time must be lower than
+         * that of the current endpoint for it to count as faster, e.g. 0.2 for 20%.
+         * If 0, \c SN_FASTEST_DEFAULT_MIGRATION_THRESHOLD is used.
+         */
+        double migrationThreshold;
+        /**
+         * The number of probe rounds in a row another endpoint has to be faster
+         * for the connection to migrate to it. If 0,
+         * \c SN_FASTEST_DEFAULT_NUM_ROUNDS_TO_MIGRATE is used.
+         */
+        int numRoundsToMigrate;
+    } snFastestWebsocketOptions;
+    
+    /**
+     * Creates a fastest websocket.
+     * @param openCallback A function to call when the connection to the fastest endpoint has opened. Ignored if NULL.
+     * @param messageCallback A function to call when the connected websocket receives pings, pongs or
+     * full text or binary messages. Ignored if NULL.
+     * @param closeCallback A function to call when the connection is closed. Ignored if NULL.
+     * @param errorCallback A function to call when an error occurs on the connected websocket, or with
+     * \c SN_SOCKET_FAILED_TO_CONNECT if no endpoint could be reached. Ignored if NULL.
+     * @param migrationCallback A function to call when the connection has migrated to another endpoint. Ignored if NULL.
+     * @param callbackData A pointer passed to the callbacks.
+     * @param options Creation options, or NULL to use the defaults.
+     * @return The created fastest websocket.
+     */
+    snFastestWebsocket* snFastestWebsocket_create(snOpenCallback openCallback,
+                                                  snMessageCallback messageCallback,
+                                                  snCloseCallback closeCallback,
+                                                  snErrorCallback errorCallback,
+                                                  snMigrationCallback migrationCallback,
+                                                  void* callbackData,
+                                                  const snFastestWebsocketOptions* options);
+    
+    /**
+     * Closes all connections and deletes a fastest websocket.
+     * @param fws The fastest websocket to delete.
+     */
+    void snFastestWebsocket_delete(snFastestWebsocket* fws);
+    
+    /**
+     * Starts probing a list of endpoints, connecting to the fastest one.
+     * @param fws The fastest websocket.
+     * @param urls The URLs of the endpoints.
+     * @param numUrls The number of URLs.
+     * @return An error code.
+     */
+    snError snFastestWebsocket_connect(snFastestWebsocket* fws, const char** urls, int numUrls);
+    
+    /**
+     * Closes all connections immediately and stops probing. Buffered
+     * outgoing data the sockets do not accept right away is dropped.
+     * @param fws The fastest websocket.
+     */
+    void snFastestWebsocket_disconnect(snFastestWebsocket* fws);
+    
+    /**
+     * Advances the shared timer wheel, polls all websockets and handles
+     * completed probes.
+     * @param fws The fastest websocket.
+     */
+    void snFastestWebsocket_poll(snFastestWebsocket* fws);
+    
+    /**
+     * Blocks until any websocket has I/O to handle, the next timer is due
+     * or a timeout expires.
+     * @param fws The fastest websocket.
+     * @param timeoutMs The maximum time to wait in milliseconds, or -1 to wait indefinitely.
+     * While no websocket has a descriptor, waiting indefinitely blocks for a short interval.
+     */
+    void snFastestWebsocket_waitForEvents(snFastestWebsocket* fws, int timeoutMs);
+    
+    /**
+     * @param fws The fastest websocket.
+     * @return The state of the connection. \c SN_STATE_CONNECTING during the
+     * first probe round.
+     */
+    snReadyState snFastestWebsocket_getState(snFastestWebsocket* fws);
+    
+    /**
+     * @param fws The fastest websocket.
+     * @return The websocket used by the application, or NULL if no endpoint has been chosen.
+     */
+    snWebsocket* snFastestWebsocket_getWebsocket(snFastestWebsocket* fws);
+    
+    /**
+     * @param fws The fastest websocket.
+     * @return The index in the URL list of the endpoint the connection is to, or -1.
+     */
+    int snFastestWebsocket_getEndpointIndex(snFastestWebsocket* fws);
+    
+    /**
+     * @param fws The fastest websocket.
+     * @param endpointIndex The index of the endpoint in the URL list.
+     * @return The time in milliseconds the endpoint's latest completed probe took,
+     * or -1 if it has not been reached.
+     */
+    double snFastestWebsocket_getEndpointProbeTime(snFastestWebsocket* fws, int endpointIndex);
+    
+    /**
+     * @param fws The fastest websocket.
+     * @return The number of times the connection has migrated to another endpoint.
+     */
+    int snFastestWebsocket_getNumMigrations(snFastestWebsocket* fws);
+    
+    /**
+     * Sends a text message on the connected websocket.
+     * @param fws The fastest websocket.
+     * @param payload A null terminated string.
+     * @return An error code.
+     */
+    snError snFastestWebsocket_sendTextData(snFastestWebsocket* fws, const char* payload);
+    
+    /**
+     * Sends a binary message on the connected websocket.
+     * @param fws The fastest websocket.
+     * @param payloadSize The size of the payload in bytes.
+     * @param payload The payload.
+     * @return An error code.
+     */
+    snError snFastestWebsocket_sendBinaryData(snFastestWebsocket* fws, int payloadSize, const char* payload);
+    
+    /**
+     * Sends a frame on the connected websocket.
+     * @param fws The fastest websocket.
+     * @param opcode The frame opcode.
+     * @param payloadSize The size of the payload in bytes.
+     * @param payload The payload.
+     * @return An error code.
+     */
+    snError snFastestWebsocket_sendFrame(snFastestWebsocket* fws, snOpcode opcode, int payloadSize, const char* payload);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_FASTEST_WEBSOCKET_H*/
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "frame.h"
+#include "masking.h"
 
 static const char* opcodeToString(snOpcode o)
 {
@@ -112,7 +113,7 @@ snError snFrameHeader_toBytes(snFrameHeader* h, char* headerBytes, int* headerSi
         return validationResult;
     }
     
-    bytes[writeIdx++] = (h->isFinal << 7) | h->opcode;
+    bytes[writeIdx++] = (h->isFinal << 7) | (h->isCompressed ? 0x40 : 0) | h->opcode;
     
     if (h->payloadSize < 126)
     {
@@ -171,12 +172,13 @@ snError snFrameHeader_fromBytes(snFrameHeader* h,
     const int rsv1 = (b1 & 0x40) >> 6;
     const int rsv2 = (b1 & 0x20) >> 5;
     const int rsv3 = (b1 & 0x10) >> 4;
-    if (rsv1 != 0 || rsv2 != 0 || rsv3 != 0)
+    if (rsv2 != 0 || rsv3 != 0)
     {
         return SN_NONZERO_RESVERVED_BIT;
     }
     
     h->isFinal = (b1 & 0x80) >> 7;
+    h->isCompressed = rsv1;
     h->opcode = b1 & 0xf;
     
     /*second header byte. read MASK flag and 7 payload size bits*/
@@ -199,7 +201,7 @@ snError snFrameHeader_fromBytes(snFrameHeader* h,
         int i;
         for (i = 0; i < 8; i++)
         {
-            h->payloadSize |= (((unsigned char*)headerBytes)[readIdx++] << ((7 - i) * 8));
+            h->payloadSize |= ((unsigned long long)((unsigned char*)headerBytes)[readIdx++] << ((7 - i) * 8));
         }
     }
     else
@@ -214,7 +216,7 @@ snError snFrameHeader_fromBytes(snFrameHeader* h,
         int i;
         for (i = 0; i < 4; i++)
         {
-            h->maskingKey |= (((unsigned char*)headerBytes)[readIdx++] << ((3 - i) * 8));
+            h->maskingKey |= ((unsigned int)((unsigned char*)headerBytes)[readIdx++] << ((3 - i) * 8));
         }
     }
     
@@ -229,6 +231,7 @@ snError snFrameHeader_fromBytes(snFrameHeader* h,
 int snFrameHeader_equals(const snFrameHeader* h1, const snFrameHeader* h2)
 {
     return h1->isFinal == h2->isFinal &&
+    h1->isCompressed == h2->isCompressed &&
     h1->isMasked == h2->isMasked &&
     h1->maskingKey == h2->maskingKey &&
     h1->opcode == h2->opcode &&
@@ -258,6 +261,13 @@ snError snFrameHeader_validate(const snFrameHeader* h)
         }
     }
     
+    /*only the first frame of a data message may be marked as compressed
+      https://tools.ietf.org/html/rfc7692#section-6.1*/
+    if (h->isCompressed && h->opcode != SN_OPCODE_TEXT && h->opcode != SN_OPCODE_BINARY)
+    {
+        return SN_NONZERO_RESVERVED_BIT;
+    }
+    
     /*check masking key*/
     if (h->isMasked && h->maskingKey == 0)
     {
@@ -283,12 +293,7 @@ snError snFrameHeader_applyMask(snFrameHeader* h, char* payload, int numBytes, i
     assert(offset >= 0);
     
     /*apply the mask to the payload*/
-    unsigned char* maskBytes = (unsigned char*)(&h->maskingKey);
-    int i;
-    for (i = 0; i < numBytes; i++)
-    {
-        payload[i] = payload[i] ^ maskBytes[3 - ((i + offset) % 4)];
-    }
+    snMaskPayload((uint32_t)h->maskingKey, payload, numBytes, offset);
     
     return SN_NO_ERROR;
 }
@@ -88,6 +88,12 @@ extern "C"
         snOpcode opcode;
         /** Indicates if the payload is split up into multiple frames. */
         int isFinal;
+        /**
+         * Non-zero if RSV1 is set, which marks the first frame of a message
+         * compressed by the permessage-deflate extension.
+         * @see https://tools.ietf.org/html/rfc7692#section-6
+         */
+        int isCompressed;
         /** Non-zero if the payload is masked, zero otherwise. */
         int isMasked;
         /** The key used to mask the payload, if \c isMasked is not zero.*/
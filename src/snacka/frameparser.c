@@ -28,13 +28,160 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "frameparser.h"
+#include "masking.h"
 #include "utf8.h"
 
+/** The size of the message buffer when it is first allocated. */
+#define SN_MIN_MESSAGE_BUFFER_SIZE (1 << 10)
+
+/** The message buffer is released after assembling messages bigger than this. */
+#define SN_MAX_RETAINED_MESSAGE_BUFFER_SIZE (1 << 16)
+
+static int isControlFrame(const snFrameHeader* header)
+{
+    return header->opcode == SN_OPCODE_PING ||
+           header->opcode == SN_OPCODE_PONG ||
+           header->opcode == SN_OPCODE_CONNECTION_CLOSE;
+}
+
+/**
+ * Returns non-zero if the payload of the current frame is
+ * passed to the message stream callbacks instead of being buffered.
+ */
+static int isStreamedFrame(const snFrameParser* parser)
+{
+    return parser->isStreamingMessages && !isControlFrame(&parser->currentFrameHeader);
+}
+
+/**
+ * Validates a chunk of a text or binary message
+ * and passes it to the message stream chunk callback.
+ */
+static snError streamMessageChunk(void* userData, const char* bytes, int numBytes)
+{
+    snFrameParser* parser = (snFrameParser*)userData;
+    const snOpcode opcode = parser->currentFrameHeader.opcode == SN_OPCODE_CONTINUATION ?
+                            parser->continuationOpcode : parser->currentFrameHeader.opcode;
+    
+    if (opcode == SN_OPCODE_TEXT &&
+        !snUTF8ValidateStringIncremental((uint8_t*)bytes, numBytes, &parser->utf8State))
+    {
+        return SN_INVALID_UTF8;
+    }
+    
+    if (parser->messageStreamCallbacks.chunkCallback)
+    {
+        parser->messageStreamCallbacks.chunkCallback(parser->messageStreamCallbackData, opcode, bytes, numBytes);
+    }
+    
+    return SN_NO_ERROR;
+}
+
+/**
+ * Passes a chunk of unmasked text or binary payload on to the message
+ * stream chunk callback, decompressing it first if needed.
+ */
+static snError streamUnmaskedPayloadChunk(snFrameParser* parser, const char* bytes, int numBytes)
+{
+    if (parser->isCompressedMessage)
+    {
+        return snPerMessageDeflate_decompressChunk(parser->perMessageDeflate,
+                                                   bytes,
+                                                   numBytes,
+                                                   0,
+                                                   streamMessageChunk,
+                                                   parser);
+    }
+    
+    return streamMessageChunk(parser, bytes, numBytes);
+}
+
+/**
+ * Decompresses a complete text or binary message, validates it
+ * and passes it to the message callback.
+ */
+static snError deliverCompressedMessage(snFrameParser* parser,
+                                        snOpcode opcode,
+                                        const char* bytes,
+                                        int numBytes)
+{
+    const char* message = NULL;
+    int messageSize = 0;
+    
+    snError result = snPerMessageDeflate_decompress(parser->perMessageDeflate,
+                                                    bytes,
+                                                    numBytes,
+                                                    parser->maxMessageSize,
+                                                    &message,
+                                                    &messageSize);
+    if (result != SN_NO_ERROR)
+    {
+        return result;
+    }
+    
+    if (opcode == SN_OPCODE_TEXT)
+    {
+        /*the message is complete, so it must not end in the middle of a code point*/
+        uint32_t utf8State = 0;
+        unsigned char terminator = '\0';
+        if (!snUTF8ValidateStringIncremental((uint8_t*)message, messageSize, &utf8State) ||
+            !snUTF8ValidateStringIncremental(&terminator, 1, &utf8State))
+        {
+            return SN_INVALID_UTF8;
+        }
+    }
+    
+    if (parser->messageCallback)
+    {
+        parser->messageCallback(parser->messageCallbackData, opcode, message, messageSize);
+    }
+    
+    return SN_NO_ERROR;
+}
+
+/**
+ * Unmasks a chunk of the payload of the current frame, if needed,
+ * and passes it on to the message stream chunk callback.
+ */
+static snError streamPayloadChunk(snFrameParser* parser, const char* bytes, int numBytes)
+{
+    if (!parser->currentFrameHeader.isMasked)
+    {
+        return streamUnmaskedPayloadChunk(parser, bytes, numBytes);
+    }
+    
+    /*the input bytes are read only, so unmask a copy*/
+    char unmaskedBytes[1024];
+    int payloadOffset = parser->currentFrameByte - parser->currentHeaderSize;
+    int numBytesStreamed = 0;
+    while (numBytesStreamed < numBytes)
+    {
+        const int numBytesLeft = numBytes - numBytesStreamed;
+        const int n = numBytesLeft < (int)sizeof(unmaskedBytes) ? numBytesLeft : (int)sizeof(unmaskedBytes);
+        snCopyMaskedPayload((uint32_t)parser->currentFrameHeader.maskingKey,
+                            &bytes[numBytesStreamed],
+                            unmaskedBytes,
+                            n,
+                            payloadOffset + numBytesStreamed);
+        
+        snError result = streamUnmaskedPayloadChunk(parser, unmaskedBytes, n);
+        if (result != SN_NO_ERROR)
+        {
+            return result;
+        }
+        
+        numBytesStreamed += n;
+    }
+    
+    return SN_NO_ERROR;
+}
+
 static snError onFinishedParsingFrame(snFrameParser* parser)
 {
     /*pass the frame to the frame callback,
@@ -46,19 +193,27 @@ static snError onFinishedParsingFrame(snFrameParser* parser)
     const int isUTF8 = (parser->continuationOpcode == SN_OPCODE_TEXT && f.header.opcode == SN_OPCODE_CONTINUATION) ||
                         f.header.opcode == SN_OPCODE_TEXT;
     
-    if (parser->currentFrameHeader.opcode == SN_OPCODE_PING ||
-        parser->currentFrameHeader.opcode == SN_OPCODE_PONG)
+    const int isStreamed = isStreamedFrame(parser);
+    
+    const int isCompressed = parser->isCompressedMessage && !isControlFrame(&f.header);
+    
+    if (isControlFrame(&f.header))
     {
         messageBuffer = parser->pingPongPayloadBuffer;
         f.payload = parser->pingPongPayloadBuffer;
     }
+    else if (isStreamed)
+    {
+        /*the payload has already been passed to the chunk callback*/
+        f.payload = NULL;
+    }
     else
     {
         messageBuffer = parser->buffer;
         f.payload = &parser->buffer[parser->continuationOffset];
     }
     
-    if (!f.header.isFinal)
+    if (!f.header.isFinal && !isStreamed)
     {
         parser->continuationOffset += f.header.payloadSize;
     }
@@ -72,24 +227,63 @@ static snError onFinishedParsingFrame(snFrameParser* parser)
     /*invoke the message callback if*/
     if (f.header.isFinal)
     {
-        int totalPayloadSize = parser->continuationOffset + f.header.payloadSize;
-        if (isUTF8)
+        int totalPayloadSize = f.header.payloadSize;
+        if (!isControlFrame(&f.header))
+        {
+            totalPayloadSize += parser->continuationOffset;
+        }
+        if (isUTF8 && !isStreamed)
         {
             parser->buffer[totalPayloadSize] = '\0';
             /*totalPayloadSize++;*/
         }
         
-        unsigned char b = '\0';
-        int v =snUTF8ValidateStringIncremental(&b, 1, &parser->utf8State);
-        if (v == 0)
+        if (isCompressed && isStreamed)
         {
-            return SN_INVALID_UTF8;
+            /*flush the decompressed end of the message*/
+            snError result = snPerMessageDeflate_decompressChunk(parser->perMessageDeflate,
+                                                                 NULL,
+                                                                 0,
+                                                                 1,
+                                                                 streamMessageChunk,
+                                                                 parser);
+            if (result != SN_NO_ERROR)
+            {
+                return result;
+            }
         }
         
-        if (parser->messageCallback)
+        if (isUTF8 && !(isCompressed && !isStreamed))
+        {
+            /*make sure the message doesn't end in the middle of a code point.
+              compressed messages are validated once decompressed.*/
+            unsigned char b = '\0';
+            int v =snUTF8ValidateStringIncremental(&b, 1, &parser->utf8State);
+            if (v == 0)
+            {
+                return SN_INVALID_UTF8;
+            }
+        }
+        
+        snOpcode messageOpcode = f.header.opcode == SN_OPCODE_CONTINUATION ? parser->continuationOpcode : f.header.opcode;
+        
+        if (isStreamed)
+        {
+            if (parser->messageStreamCallbacks.endCallback)
+            {
+                parser->messageStreamCallbacks.endCallback(parser->messageStreamCallbackData, messageOpcode);
+            }
+        }
+        else if (isCompressed)
+        {
+            snError result = deliverCompressedMessage(parser, messageOpcode, messageBuffer, totalPayloadSize);
+            if (result != SN_NO_ERROR)
+            {
+                return result;
+            }
+        }
+        else if (parser->messageCallback)
         {
-            snOpcode messageOpcode = f.header.opcode == SN_OPCODE_CONTINUATION ? parser->continuationOpcode : f.header.opcode;
-            
             if (messageOpcode == SN_OPCODE_PING ||
                 messageOpcode == SN_OPCODE_PONG ||
                 messageOpcode == SN_OPCODE_TEXT ||
@@ -103,25 +297,65 @@ static snError onFinishedParsingFrame(snFrameParser* parser)
         }
         
         /*allow pings, pongs and close frames in between continuation frames*/
-        if (f.header.opcode != SN_OPCODE_PONG &&
-            f.header.opcode != SN_OPCODE_PING &&
-            f.header.opcode != SN_OPCODE_CONNECTION_CLOSE)
+        if (!isControlFrame(&f.header))
         {
             parser->isWaitingForFinalFrame = 0;
+            parser->continuationOffset = 0;
+            
+            if (parser->bufferSize > SN_MAX_RETAINED_MESSAGE_BUFFER_SIZE)
+            {
+                /*don't hold on to memory needed for an unusually big message*/
+                free(parser->buffer);
+                parser->buffer = NULL;
+                parser->bufferSize = 0;
+            }
         }
     }
     
+    /*the header fields are overwritten when parsing the next header,
+      so there is no need to clear them here.*/
     parser->isParsingHeader = 1;
     parser->currentFrameByte = 0;
     parser->bufferPosition = 0;
-    parser->firstPayloadSizeByte = 0;
-    parser->numPayloadSizeBytes = 0;
-    memset(parser->payloadSizeBytes, 0, 8);
-    memset(&parser->currentFrameHeader, 0, sizeof(snFrameHeader));
         
     return SN_NO_ERROR;
 }
 
+/**
+ * Makes sure the message buffer can hold at least a given number
+ * of bytes, growing it geometrically if needed.
+ */
+static snError reserveMessageBuffer(snFrameParser* parser, int size)
+{
+    if (size <= parser->bufferSize)
+    {
+        return SN_NO_ERROR;
+    }
+    
+    int newSize = parser->bufferSize > 0 ? parser->bufferSize : SN_MIN_MESSAGE_BUFFER_SIZE;
+    while (newSize < size)
+    {
+        newSize = newSize > INT_MAX / 2 ? INT_MAX : 2 * newSize;
+    }
+    
+    /*the buffer never needs to be bigger than a message and its null terminator*/
+    if (parser->maxMessageSize < INT_MAX && newSize > parser->maxMessageSize + 1)
+    {
+        newSize = parser->maxMessageSize + 1;
+    }
+    
+    char* newBuffer = realloc(parser->buffer, newSize);
+    if (newBuffer == NULL)
+    {
+        return SN_EXCEEDED_MAX_MESSAGE_SIZE;
+    }
+    
+    parser->buffer = newBuffer;
+    parser->bufferSize = newSize;
+    
+    return SN_NO_ERROR;
+}
+
 static snError onFinishedParsingHeader(snFrameParser* parser)
 {
     assert(parser->isParsingHeader != 0);
@@ -135,6 +369,17 @@ static snError onFinishedParsingHeader(snFrameParser* parser)
         return result;
     }
     
+    if (header->isCompressed && parser->perMessageDeflate == NULL)
+    {
+        /*RSV1 has no meaning unless permessage-deflate was negotiated*/
+        return SN_NONZERO_RESVERVED_BIT;
+    }
+    
+    if (parser->requireMaskedFrames && !header->isMasked)
+    {
+        return SN_UNMASKED_CLIENT_FRAME;
+    }
+    
     if (parser->isWaitingForFinalFrame &&
         header->opcode != SN_OPCODE_CONNECTION_CLOSE &&
         header->opcode != SN_OPCODE_CONTINUATION &&
@@ -146,7 +391,15 @@ static snError onFinishedParsingHeader(snFrameParser* parser)
         return SN_EXPECTED_CONTINUATION_FRAME;
     }
     
-    if (header->payloadSize > parser->maxFrameSize - SN_MAX_HEADER_SIZE)
+    if (isStreamedFrame(parser))
+    {
+        /*the payload is not buffered, but frame offsets are ints*/
+        if (header->payloadSize > INT_MAX - SN_MAX_HEADER_SIZE)
+        {
+            return SN_EXCEEDED_MAX_PAYLOAD_SIZE;
+        }
+    }
+    else if (header->payloadSize > parser->maxFrameSize - SN_MAX_HEADER_SIZE)
     {
         return SN_EXCEEDED_MAX_PAYLOAD_SIZE;
     }
@@ -163,6 +416,9 @@ static snError onFinishedParsingHeader(snFrameParser* parser)
     }
     else if (isTextOrBinary)
     {
+        /*the first frame of a message tells if the whole message is compressed*/
+        parser->isCompressedMessage = header->isCompressed;
+        
         if (header->isFinal)
         {
             
@@ -176,6 +432,27 @@ static snError onFinishedParsingHeader(snFrameParser* parser)
             parser->isWaitingForFinalFrame = 1;
             parser->continuationOffset = 0;
         }
+        
+        if (parser->isStreamingMessages && parser->messageStreamCallbacks.beginCallback)
+        {
+            parser->messageStreamCallbacks.beginCallback(parser->messageStreamCallbackData, header->opcode);
+        }
+    }
+    
+    if (!isControlFrame(header) && !isStreamedFrame(parser))
+    {
+        /*make room for the message so far, plus a null terminator*/
+        const unsigned long long messageSize = parser->continuationOffset + header->payloadSize;
+        if (messageSize > parser->maxMessageSize)
+        {
+            return SN_EXCEEDED_MAX_MESSAGE_SIZE;
+        }
+        
+        snError reserveResult = reserveMessageBuffer(parser, (int)messageSize + 1);
+        if (reserveResult != SN_NO_ERROR)
+        {
+            return reserveResult;
+        }
     }
 
     parser->currentHeaderSize = parser->currentFrameByte;
@@ -199,14 +476,14 @@ void snFrameParser_init(snFrameParser* parser,
                         void* frameCallbackData,
                         snMessageCallback messageCallback,
                         void* messageCallbackData,
-                        char* readBuffer,
-                        int maxFrameSize)
+                        int maxFrameSize,
+                        int maxMessageSize)
 {
     memset(parser, 0, sizeof(snFrameParser));
-    parser->buffer = readBuffer;
     
-    memset(parser->buffer, 0, maxFrameSize);
+    /*the message buffer is allocated when the first message arrives*/
     parser->maxFrameSize = maxFrameSize;
+    parser->maxMessageSize = maxMessageSize;
     
     parser->frameCallback = frameCallback;
     parser->frameCallbackData = frameCallbackData;
@@ -217,8 +494,39 @@ void snFrameParser_init(snFrameParser* parser,
     snFrameParser_reset(parser);
 }
 
+void snFrameParser_setMessageStreamCallbacks(snFrameParser* parser,
+                                             const snMessageStreamCallbacks* callbacks,
+                                             void* userData)
+{
+    parser->isStreamingMessages = callbacks != NULL;
+    
+    if (callbacks)
+    {
+        memcpy(&parser->messageStreamCallbacks, callbacks, sizeof(snMessageStreamCallbacks));
+    }
+    else
+    {
+        memset(&parser->messageStreamCallbacks, 0, sizeof(snMessageStreamCallbacks));
+    }
+    
+    parser->messageStreamCallbackData = userData;
+}
+
+void snFrameParser_setPerMessageDeflate(snFrameParser* parser,
+                                        snPerMessageDeflate* perMessageDeflate)
+{
+    parser->perMessageDeflate = perMessageDeflate;
+    parser->isCompressedMessage = 0;
+}
+
+void snFrameParser_setRequireMaskedFrames(snFrameParser* parser, int requireMaskedFrames)
+{
+    parser->requireMaskedFrames = requireMaskedFrames;
+}
+
 void snFrameParser_deinit(snFrameParser* parser)
 {
+    free(parser->buffer);
     memset(parser, 0, sizeof(snFrameParser));
 }
 
@@ -233,18 +541,216 @@ void snFrameParser_reset(snFrameParser* parser)
     parser->firstPayloadSizeByte = 0;
     parser->numPayloadSizeBytes = 0;
     parser->utf8State = 0;
+    parser->isCompressedMessage = 0;
     memset(parser->payloadSizeBytes, 0, 8);
     memset(&parser->currentFrameHeader, 0, sizeof(snFrameHeader));
 }
 
-snError snFrameParser_processBytes(snFrameParser* parser,
-                                   const char* bytes,
-                                   int numBytes)
+/**
+ * Returns the size of a header given its second byte.
+ */
+static int getHeaderSize(char secondHeaderByte)
+{
+    const int payloadSize = secondHeaderByte & 0x7f;
+    int headerSize = 2;
+    
+    if (payloadSize == 126)
+    {
+        headerSize += 2;
+    }
+    else if (payloadSize == 127)
+    {
+        headerSize += 8;
+    }
+    
+    if (secondHeaderByte & 0x80)
+    {
+        /*masking key*/
+        headerSize += 4;
+    }
+    
+    return headerSize;
+}
+
+/**
+ * Decodes a complete header from contiguous bytes into the current
+ * frame header and sets the current frame byte to the header size.
+ * Does the same thing as \c snFrameHeader_fromBytes, minus the
+ * validation that is done in \c onFinishedParsingHeader.
+ */
+static snError decodeHeader(snFrameParser* parser, const unsigned char* b)
+{
+    snFrameHeader* h = &parser->currentFrameHeader;
+    int readIdx = 2;
+    
+    if (b[0] & 0x30)
+    {
+        return SN_NONZERO_RESVERVED_BIT;
+    }
+    
+    h->isFinal = (b[0] & 0x80) >> 7;
+    h->isCompressed = (b[0] & 0x40) >> 6;
+    h->opcode = b[0] & 0xf;
+    h->isMasked = (b[1] & 0x80) >> 7;
+    h->payloadSize = b[1] & 0x7f;
+    h->maskingKey = 0;
+    
+    if (h->payloadSize == 126)
+    {
+        h->payloadSize = (b[2] << 8) | b[3];
+        readIdx = 4;
+    }
+    else if (h->payloadSize == 127)
+    {
+        unsigned long long payloadSize = 0;
+        for (readIdx = 2; readIdx < 10; readIdx++)
+        {
+            payloadSize = (payloadSize << 8) | b[readIdx];
+        }
+        h->payloadSize = payloadSize;
+    }
+    
+    if (h->isMasked)
+    {
+        h->maskingKey = (int)(((unsigned int)b[readIdx] << 24) |
+                              ((unsigned int)b[readIdx + 1] << 16) |
+                              ((unsigned int)b[readIdx + 2] << 8) |
+                              ((unsigned int)b[readIdx + 3] << 0));
+        readIdx += 4;
+    }
+    
+    parser->currentFrameByte = readIdx;
+    
+    return SN_NO_ERROR;
+}
+
+/**
+ * Returns non-zero if the frame described by the current header
+ * may be delivered straight from the bytes passed to the parser,
+ * i.e if it's a complete, unfragmented text or binary message.
+ */
+static int canDeliverInPlace(const snFrameParser* parser)
+{
+    const snFrameHeader* header = &parser->currentFrameHeader;
+    
+    return header->isFinal &&
+           !parser->isStreamingMessages &&
+           !parser->isWaitingForFinalFrame &&
+           (header->opcode == SN_OPCODE_TEXT || header->opcode == SN_OPCODE_BINARY);
+}
+
+/**
+ * Validates the current header and passes a frame whose payload
+ * starts at \c payload to the frame and message callbacks without
+ * copying it. The byte following the payload is temporarily replaced
+ * by a null terminator for text messages.
+ */
+static snError deliverFrameInPlace(snFrameParser* parser, char* payload)
+{
+    snFrameHeader* header = &parser->currentFrameHeader;
+    
+    snError result = snFrameHeader_validate(header);
+    if (result != SN_NO_ERROR)
+    {
+        return result;
+    }
+    
+    if (header->payloadSize > parser->maxFrameSize - SN_MAX_HEADER_SIZE)
+    {
+        return SN_EXCEEDED_MAX_PAYLOAD_SIZE;
+    }
+    
+    if (header->payloadSize > parser->maxMessageSize)
+    {
+        return SN_EXCEEDED_MAX_MESSAGE_SIZE;
+    }
+    
+    if (header->isCompressed && parser->perMessageDeflate == NULL)
+    {
+        return SN_NONZERO_RESVERVED_BIT;
+    }
+    
+    if (parser->requireMaskedFrames && !header->isMasked)
+    {
+        return SN_UNMASKED_CLIENT_FRAME;
+    }
+    
+    const int payloadSize = (int)header->payloadSize;
+    
+    if (header->isMasked)
+    {
+        /*the frame is consumed here, so it can be unmasked where it is*/
+        snMaskPayload((uint32_t)header->maskingKey, payload, payloadSize, 0);
+    }
+    
+    if (header->opcode == SN_OPCODE_TEXT && !header->isCompressed)
+    {
+        /*the message is complete, so it must not end in the middle of a code point*/
+        uint32_t utf8State = 0;
+        unsigned char terminator = '\0';
+        if (!snUTF8ValidateStringIncremental((uint8_t*)payload, payloadSize, &utf8State) ||
+            !snUTF8ValidateStringIncremental(&terminator, 1, &utf8State))
+        {
+            return SN_INVALID_UTF8;
+        }
+    }
+    
+    snFrame f;
+    memcpy(&f.header, header, sizeof(snFrameHeader));
+    f.payload = payload;
+    
+    if (parser->frameCallback)
+    {
+        parser->frameCallback(parser->frameCallbackData, &f);
+    }
+    
+    if (header->isCompressed)
+    {
+        /*decompress straight from the received bytes*/
+        result = deliverCompressedMessage(parser, header->opcode, payload, payloadSize);
+        if (result != SN_NO_ERROR)
+        {
+            return result;
+        }
+    }
+    else if (parser->messageCallback)
+    {
+        if (header->opcode == SN_OPCODE_TEXT)
+        {
+            const char replacedByte = payload[payloadSize];
+            payload[payloadSize] = '\0';
+            parser->messageCallback(parser->messageCallbackData, SN_OPCODE_TEXT, payload, payloadSize);
+            payload[payloadSize] = replacedByte;
+        }
+        else
+        {
+            parser->messageCallback(parser->messageCallbackData, SN_OPCODE_BINARY, payload, payloadSize);
+        }
+    }
+    
+    parser->currentFrameByte = 0;
+    
+    return SN_NO_ERROR;
+}
+
+/**
+ * Does the actual parsing for \c snFrameParser_processBytes and
+ * \c snFrameParser_processBytesInPlace. \c bytes is only written to
+ * if \c inPlace is non-zero.
+ */
+static snError processBytes(snFrameParser* parser,
+                            char* bytes,
+                            int numBytes,
+                            int inPlace,
+                            int maxDeferredFrameSize,
+                            int* numBytesProcessed)
 {
     /*https://tools.ietf.org/html/rfc6455#section-5.2*/
     
     int currentSrcByte = 0;
     
+    *numBytesProcessed = 0;
+    
     /*printf("snFrameParser_processBytes: %d bytes\n", numBytes);*/
     
     while (currentSrcByte < numBytes)
@@ -252,16 +758,78 @@ snError snFrameParser_processBytes(snFrameParser* parser,
         if (parser->isParsingHeader)
         {
             int doneParsingHeader = 0;
-            /*parse header bytes one at a time*/
+            
             if (parser->currentFrameByte == 0)
             {
+                const int numBytesLeft = numBytes - currentSrcByte;
+                if (numBytesLeft >= SN_MAX_HEADER_SIZE ||
+                    (numBytesLeft >= 2 && numBytesLeft >= getHeaderSize(bytes[currentSrcByte + 1])))
+                {
+                    /*the whole header is available. decode it in one go.*/
+                    snError result = decodeHeader(parser, (const unsigned char*)&bytes[currentSrcByte]);
+                    if (result != SN_NO_ERROR)
+                    {
+                        return result;
+                    }
+                    
+                    if (inPlace && canDeliverInPlace(parser))
+                    {
+                        const unsigned long long frameSize = parser->currentFrameByte +
+                                                             parser->currentFrameHeader.payloadSize;
+                        if (frameSize <= numBytesLeft)
+                        {
+                            /*the whole frame is available. skip the copy.*/
+                            result = deliverFrameInPlace(parser, &bytes[currentSrcByte + parser->currentFrameByte]);
+                            if (result != SN_NO_ERROR)
+                            {
+                                return result;
+                            }
+                            
+                            currentSrcByte += (int)frameSize;
+                            *numBytesProcessed = currentSrcByte;
+                            continue;
+                        }
+                        else if (frameSize <= maxDeferredFrameSize)
+                        {
+                            /*leave the frame to the caller, who will pass it
+                              again once more data has been appended.*/
+                            parser->currentFrameByte = 0;
+                            return SN_NO_ERROR;
+                        }
+                    }
+                    
+                    currentSrcByte += parser->currentFrameByte;
+                    
+                    result = onFinishedParsingHeader(parser);
+                    if (result != SN_NO_ERROR)
+                    {
+                        return result;
+                    }
+                    
+                    *numBytesProcessed = currentSrcByte;
+                    continue;
+                }
+                
+                if (inPlace && SN_MAX_HEADER_SIZE <= maxDeferredFrameSize)
+                {
+                    /*wait for the rest of the header, which may
+                      be followed by a frame that can be delivered in place.*/
+                    return SN_NO_ERROR;
+                }
+                
+                /*the header is split across chunks. parse it one byte at a time.*/
+                parser->firstPayloadSizeByte = 0;
+                parser->numPayloadSizeBytes = 0;
+                parser->currentFrameHeader.payloadSize = 0;
+                parser->currentFrameHeader.maskingKey = 0;
+                
                 /*first header byte. read FIN flag and opcode*/
                 const char b = bytes[currentSrcByte];
                 const int rsv1 = (b & 0x40) >> 6;
                 const int rsv2 = (b & 0x20) >> 5;
                 const int rsv3 = (b & 0x10) >> 4;
                 
-                if (rsv1 != 0 || rsv2 != 0 || rsv3 != 0)
+                if (rsv2 != 0 || rsv3 != 0)
                 {
                     return SN_NONZERO_RESVERVED_BIT;
                 }
@@ -271,6 +839,7 @@ snError snFrameParser_processBytes(snFrameParser* parser,
                 
                 parser->currentFrameHeader.opcode = opcode;
                 parser->currentFrameHeader.isFinal = isFinal;
+                parser->currentFrameHeader.isCompressed = rsv1;
             }
             else if (parser->currentFrameByte == 1)
             {
@@ -322,7 +891,7 @@ snError snFrameParser_processBytes(snFrameParser* parser,
                         int i;
                         for (i = 0; i < 8; i++)
                         {
-                            parser->currentFrameHeader.payloadSize |= (((unsigned char*)parser->payloadSizeBytes)[i] << ((7 - i) * 8));
+                            parser->currentFrameHeader.payloadSize |= ((unsigned long long)((unsigned char*)parser->payloadSizeBytes)[i] << ((7 - i) * 8));
                         }
                     }
                     else
@@ -347,7 +916,7 @@ snError snFrameParser_processBytes(snFrameParser* parser,
                         int i;
                         for (i = 0; i < 4; i++)
                         {
-                            parser->currentFrameHeader.maskingKey |= ((unsigned char*)parser->maskingKeyBytes)[i] << (3 - i) * 8;
+                            parser->currentFrameHeader.maskingKey |= (unsigned int)((unsigned char*)parser->maskingKeyBytes)[i] << (3 - i) * 8;
                         }
                         doneParsingHeader = 1;
                     }
@@ -372,6 +941,7 @@ snError snFrameParser_processBytes(snFrameParser* parser,
                 }
             }
             currentSrcByte++;
+            *numBytesProcessed = currentSrcByte;
         }
         else
         {
@@ -381,35 +951,64 @@ snError snFrameParser_processBytes(snFrameParser* parser,
             unsigned long long chunkSize = bytesLeft < payloadBytesLeft ? bytesLeft : payloadBytesLeft;
             
             
-            if (parser->currentFrameHeader.opcode == SN_OPCODE_TEXT ||
-                (parser->currentFrameHeader.opcode == SN_OPCODE_CONTINUATION &&
-                 parser->continuationOpcode == SN_OPCODE_TEXT))
+            const int payloadOffset = parser->currentFrameByte - parser->currentHeaderSize;
+            char* destination = NULL;
+            
+            /*store control frame payload bytes in a separate buffer to allow for
+              control frames in between continuation frames.*/
+            if (isControlFrame(&parser->currentFrameHeader))
+            {
+                destination = &parser->pingPongPayloadBuffer[payloadOffset];
+            }
+            else if (parser->isStreamingMessages)
             {
-                const int validUTF8 = snUTF8ValidateStringIncremental(&bytes[currentSrcByte], chunkSize, &parser->utf8State);
-                if (!validUTF8)
+                /*unmasked and validated chunk by chunk*/
+                snError result = streamPayloadChunk(parser, &bytes[currentSrcByte], (int)chunkSize);
+                if (result != SN_NO_ERROR)
                 {
-                    return SN_INVALID_UTF8;
+                    return result;
                 }
             }
-            
-            /*store ping/pong payload bytes in a separate buffer to allow for
-              pings/pongs in between continuation frames.*/
-            if (parser->currentFrameHeader.opcode == SN_OPCODE_PING ||
-                parser->currentFrameHeader.opcode == SN_OPCODE_PONG)
+            else
             {
-                memcpy(&parser->pingPongPayloadBuffer[parser->currentFrameByte - parser->currentHeaderSize],
-                       &bytes[currentSrcByte],
-                       chunkSize);
+                destination = &parser->buffer[parser->continuationOffset + payloadOffset];
             }
-            else
+            
+            if (destination)
             {
-                memcpy(&parser->buffer[parser->continuationOffset + parser->currentFrameByte - parser->currentHeaderSize],
-                       &bytes[currentSrcByte],
-                       chunkSize);
+                if (parser->currentFrameHeader.isMasked)
+                {
+                    /*copy and unmask in a single pass*/
+                    snCopyMaskedPayload((uint32_t)parser->currentFrameHeader.maskingKey,
+                                        &bytes[currentSrcByte],
+                                        destination,
+                                        (int)chunkSize,
+                                        payloadOffset);
+                }
+                else
+                {
+                    memcpy(destination, &bytes[currentSrcByte], chunkSize);
+                }
+                
+                if (parser->isCompressedMessage && !isControlFrame(&parser->currentFrameHeader))
+                {
+                    /*validated after decompression*/
+                }
+                else if (parser->currentFrameHeader.opcode == SN_OPCODE_TEXT ||
+                         (parser->currentFrameHeader.opcode == SN_OPCODE_CONTINUATION &&
+                          parser->continuationOpcode == SN_OPCODE_TEXT))
+                {
+                    const int validUTF8 = snUTF8ValidateStringIncremental((uint8_t*)destination, chunkSize, &parser->utf8State);
+                    if (!validUTF8)
+                    {
+                        return SN_INVALID_UTF8;
+                    }
+                }
             }
             
             parser->currentFrameByte += chunkSize;
             currentSrcByte += chunkSize;
+            *numBytesProcessed = currentSrcByte;
             
             assert(parser->currentFrameByte <= parser->currentFrameHeader.payloadSize + parser->currentHeaderSize);
             
@@ -426,4 +1025,21 @@ snError snFrameParser_processBytes(snFrameParser* parser,
     }
     
     return SN_NO_ERROR;
-}
\ No newline at end of file
+}
+
+snError snFrameParser_processBytes(snFrameParser* parser,
+                                   const char* bytes,
+                                   int numBytes)
+{
+    int numBytesProcessed = 0;
+    return processBytes(parser, (char*)bytes, numBytes, 0, 0, &numBytesProcessed);
+}
+
+snError snFrameParser_processBytesInPlace(snFrameParser* parser,
+                                          char* bytes,
+                                          int numBytes,
+                                          int maxDeferredFrameSize,
+                                          int* numBytesProcessed)
+{
+    return processBytes(parser, bytes, numBytes, 1, maxDeferredFrameSize, numBytesProcessed);
+}
@@ -34,6 +34,7 @@
 #include "frame.h"
 #include "websocket.h"
 #include "errorcodes.h"
+#include "permessagedeflate.h"
 
 /*! \file */
 
@@ -57,8 +58,12 @@ extern "C"
         void* messageCallbackData;
         /** */
         int maxFrameSize;
-        /** */
+        /** The maximum size of an assembled text or binary message. */
+        int maxMessageSize;
+        /** Buffer that messages are assembled in. Allocated and grown on demand. */
         char* buffer;
+        /** The size of \c buffer in bytes. */
+        int bufferSize;
         /** */
         char payloadSizeBytes[8];
         /** */
@@ -88,6 +93,18 @@ extern "C"
         snOpcode continuationOpcode;
         /** */
         uint32_t utf8State;
+        /** Non-zero if text and binary messages are passed to \c messageStreamCallbacks. */
+        int isStreamingMessages;
+        /** */
+        snMessageStreamCallbacks messageStreamCallbacks;
+        /** */
+        void* messageStreamCallbackData;
+        /** Decompresses messages with RSV1 set, or NULL if no extension was negotiated. */
+        snPerMessageDeflate* perMessageDeflate;
+        /** Non-zero if the current text or binary message is compressed. */
+        int isCompressedMessage;
+        /** Non-zero if unmasked frames are a protocol error, as they are for servers. */
+        int requireMaskedFrames;
     } snFrameParser;
     
     /**
@@ -98,16 +115,49 @@ extern "C"
      * @param messageCallback A function to invoke when receiving a ping or pong
      * or a full text or binary message.
      * @param messageCallbackData A pointer to pass to \c messageCallback.
-     * @param readBuffer A buffer to store received payloads in.
      * @param maxFrameSize The maximum allowed frame size.
+     * @param maxMessageSize The maximum allowed size of a text or binary message,
+     * which may consist of several frames.
      */
     void snFrameParser_init(snFrameParser* parser,
                             snFrameCallback frameCallback,
                             void* frameCallbackData,
                             snMessageCallback messageCallback,
                             void* messageCallbackData,
-                            char* readBuffer,
-                            int maxFrameSize);
+                            int maxFrameSize,
+                            int maxMessageSize);
+    
+    /**
+     * Makes the parser pass text and binary messages to a set of stream callbacks
+     * as they arrive, instead of assembling them and passing them to the message
+     * callback. Text and binary frames are then not limited by the max frame size.
+     * @param parser The parser.
+     * @param callbacks The callbacks to use, or NULL to assemble messages as usual.
+     * @param userData A pointer to pass to the callbacks.
+     */
+    void snFrameParser_setMessageStreamCallbacks(snFrameParser* parser,
+                                                 const snMessageStreamCallbacks* callbacks,
+                                                 void* userData);
+    
+    /**
+     * Makes the parser accept compressed messages, which are decompressed
+     * before being passed to the message or message stream callbacks.
+     * The frame callback receives the compressed frames.
+     * @param parser The parser.
+     * @param perMessageDeflate The negotiated permessage-deflate state, or NULL
+     * to treat RSV1 as a protocol error.
+     */
+    void snFrameParser_setPerMessageDeflate(snFrameParser* parser,
+                                            snPerMessageDeflate* perMessageDeflate);
+    
+    /**
+     * Makes the parser reject unmasked frames with \c SN_UNMASKED_CLIENT_FRAME.
+     * Servers must do this, since clients are required to mask all frames.
+     * Masked frames are always unmasked before being passed to the callbacks.
+     * @param parser The parser.
+     * @param requireMaskedFrames Non-zero to reject unmasked frames.
+     */
+    void snFrameParser_setRequireMaskedFrames(snFrameParser* parser, int requireMaskedFrames);
     
     /**
      * Deinitializes a frame parser and frees any allocated memory.
@@ -131,7 +181,31 @@ extern "C"
     snError snFrameParser_processBytes(snFrameParser* parser,
                                        const char* bytes,
                                        int numBytes);
-    
+
+    /**
+     * Like \c snFrameParser_processBytes, but unfragmented text and binary
+     * frames that are contained in \c bytes are passed to the callbacks as
+     * pointers into \c bytes, without copying. All other frames are copied as usual.
+     * If an unfragmented frame is incomplete but no bigger than \c maxDeferredFrameSize,
+     * parsing stops at the start of the frame so that the caller can pass it again
+     * once more data has been received.
+     * @param parser The parser doing the processing.
+     * @param bytes The bytes to process. These are temporarily modified
+     * to null terminate text messages, so the byte following the last byte
+     * must be writable too. Masked frames delivered in place are unmasked
+     * where they are.
+     * @param numBytes The number of bytes to process.
+     * @param maxDeferredFrameSize The maximum size of incomplete frames to
+     * leave unprocessed, or 0 to process all bytes.
+     * @param numBytesProcessed Set to the number of processed bytes.
+     * @return An error code, SN_NO_ERROR on success.
+     */
+    snError snFrameParser_processBytesInPlace(snFrameParser* parser,
+                                              char* bytes,
+                                              int numBytes,
+                                              int maxDeferredFrameSize,
+                                              int* numBytesProcessed);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -57,6 +57,23 @@ extern "C"
                                            const char* host,
                                            int port);
     
+    /**
+     * Connects to a custom IO object and sends some data as early as possible,
+     * e.g. in the SYN using TCP Fast Open. The IO object is responsible for
+     * sending all of the data once connected, before anything passed to the
+     * write callbacks.
+     * @param ioObject The IO object.
+     * @param host The host to connect to.
+     * @param port The port to connect to.
+     * @param data The data to send. Must be copied if needed after returning.
+     * @param numBytes The number of bytes to send.
+     */
+    typedef snError (*snIOConnectWithDataCallback)(void* ioObject,
+                                                   const char* host,
+                                                   int port,
+                                                   const char* data,
+                                                   int numBytes);
+    
     /**
      * Checks if a custom IO object is open, i.e ready for reading/writing.
      * @param ioObject The IO object
@@ -80,13 +97,62 @@ extern "C"
     typedef snError (*snIOReadCallback)(void* ioObject, char* buffer, int bufferSize, int* numBytesRead);
     
     /**
-     * Attempts to write data to a custom IO object
+     * Attempts to write data to a custom IO object. Should not block. If the IO object
+     * can not accept all of the data right now, \c numBytesWritten should be set to the
+     * number of bytes that were accepted. The rest will be written later.
      */
     typedef snError (*snIOWriteCallback)(void* ioObject,
                                          const char* buffer,
                                          int bufferSize,
                                          int* numBytesWritten);
     
+    /**
+     * A contiguous range of bytes to write.
+     */
+    typedef struct snIOBuffer
+    {
+        /** */
+        const char* bytes;
+        /** */
+        int numBytes;
+    } snIOBuffer;
+    
+    /**
+     * Attempts to write the contents of several buffers to a custom IO object,
+     * in order, as if they were a single buffer. Like \c writev, this allows
+     * a frame header and its payload to be written with a single system call.
+     * Like \c snIOWriteCallback, this should write as much as possible without blocking.
+     * @param ioObject The I/O object to write to.
+     * @param buffers The buffers to write.
+     * @param numBuffers The number of buffers.
+     * @param numBytesWritten The total number of bytes actually written.
+     * @return An error code.
+     */
+    typedef snError (*snIOWriteVectorCallback)(void* ioObject,
+                                               const snIOBuffer* buffers,
+                                               int numBuffers,
+                                               int* numBytesWritten);
+    
+    /**
+     * Gets the file descriptor of a custom IO object, so that applications
+     * can wait for it to become readable or writable using select, poll, epoll etc.
+     * @param ioObject The I/O object.
+     * @param descriptor Set to the descriptor, or -1 if there is none.
+     * @return An error code.
+     */
+    typedef snError (*snIOGetDescriptorCallback)(void* ioObject, int* descriptor);
+    
+    /**
+     * Makes a custom IO object take ownership of an already connected
+     * descriptor, e.g. one returned by \c accept. Used by servers instead
+     * of connecting. The IO object should be open once this returns.
+     * @param ioObject The IO object.
+     * @param descriptor The connected descriptor. On success, the IO object
+     * is responsible for closing it.
+     * @return An error code.
+     */
+    typedef snError (*snIOAcceptCallback)(void* ioObject, int descriptor);
+    
     /**
      * A set of callbacks representing operations on a custom IO object, e.g a socket.
      */
@@ -106,6 +172,14 @@ extern "C"
         snIOReadCallback readCallback;
         /** */
         snIOWriteCallback writeCallback;
+        /** Optional. If NULL, buffers are combined and passed to \c writeCallback. */
+        snIOWriteVectorCallback writeVectorCallback;
+        /** Optional. If NULL, the websocket has no descriptor to wait on. */
+        snIOGetDescriptorCallback getDescriptorCallback;
+        /** Optional. If NULL, TCP Fast Open is not used and early data is written once connected. */
+        snIOConnectWithDataCallback connectWithDataCallback;
+        /** Optional. If NULL, the IO object can't be used for connections accepted by a server. */
+        snIOAcceptCallback acceptCallback;
         
     } snIOCallbacks;
     
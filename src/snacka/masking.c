@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#include <string.h>
+
+#include "cpufeatures.h"
+#include "masking.h"
+
+#ifdef SN_HAS_X86_SIMD_KERNELS
+#include <immintrin.h>
+#endif
+
+/**
+ * Masks bytes one at a time using a key that has been rotated
+ * so that its first byte applies to the first payload byte.
+ * \c source and \c destination may be the same.
+ */
+static void maskBytewise(const unsigned char* key,
+                         const unsigned char* source,
+                         unsigned char* destination,
+                         int numBytes)
+{
+    int i;
+    for (i = 0; i < numBytes; i++)
+    {
+        destination[i] = source[i] ^ key[i & 3];
+    }
+}
+
+/**
+ * Masks eight bytes at a time.
+ * @return The number of masked bytes, a multiple of 8.
+ */
+static int maskWords(const unsigned char* key,
+                     const unsigned char* source,
+                     unsigned char* destination,
+                     int numBytes)
+{
+    unsigned char keyBytes[8];
+    uint64_t key64;
+    int i;
+    
+    memcpy(keyBytes, key, 4);
+    memcpy(&keyBytes[4], key, 4);
+    memcpy(&key64, keyBytes, 8);
+    
+    for (i = 0; i + 8 <= numBytes; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, &source[i], 8);
+        word ^= key64;
+        memcpy(&destination[i], &word, 8);
+    }
+    
+    return i;
+}
+
+#ifdef SN_HAS_X86_SIMD_KERNELS
+
+/**
+ * Masks 16 bytes at a time.
+ * @return The number of masked bytes, a multiple of 16.
+ */
+__attribute__((target("sse2")))
+static int maskSSE2(const unsigned char* key,
+                    const unsigned char* source,
+                    unsigned char* destination,
+                    int numBytes)
+{
+    uint32_t key32;
+    memcpy(&key32, key, 4);
+    const __m128i keyVector = _mm_set1_epi32((int)key32);
+    int i;
+    
+    for (i = 0; i + 16 <= numBytes; i += 16)
+    {
+        const __m128i input = _mm_loadu_si128((const __m128i*)&source[i]);
+        _mm_storeu_si128((__m128i*)&destination[i], _mm_xor_si128(input, keyVector));
+    }
+    
+    return i;
+}
+
+/**
+ * Masks 32 bytes at a time, followed by at most one 16 byte step.
+ * @return The number of masked bytes, a multiple of 16.
+ */
+__attribute__((target("avx2")))
+static int maskAVX2(const unsigned char* key,
+                    const unsigned char* source,
+                    unsigned char* destination,
+                    int numBytes)
+{
+    uint32_t key32;
+    memcpy(&key32, key, 4);
+    const __m256i keyVector = _mm256_set1_epi32((int)key32);
+    int i;
+    
+    for (i = 0; i + 32 <= numBytes; i += 32)
+    {
+        const __m256i input = _mm256_loadu_si256((const __m256i*)&source[i]);
+        _mm256_storeu_si256((__m256i*)&destination[i], _mm256_xor_si256(input, keyVector));
+    }
+    
+    if (i + 16 <= numBytes)
+    {
+        const __m128i input = _mm_loadu_si128((const __m128i*)&source[i]);
+        _mm_storeu_si128((__m128i*)&destination[i], _mm_xor_si128(input, _mm256_castsi256_si128(keyVector)));
+        i += 16;
+    }
+    
+    return i;
+}
+
+#endif /*SN_HAS_X86_SIMD_KERNELS*/
+
+int snMaskIsKernelSupported(snMaskingKernel kernel)
+{
+    switch (kernel)
+    {
+        case SN_MASKING_KERNEL_AUTO:
+        case SN_MASKING_KERNEL_BYTEWISE:
+        case SN_MASKING_KERNEL_WORD:
+        {
+            return 1;
+        }
+#ifdef SN_HAS_X86_SIMD_KERNELS
+        case SN_MASKING_KERNEL_SSE2:
+        {
+            return (snGetCPUFeatures() & SN_CPU_FEATURE_SSE2) != 0;
+        }
+        case SN_MASKING_KERNEL_AVX2:
+        {
+            return (snGetCPUFeatures() & SN_CPU_FEATURE_AVX2) != 0;
+        }
+#endif
+        default:
+            break;
+    }
+    
+    return 0;
+}
+
+/**
+ * Returns the fastest kernel supported by the CPU.
+ */
+static snMaskingKernel getBestKernel(void)
+{
+    /*concurrent first calls pick the same kernel, so no locking is needed*/
+    static snMaskingKernel bestKernel = SN_MASKING_KERNEL_AUTO;
+    
+    if (bestKernel == SN_MASKING_KERNEL_AUTO)
+    {
+        if (snMaskIsKernelSupported(SN_MASKING_KERNEL_AVX2))
+        {
+            bestKernel = SN_MASKING_KERNEL_AVX2;
+        }
+        else if (snMaskIsKernelSupported(SN_MASKING_KERNEL_SSE2))
+        {
+            bestKernel = SN_MASKING_KERNEL_SSE2;
+        }
+        else
+        {
+            bestKernel = SN_MASKING_KERNEL_WORD;
+        }
+    }
+    
+    return bestKernel;
+}
+
+void snCopyMaskedPayloadWithKernel(snMaskingKernel kernel,
+                                   uint32_t maskingKey,
+                                   const char* source,
+                                   char* destination,
+                                   int numBytes,
+                                   int offset)
+{
+    const unsigned char* maskBytes = (const unsigned char*)&maskingKey;
+    const unsigned char* src = (const unsigned char*)source;
+    unsigned char* dst = (unsigned char*)destination;
+    unsigned char key[4];
+    int numMaskedBytes = 0;
+    int i;
+    
+    /*the key is stored most significant byte first on the wire. rotate it once
+     so that key[i % 4] applies to payload byte i.*/
+    for (i = 0; i < 4; i++)
+    {
+        key[i] = maskBytes[3 - ((i + offset) % 4)];
+    }
+    
+    if (kernel == SN_MASKING_KERNEL_AUTO)
+    {
+        kernel = getBestKernel();
+    }
+    else if (!snMaskIsKernelSupported(kernel))
+    {
+        kernel = SN_MASKING_KERNEL_WORD;
+    }
+    
+    /*the kernels mask multiples of 4 bytes, so the key stays aligned*/
+    switch (kernel)
+    {
+#ifdef SN_HAS_X86_SIMD_KERNELS
+        case SN_MASKING_KERNEL_SSE2:
+        {
+            numMaskedBytes = maskSSE2(key, src, dst, numBytes);
+            break;
+        }
+        case SN_MASKING_KERNEL_AVX2:
+        {
+            numMaskedBytes = maskAVX2(key, src, dst, numBytes);
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+    
+    if (kernel != SN_MASKING_KERNEL_BYTEWISE)
+    {
+        numMaskedBytes += maskWords(key,
+                                    &src[numMaskedBytes],
+                                    &dst[numMaskedBytes],
+                                    numBytes - numMaskedBytes);
+    }
+    
+    maskBytewise(key, &src[numMaskedBytes], &dst[numMaskedBytes], numBytes - numMaskedBytes);
+}
+
+void snCopyMaskedPayload(uint32_t maskingKey,
+                         const char* source,
+                         char* destination,
+                         int numBytes,
+                         int offset)
+{
+    snCopyMaskedPayloadWithKernel(SN_MASKING_KERNEL_AUTO, maskingKey, source, destination, numBytes, offset);
+}
+
+void snMaskPayloadWithKernel(snMaskingKernel kernel,
+                             uint32_t maskingKey,
+                             char* payload,
+                             int numBytes,
+                             int offset)
+{
+    snCopyMaskedPayloadWithKernel(kernel, maskingKey, payload, payload, numBytes, offset);
+}
+
+void snMaskPayload(uint32_t maskingKey, char* payload, int numBytes, int offset)
+{
+    snCopyMaskedPayloadWithKernel(SN_MASKING_KERNEL_AUTO, maskingKey, payload, payload, numBytes, offset);
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_MASKING_H
+#define SN_MASKING_H
+
+#include <stdint.h>
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * Masking implementations.
+     */
+    typedef enum snMaskingKernel
+    {
+        /** The fastest kernel supported by the CPU. */
+        SN_MASKING_KERNEL_AUTO = 0,
+        /** One byte at a time. */
+        SN_MASKING_KERNEL_BYTEWISE,
+        /** Eight bytes at a time. */
+        SN_MASKING_KERNEL_WORD,
+        /** 16 bytes at a time. Requires SSE2. */
+        SN_MASKING_KERNEL_SSE2,
+        /** 32 bytes at a time. Requires AVX2. */
+        SN_MASKING_KERNEL_AVX2
+    } snMaskingKernel;
+    
+    /**
+     * XORs a portion of a payload with a masking key, as described in
+     * https://tools.ietf.org/html/rfc6455#section-5.3
+     * @param maskingKey The masking key, as stored in \c snFrameHeader.
+     * @param payload The bytes to mask.
+     * @param numBytes The number of bytes to mask.
+     * @param offset The position of the first byte in the payload.
+     */
+    void snMaskPayload(uint32_t maskingKey, char* payload, int numBytes, int offset);
+    
+    /**
+     * Like \c snMaskPayload, but using a specific kernel. All kernels give
+     * the same results. Useful for testing and benchmarking.
+     * @param kernel The kernel to use. Falls back to \c SN_MASKING_KERNEL_WORD
+     * if not supported by the CPU.
+     * @param maskingKey The masking key, as stored in \c snFrameHeader.
+     * @param payload The bytes to mask.
+     * @param numBytes The number of bytes to mask.
+     * @param offset The position of the first byte in the payload.
+     */
+    void snMaskPayloadWithKernel(snMaskingKernel kernel,
+                                 uint32_t maskingKey,
+                                 char* payload,
+                                 int numBytes,
+                                 int offset);
+    
+    /**
+     * Masks a portion of a payload while copying it to another buffer, in a
+     * single pass. Equivalent to copying followed by \c snMaskPayload.
+     * @param maskingKey The masking key, as stored in \c snFrameHeader.
+     * @param source The bytes to mask.
+     * @param destination Receives the masked bytes. May be the same as \c source,
+     * but must not otherwise overlap it.
+     * @param numBytes The number of bytes to mask.
+     * @param offset The position of the first byte in the payload.
+     */
+    void snCopyMaskedPayload(uint32_t maskingKey,
+                             const char* source,
+                             char* destination,
+                             int numBytes,
+                             int offset);
+    
+    /**
+     * Like \c snCopyMaskedPayload, but using a specific kernel.
+     * @see snMaskPayloadWithKernel
+     */
+    void snCopyMaskedPayloadWithKernel(snMaskingKernel kernel,
+                                       uint32_t maskingKey,
+                                       const char* source,
+                                       char* destination,
+                                       int numBytes,
+                                       int offset);
+    
+    /**
+     * Checks if a masking kernel can be used on the current CPU.
+     * @param kernel The kernel to check.
+     * @return Non-zero if the kernel is supported.
+     */
+    int snMaskIsKernelSupported(snMaskingKernel kernel);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_MASKING_H*/
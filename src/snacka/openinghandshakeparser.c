@@ -27,10 +27,14 @@
  * either expressed or implied, of the copyright holders.
  */
 
+/*for snprintf*/
+#define _POSIX_C_SOURCE 200112L
+
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <strings.h>
 #include "openinghandshakeparser.h"
 #include "websocket.h"
 
@@ -40,9 +44,19 @@ static const char* HTTP_UPGRADE_FIELD_NAME = "Upgrade";
 static const char* HTTP_CONNECTION_FIELD_NAME = "Connection";
 static const char* HTTP_WS_PROTOCOL_NAME = "Sec-WebSocket-Protocol";
 static const char* HTTP_WS_EXTENSIONS_NAME = "Sec-WebSocket-Extensions";
+static const char* HTTP_WS_KEY_NAME = "Sec-WebSocket-Key";
+static const char* HTTP_WS_VERSION_NAME = "Sec-WebSocket-Version";
+
+/** Appended to Sec-WebSocket-Key before hashing. */
+static const char* WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+/** The length of a base64 encoded 16 byte Sec-WebSocket-Key. */
+#define SN_HANDSHAKE_KEY_LENGTH 24
 
 static snError validateResponse(snOpeningHandshakeParser* p);
 
+static snError validateRequest(snOpeningHandshakeParser* p);
+
 
 static int on_header_field(http_parser* p, const char *at, size_t length)
 {
@@ -67,26 +81,34 @@ static int on_header_value(http_parser* p, const char *at, size_t length)
         parser->currentHeaderField = SN_UNRECOGNIZED_HTTP_FIELD;
         const char* fn = snMutableString_getString(&parser->currentHeaderFieldName);
         
-        if (strcmp(HTTP_ACCEPT_FIELD_NAME, fn) == 0)
+        if (strcasecmp(HTTP_ACCEPT_FIELD_NAME, fn) == 0)
         {
             parser->currentHeaderField = SN_HTTP_ACCEPT;
         }
-        else if (strcmp(HTTP_UPGRADE_FIELD_NAME, fn) == 0)
+        else if (strcasecmp(HTTP_UPGRADE_FIELD_NAME, fn) == 0)
         {
             parser->currentHeaderField = SN_HTTP_UPGRADE;
         }
-        else if (strcmp(HTTP_CONNECTION_FIELD_NAME, fn) == 0)
+        else if (strcasecmp(HTTP_CONNECTION_FIELD_NAME, fn) == 0)
         {
             parser->currentHeaderField = SN_HTTP_CONNECTION;
         }
-        else if (strcmp(HTTP_WS_PROTOCOL_NAME, fn) == 0)
+        else if (strcasecmp(HTTP_WS_PROTOCOL_NAME, fn) == 0)
         {
             parser->currentHeaderField = SN_HTTP_WS_PROTOCOL;
         }
-        else if (strcmp(HTTP_WS_EXTENSIONS_NAME, fn) == 0)
+        else if (strcasecmp(HTTP_WS_EXTENSIONS_NAME, fn) == 0)
         {
             parser->currentHeaderField = SN_HTTP_WS_EXTENSIONS;
         }
+        else if (strcasecmp(HTTP_WS_KEY_NAME, fn) == 0)
+        {
+            parser->currentHeaderField = SN_HTTP_WS_KEY;
+        }
+        else if (strcasecmp(HTTP_WS_VERSION_NAME, fn) == 0)
+        {
+            parser->currentHeaderField = SN_HTTP_WS_VERSION;
+        }
         
         snMutableString_deinit(&parser->currentHeaderFieldName);
     }
@@ -120,7 +142,12 @@ static int on_headers_complete(http_parser* p)
     snOpeningHandshakeParser* parser = (snOpeningHandshakeParser*)p->data;
     snError e = SN_NO_ERROR;
     
-    if (p->status_code != 101)
+    if (parser->isParsingRequest)
+    {
+        /*http://tools.ietf.org/html/rfc6455#section-4.2.1*/
+        e = p->method == HTTP_GET ? validateRequest(parser) : SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_REQUEST;
+    }
+    else if (p->status_code != 101)
     {
         /*
          http://tools.ietf.org/html/rfc6455#section-1.3
@@ -144,12 +171,6 @@ static int on_headers_complete(http_parser* p)
     return 0;
 }
 
-static void generateKey(snMutableString* key)
-{
-    /*TODO: randomize properly*/
-    snMutableString_append(key, "x3JJHMbDL1EzLkh9GBhXDw==");
-}
-
 void snOpeningHandshakeParser_init(snOpeningHandshakeParser* p,
                                    snOpeningHandshakeParsingCallback parsingCallback,
                                    void* callbackData)
@@ -179,6 +200,17 @@ void snOpeningHandshakeParser_init(snOpeningHandshakeParser* p,
     }
 }
 
+void snOpeningHandshakeParser_initRequestParser(snOpeningHandshakeParser* p,
+                                                snOpeningHandshakeParsingCallback parsingCallback,
+                                                void* callbackData)
+{
+    snOpeningHandshakeParser_init(p, parsingCallback, callbackData);
+    
+    http_parser_init(&p->httpParser, HTTP_REQUEST);
+    p->httpParser.data = p;
+    p->isParsingRequest = 1;
+}
+
 void snOpeningHandshakeParser_deinit(snOpeningHandshakeParser* p)
 {
     int i;
@@ -189,11 +221,19 @@ void snOpeningHandshakeParser_deinit(snOpeningHandshakeParser* p)
     snMutableString_deinit(&p->currentHeaderFieldName);
 }
 
+void snOpeningHandshakeParser_setPerMessageDeflateOffer(snOpeningHandshakeParser* parser,
+                                                        const snPerMessageDeflateOptions* offer)
+{
+    parser->perMessageDeflateOffer = offer;
+    parser->hasNegotiatedPerMessageDeflate = 0;
+}
+
 void snOpeningHandshakeParser_createOpeningHandshakeRequest(snOpeningHandshakeParser* parser,
                                                             const char* host,
                                                             int port,
                                                             const char* path,
                                                             const char* queryString,
+                                                            const char* key,
                                                             snMutableString* request)
 {
     const size_t queryLength = strlen(queryString);
@@ -222,21 +262,128 @@ void snOpeningHandshakeParser_createOpeningHandshakeRequest(snOpeningHandshakePa
     snMutableString_append(request, "Connection: Upgrade\r\n");
     
     /*Key*/
-    snMutableString_append(request, "Sec-WebSocket-Key:");
-    
-    snMutableString key;
-    snMutableString_init(&key);
-    generateKey(&key);
-    snMutableString_append(request, snMutableString_getString(&key));
-    snMutableString_deinit(&key);
-    
+    snMutableString_append(request, "Sec-WebSocket-Key: ");
+    snMutableString_append(request, key);
     snMutableString_append(request, "\r\n");
     
     /*Version*/
     snMutableString_append(request, "Sec-WebSocket-Version: 13\r\n");
+    
+    /*Extensions*/
+    if (parser->perMessageDeflateOffer)
+    {
+        snMutableString_append(request, "Sec-WebSocket-Extensions: ");
+        snPerMessageDeflate_createOffer(parser->perMessageDeflateOffer, request);
+        snMutableString_append(request, "\r\n");
+    }
+    
     snMutableString_append(request, "\r\n");
 }
 
+void snOpeningHandshakeParser_createOpeningHandshakeResponse(snOpeningHandshakeParser* parser,
+                                                             snMutableString* response)
+{
+    snMutableString_append(response, "HTTP/1.1 101 Switching Protocols\r\n");
+    snMutableString_append(response, "Upgrade: websocket\r\n");
+    snMutableString_append(response, "Connection: Upgrade\r\n");
+    snMutableString_append(response, "Sec-WebSocket-Accept: ");
+    snMutableString_append(response, parser->acceptKey);
+    snMutableString_append(response, "\r\n\r\n");
+}
+
+void snOpeningHandshakeParser_computeAcceptKey(const char* key, char* acceptKey)
+{
+    char keyAndGUID[128];
+    unsigned char digest[SN_SHA1_DIGEST_SIZE];
+    
+    snprintf(keyAndGUID, sizeof(keyAndGUID), "%s%s", key, WEBSOCKET_GUID);
+    snSHA1((const unsigned char*)keyAndGUID, (int)strlen(keyAndGUID), digest);
+    snBase64Encode(digest, SN_SHA1_DIGEST_SIZE, acceptKey);
+}
+
+/**
+ * Returns non-zero if a comma separated header field value
+ * contains a given token, ignoring case and surrounding whitespace.
+ */
+static int containsToken(const char* value, const char* token)
+{
+    const size_t tokenLength = strlen(token);
+    
+    while (*value != '\0')
+    {
+        while (*value == ' ' || *value == '\t' || *value == ',')
+        {
+            value++;
+        }
+        
+        size_t length = 0;
+        while (value[length] != '\0' && value[length] != ',')
+        {
+            length++;
+        }
+        
+        const char* next = &value[length];
+        while (length > 0 && (value[length - 1] == ' ' || value[length - 1] == '\t'))
+        {
+            length--;
+        }
+        
+        if (length == tokenLength && strncasecmp(value, token, length) == 0)
+        {
+            return 1;
+        }
+        
+        value = next;
+    }
+    
+    return 0;
+}
+
+static snError validateRequest(snOpeningHandshakeParser* p)
+{
+    /*http://tools.ietf.org/html/rfc6455#section-4.2.1*/
+    
+    /*
+     An |Upgrade| header field containing the value "websocket",
+     treated as an ASCII case-insensitive value.
+     */
+    if (!containsToken(snMutableString_getString(&p->headerFieldValues[SN_HTTP_UPGRADE]), "websocket"))
+    {
+        return SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_REQUEST;
+    }
+    
+    /*
+     A |Connection| header field that includes the token "Upgrade",
+     treated as an ASCII case-insensitive value.
+     */
+    if (!containsToken(snMutableString_getString(&p->headerFieldValues[SN_HTTP_CONNECTION]), "Upgrade"))
+    {
+        return SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_REQUEST;
+    }
+    
+    /*
+     A |Sec-WebSocket-Version| header field, with a value of 13.
+     */
+    if (strcmp(snMutableString_getString(&p->headerFieldValues[SN_HTTP_WS_VERSION]), "13") != 0)
+    {
+        return SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_REQUEST;
+    }
+    
+    /*
+     A |Sec-WebSocket-Key| header field with a base64-encoded value
+     that, when decoded, is 16 bytes in length.
+     */
+    const char* key = snMutableString_getString(&p->headerFieldValues[SN_HTTP_WS_KEY]);
+    if (strlen(key) != SN_HANDSHAKE_KEY_LENGTH)
+    {
+        return SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_REQUEST;
+    }
+    
+    snOpeningHandshakeParser_computeAcceptKey(key, p->acceptKey);
+    
+    return SN_NO_ERROR;
+}
+
 static snError validateResponse(snOpeningHandshakeParser* p)
 {
     /*http://tools.ietf.org/html/rfc6455#section-4.1*/
@@ -341,10 +488,27 @@ static snError validateResponse(snOpeningHandshakeParser* p)
      discussed in Section 9.1.)
      */
     {
-        /* No extensions were sent, so none should be received.*/
-        if (strlen(snMutableString_getString(&p->headerFieldValues[SN_HTTP_WS_EXTENSIONS])) != 0)
+        const char* extVal = snMutableString_getString(&p->headerFieldValues[SN_HTTP_WS_EXTENSIONS]);
+        if (p->perMessageDeflateOffer == NULL)
         {
-            return SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_RESPONSE;
+            /* No extensions were sent, so none should be received.*/
+            if (strlen(extVal) != 0)
+            {
+                return SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_RESPONSE;
+            }
+        }
+        else if (strlen(extVal) != 0)
+        {
+            /*https://tools.ietf.org/html/rfc7692#section-5*/
+            snError e = snPerMessageDeflate_parseResponse(extVal,
+                                                          p->perMessageDeflateOffer,
+                                                          &p->perMessageDeflateParameters);
+            if (e != SN_NO_ERROR)
+            {
+                return e;
+            }
+            
+            p->hasNegotiatedPerMessageDeflate = 1;
         }
     }
     
@@ -372,8 +536,9 @@ snError snOpeningHandshakeParser_processBytes(snOpeningHandshakeParser* p,
     
     if (HTTP_PARSER_ERRNO(&p->httpParser) != HPE_OK)
     {
-        /*http response header parsing error*/
-        return SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_RESPONSE;
+        /*http header parsing error*/
+        return p->isParsingRequest ? SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_REQUEST :
+                                     SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_RESPONSE;
     }
     
     *numBytesProcessed = http_parser_execute(&p->httpParser,
@@ -34,6 +34,9 @@
 
 #include "errorcodes.h"
 #include "mutablestring.h"
+#include "permessagedeflate.h"
+#include "base64.h"
+#include "sha1.h"
 #include "../external/http_parser/http_parser.h"
 
 #ifdef __cplusplus
@@ -54,6 +57,8 @@ extern "C"
         SN_HTTP_CONNECTION,
         SN_HTTP_WS_PROTOCOL,
         SN_HTTP_WS_EXTENSIONS,
+        SN_HTTP_WS_KEY,
+        SN_HTTP_WS_VERSION,
         SN_HTTP_PARSED_HEADER_FIELD_COUNT
         
     } snHandshakeResponseHTTPField;
@@ -65,8 +70,12 @@ extern "C"
      */
     typedef void (*snOpeningHandshakeParsingCallback)(void* userData, snError result);
     
+    /** The size of a Sec-WebSocket-Accept value, including the null terminator. */
+#define SN_HANDSHAKE_ACCEPT_KEY_SIZE (SN_BASE64_ENCODED_SIZE(SN_SHA1_DIGEST_SIZE) + 1)
+    
     /**
-     * Incremental parser of websocket opening handshake http responses. 
+     * Incremental parser of websocket opening handshake http responses,
+     * or of opening handshake requests when acting as a server.
      * @see http://tools.ietf.org/html/rfc6455#section-1.3
      */
     typedef struct snOpeningHandshakeParser
@@ -85,6 +94,16 @@ extern "C"
         void* callbackData;
         /** */
         snMutableString headerFieldValues[SN_HTTP_PARSED_HEADER_FIELD_COUNT];
+        /** The offered permessage-deflate parameters, or NULL if no extensions are offered. */
+        const snPerMessageDeflateOptions* perMessageDeflateOffer;
+        /** Non-zero if the server accepted the permessage-deflate offer. */
+        int hasNegotiatedPerMessageDeflate;
+        /** The permessage-deflate parameters agreed on, if \c hasNegotiatedPerMessageDeflate is non-zero. */
+        snPerMessageDeflateOptions perMessageDeflateParameters;
+        /** Non-zero if the parser parses a client's request instead of a server's response. */
+        int isParsingRequest;
+        /** The Sec-WebSocket-Accept value to respond with, once a valid request has been parsed. */
+        char acceptKey[SN_HANDSHAKE_ACCEPT_KEY_SIZE];
     } snOpeningHandshakeParser;
 
     /**
@@ -95,13 +114,33 @@ extern "C"
                                        snOpeningHandshakeParsingCallback parsingCallback,
                                        void* callbackData);
     
+    /**
+     * Initializes a parser of opening handshake requests, used by servers.
+     * The parsing callback is invoked once the request headers have been parsed.
+     * @param parser The parser to initialize.
+     */
+    void snOpeningHandshakeParser_initRequestParser(snOpeningHandshakeParser* parser,
+                                                    snOpeningHandshakeParsingCallback parsingCallback,
+                                                    void* callbackData);
+    
     /**
      *
      */
     void snOpeningHandshakeParser_deinit(snOpeningHandshakeParser* parser);
 
+    /**
+     * Makes the parser offer the permessage-deflate extension in the
+     * request and accept it in the response. Call after \c snOpeningHandshakeParser_init.
+     * @param parser The parser.
+     * @param offer The parameters to offer, which must outlive the parser,
+     * or NULL to offer no extensions.
+     */
+    void snOpeningHandshakeParser_setPerMessageDeflateOffer(snOpeningHandshakeParser* parser,
+                                                            const snPerMessageDeflateOptions* offer);
+    
     /**
      * TODO: move to websocket.c
+     * @param key The base64 encoded 16 byte random nonce to send as Sec-WebSocket-Key.
      * @see http://tools.ietf.org/html/rfc6455#section-4.1
      */
     void snOpeningHandshakeParser_createOpeningHandshakeRequest(snOpeningHandshakeParser* parser,
@@ -109,8 +148,26 @@ extern "C"
                                                                 int port,
                                                                 const char* path,
                                                                 const char* queryString,
+                                                                const char* key,
                                                                 snMutableString* request);
     
+    /**
+     * Creates the response to a valid opening handshake request. Extensions
+     * and subprotocols requested by the client are not accepted.
+     * @see http://tools.ietf.org/html/rfc6455#section-4.2.2
+     */
+    void snOpeningHandshakeParser_createOpeningHandshakeResponse(snOpeningHandshakeParser* parser,
+                                                                 snMutableString* response);
+    
+    /**
+     * Computes the Sec-WebSocket-Accept value for a given Sec-WebSocket-Key,
+     * i.e the base64 encoded SHA-1 of the key followed by the websocket GUID.
+     * @param key The null terminated key.
+     * @param acceptKey Receives the null terminated accept value. Must have
+     * room for \c SN_HANDSHAKE_ACCEPT_KEY_SIZE characters.
+     */
+    void snOpeningHandshakeParser_computeAcceptKey(const char* key, char* acceptKey);
+    
     /**
      *
      */
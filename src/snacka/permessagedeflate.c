@@ -0,0 +1,638 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+/*for strdup and strtok_r*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+#include "permessagedeflate.h"
+
+/** The largest window size as a base 2 logarithm. */
+#define SN_DEFLATE_MAX_WINDOW_BITS 15
+
+/** The size of the buffer decompressed bytes are passed to callbacks in. */
+#define SN_INFLATE_CHUNK_SIZE 8192
+
+/** The buffer is released after holding messages bigger than this. */
+#define SN_MAX_RETAINED_DEFLATE_BUFFER_SIZE (1 << 16)
+
+/**
+ * The empty stored block that ends a flushed deflate stream. Senders remove it
+ * from the end of compressed messages and receivers append it again.
+ * @see https://tools.ietf.org/html/rfc7692#section-7.2.1
+ */
+static const char messageTail[4] = {0x00, 0x00, (char)0xff, (char)0xff};
+
+struct snDeflateStream
+{
+    z_stream z;
+    /** Non-zero for a compressing stream, zero for a decompressing one. */
+    int isDeflate;
+    /** */
+    int windowBits;
+    /** The next idle stream in the pool. */
+    snDeflateStream* next;
+};
+
+/** The process wide pool of idle zlib streams, protected by \c mutex. */
+static struct
+{
+    pthread_mutex_t mutex;
+    snDeflateStream* idleStreams;
+    int maxIdleStreams;
+    snDeflateStreamPoolStats stats;
+} pool =
+{
+    PTHREAD_MUTEX_INITIALIZER,
+    NULL,
+    SN_DEFAULT_MAX_IDLE_DEFLATE_STREAMS,
+    {0, 0, 0}
+};
+
+static void deleteStream(snDeflateStream* s)
+{
+    if (s->isDeflate)
+    {
+        deflateEnd(&s->z);
+    }
+    else
+    {
+        inflateEnd(&s->z);
+    }
+    free(s);
+}
+
+/**
+ * Takes an idle stream of the given kind from the pool, or creates one.
+ * @return The stream, or NULL if zlib failed to create one.
+ */
+static snDeflateStream* acquireStream(int isDeflate, int windowBits)
+{
+    snDeflateStream* s = NULL;
+    snDeflateStream** link;
+    
+    pthread_mutex_lock(&pool.mutex);
+    for (link = &pool.idleStreams; *link; link = &(*link)->next)
+    {
+        if ((*link)->isDeflate == isDeflate && (*link)->windowBits == windowBits)
+        {
+            s = *link;
+            *link = s->next;
+            pool.stats.numIdleStreams--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool.mutex);
+    
+    if (s)
+    {
+        return s;
+    }
+    
+    s = malloc(sizeof(snDeflateStream));
+    memset(s, 0, sizeof(snDeflateStream));
+    s->isDeflate = isDeflate;
+    s->windowBits = windowBits;
+    
+    /*negative window bits mean raw deflate data, without a zlib header*/
+    const int result = isDeflate ?
+                       deflateInit2(&s->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -windowBits, 8, Z_DEFAULT_STRATEGY) :
+                       inflateInit2(&s->z, -windowBits);
+    if (result != Z_OK)
+    {
+        free(s);
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&pool.mutex);
+    pool.stats.numStreams++;
+    pool.stats.numCreatedStreams++;
+    pthread_mutex_unlock(&pool.mutex);
+    
+    return s;
+}
+
+/**
+ * Resets a stream and returns it to the pool, or frees it if the pool is full.
+ */
+static void releaseStream(snDeflateStream* s)
+{
+    if (s->isDeflate)
+    {
+        deflateReset(&s->z);
+    }
+    else
+    {
+        inflateReset(&s->z);
+    }
+    
+    pthread_mutex_lock(&pool.mutex);
+    const int isKept = pool.stats.numIdleStreams < pool.maxIdleStreams;
+    if (isKept)
+    {
+        s->next = pool.idleStreams;
+        pool.idleStreams = s;
+        pool.stats.numIdleStreams++;
+    }
+    else
+    {
+        pool.stats.numStreams--;
+    }
+    pthread_mutex_unlock(&pool.mutex);
+    
+    if (!isKept)
+    {
+        deleteStream(s);
+    }
+}
+
+void snPerMessageDeflate_setMaxIdleStreams(int maxIdleStreams)
+{
+    snDeflateStream* freedStreams = NULL;
+    
+    pthread_mutex_lock(&pool.mutex);
+    pool.maxIdleStreams = maxIdleStreams > 0 ? maxIdleStreams : 0;
+    while (pool.stats.numIdleStreams > pool.maxIdleStreams)
+    {
+        snDeflateStream* s = pool.idleStreams;
+        pool.idleStreams = s->next;
+        pool.stats.numIdleStreams--;
+        pool.stats.numStreams--;
+        s->next = freedStreams;
+        freedStreams = s;
+    }
+    pthread_mutex_unlock(&pool.mutex);
+    
+    while (freedStreams)
+    {
+        snDeflateStream* next = freedStreams->next;
+        deleteStream(freedStreams);
+        freedStreams = next;
+    }
+}
+
+void snPerMessageDeflate_getPoolStats(snDeflateStreamPoolStats* stats)
+{
+    pthread_mutex_lock(&pool.mutex);
+    memcpy(stats, &pool.stats, sizeof(snDeflateStreamPoolStats));
+    pthread_mutex_unlock(&pool.mutex);
+}
+
+void snPerMessageDeflate_createOffer(const snPerMessageDeflateOptions* options,
+                                     snMutableString* offer)
+{
+    /*zlib can't compress with a 256 byte window, so 8 is never offered*/
+    int clientMaxWindowBits = options->clientMaxWindowBits > 0 ? options->clientMaxWindowBits : SN_DEFLATE_MAX_WINDOW_BITS;
+    if (clientMaxWindowBits < 9)
+    {
+        clientMaxWindowBits = 9;
+    }
+    
+    snMutableString_append(offer, "permessage-deflate; client_max_window_bits=");
+    snMutableString_appendInt(offer, clientMaxWindowBits);
+    
+    if (options->serverMaxWindowBits > 0)
+    {
+        snMutableString_append(offer, "; server_max_window_bits=");
+        snMutableString_appendInt(offer, options->serverMaxWindowBits);
+    }
+    
+    if (options->clientNoContextTakeover)
+    {
+        snMutableString_append(offer, "; client_no_context_takeover");
+    }
+    
+    if (options->serverNoContextTakeover)
+    {
+        snMutableString_append(offer, "; server_no_context_takeover");
+    }
+}
+
+/**
+ * Removes leading and trailing whitespace and surrounding quotes in place.
+ */
+static char* trim(char* s)
+{
+    while (*s == ' ' || *s == '\t')
+    {
+        s++;
+    }
+    
+    size_t length = strlen(s);
+    while (length > 0 && (s[length - 1] == ' ' || s[length - 1] == '\t'))
+    {
+        s[--length] = '\0';
+    }
+    
+    if (length >= 2 && s[0] == '"' && s[length - 1] == '"')
+    {
+        s[length - 1] = '\0';
+        s++;
+    }
+    
+    return s;
+}
+
+/**
+ * Parses a window bits parameter value.
+ * @return The value, or -1 if it is missing or out of range.
+ */
+static int parseWindowBits(const char* value, int minWindowBits, int maxWindowBits)
+{
+    if (value == NULL || strlen(value) == 0 || strlen(value) > 2)
+    {
+        return -1;
+    }
+    
+    char* end = NULL;
+    const long windowBits = strtol(value, &end, 10);
+    if (*end != '\0' || windowBits < minWindowBits || windowBits > maxWindowBits)
+    {
+        return -1;
+    }
+    
+    return (int)windowBits;
+}
+
+snError snPerMessageDeflate_parseResponse(const char* response,
+                                          const snPerMessageDeflateOptions* offer,
+                                          snPerMessageDeflateOptions* parameters)
+{
+    /*https://tools.ietf.org/html/rfc7692#section-7.1*/
+    const int offeredClientMaxWindowBits = offer->clientMaxWindowBits > 0 ? offer->clientMaxWindowBits : SN_DEFLATE_MAX_WINDOW_BITS;
+    const int offeredServerMaxWindowBits = offer->serverMaxWindowBits > 0 ? offer->serverMaxWindowBits : SN_DEFLATE_MAX_WINDOW_BITS;
+    int hasServerMaxWindowBits = 0;
+    int hasClientMaxWindowBits = 0;
+    int hasServerNoContextTakeover = 0;
+    int hasClientNoContextTakeover = 0;
+    snError result = SN_NO_ERROR;
+    
+    memset(parameters, 0, sizeof(snPerMessageDeflateOptions));
+    parameters->clientMaxWindowBits = offeredClientMaxWindowBits < 9 ? 9 : offeredClientMaxWindowBits;
+    parameters->serverMaxWindowBits = SN_DEFLATE_MAX_WINDOW_BITS;
+    parameters->compressionThreshold = offer->compressionThreshold;
+    
+    /*only one extension was offered, so only one may be accepted*/
+    if (strchr(response, ',') != NULL)
+    {
+        return SN_EXTENSION_NEGOTIATION_FAILED;
+    }
+    
+    char* copy = strdup(response);
+    char* context = NULL;
+    char* element = strtok_r(copy, ";", &context);
+    
+    if (element == NULL || strcasecmp(trim(element), "permessage-deflate") != 0)
+    {
+        result = SN_EXTENSION_NEGOTIATION_FAILED;
+    }
+    
+    while (result == SN_NO_ERROR && (element = strtok_r(NULL, ";", &context)) != NULL)
+    {
+        char* value = strchr(element, '=');
+        if (value)
+        {
+            *value = '\0';
+            value = trim(value + 1);
+        }
+        const char* name = trim(element);
+        
+        if (strcmp(name, "server_no_context_takeover") == 0 && !value && !hasServerNoContextTakeover)
+        {
+            hasServerNoContextTakeover = 1;
+        }
+        else if (strcmp(name, "client_no_context_takeover") == 0 && !value && !hasClientNoContextTakeover)
+        {
+            hasClientNoContextTakeover = 1;
+        }
+        else if (strcmp(name, "server_max_window_bits") == 0 && !hasServerMaxWindowBits)
+        {
+            hasServerMaxWindowBits = 1;
+            parameters->serverMaxWindowBits = parseWindowBits(value, 8, offeredServerMaxWindowBits);
+            result = parameters->serverMaxWindowBits < 0 ? SN_EXTENSION_NEGOTIATION_FAILED : SN_NO_ERROR;
+        }
+        else if (strcmp(name, "client_max_window_bits") == 0 && !hasClientMaxWindowBits)
+        {
+            /*zlib can't compress with a 256 byte window*/
+            hasClientMaxWindowBits = 1;
+            parameters->clientMaxWindowBits = parseWindowBits(value, 9, offeredClientMaxWindowBits);
+            result = parameters->clientMaxWindowBits < 0 ? SN_EXTENSION_NEGOTIATION_FAILED : SN_NO_ERROR;
+        }
+        else
+        {
+            /*unknown or repeated parameter*/
+            result = SN_EXTENSION_NEGOTIATION_FAILED;
+        }
+    }
+    
+    free(copy);
+    
+    /*the server accepts a limit on its own window or context by echoing it*/
+    if ((offer->serverMaxWindowBits > 0 && !hasServerMaxWindowBits) ||
+        (offer->serverNoContextTakeover && !hasServerNoContextTakeover))
+    {
+        result = SN_EXTENSION_NEGOTIATION_FAILED;
+    }
+    
+    parameters->serverNoContextTakeover = hasServerNoContextTakeover;
+    parameters->clientNoContextTakeover = offer->clientNoContextTakeover || hasClientNoContextTakeover;
+    
+    return result;
+}
+
+void snPerMessageDeflate_init(snPerMessageDeflate* d, const snPerMessageDeflateOptions* parameters)
+{
+    memset(d, 0, sizeof(snPerMessageDeflate));
+    memcpy(&d->parameters, parameters, sizeof(snPerMessageDeflateOptions));
+    
+    if (d->parameters.compressionThreshold <= 0)
+    {
+        d->parameters.compressionThreshold = SN_DEFAULT_COMPRESSION_THRESHOLD;
+    }
+    
+    /*zlib can't compress with a 256 byte window*/
+    if (d->parameters.clientMaxWindowBits < 9 || d->parameters.clientMaxWindowBits > SN_DEFLATE_MAX_WINDOW_BITS)
+    {
+        d->parameters.clientMaxWindowBits = d->parameters.clientMaxWindowBits == 8 ? 9 : SN_DEFLATE_MAX_WINDOW_BITS;
+    }
+    
+    if (d->parameters.serverMaxWindowBits < 8 || d->parameters.serverMaxWindowBits > SN_DEFLATE_MAX_WINDOW_BITS)
+    {
+        d->parameters.serverMaxWindowBits = SN_DEFLATE_MAX_WINDOW_BITS;
+    }
+}
+
+void snPerMessageDeflate_deinit(snPerMessageDeflate* d)
+{
+    if (d->deflateStream)
+    {
+        releaseStream(d->deflateStream);
+    }
+    
+    if (d->inflateStream)
+    {
+        releaseStream(d->inflateStream);
+    }
+    
+    free(d->buffer);
+    memset(d, 0, sizeof(snPerMessageDeflate));
+}
+
+/**
+ * Makes sure the buffer can hold at least a given number of bytes,
+ * growing it geometrically if needed.
+ */
+static void reserveBuffer(snPerMessageDeflate* d, int size)
+{
+    if (size <= d->bufferSize)
+    {
+        return;
+    }
+    
+    int newSize = d->bufferSize > 0 ? d->bufferSize : 1024;
+    while (newSize < size)
+    {
+        newSize *= 2;
+    }
+    
+    d->buffer = realloc(d->buffer, newSize);
+    d->bufferSize = newSize;
+}
+
+/**
+ * Frees the buffer if the previous message made it unusually big.
+ */
+static void trimBuffer(snPerMessageDeflate* d)
+{
+    if (d->bufferSize > SN_MAX_RETAINED_DEFLATE_BUFFER_SIZE)
+    {
+        free(d->buffer);
+        d->buffer = NULL;
+        d->bufferSize = 0;
+    }
+}
+
+snError snPerMessageDeflate_compress(snPerMessageDeflate* d,
+                                     const char* bytes,
+                                     int numBytes,
+                                     const char** compressedBytes,
+                                     int* numCompressedBytes)
+{
+    if (d->deflateStream == NULL)
+    {
+        d->deflateStream = acquireStream(1, d->parameters.clientMaxWindowBits);
+        if (d->deflateStream == NULL)
+        {
+            return SN_COMPRESSION_FAILED;
+        }
+    }
+    
+    z_stream* z = &d->deflateStream->z;
+    int size = 0;
+    
+    trimBuffer(d);
+    reserveBuffer(d, (int)deflateBound(z, numBytes) + sizeof(messageTail));
+    
+    z->next_in = (Bytef*)bytes;
+    z->avail_in = numBytes;
+    
+    /*flush, so that the message ends on a byte boundary with an empty stored block*/
+    do
+    {
+        if (size == d->bufferSize)
+        {
+            reserveBuffer(d, size + 1);
+        }
+        
+        z->next_out = (Bytef*)&d->buffer[size];
+        z->avail_out = d->bufferSize - size;
+        
+        const int result = deflate(z, Z_SYNC_FLUSH);
+        size = d->bufferSize - z->avail_out;
+        
+        if (result != Z_OK && result != Z_BUF_ERROR)
+        {
+            return SN_COMPRESSION_FAILED;
+        }
+    }
+    while (z->avail_in > 0 || z->avail_out == 0);
+    
+    if (size < (int)sizeof(messageTail) ||
+        memcmp(&d->buffer[size - sizeof(messageTail)], messageTail, sizeof(messageTail)) != 0)
+    {
+        return SN_COMPRESSION_FAILED;
+    }
+    
+    if (d->parameters.clientNoContextTakeover)
+    {
+        releaseStream(d->deflateStream);
+        d->deflateStream = NULL;
+    }
+    
+    *compressedBytes = d->buffer;
+    *numCompressedBytes = size - sizeof(messageTail);
+    
+    return SN_NO_ERROR;
+}
+
+/**
+ * Decompresses bytes with the inflate stream, passing the output to a callback.
+ */
+static snError inflateBytes(snPerMessageDeflate* d,
+                            const char* bytes,
+                            int numBytes,
+                            snDecompressedChunkCallback callback,
+                            void* userData)
+{
+    char output[SN_INFLATE_CHUNK_SIZE];
+    z_stream* z = &d->inflateStream->z;
+    
+    z->next_in = (Bytef*)bytes;
+    z->avail_in = numBytes;
+    
+    do
+    {
+        z->next_out = (Bytef*)output;
+        z->avail_out = sizeof(output);
+        
+        const int result = inflate(z, Z_SYNC_FLUSH);
+        if (result != Z_OK && result != Z_BUF_ERROR && result != Z_STREAM_END)
+        {
+            return SN_DECOMPRESSION_FAILED;
+        }
+        
+        const int numOutputBytes = (int)(sizeof(output) - z->avail_out);
+        if (numOutputBytes > 0)
+        {
+            snError e = callback(userData, output, numOutputBytes);
+            if (e != SN_NO_ERROR)
+            {
+                return e;
+            }
+        }
+        
+        if (result == Z_STREAM_END)
+        {
+            /*a final block ends the deflate stream. the next message starts a new one.*/
+            inflateReset(z);
+            z->avail_in = 0;
+        }
+    }
+    while (z->avail_in > 0 || z->avail_out == 0);
+    
+    return SN_NO_ERROR;
+}
+
+snError snPerMessageDeflate_decompressChunk(snPerMessageDeflate* d,
+                                            const char* bytes,
+                                            int numBytes,
+                                            int isLastChunk,
+                                            snDecompressedChunkCallback callback,
+                                            void* userData)
+{
+    if (d->inflateStream == NULL)
+    {
+        d->inflateStream = acquireStream(0, d->parameters.serverMaxWindowBits);
+        if (d->inflateStream == NULL)
+        {
+            return SN_DECOMPRESSION_FAILED;
+        }
+    }
+    
+    snError result = inflateBytes(d, bytes, numBytes, callback, userData);
+    
+    if (result == SN_NO_ERROR && isLastChunk)
+    {
+        result = inflateBytes(d, messageTail, sizeof(messageTail), callback, userData);
+        
+        if (d->parameters.serverNoContextTakeover)
+        {
+            releaseStream(d->inflateStream);
+            d->inflateStream = NULL;
+        }
+    }
+    
+    return result;
+}
+
+/** Where \c appendToBuffer puts decompressed bytes. */
+typedef struct snDecompressedMessage
+{
+    snPerMessageDeflate* deflate;
+    int size;
+    int maxSize;
+} snDecompressedMessage;
+
+static snError appendToBuffer(void* userData, const char* bytes, int numBytes)
+{
+    snDecompressedMessage* m = (snDecompressedMessage*)userData;
+    
+    if (numBytes > m->maxSize - m->size)
+    {
+        return SN_EXCEEDED_MAX_MESSAGE_SIZE;
+    }
+    
+    /*leave room for a null terminator*/
+    reserveBuffer(m->deflate, m->size + numBytes + 1);
+    memcpy(&m->deflate->buffer[m->size], bytes, numBytes);
+    m->size += numBytes;
+    
+    return SN_NO_ERROR;
+}
+
+snError snPerMessageDeflate_decompress(snPerMessageDeflate* d,
+                                       const char* bytes,
+                                       int numBytes,
+                                       int maxMessageSize,
+                                       const char** message,
+                                       int* messageSize)
+{
+    snDecompressedMessage m = {d, 0, maxMessageSize};
+    
+    trimBuffer(d);
+    reserveBuffer(d, 1);
+    
+    snError result = snPerMessageDeflate_decompressChunk(d, bytes, numBytes, 1, appendToBuffer, &m);
+    if (result != SN_NO_ERROR)
+    {
+        return result;
+    }
+    
+    d->buffer[m.size] = '\0';
+    *message = d->buffer;
+    *messageSize = m.size;
+    
+    return SN_NO_ERROR;
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_PER_MESSAGE_DEFLATE_H
+#define SN_PER_MESSAGE_DEFLATE_H
+
+/*! \file */
+
+#include "errorcodes.h"
+#include "mutablestring.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /** Messages smaller than this many bytes are sent uncompressed by default. */
+#define SN_DEFAULT_COMPRESSION_THRESHOLD 128
+    
+    /** The default maximum number of idle zlib streams kept in the stream pool. */
+#define SN_DEFAULT_MAX_IDLE_DEFLATE_STREAMS 16
+    
+    /**
+     * Parameters of the permessage-deflate extension.
+     * @see https://tools.ietf.org/html/rfc7692
+     */
+    typedef struct snPerMessageDeflateOptions
+    {
+        /**
+         * The base 2 logarithm of the largest LZ77 window the client may compress
+         * with, from 9 to 15. Smaller windows need less memory but compress worse.
+         * If 0, 15 is offered and the server may pick a smaller window.
+         */
+        int clientMaxWindowBits;
+        /**
+         * The base 2 logarithm of the largest LZ77 window the server may compress
+         * with, from 8 to 15, which bounds the memory needed to decompress
+         * received messages. If 0, the server picks the window size.
+         */
+        int serverMaxWindowBits;
+        /**
+         * If non-zero, the client compresses every message on its own, so that no
+         * compression state is held between messages. Saves memory, costs ratio.
+         */
+        int clientNoContextTakeover;
+        /**
+         * If non-zero, the server is asked to compress every message on its own,
+         * so that no decompression state is held between messages.
+         */
+        int serverNoContextTakeover;
+        /**
+         * Text and binary messages smaller than this many bytes are sent
+         * uncompressed. Not negotiated. If 0, \c SN_DEFAULT_COMPRESSION_THRESHOLD is used.
+         */
+        int compressionThreshold;
+    } snPerMessageDeflateOptions;
+    
+    /** A pooled zlib stream. */
+    typedef struct snDeflateStream snDeflateStream;
+    
+    /**
+     * The permessage-deflate state of a connection. Streams are taken from
+     * a process wide pool when needed. If a direction has no context takeover,
+     * its stream is returned to the pool after every message, so idle connections
+     * hold no zlib memory.
+     */
+    typedef struct snPerMessageDeflate
+    {
+        /** The parameters agreed on in the opening handshake. */
+        snPerMessageDeflateOptions parameters;
+        /** Compresses sent messages, or NULL. */
+        snDeflateStream* deflateStream;
+        /** Decompresses received messages, or NULL. */
+        snDeflateStream* inflateStream;
+        /** Holds the latest compressed or decompressed message. */
+        char* buffer;
+        /** The size of \c buffer in bytes. */
+        int bufferSize;
+    } snPerMessageDeflate;
+    
+    /**
+     * Invoked with decompressed bytes.
+     * @param userData The pointer passed to \c snPerMessageDeflate_decompressChunk.
+     * @param bytes The decompressed bytes.
+     * @param numBytes The number of decompressed bytes.
+     * @return An error code. Decompression stops on errors.
+     */
+    typedef snError (*snDecompressedChunkCallback)(void* userData, const char* bytes, int numBytes);
+    
+    /**
+     * Statistics of the process wide zlib stream pool.
+     */
+    typedef struct snDeflateStreamPoolStats
+    {
+        /** The number of zlib streams, in use or idle. */
+        int numStreams;
+        /** The number of idle zlib streams kept for reuse. */
+        int numIdleStreams;
+        /** The number of zlib streams created. */
+        int numCreatedStreams;
+    } snDeflateStreamPoolStats;
+    
+    /**
+     * Appends a permessage-deflate offer for the Sec-WebSocket-Extensions
+     * request header field to a string.
+     * @param options The parameters to offer.
+     * @param offer The string to append the offer to.
+     */
+    void snPerMessageDeflate_createOffer(const snPerMessageDeflateOptions* options,
+                                         snMutableString* offer);
+    
+    /**
+     * Parses the Sec-WebSocket-Extensions response header field value
+     * for a permessage-deflate offer.
+     * @param response The header field value.
+     * @param offer The offered parameters.
+     * @param parameters Set to the parameters agreed on.
+     * @return \c SN_EXTENSION_NEGOTIATION_FAILED if the response does not
+     * accept the offer with valid parameters, otherwise \c SN_NO_ERROR.
+     */
+    snError snPerMessageDeflate_parseResponse(const char* response,
+                                              const snPerMessageDeflateOptions* offer,
+                                              snPerMessageDeflateOptions* parameters);
+    
+    /**
+     * Initializes the permessage-deflate state of a connection.
+     * @param d The state to initialize.
+     * @param parameters The parameters agreed on.
+     */
+    void snPerMessageDeflate_init(snPerMessageDeflate* d, const snPerMessageDeflateOptions* parameters);
+    
+    /**
+     * Returns any streams to the pool and frees the buffer.
+     * @param d The state to deinitialize.
+     */
+    void snPerMessageDeflate_deinit(snPerMessageDeflate* d);
+    
+    /**
+     * Compresses a message sent by the client.
+     * @param d The permessage-deflate state.
+     * @param bytes The message.
+     * @param numBytes The size of the message.
+     * @param compressedBytes Set to the compressed message, valid until the next call.
+     * @param numCompressedBytes Set to the size of the compressed message.
+     * @return An error code.
+     */
+    snError snPerMessageDeflate_compress(snPerMessageDeflate* d,
+                                         const char* bytes,
+                                         int numBytes,
+                                         const char** compressedBytes,
+                                         int* numCompressedBytes);
+    
+    /**
+     * Decompresses a complete message received from the server.
+     * @param d The permessage-deflate state.
+     * @param bytes The compressed message.
+     * @param numBytes The size of the compressed message.
+     * @param maxMessageSize The maximum allowed size of the decompressed message.
+     * @param message Set to the decompressed message, followed by a null terminator
+     * and valid until the next call.
+     * @param messageSize Set to the size of the decompressed message.
+     * @return \c SN_EXCEEDED_MAX_MESSAGE_SIZE if the decompressed message is too
+     * big, \c SN_DECOMPRESSION_FAILED if the message is not valid deflate data,
+     * otherwise \c SN_NO_ERROR.
+     */
+    snError snPerMessageDeflate_decompress(snPerMessageDeflate* d,
+                                           const char* bytes,
+                                           int numBytes,
+                                           int maxMessageSize,
+                                           const char** message,
+                                           int* messageSize);
+    
+    /**
+     * Decompresses a chunk of a message received from the server,
+     * passing the decompressed bytes to a callback as they are produced.
+     * @param d The permessage-deflate state.
+     * @param bytes The compressed bytes.
+     * @param numBytes The number of compressed bytes.
+     * @param isLastChunk Non-zero if this chunk ends the message.
+     * @param callback Invoked with the decompressed bytes.
+     * @param userData A pointer to pass to \c callback.
+     * @return An error code.
+     */
+    snError snPerMessageDeflate_decompressChunk(snPerMessageDeflate* d,
+                                                const char* bytes,
+                                                int numBytes,
+                                                int isLastChunk,
+                                                snDecompressedChunkCallback callback,
+                                                void* userData);
+    
+    /**
+     * Sets the maximum number of idle zlib streams kept in the process wide
+     * pool. Streams returned to a full pool are freed. Thread safe.
+     * @param maxIdleStreams The maximum number of idle streams.
+     */
+    void snPerMessageDeflate_setMaxIdleStreams(int maxIdleStreams);
+    
+    /**
+     * @param stats Set to the current stream pool statistics. Thread safe.
+     */
+    void snPerMessageDeflate_getPoolStats(snDeflateStreamPoolStats* stats);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_PER_MESSAGE_DEFLATE_H*/
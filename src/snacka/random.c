@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifdef __linux__
+/*for syscall*/
+#define _GNU_SOURCE
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "random.h"
+
+#ifndef SN_RANDOM_NUM_ROUNDS
+#define SN_RANDOM_NUM_ROUNDS 8
+#endif
+
+#define SN_ROTATE_LEFT(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define SN_QUARTER_ROUND(x, a, b, c, d) \
+    x[a] += x[b]; x[d] = SN_ROTATE_LEFT(x[d] ^ x[a], 16); \
+    x[c] += x[d]; x[b] = SN_ROTATE_LEFT(x[b] ^ x[c], 12); \
+    x[a] += x[b]; x[d] = SN_ROTATE_LEFT(x[d] ^ x[a], 8); \
+    x[c] += x[d]; x[b] = SN_ROTATE_LEFT(x[b] ^ x[c], 7)
+
+static uint32_t readLittleEndian32(const unsigned char* bytes)
+{
+    return (uint32_t)bytes[0] |
+           ((uint32_t)bytes[1] << 8) |
+           ((uint32_t)bytes[2] << 16) |
+           ((uint32_t)bytes[3] << 24);
+}
+
+/**
+ * Computes one ChaCha block from the current state and advances the block counter.
+ */
+static void generateBlock(snRandom* random, uint32_t* output)
+{
+    uint32_t x[16];
+    int i;
+    
+    memcpy(x, random->state, sizeof(x));
+    
+    for (i = 0; i < SN_RANDOM_NUM_ROUNDS; i += 2)
+    {
+        /*column round*/
+        SN_QUARTER_ROUND(x, 0, 4, 8, 12);
+        SN_QUARTER_ROUND(x, 1, 5, 9, 13);
+        SN_QUARTER_ROUND(x, 2, 6, 10, 14);
+        SN_QUARTER_ROUND(x, 3, 7, 11, 15);
+        /*diagonal round*/
+        SN_QUARTER_ROUND(x, 0, 5, 10, 15);
+        SN_QUARTER_ROUND(x, 1, 6, 11, 12);
+        SN_QUARTER_ROUND(x, 2, 7, 8, 13);
+        SN_QUARTER_ROUND(x, 3, 4, 9, 14);
+    }
+    
+    for (i = 0; i < 16; i++)
+    {
+        output[i] = x[i] + random->state[i];
+    }
+    
+    /*64 bit block counter*/
+    random->state[12]++;
+    if (random->state[12] == 0)
+    {
+        random->state[13]++;
+    }
+}
+
+/**
+ * Refills the output buffer with a batch of blocks.
+ */
+static void refill(snRandom* random)
+{
+    int i;
+    for (i = 0; i < SN_RANDOM_NUM_BLOCKS; i++)
+    {
+        generateBlock(random, &random->output[16 * i]);
+    }
+    random->outputPosition = 0;
+}
+
+/**
+ * Reads seed bytes from the operating system.
+ * @return Non-zero on success.
+ */
+static int getEntropy(unsigned char* bytes, int numBytes)
+{
+#if defined(__linux__) && defined(SYS_getrandom)
+    if (syscall(SYS_getrandom, bytes, numBytes, 0) == numBytes)
+    {
+        return 1;
+    }
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    arc4random_buf(bytes, numBytes);
+    return 1;
+#endif
+    
+    int numBytesRead = 0;
+    const int fd = open("/dev/urandom", O_RDONLY);
+    if (fd >= 0)
+    {
+        while (numBytesRead < numBytes)
+        {
+            const ssize_t n = read(fd, &bytes[numBytesRead], numBytes - numBytesRead);
+            if (n <= 0)
+            {
+                break;
+            }
+            numBytesRead += (int)n;
+        }
+        close(fd);
+    }
+    
+    return numBytesRead == numBytes;
+}
+
+void snRandom_initWithSeed(snRandom* random, const unsigned char* seed)
+{
+    static const unsigned char constants[] = "expand 32-byte k";
+    int i;
+    
+    memset(random, 0, sizeof(snRandom));
+    
+    for (i = 0; i < 4; i++)
+    {
+        random->state[i] = readLittleEndian32(&constants[4 * i]);
+    }
+    
+    for (i = 0; i < 8; i++)
+    {
+        random->state[4 + i] = readLittleEndian32(&seed[4 * i]);
+    }
+    
+    /*the block counter and nonce start at zero*/
+    
+    random->outputPosition = 16 * SN_RANDOM_NUM_BLOCKS;
+}
+
+void snRandom_init(snRandom* random)
+{
+    unsigned char seed[32];
+    
+    if (!getEntropy(seed, sizeof(seed)))
+    {
+        /*no entropy source. fall back to something that at least differs
+          between connections and processes.*/
+        struct timeval time;
+        uintptr_t address = (uintptr_t)random;
+        gettimeofday(&time, NULL);
+        memset(seed, 0, sizeof(seed));
+        memcpy(seed, &time, sizeof(time) < 16 ? sizeof(time) : 16);
+        memcpy(&seed[16], &address, sizeof(address));
+        seed[24] ^= (unsigned char)getpid();
+    }
+    
+    snRandom_initWithSeed(random, seed);
+    memset(seed, 0, sizeof(seed));
+}
+
+uint32_t snRandom_next(snRandom* random)
+{
+    if (random->outputPosition == 16 * SN_RANDOM_NUM_BLOCKS)
+    {
+        refill(random);
+    }
+    
+    return random->output[random->outputPosition++];
+}
+
+void snRandom_getBytes(snRandom* random, unsigned char* bytes, int numBytes)
+{
+    int i = 0;
+    
+    while (i < numBytes)
+    {
+        uint32_t word = snRandom_next(random);
+        int j;
+        for (j = 0; j < 4 && i < numBytes; j++)
+        {
+            bytes[i++] = (unsigned char)(word >> (8 * j));
+        }
+    }
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_RANDOM_H
+#define SN_RANDOM_H
+
+#include <stdint.h>
+
+/*! \file */
+
+/** The number of ChaCha blocks generated at a time. */
+#define SN_RANDOM_NUM_BLOCKS 4
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * A ChaCha8 based pseudo random number generator. Each websocket owns
+     * one, so generating masking keys requires no locking.
+     * @see https://cr.yp.to/chacha.html
+     */
+    typedef struct snRandom
+    {
+        /** The ChaCha input block: constants, key, block counter and nonce. */
+        uint32_t state[16];
+        /** Generated words, handed out one at a time. */
+        uint32_t output[16 * SN_RANDOM_NUM_BLOCKS];
+        /** The index of the next unused word in \c output. */
+        int outputPosition;
+    } snRandom;
+    
+    /**
+     * Initializes a random number generator with a seed from the
+     * operating system's entropy source.
+     * @param random The generator to initialize.
+     */
+    void snRandom_init(snRandom* random);
+    
+    /**
+     * Initializes a random number generator with a given seed. The same
+     * seed always gives the same sequence of numbers.
+     * @param random The generator to initialize.
+     * @param seed 32 bytes of seed data.
+     */
+    void snRandom_initWithSeed(snRandom* random, const unsigned char* seed);
+    
+    /**
+     * Returns the next 32 random bits.
+     * @param random The generator.
+     */
+    uint32_t snRandom_next(snRandom* random);
+    
+    /**
+     * Fills a buffer with random bytes.
+     * @param random The generator.
+     * @param bytes The buffer to fill.
+     * @param numBytes The number of bytes to generate.
+     */
+    void snRandom_getBytes(snRandom* random, unsigned char* bytes, int numBytes);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_RANDOM_H*/
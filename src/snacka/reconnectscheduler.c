@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+/*for clock_gettime*/
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "reconnectscheduler.h"
+
+/** How long to wait before asking again while the handshake limit is reached. */
+#define SN_RECONNECT_HANDSHAKE_RETRY_DELAY 10 /*in milliseconds*/
+
+/** The reconnect scheduler's state, protected by \c mutex. */
+static struct
+{
+    pthread_mutex_t mutex;
+    int maxHandshakes;
+    double tokensPerSecond;
+    double burstSize;
+    double numTokens;
+    /** The time in microseconds when \c numTokens was last refilled. */
+    long long refillTime;
+    snReconnectSchedulerStats stats;
+} scheduler =
+{
+    PTHREAD_MUTEX_INITIALIZER,
+    SN_RECONNECT_DEFAULT_MAX_HANDSHAKES,
+    0,
+    1,
+    1,
+    0,
+    {0, 0, 0, 0}
+};
+
+static long long getTimeMicroseconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void refillTokens(void)
+{
+    const long long now = getTimeMicroseconds();
+    
+    scheduler.numTokens += scheduler.tokensPerSecond * (now - scheduler.refillTime) / 1000000.0;
+    if (scheduler.numTokens > scheduler.burstSize)
+    {
+        scheduler.numTokens = scheduler.burstSize;
+    }
+    scheduler.refillTime = now;
+}
+
+void snReconnectScheduler_setLimits(int maxHandshakes, double maxReconnectsPerSecond, int burstSize)
+{
+    pthread_mutex_lock(&scheduler.mutex);
+    scheduler.maxHandshakes = maxHandshakes > 0 ? maxHandshakes : 0;
+    scheduler.tokensPerSecond = maxReconnectsPerSecond > 0 ? maxReconnectsPerSecond : 0;
+    scheduler.burstSize = burstSize > 1 ? burstSize : 1;
+    scheduler.numTokens = scheduler.burstSize;
+    scheduler.refillTime = getTimeMicroseconds();
+    pthread_mutex_unlock(&scheduler.mutex);
+}
+
+int snReconnectScheduler_acquire(int* retryDelay)
+{
+    int isGranted = 1;
+    
+    pthread_mutex_lock(&scheduler.mutex);
+    
+    if (scheduler.maxHandshakes > 0 && scheduler.stats.numHandshakes >= scheduler.maxHandshakes)
+    {
+        isGranted = 0;
+        *retryDelay = SN_RECONNECT_HANDSHAKE_RETRY_DELAY;
+    }
+    else if (scheduler.tokensPerSecond > 0)
+    {
+        refillTokens();
+        if (scheduler.numTokens < 1)
+        {
+            /*wait for the next token*/
+            isGranted = 0;
+            *retryDelay = 1 + (int)(1000.0 * (1 - scheduler.numTokens) / scheduler.tokensPerSecond);
+        }
+        else
+        {
+            scheduler.numTokens -= 1;
+        }
+    }
+    
+    if (isGranted)
+    {
+        scheduler.stats.numHandshakes++;
+        scheduler.stats.numReconnects++;
+        if (scheduler.stats.numHandshakes > scheduler.stats.maxNumHandshakes)
+        {
+            scheduler.stats.maxNumHandshakes = scheduler.stats.numHandshakes;
+        }
+    }
+    else
+    {
+        scheduler.stats.numDeferrals++;
+    }
+    
+    pthread_mutex_unlock(&scheduler.mutex);
+    
+    return isGranted;
+}
+
+void snReconnectScheduler_release(void)
+{
+    pthread_mutex_lock(&scheduler.mutex);
+    scheduler.stats.numHandshakes--;
+    pthread_mutex_unlock(&scheduler.mutex);
+}
+
+void snReconnectScheduler_getStats(snReconnectSchedulerStats* stats)
+{
+    pthread_mutex_lock(&scheduler.mutex);
+    *stats = scheduler.stats;
+    pthread_mutex_unlock(&scheduler.mutex);
+}
+
+void snReconnectScheduler_resetStats(void)
+{
+    pthread_mutex_lock(&scheduler.mutex);
+    scheduler.stats.maxNumHandshakes = scheduler.stats.numHandshakes;
+    scheduler.stats.numReconnects = 0;
+    scheduler.stats.numDeferrals = 0;
+    pthread_mutex_unlock(&scheduler.mutex);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_RECONNECT_SCHEDULER_H
+#define SN_RECONNECT_SCHEDULER_H
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /** The default maximum number of automatic reconnects in flight at a time. */
+#define SN_RECONNECT_DEFAULT_MAX_HANDSHAKES 64
+    
+    /**
+     * The process wide reconnect scheduler limits how hard websockets that
+     * reconnect automatically hit the name server and the server, e.g. when
+     * an upstream restart closes thousands of connections at once. It caps the
+     * number of reconnects that have started connecting but not yet completed
+     * the opening handshake, and the rate at which reconnects start, using
+     * a token bucket. Connects made by the application are not limited.
+     * All functions are thread safe.
+     */
+    
+    /**
+     * Reconnect scheduler statistics.
+     */
+    typedef struct snReconnectSchedulerStats
+    {
+        /** The number of reconnects currently in flight. */
+        int numHandshakes;
+        /** The highest number of reconnects in flight at a time. */
+        int maxNumHandshakes;
+        /** The number of reconnects started. */
+        int numReconnects;
+        /** The number of times a reconnect had to wait because of the limits. */
+        int numDeferrals;
+    } snReconnectSchedulerStats;
+    
+    /**
+     * Sets the reconnect limits.
+     * @param maxHandshakes The maximum number of reconnects in flight at a time,
+     * or 0 for no limit.
+     * @param maxReconnectsPerSecond The rate at which the token bucket is
+     * refilled, or 0 for no rate limit.
+     * @param burstSize The size of the token bucket, i.e. the number of
+     * reconnects that may start at once after a quiet period. At least 1.
+     */
+    void snReconnectScheduler_setLimits(int maxHandshakes, double maxReconnectsPerSecond, int burstSize);
+    
+    /**
+     * Asks for permission to start a reconnect. If granted, the caller must
+     * call \c snReconnectScheduler_release when the reconnect has completed
+     * the opening handshake or failed.
+     * @param retryDelay Set to the time in milliseconds to wait before asking
+     * again if permission was not granted.
+     * @return Non-zero if the reconnect may start.
+     */
+    int snReconnectScheduler_acquire(int* retryDelay);
+    
+    /**
+     * Ends a reconnect started after a successful \c snReconnectScheduler_acquire.
+     */
+    void snReconnectScheduler_release(void);
+    
+    /**
+     * @param stats Set to the current statistics.
+     */
+    void snReconnectScheduler_getStats(snReconnectSchedulerStats* stats);
+    
+    /**
+     * Resets the peak number of handshakes and the counters.
+     */
+    void snReconnectScheduler_resetStats(void);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_RECONNECT_SCHEDULER_H*/
@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+/*for getaddrinfo, clock_gettime and strdup*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "resolver.h"
+#include "timerwheel.h"
+
+/** The number of threads doing lookups. */
+#define SN_RESOLVER_NUM_THREADS 4
+
+#define SN_RESOLVER_DEFAULT_TIME_TO_LIVE 60000 /*in milliseconds*/
+
+#define SN_RESOLVER_DEFAULT_NEGATIVE_TIME_TO_LIVE 5000 /*in milliseconds*/
+
+/**
+ * Expired entries are removed when the cache grows beyond this size,
+ * and if that is not enough, the one that expires first.
+ */
+#define SN_RESOLVER_MAX_CACHE_SIZE 256
+
+struct snResolveRequest
+{
+    /** Written by the resolver thread completing the request. */
+    snResolveStatus status;
+    /** */
+    snResolvedAddress addresses[SN_RESOLVER_MAX_ADDRESSES];
+    /** */
+    int numAddresses;
+    /** A pipe written to when the request completes, or -1. */
+    int descriptors[2];
+    /** Non-zero if deleted while pending, in which case the resolver thread frees the request. */
+    int isDeleted;
+    /** The next request waiting for the same lookup. */
+    struct snResolveRequest* nextWaitingRequest;
+};
+
+/** The cached result of looking up a host. */
+typedef struct snResolverCacheEntry
+{
+    /** */
+    char* host;
+    /** Pending while the lookup is queued or running. */
+    snResolveStatus status;
+    /** */
+    snResolvedAddress addresses[SN_RESOLVER_MAX_ADDRESSES];
+    /** */
+    int numAddresses;
+    /** The monotonic time in milliseconds when the result expires. */
+    long long expiryTime;
+    /** Requests to complete when the lookup finishes. */
+    snResolveRequest* waitingRequests;
+    /** The next entry waiting for a resolver thread. */
+    struct snResolverCacheEntry* nextQueuedEntry;
+    /** */
+    struct snResolverCacheEntry* next;
+} snResolverCacheEntry;
+
+static snError resolveWithGetaddrinfo(void* userData,
+                                      const char* host,
+                                      snResolvedAddress* addresses,
+                                      int maxNumAddresses,
+                                      int* numAddresses,
+                                      int* timeToLive);
+
+/** The resolver's state, protected by \c mutex. */
+static struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    int hasStartedThreads;
+    snResolveFunction resolveFunction;
+    void* resolveFunctionData;
+    int timeToLive;
+    int negativeTimeToLive;
+    snResolverCacheEntry* entries;
+    int numEntries;
+    snResolverCacheEntry* firstQueuedEntry;
+    snResolverCacheEntry* lastQueuedEntry;
+} resolver =
+{
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    0,
+    resolveWithGetaddrinfo,
+    NULL,
+    SN_RESOLVER_DEFAULT_TIME_TO_LIVE,
+    SN_RESOLVER_DEFAULT_NEGATIVE_TIME_TO_LIVE,
+    NULL,
+    0,
+    NULL,
+    NULL
+};
+
+/**
+ * Resolves a host with getaddrinfo, which blocks. Also used on the
+ * calling thread for numeric hosts, which don't block.
+ */
+static snError getAddresses(const char* host,
+                            int flags,
+                            snResolvedAddress* addresses,
+                            int maxNumAddresses,
+                            int* numAddresses)
+{
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    struct addrinfo* p;
+    
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = flags;
+    
+    *numAddresses = 0;
+    
+    if (getaddrinfo(host, NULL, &hints, &result) != 0)
+    {
+        return SN_NAME_RESOLUTION_FAILED;
+    }
+    
+    for (p = result; p != NULL && *numAddresses < maxNumAddresses; p = p->ai_next)
+    {
+        if (p->ai_addrlen > sizeof(struct sockaddr_storage))
+        {
+            continue;
+        }
+        
+        memset(&addresses[*numAddresses], 0, sizeof(snResolvedAddress));
+        memcpy(&addresses[*numAddresses].address, p->ai_addr, p->ai_addrlen);
+        addresses[*numAddresses].addressSize = p->ai_addrlen;
+        (*numAddresses)++;
+    }
+    
+    freeaddrinfo(result);
+    
+    return *numAddresses > 0 ? SN_NO_ERROR : SN_NAME_RESOLUTION_FAILED;
+}
+
+static snError resolveWithGetaddrinfo(void* userData,
+                                      const char* host,
+                                      snResolvedAddress* addresses,
+                                      int maxNumAddresses,
+                                      int* numAddresses,
+                                      int* timeToLive)
+{
+    /*getaddrinfo doesn't report record TTLs*/
+    *timeToLive = -1;
+    return getAddresses(host, 0, addresses, maxNumAddresses, numAddresses);
+}
+
+static snResolveRequest* createRequest(void)
+{
+    snResolveRequest* request = malloc(sizeof(snResolveRequest));
+    memset(request, 0, sizeof(snResolveRequest));
+    request->descriptors[0] = -1;
+    request->descriptors[1] = -1;
+    return request;
+}
+
+static void closeRequestDescriptors(snResolveRequest* request)
+{
+    if (request->descriptors[0] >= 0)
+    {
+        close(request->descriptors[0]);
+        close(request->descriptors[1]);
+    }
+    request->descriptors[0] = -1;
+    request->descriptors[1] = -1;
+}
+
+/**
+ * Copies the result of a lookup to a request. Called with the mutex locked.
+ */
+static void completeRequest(snResolveRequest* request, snResolverCacheEntry* entry)
+{
+    memcpy(request->addresses, entry->addresses, entry->numAddresses * sizeof(snResolvedAddress));
+    request->numAddresses = entry->numAddresses;
+    request->status = entry->status;
+    
+    if (request->descriptors[1] >= 0)
+    {
+        const char byte = 0;
+        if (write(request->descriptors[1], &byte, 1) < 0)
+        {
+            /*the pipe is empty, so this can't happen*/
+        }
+    }
+}
+
+static void* resolverThread(void* userData)
+{
+    snResolvedAddress addresses[SN_RESOLVER_MAX_ADDRESSES];
+    
+    pthread_mutex_lock(&resolver.mutex);
+    
+    while (1)
+    {
+        while (resolver.firstQueuedEntry == NULL)
+        {
+            pthread_cond_wait(&resolver.condition, &resolver.mutex);
+        }
+        
+        snResolverCacheEntry* entry = resolver.firstQueuedEntry;
+        resolver.firstQueuedEntry = entry->nextQueuedEntry;
+        if (resolver.firstQueuedEntry == NULL)
+        {
+            resolver.lastQueuedEntry = NULL;
+        }
+        entry->nextQueuedEntry = NULL;
+        
+        const snResolveFunction resolveFunction = resolver.resolveFunction;
+        void* resolveFunctionData = resolver.resolveFunctionData;
+        int numAddresses = 0;
+        int timeToLive = -1;
+        
+        /*entries with pending lookups are never freed, so the host stays valid*/
+        pthread_mutex_unlock(&resolver.mutex);
+        const snError result = resolveFunction(resolveFunctionData,
+                                               entry->host,
+                                               addresses,
+                                               SN_RESOLVER_MAX_ADDRESSES,
+                                               &numAddresses,
+                                               &timeToLive);
+        pthread_mutex_lock(&resolver.mutex);
+        
+        if (result == SN_NO_ERROR && numAddresses > 0)
+        {
+            memcpy(entry->addresses, addresses, numAddresses * sizeof(snResolvedAddress));
+            entry->numAddresses = numAddresses;
+            entry->status = SN_RESOLVE_SUCCEEDED;
+        }
+        else
+        {
+            entry->numAddresses = 0;
+            entry->status = SN_RESOLVE_FAILED;
+        }
+        
+        if (timeToLive < 0)
+        {
+            timeToLive = entry->status == SN_RESOLVE_SUCCEEDED ? resolver.timeToLive : resolver.negativeTimeToLive;
+        }
+        entry->expiryTime = snTimerWheel_getMonotonicTime() + timeToLive;
+        
+        while (entry->waitingRequests)
+        {
+            snResolveRequest* request = entry->waitingRequests;
+            entry->waitingRequests = request->nextWaitingRequest;
+            request->nextWaitingRequest = NULL;
+            
+            if (request->isDeleted)
+            {
+                closeRequestDescriptors(request);
+                free(request);
+            }
+            else
+            {
+                completeRequest(request, entry);
+            }
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Removes completed entries from the cache, or only the expired
+ * ones. Called with the mutex locked.
+ */
+static void removeEntries(int onlyExpired)
+{
+    const long long now = snTimerWheel_getMonotonicTime();
+    snResolverCacheEntry** previousNext = &resolver.entries;
+    
+    while (*previousNext)
+    {
+        snResolverCacheEntry* entry = *previousNext;
+        
+        if (entry->status != SN_RESOLVE_PENDING &&
+            (!onlyExpired || entry->expiryTime <= now))
+        {
+            *previousNext = entry->next;
+            free(entry->host);
+            free(entry);
+            resolver.numEntries--;
+        }
+        else
+        {
+            previousNext = &entry->next;
+        }
+    }
+}
+
+/**
+ * Removes the completed entry that expires first, or the one added first
+ * of those expiring at the same time. Entries are added at the front of
+ * the list. Called with the mutex locked.
+ */
+static void removeOldestEntry(void)
+{
+    snResolverCacheEntry** oldestPreviousNext = NULL;
+    snResolverCacheEntry** previousNext;
+    
+    for (previousNext = &resolver.entries; *previousNext; previousNext = &(*previousNext)->next)
+    {
+        if ((*previousNext)->status != SN_RESOLVE_PENDING &&
+            (oldestPreviousNext == NULL || (*previousNext)->expiryTime <= (*oldestPreviousNext)->expiryTime))
+        {
+            oldestPreviousNext = previousNext;
+        }
+    }
+    
+    if (oldestPreviousNext)
+    {
+        snResolverCacheEntry* entry = *oldestPreviousNext;
+        *oldestPreviousNext = entry->next;
+        free(entry->host);
+        free(entry);
+        resolver.numEntries--;
+    }
+}
+
+/**
+ * Queues a lookup of an entry. Called with the mutex locked.
+ */
+static void queueLookup(snResolverCacheEntry* entry)
+{
+    int i;
+    
+    entry->status = SN_RESOLVE_PENDING;
+    
+    if (resolver.lastQueuedEntry)
+    {
+        resolver.lastQueuedEntry->nextQueuedEntry = entry;
+    }
+    else
+    {
+        resolver.firstQueuedEntry = entry;
+    }
+    resolver.lastQueuedEntry = entry;
+    
+    if (!resolver.hasStartedThreads)
+    {
+        for (i = 0; i < SN_RESOLVER_NUM_THREADS; i++)
+        {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, resolverThread, NULL) == 0)
+            {
+                pthread_detach(thread);
+            }
+        }
+        resolver.hasStartedThreads = 1;
+    }
+    
+    pthread_cond_signal(&resolver.condition);
+}
+
+snResolveRequest* snResolver_resolve(const char* host)
+{
+    snResolveRequest* request = createRequest();
+    snResolverCacheEntry* entry;
+    
+    /*IP addresses are parsed right away*/
+    if (getAddresses(host,
+                     AI_NUMERICHOST,
+                     request->addresses,
+                     SN_RESOLVER_MAX_ADDRESSES,
+                     &request->numAddresses) == SN_NO_ERROR)
+    {
+        request->status = SN_RESOLVE_SUCCEEDED;
+        return request;
+    }
+    
+    pthread_mutex_lock(&resolver.mutex);
+    
+    for (entry = resolver.entries; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->host, host) == 0)
+        {
+            break;
+        }
+    }
+    
+    if (entry == NULL)
+    {
+        if (resolver.numEntries >= SN_RESOLVER_MAX_CACHE_SIZE)
+        {
+            removeEntries(1);
+        }
+        
+        if (resolver.numEntries >= SN_RESOLVER_MAX_CACHE_SIZE)
+        {
+            /*pending entries have requests waiting, so the cache
+              can still grow while all of them are being looked up*/
+            removeOldestEntry();
+        }
+        
+        entry = malloc(sizeof(snResolverCacheEntry));
+        memset(entry, 0, sizeof(snResolverCacheEntry));
+        entry->host = strdup(host);
+        entry->next = resolver.entries;
+        resolver.entries = entry;
+        resolver.numEntries++;
+        queueLookup(entry);
+    }
+    else if (entry->status != SN_RESOLVE_PENDING &&
+             entry->expiryTime <= snTimerWheel_getMonotonicTime())
+    {
+        queueLookup(entry);
+    }
+    
+    if (entry->status == SN_RESOLVE_PENDING)
+    {
+        if (pipe(request->descriptors) == 0)
+        {
+            fcntl(request->descriptors[0], F_SETFL, fcntl(request->descriptors[0], F_GETFL, 0) | O_NONBLOCK);
+        }
+        else
+        {
+            request->descriptors[0] = -1;
+            request->descriptors[1] = -1;
+        }
+        request->nextWaitingRequest = entry->waitingRequests;
+        entry->waitingRequests = request;
+    }
+    else
+    {
+        completeRequest(request, entry);
+    }
+    
+    pthread_mutex_unlock(&resolver.mutex);
+    
+    return request;
+}
+
+void snResolver_setResolveFunction(snResolveFunction function, void* userData)
+{
+    pthread_mutex_lock(&resolver.mutex);
+    resolver.resolveFunction = function ? function : resolveWithGetaddrinfo;
+    resolver.resolveFunctionData = function ? userData : NULL;
+    removeEntries(0);
+    pthread_mutex_unlock(&resolver.mutex);
+}
+
+void snResolver_setDefaultTimeToLive(int timeToLive, int negativeTimeToLive)
+{
+    pthread_mutex_lock(&resolver.mutex);
+    resolver.timeToLive = timeToLive;
+    resolver.negativeTimeToLive = negativeTimeToLive;
+    pthread_mutex_unlock(&resolver.mutex);
+}
+
+void snResolver_clearCache(void)
+{
+    pthread_mutex_lock(&resolver.mutex);
+    removeEntries(0);
+    pthread_mutex_unlock(&resolver.mutex);
+}
+
+snResolveStatus snResolveRequest_getStatus(snResolveRequest* request)
+{
+    pthread_mutex_lock(&resolver.mutex);
+    const snResolveStatus status = request->status;
+    pthread_mutex_unlock(&resolver.mutex);
+    return status;
+}
+
+int snResolveRequest_getDescriptor(snResolveRequest* request)
+{
+    return request->descriptors[0];
+}
+
+const snResolvedAddress* snResolveRequest_getAddresses(snResolveRequest* request, int* numAddresses)
+{
+    assert(request->status == SN_RESOLVE_SUCCEEDED);
+    *numAddresses = request->numAddresses;
+    return request->addresses;
+}
+
+void snResolveRequest_delete(snResolveRequest* request)
+{
+    pthread_mutex_lock(&resolver.mutex);
+    
+    if (request->status == SN_RESOLVE_PENDING)
+    {
+        /*freed by the resolver thread*/
+        request->isDeleted = 1;
+        pthread_mutex_unlock(&resolver.mutex);
+        return;
+    }
+    
+    pthread_mutex_unlock(&resolver.mutex);
+    
+    closeRequestDescriptors(request);
+    free(request);
+}
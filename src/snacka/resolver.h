@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_RESOLVER_H
+#define SN_RESOLVER_H
+
+#include <sys/socket.h>
+
+#include "errorcodes.h"
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /** The maximum number of addresses kept per host. */
+#define SN_RESOLVER_MAX_ADDRESSES 8
+    
+    /**
+     * The process wide host name resolver runs lookups on a small pool of
+     * threads, so that a slow name server never blocks the thread connecting
+     * a websocket, and caches the results. Concurrent lookups of the same host
+     * are done once. Failed lookups are cached too, for a shorter time,
+     * so that reconnecting clients don't flood the name server.
+     */
+    typedef struct snResolveRequest snResolveRequest;
+    
+    /** */
+    typedef enum snResolveStatus
+    {
+        /** */
+        SN_RESOLVE_PENDING = 0,
+        /** */
+        SN_RESOLVE_SUCCEEDED,
+        /** */
+        SN_RESOLVE_FAILED
+    } snResolveStatus;
+    
+    /**
+     * A resolved address. The port is 0 and is filled in by whoever connects.
+     */
+    typedef struct snResolvedAddress
+    {
+        /** */
+        struct sockaddr_storage address;
+        /** The size of \c address in bytes. */
+        socklen_t addressSize;
+    } snResolvedAddress;
+    
+    /**
+     * A function that looks up the addresses of a host. Called on a
+     * resolver thread.
+     * @param userData The pointer passed to \c snResolver_setResolveFunction.
+     * @param host The host name.
+     * @param addresses Receives the addresses, in order of preference.
+     * @param maxNumAddresses The capacity of \c addresses.
+     * @param numAddresses Set to the number of addresses.
+     * @param timeToLive Set to the time in milliseconds to cache the
+     * result, or to -1 to use the default time.
+     * @return An error code, SN_NO_ERROR on success.
+     */
+    typedef snError (*snResolveFunction)(void* userData,
+                                         const char* host,
+                                         snResolvedAddress* addresses,
+                                         int maxNumAddresses,
+                                         int* numAddresses,
+                                         int* timeToLive);
+    
+    /**
+     * Starts resolving a host name. Completes immediately if the host is an IP
+     * address or if the cache holds a result that has not expired.
+     * @param host The host name.
+     * @return The request, to be deleted with \c snResolveRequest_delete.
+     */
+    snResolveRequest* snResolver_resolve(const char* host);
+    
+    /**
+     * Replaces the function used for lookups, e.g with a local stand-in for
+     * testing. Clears the cache.
+     * @param function The function, or NULL to use getaddrinfo.
+     * @param userData A pointer to pass to \c function.
+     */
+    void snResolver_setResolveFunction(snResolveFunction function, void* userData);
+    
+    /**
+     * Sets how long to cache results when the resolve function does not say.
+     * getaddrinfo does not report the time to live of the records it finds,
+     * so this applies to all of its results.
+     * @param timeToLive The time in milliseconds to cache addresses.
+     * @param negativeTimeToLive The time in milliseconds to cache failed lookups.
+     */
+    void snResolver_setDefaultTimeToLive(int timeToLive, int negativeTimeToLive);
+    
+    /**
+     * Removes all completed lookups from the cache.
+     */
+    void snResolver_clearCache(void);
+    
+    /**
+     * @param request The request.
+     * @return The status of the request.
+     */
+    snResolveStatus snResolveRequest_getStatus(snResolveRequest* request);
+    
+    /**
+     * Gets a descriptor that becomes readable when the request completes, for
+     * waiting with poll or an event loop.
+     * @param request The request.
+     * @return The descriptor, or -1 if the request completed right away.
+     */
+    int snResolveRequest_getDescriptor(snResolveRequest* request);
+    
+    /**
+     * @param request A request that has succeeded.
+     * @param numAddresses Set to the number of addresses.
+     * @return The resolved addresses, in order of preference.
+     */
+    const snResolvedAddress* snResolveRequest_getAddresses(snResolveRequest* request, int* numAddresses);
+    
+    /**
+     * Deletes a request. Pending requests may be deleted too.
+     * @param request The request to delete.
+     */
+    void snResolveRequest_delete(snResolveRequest* request);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_RESOLVER_H*/
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ringbuffer.h"
+
+/** Records are aligned to this many bytes. */
+#define SN_RING_BUFFER_ALIGNMENT 8
+
+/** Marks the unused space at the end of the buffer before a wrapped record. */
+#define SN_RING_BUFFER_PADDING_TAG -1
+
+/** Precedes every record. */
+typedef struct snRecordHeader
+{
+    /** */
+    int32_t size;
+    /** */
+    int32_t tag;
+} snRecordHeader;
+
+static unsigned int getRecordSize(int size)
+{
+    const unsigned int recordSize = sizeof(snRecordHeader) + size;
+    return (recordSize + SN_RING_BUFFER_ALIGNMENT - 1) & ~(SN_RING_BUFFER_ALIGNMENT - 1);
+}
+
+void snRingBuffer_init(snRingBuffer* ring, int capacity)
+{
+    memset(ring, 0, sizeof(snRingBuffer));
+    
+    ring->capacity = 64;
+    while (ring->capacity < (unsigned int)capacity)
+    {
+        ring->capacity *= 2;
+    }
+    
+    ring->buffer = malloc(ring->capacity);
+}
+
+void snRingBuffer_deinit(snRingBuffer* ring)
+{
+    free(ring->buffer);
+    ring->buffer = NULL;
+}
+
+int snRingBuffer_getMaxRecordSize(snRingBuffer* ring)
+{
+    /*a record must fit after the padding at the end of the buffer*/
+    return ring->capacity / 2 - sizeof(snRecordHeader);
+}
+
+char* snRingBuffer_beginWrite(snRingBuffer* ring, int size)
+{
+    const unsigned int recordSize = getRecordSize(size);
+    unsigned int position = ring->writePosition;
+    const unsigned int offset = position & (ring->capacity - 1);
+    const unsigned int numBytesToEnd = ring->capacity - offset;
+    unsigned int requiredSize = recordSize;
+    
+    if (size > snRingBuffer_getMaxRecordSize(ring))
+    {
+        /*might fit now, but not at every position*/
+        return NULL;
+    }
+    
+    if (numBytesToEnd < recordSize)
+    {
+        /*skip to the start of the buffer*/
+        requiredSize += numBytesToEnd;
+    }
+    
+    if (requiredSize > ring->capacity - (position - ring->cachedReadPosition))
+    {
+        /*only read the consumer position when out of space*/
+        ring->cachedReadPosition = __atomic_load_n(&ring->readPosition, __ATOMIC_ACQUIRE);
+        if (requiredSize > ring->capacity - (position - ring->cachedReadPosition))
+        {
+            return NULL;
+        }
+    }
+    
+    if (numBytesToEnd < recordSize)
+    {
+        snRecordHeader* padding = (snRecordHeader*)&ring->buffer[offset];
+        padding->size = numBytesToEnd - sizeof(snRecordHeader);
+        padding->tag = SN_RING_BUFFER_PADDING_TAG;
+        position += numBytesToEnd;
+    }
+    
+    ring->pendingRecordPosition = position;
+    
+    return &ring->buffer[(position & (ring->capacity - 1)) + sizeof(snRecordHeader)];
+}
+
+void snRingBuffer_endWrite(snRingBuffer* ring, int size, int tag)
+{
+    const unsigned int position = ring->pendingRecordPosition;
+    snRecordHeader* header = (snRecordHeader*)&ring->buffer[position & (ring->capacity - 1)];
+    
+    assert(tag >= 0);
+    header->size = size;
+    header->tag = tag;
+    
+    __atomic_store_n(&ring->writePosition, position + getRecordSize(size), __ATOMIC_RELEASE);
+}
+
+const char* snRingBuffer_beginRead(snRingBuffer* ring, int* size, int* tag)
+{
+    unsigned int position = ring->readPosition;
+    
+    if (position == ring->cachedWritePosition)
+    {
+        ring->cachedWritePosition = __atomic_load_n(&ring->writePosition, __ATOMIC_ACQUIRE);
+        if (position == ring->cachedWritePosition)
+        {
+            return NULL;
+        }
+    }
+    
+    const snRecordHeader* header = (const snRecordHeader*)&ring->buffer[position & (ring->capacity - 1)];
+    
+    if (header->tag == SN_RING_BUFFER_PADDING_TAG)
+    {
+        /*the padding is published together with the record after it*/
+        position += getRecordSize(header->size);
+        header = (const snRecordHeader*)&ring->buffer[position & (ring->capacity - 1)];
+    }
+    
+    *size = header->size;
+    *tag = header->tag;
+    ring->pendingReadPosition = position + getRecordSize(header->size);
+    
+    return (const char*)header + sizeof(snRecordHeader);
+}
+
+void snRingBuffer_endRead(snRingBuffer* ring)
+{
+    __atomic_store_n(&ring->readPosition, ring->pendingReadPosition, __ATOMIC_RELEASE);
+}
+
+int snRingBuffer_isEmpty(snRingBuffer* ring)
+{
+    return ring->readPosition == __atomic_load_n(&ring->writePosition, __ATOMIC_ACQUIRE);
+}
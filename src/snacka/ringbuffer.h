@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_RING_BUFFER_H
+#define SN_RING_BUFFER_H
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * A lock free single producer single consumer queue of variable size
+     * records, stored contiguously in a power of two sized buffer. One
+     * thread may write records and another may read them, without locks
+     * or system calls. Each record has a size and an integer tag.
+     */
+    typedef struct snRingBuffer
+    {
+        /** */
+        char* buffer;
+        /** The size of \c buffer in bytes, a power of two. */
+        unsigned int capacity;
+        /** Keeps the producer fields on their own cache line. */
+        char padding0[64];
+        /** The position after the last published record. Written by the producer. */
+        unsigned int writePosition;
+        /** The producer's last seen value of \c readPosition. */
+        unsigned int cachedReadPosition;
+        /** Where the record being written starts. */
+        unsigned int pendingRecordPosition;
+        /** Keeps the consumer fields on their own cache line. */
+        char padding1[64];
+        /** The position after the last consumed record. Written by the consumer. */
+        unsigned int readPosition;
+        /** The consumer's last seen value of \c writePosition. */
+        unsigned int cachedWritePosition;
+        /** Where the record being read ends. */
+        unsigned int pendingReadPosition;
+        /** */
+        char padding2[64];
+    } snRingBuffer;
+    
+    /**
+     * Initializes a ring buffer.
+     * @param ring The ring buffer to initialize.
+     * @param capacity The size of the buffer in bytes, rounded up to a power of two.
+     */
+    void snRingBuffer_init(snRingBuffer* ring, int capacity);
+    
+    /**
+     * Frees the memory used by a ring buffer.
+     * @param ring The ring buffer.
+     */
+    void snRingBuffer_deinit(snRingBuffer* ring);
+    
+    /**
+     * @param ring The ring buffer.
+     * @return The size of the biggest record that fits in an empty ring buffer.
+     */
+    int snRingBuffer_getMaxRecordSize(snRingBuffer* ring);
+    
+    /**
+     * Reserves space for a record. Producer thread only.
+     * @param ring The ring buffer.
+     * @param size The size of the record in bytes.
+     * @return A pointer to write the record to, or NULL if there is not
+     * enough free space or the record is bigger than the max record size.
+     */
+    char* snRingBuffer_beginWrite(snRingBuffer* ring, int size);
+    
+    /**
+     * Publishes a record reserved with \c snRingBuffer_beginWrite,
+     * making it visible to the consumer. Producer thread only.
+     * @param ring The ring buffer.
+     * @param size The size of the record, at most the reserved size.
+     * @param tag A non-negative number to store with the record.
+     */
+    void snRingBuffer_endWrite(snRingBuffer* ring, int size, int tag);
+    
+    /**
+     * Gets the oldest record. Consumer thread only.
+     * @param ring The ring buffer.
+     * @param size Set to the size of the record.
+     * @param tag Set to the tag of the record.
+     * @return The record, or NULL if there is none. The record stays valid
+     * until \c snRingBuffer_endRead is called.
+     */
+    const char* snRingBuffer_beginRead(snRingBuffer* ring, int* size, int* tag);
+    
+    /**
+     * Releases the record returned by \c snRingBuffer_beginRead, freeing its
+     * space for the producer. Consumer thread only.
+     * @param ring The ring buffer.
+     */
+    void snRingBuffer_endRead(snRingBuffer* ring);
+    
+    /**
+     * Consumer thread only.
+     * @param ring The ring buffer.
+     * @return Non-zero if there are no records to read.
+     */
+    int snRingBuffer_isEmpty(snRingBuffer* ring);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_RING_BUFFER_H*/
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sha1.h"
+
+#define ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/**
+ * Updates the hash state with a 64 byte block.
+ */
+static void processBlock(uint32_t* state, const unsigned char* block)
+{
+    uint32_t w[80];
+    int i;
+    
+    for (i = 0; i < 16; i++)
+    {
+        w[i] = ((uint32_t)block[4 * i] << 24) |
+               ((uint32_t)block[4 * i + 1] << 16) |
+               ((uint32_t)block[4 * i + 2] << 8) |
+               ((uint32_t)block[4 * i + 3] << 0);
+    }
+    
+    for (i = 16; i < 80; i++)
+    {
+        w[i] = ROTATE_LEFT(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+    
+    for (i = 0; i < 80; i++)
+    {
+        uint32_t f;
+        uint32_t k;
+        
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        
+        const uint32_t temp = ROTATE_LEFT(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROTATE_LEFT(b, 30);
+        b = a;
+        a = temp;
+    }
+    
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void snSHA1(const unsigned char* bytes, int numBytes, unsigned char* digest)
+{
+    uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    unsigned char lastBlocks[128];
+    int i;
+    
+    int numFullBlockBytes = numBytes & ~63;
+    for (i = 0; i < numFullBlockBytes; i += 64)
+    {
+        processBlock(state, &bytes[i]);
+    }
+    
+    /*pad with a one bit, zeros and the message length in bits*/
+    const int numBytesLeft = numBytes - numFullBlockBytes;
+    const int numLastBlockBytes = numBytesLeft < 56 ? 64 : 128;
+    memset(lastBlocks, 0, sizeof(lastBlocks));
+    memcpy(lastBlocks, &bytes[numFullBlockBytes], numBytesLeft);
+    lastBlocks[numBytesLeft] = 0x80;
+    
+    const unsigned long long numBits = (unsigned long long)numBytes * 8;
+    for (i = 0; i < 8; i++)
+    {
+        lastBlocks[numLastBlockBytes - 1 - i] = (unsigned char)(numBits >> (8 * i));
+    }
+    
+    for (i = 0; i < numLastBlockBytes; i += 64)
+    {
+        processBlock(state, &lastBlocks[i]);
+    }
+    
+    for (i = 0; i < 5; i++)
+    {
+        digest[4 * i] = (unsigned char)(state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char)(state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char)(state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char)(state[i] >> 0);
+    }
+}
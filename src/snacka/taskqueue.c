@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "taskqueue.h"
+
+static void pushNode(snTaskQueue* queue, snTaskQueueNode* node)
+{
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    /*sequentially consistent, so that a consumer that announces it is about
+      to wait and then finds the queue empty is seen waiting by the producer*/
+    snTaskQueueNode* previous = __atomic_exchange_n(&queue->head, node, __ATOMIC_SEQ_CST);
+    /*until this store, the consumer sees the queue end at previous*/
+    __atomic_store_n(&previous->next, node, __ATOMIC_RELEASE);
+}
+
+/**
+ * @return The oldest node, or NULL if the queue is empty or
+ * a producer has not finished pushing the next node.
+ */
+static snTaskQueueNode* popNode(snTaskQueue* queue)
+{
+    snTaskQueueNode* tail = queue->tail;
+    snTaskQueueNode* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    
+    if (tail == &queue->stub)
+    {
+        if (next == NULL)
+        {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+    
+    if (next)
+    {
+        queue->tail = next;
+        return tail;
+    }
+    
+    if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+    
+    /*tail is the last node. put the stub after it so it can be unlinked*/
+    pushNode(queue, &queue->stub);
+    
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next)
+    {
+        queue->tail = next;
+        return tail;
+    }
+    
+    return NULL;
+}
+
+void snTaskQueue_init(snTaskQueue* queue)
+{
+    memset(queue, 0, sizeof(snTaskQueue));
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+}
+
+void snTaskQueue_deinit(snTaskQueue* queue)
+{
+    snTaskQueue_run(queue);
+}
+
+void snTaskQueue_push(snTaskQueue* queue, snTask task, void* userData)
+{
+    snTaskQueueNode* node = malloc(sizeof(snTaskQueueNode));
+    node->task = task;
+    node->userData = userData;
+    pushNode(queue, node);
+}
+
+int snTaskQueue_run(snTaskQueue* queue)
+{
+    return snTaskQueue_runAtMost(queue, INT_MAX);
+}
+
+int snTaskQueue_runAtMost(snTaskQueue* queue, int maxNumTasks)
+{
+    int numTasks = 0;
+    snTaskQueueNode* node;
+    
+    while (numTasks < maxNumTasks && (node = popNode(queue)) != NULL)
+    {
+        snTask task = node->task;
+        void* userData = node->userData;
+        free(node);
+        
+        task(userData);
+        numTasks++;
+    }
+    
+    return numTasks;
+}
+
+int snTaskQueue_isEmpty(snTaskQueue* queue)
+{
+    return queue->tail == &queue->stub &&
+           __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST) == &queue->stub;
+}
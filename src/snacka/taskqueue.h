@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TASK_QUEUE_H
+#define SN_TASK_QUEUE_H
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * A function to run on another thread.
+     * @param userData The pointer passed along with the task.
+     */
+    typedef void (*snTask)(void* userData);
+    
+    /**
+     * A queued task.
+     */
+    typedef struct snTaskQueueNode
+    {
+        /** */
+        struct snTaskQueueNode* next;
+        /** */
+        snTask task;
+        /** */
+        void* userData;
+    } snTaskQueueNode;
+    
+    /**
+     * A lock free, unbounded multiple producer single consumer queue of tasks.
+     * Any thread may push tasks, but only one thread may run them.
+     * Tasks pushed by the same thread are run in the order they were pushed.
+     * @see http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
+     */
+    typedef struct snTaskQueue
+    {
+        /** The most recently pushed node. Written by producers. */
+        snTaskQueueNode* head;
+        /** Keeps \c head and \c tail on separate cache lines. */
+        char padding[64];
+        /** The oldest node. Only accessed by the consumer. */
+        snTaskQueueNode* tail;
+        /** A placeholder node that keeps the queue non-empty. */
+        snTaskQueueNode stub;
+    } snTaskQueue;
+    
+    /**
+     * Initializes an empty task queue.
+     * @param queue The queue to initialize.
+     */
+    void snTaskQueue_init(snTaskQueue* queue);
+    
+    /**
+     * Runs any remaining tasks and deinitializes a task queue.
+     * @param queue The queue to deinitialize.
+     */
+    void snTaskQueue_deinit(snTaskQueue* queue);
+    
+    /**
+     * Adds a task to a queue. May be called from any thread.
+     * @param queue The queue.
+     * @param task The function to run.
+     * @param userData A pointer to pass to \c task.
+     */
+    void snTaskQueue_push(snTaskQueue* queue, snTask task, void* userData);
+    
+    /**
+     * Runs the tasks in the queue. Tasks pushed while running are run too,
+     * unless a producer is interrupted while pushing. May only be called
+     * from the consumer thread.
+     * @param queue The queue.
+     * @return The number of tasks that were run.
+     */
+    int snTaskQueue_run(snTaskQueue* queue);
+    
+    /**
+     * Like \c snTaskQueue_run, but stops after a given number of tasks.
+     * May only be called from the consumer thread.
+     * @param queue The queue.
+     * @param maxNumTasks The maximum number of tasks to run.
+     * @return The number of tasks that were run.
+     */
+    int snTaskQueue_runAtMost(snTaskQueue* queue, int maxNumTasks);
+    
+    /**
+     * May only be called from the consumer thread.
+     * @param queue The queue.
+     * @return Non-zero if there are no queued tasks.
+     */
+    int snTaskQueue_isEmpty(snTaskQueue* queue);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_TASK_QUEUE_H*/
@@ -0,0 +1,634 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifdef __linux__
+/*for syscall*/
+#define _GNU_SOURCE
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ringbuffer.h"
+#include "threadedwebsocket.h"
+
+#define SN_DEFAULT_RECEIVE_RING_BUFFER_SIZE (1 << 20)
+
+#define SN_DEFAULT_SEND_RING_BUFFER_SIZE (1 << 20)
+
+/** Matches the websocket's default max frame size. */
+#define SN_THREADED_DEFAULT_MAX_MESSAGE_SIZE (1 << 16)
+
+/** The longest a sleeping I/O thread waits if it can't be woken up through the pipe. */
+#define SN_IO_THREAD_MAX_WAIT 100 /*in milliseconds*/
+
+/** Kinds of records passed between the threads. */
+enum
+{
+    /** I/O thread to application. */
+    SN_RECORD_OPEN = 0,
+    /** I/O thread to application. The opcode is in the tag. */
+    SN_RECORD_MESSAGE,
+    /** I/O thread to application. */
+    SN_RECORD_CLOSE,
+    /** I/O thread to application. */
+    SN_RECORD_ERROR,
+    /** Application to I/O thread. */
+    SN_RECORD_CONNECT,
+    /** Application to I/O thread. */
+    SN_RECORD_DISCONNECT,
+    /** Application to I/O thread. The opcode is in the tag. */
+    SN_RECORD_FRAME
+};
+
+#define SN_RECORD_TAG(type, opcode) ((type) | ((opcode) << 8))
+
+#define SN_RECORD_TYPE(tag) ((tag) & 0xff)
+
+#define SN_RECORD_OPCODE(tag) ((snOpcode)((tag) >> 8))
+
+struct snThreadedWebsocket
+{
+    /** Only used by the I/O thread while it runs. */
+    snWebsocket* websocket;
+    /** */
+    pthread_t thread;
+    /** Received messages and state changes, from the I/O thread. */
+    snRingBuffer receiveRing;
+    /** Commands and outgoing frames, from the application. */
+    snRingBuffer sendRing;
+    /** */
+    snWaitStrategy waitStrategy;
+    /** Written to by the application to wake up a sleeping I/O thread. */
+    int wakeUpPipe[2];
+    /** Non-zero while the I/O thread sleeps. */
+    int isIOThreadWaiting;
+    /** Non-zero while the application sleeps. */
+    int isApplicationWaiting;
+    /** Incremented by the I/O thread when publishing records. The application waits on it. */
+    int receiveSequence;
+    /** */
+    int isStopped;
+    /** The websocket state, as last seen by the I/O thread. */
+    int state;
+    /** The state last written to \c state by the I/O thread. */
+    int ioThreadState;
+    /** */
+    snOpenCallback openCallback;
+    /** */
+    snMessageCallback messageCallback;
+    /** */
+    snCloseCallback closeCallback;
+    /** */
+    snErrorCallback errorCallback;
+    /** */
+    void* callbackData;
+};
+
+static double getTime(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+#ifdef __linux__
+
+static void futexWait(int* address, int value, int timeoutMs)
+{
+    struct timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, value, &timeout, NULL, 0);
+}
+
+static void futexWake(int* address)
+{
+    syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+#endif /*__linux__*/
+
+/**
+ * Called by the I/O thread. Copies a record to the receive ring, waiting
+ * for the application to make room if necessary.
+ */
+static void publish(snThreadedWebsocket* tws, int tag, const char* bytes, int numBytes)
+{
+    char* record;
+    
+    if (numBytes + 1 > snRingBuffer_getMaxRecordSize(&tws->receiveRing))
+    {
+        return;
+    }
+    
+    while ((record = snRingBuffer_beginWrite(&tws->receiveRing, numBytes + 1)) == NULL)
+    {
+        if (__atomic_load_n(&tws->isStopped, __ATOMIC_ACQUIRE))
+        {
+            return;
+        }
+        sched_yield();
+    }
+    
+    /*text messages are null terminated. state changes may have no bytes at all.*/
+    if (numBytes > 0)
+    {
+        memcpy(record, bytes, numBytes);
+    }
+    record[numBytes] = '\0';
+    snRingBuffer_endWrite(&tws->receiveRing, numBytes + 1, tag);
+    
+#ifdef __linux__
+    if (tws->waitStrategy == SN_WAIT_STRATEGY_FUTEX)
+    {
+        __atomic_add_fetch(&tws->receiveSequence, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&tws->isApplicationWaiting, __ATOMIC_SEQ_CST))
+        {
+            futexWake(&tws->receiveSequence);
+        }
+    }
+#endif
+}
+
+static void ioOpenCallback(void* userData)
+{
+    publish((snThreadedWebsocket*)userData, SN_RECORD_OPEN, NULL, 0);
+}
+
+static void ioMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    publish((snThreadedWebsocket*)userData, SN_RECORD_TAG(SN_RECORD_MESSAGE, opcode), bytes, numBytes);
+}
+
+static void ioCloseCallback(void* userData, snStatusCode status)
+{
+    const int value = status;
+    publish((snThreadedWebsocket*)userData, SN_RECORD_CLOSE, (const char*)&value, sizeof(int));
+}
+
+static void ioErrorCallback(void* userData, snError error)
+{
+    const int value = error;
+    publish((snThreadedWebsocket*)userData, SN_RECORD_ERROR, (const char*)&value, sizeof(int));
+}
+
+/**
+ * Called by the I/O thread. Carries out the commands from the application.
+ * @return The number of commands.
+ */
+static int runCommands(snThreadedWebsocket* tws)
+{
+    const char* record;
+    int numCommands = 0;
+    int size, tag;
+    
+    while ((record = snRingBuffer_beginRead(&tws->sendRing, &size, &tag)) != NULL)
+    {
+        snError result = SN_NO_ERROR;
+        
+        switch (SN_RECORD_TYPE(tag))
+        {
+            case SN_RECORD_CONNECT:
+            {
+                result = snWebsocket_connect(tws->websocket, record);
+                break;
+            }
+            case SN_RECORD_DISCONNECT:
+            {
+                int disconnectImmediately;
+                memcpy(&disconnectImmediately, record, sizeof(int));
+                snWebsocket_disconnect(tws->websocket, disconnectImmediately);
+                break;
+            }
+            case SN_RECORD_FRAME:
+            {
+                result = snWebsocket_sendFrame(tws->websocket, SN_RECORD_OPCODE(tag), size, record);
+                break;
+            }
+            default:
+                break;
+        }
+        
+        snRingBuffer_endRead(&tws->sendRing);
+        numCommands++;
+        
+        if (result != SN_NO_ERROR)
+        {
+            ioErrorCallback(tws, result);
+        }
+    }
+    
+    return numCommands;
+}
+
+/**
+ * Called by the I/O thread when there is nothing to do.
+ */
+static void waitForWork(snThreadedWebsocket* tws)
+{
+    if (tws->waitStrategy == SN_WAIT_STRATEGY_SPIN)
+    {
+        return;
+    }
+    
+    if (tws->waitStrategy == SN_WAIT_STRATEGY_YIELD)
+    {
+        sched_yield();
+        return;
+    }
+    
+    /*announce that a wake up is needed, then check for commands that were
+      sent before the announcement was seen*/
+    __atomic_store_n(&tws->isIOThreadWaiting, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    
+    if (snRingBuffer_isEmpty(&tws->sendRing) && !__atomic_load_n(&tws->isStopped, __ATOMIC_ACQUIRE))
+    {
+        struct pollfd fds[2];
+        int numFds = 1;
+        
+        fds[0].fd = tws->wakeUpPipe[0];
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        
+        const int descriptor = snWebsocket_getDescriptor(tws->websocket);
+        const int events = snWebsocket_getWantedEvents(tws->websocket);
+        if (descriptor >= 0 && events != 0)
+        {
+            fds[1].fd = descriptor;
+            fds[1].events = ((events & SN_IO_EVENT_READ) ? POLLIN : 0) | ((events & SN_IO_EVENT_WRITE) ? POLLOUT : 0);
+            fds[1].revents = 0;
+            numFds++;
+        }
+        
+        /*sleep until the next connect or close timeout at the latest*/
+        int timeoutMs = snWebsocket_getTimeUntilNextTimer(tws->websocket);
+        if (tws->wakeUpPipe[0] < 0 && (timeoutMs < 0 || timeoutMs > SN_IO_THREAD_MAX_WAIT))
+        {
+            timeoutMs = SN_IO_THREAD_MAX_WAIT;
+        }
+        
+        poll(fds, numFds, timeoutMs);
+        
+        if (fds[0].revents & POLLIN)
+        {
+            char bytes[64];
+            while (read(tws->wakeUpPipe[0], bytes, sizeof(bytes)) > 0) {}
+        }
+    }
+    
+    __atomic_store_n(&tws->isIOThreadWaiting, 0, __ATOMIC_SEQ_CST);
+}
+
+static void* ioThreadFunction(void* userData)
+{
+    snThreadedWebsocket* tws = (snThreadedWebsocket*)userData;
+    
+    while (!__atomic_load_n(&tws->isStopped, __ATOMIC_ACQUIRE))
+    {
+        const int numCommands = runCommands(tws);
+        
+        snWebsocket_poll(tws->websocket);
+        
+        /*only publish actual changes, so that the state set by
+          snThreadedWebsocket_connect is not overwritten by a stale one*/
+        const snReadyState state = snWebsocket_getState(tws->websocket);
+        if (state != tws->ioThreadState)
+        {
+            tws->ioThreadState = state;
+            __atomic_store_n(&tws->state, state, __ATOMIC_RELEASE);
+        }
+        
+        if (numCommands == 0 && !snWebsocket_needsPoll(tws->websocket))
+        {
+            waitForWork(tws);
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Called by the application. Copies a record to the send ring.
+ */
+static snError pushCommand(snThreadedWebsocket* tws, int tag, const char* bytes, int numBytes)
+{
+    char* record = snRingBuffer_beginWrite(&tws->sendRing, numBytes);
+    
+    if (record == NULL)
+    {
+        if (numBytes > snRingBuffer_getMaxRecordSize(&tws->sendRing))
+        {
+            return SN_EXCEEDED_MAX_PAYLOAD_SIZE;
+        }
+        return SN_RING_BUFFER_FULL;
+    }
+    
+    memcpy(record, bytes, numBytes);
+    snRingBuffer_endWrite(&tws->sendRing, numBytes, tag);
+    
+    if (tws->waitStrategy == SN_WAIT_STRATEGY_FUTEX)
+    {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_exchange_n(&tws->isIOThreadWaiting, 0, __ATOMIC_SEQ_CST))
+        {
+            const char byte = 0;
+            ssize_t result = write(tws->wakeUpPipe[1], &byte, 1);
+            (void)result;
+        }
+    }
+    
+    return SN_NO_ERROR;
+}
+
+snThreadedWebsocket* snThreadedWebsocket_create(snOpenCallback openCallback,
+                                                snMessageCallback messageCallback,
+                                                snCloseCallback closeCallback,
+                                                snErrorCallback errorCallback,
+                                                void* callbackData,
+                                                const snThreadedWebsocketOptions* options)
+{
+    snWebsocketOptions websocketOptions;
+    int receiveRingBufferSize = SN_DEFAULT_RECEIVE_RING_BUFFER_SIZE;
+    int sendRingBufferSize = SN_DEFAULT_SEND_RING_BUFFER_SIZE;
+    int maxMessageSize = SN_THREADED_DEFAULT_MAX_MESSAGE_SIZE;
+    int i;
+    
+    snThreadedWebsocket* tws = malloc(sizeof(snThreadedWebsocket));
+    memset(tws, 0, sizeof(snThreadedWebsocket));
+    
+    tws->openCallback = openCallback;
+    tws->messageCallback = messageCallback;
+    tws->closeCallback = closeCallback;
+    tws->errorCallback = errorCallback;
+    tws->callbackData = callbackData;
+    tws->state = SN_STATE_CLOSED;
+    tws->ioThreadState = SN_STATE_CLOSED;
+    
+    memset(&websocketOptions, 0, sizeof(snWebsocketOptions));
+    
+    if (options)
+    {
+        tws->waitStrategy = options->waitStrategy;
+        
+        if (options->websocketOptions)
+        {
+            websocketOptions = *options->websocketOptions;
+        }
+        
+        if (options->receiveRingBufferSize > 0)
+        {
+            receiveRingBufferSize = options->receiveRingBufferSize;
+        }
+        
+        if (options->sendRingBufferSize > 0)
+        {
+            sendRingBufferSize = options->sendRingBufferSize;
+        }
+    }
+    
+    /*messages are delivered whole*/
+    websocketOptions.messageStreamCallbacks = NULL;
+    
+    if (websocketOptions.maxMessageSize > 0)
+    {
+        maxMessageSize = websocketOptions.maxMessageSize;
+    }
+    else if (websocketOptions.maxFrameSize > 0)
+    {
+        maxMessageSize = websocketOptions.maxFrameSize;
+    }
+    
+    /*leave room for at least two messages and the record overhead*/
+    if (receiveRingBufferSize < 2 * (maxMessageSize + 64))
+    {
+        receiveRingBufferSize = 2 * (maxMessageSize + 64);
+    }
+    
+    snRingBuffer_init(&tws->receiveRing, receiveRingBufferSize);
+    snRingBuffer_init(&tws->sendRing, sendRingBufferSize);
+    
+    if (pipe(tws->wakeUpPipe) == 0)
+    {
+        for (i = 0; i < 2; i++)
+        {
+            fcntl(tws->wakeUpPipe[i], F_SETFL, fcntl(tws->wakeUpPipe[i], F_GETFL, 0) | O_NONBLOCK);
+        }
+    }
+    else
+    {
+        /*ignored by poll(2)*/
+        tws->wakeUpPipe[0] = -1;
+        tws->wakeUpPipe[1] = -1;
+    }
+    
+    tws->websocket = snWebsocket_createWithSettings(ioOpenCallback,
+                                                    ioMessageCallback,
+                                                    ioCloseCallback,
+                                                    ioErrorCallback,
+                                                    tws,
+                                                    &websocketOptions);
+    
+    pthread_create(&tws->thread, NULL, ioThreadFunction, tws);
+    
+    return tws;
+}
+
+void snThreadedWebsocket_delete(snThreadedWebsocket* tws)
+{
+    const char byte = 0;
+    
+    __atomic_store_n(&tws->isStopped, 1, __ATOMIC_RELEASE);
+    if (write(tws->wakeUpPipe[1], &byte, 1) < 0)
+    {
+        /*without a pipe, the I/O thread wakes up by itself within SN_IO_THREAD_MAX_WAIT*/
+    }
+    pthread_join(tws->thread, NULL);
+    
+    /*the I/O thread is gone, so the websocket can be used from here*/
+    snWebsocket_delete(tws->websocket);
+    
+    snRingBuffer_deinit(&tws->receiveRing);
+    snRingBuffer_deinit(&tws->sendRing);
+    close(tws->wakeUpPipe[0]);
+    close(tws->wakeUpPipe[1]);
+    
+    free(tws);
+}
+
+snError snThreadedWebsocket_connect(snThreadedWebsocket* tws, const char* url)
+{
+    snError result = pushCommand(tws, SN_RECORD_CONNECT, url, (int)strlen(url) + 1);
+    
+    if (result == SN_NO_ERROR)
+    {
+        __atomic_store_n(&tws->state, SN_STATE_CONNECTING, __ATOMIC_RELEASE);
+    }
+    
+    return result;
+}
+
+snError snThreadedWebsocket_disconnect(snThreadedWebsocket* tws, int disconnectImmediately)
+{
+    return pushCommand(tws, SN_RECORD_DISCONNECT, (const char*)&disconnectImmediately, sizeof(int));
+}
+
+snReadyState snThreadedWebsocket_getState(snThreadedWebsocket* tws)
+{
+    return (snReadyState)__atomic_load_n(&tws->state, __ATOMIC_ACQUIRE);
+}
+
+snError snThreadedWebsocket_sendFrame(snThreadedWebsocket* tws,
+                                      snOpcode opcode,
+                                      int payloadSize,
+                                      const char* payload)
+{
+    return pushCommand(tws, SN_RECORD_TAG(SN_RECORD_FRAME, opcode), payload, payloadSize);
+}
+
+snError snThreadedWebsocket_sendTextData(snThreadedWebsocket* tws, const char* payload)
+{
+    return snThreadedWebsocket_sendFrame(tws, SN_OPCODE_TEXT, (int)strlen(payload), payload);
+}
+
+snError snThreadedWebsocket_sendBinaryData(snThreadedWebsocket* tws, int payloadSize, const char* payload)
+{
+    return snThreadedWebsocket_sendFrame(tws, SN_OPCODE_BINARY, payloadSize, payload);
+}
+
+int snThreadedWebsocket_poll(snThreadedWebsocket* tws)
+{
+    const char* record;
+    int numRecords = 0;
+    int size, tag;
+    
+    while ((record = snRingBuffer_beginRead(&tws->receiveRing, &size, &tag)) != NULL)
+    {
+        int value = 0;
+        
+        switch (SN_RECORD_TYPE(tag))
+        {
+            case SN_RECORD_OPEN:
+            {
+                if (tws->openCallback)
+                {
+                    tws->openCallback(tws->callbackData);
+                }
+                break;
+            }
+            case SN_RECORD_MESSAGE:
+            {
+                if (tws->messageCallback)
+                {
+                    /*the size includes the null terminator*/
+                    tws->messageCallback(tws->callbackData, SN_RECORD_OPCODE(tag), record, size - 1);
+                }
+                break;
+            }
+            case SN_RECORD_CLOSE:
+            {
+                memcpy(&value, record, sizeof(int));
+                if (tws->closeCallback)
+                {
+                    tws->closeCallback(tws->callbackData, (snStatusCode)value);
+                }
+                break;
+            }
+            case SN_RECORD_ERROR:
+            {
+                memcpy(&value, record, sizeof(int));
+                if (tws->errorCallback)
+                {
+                    tws->errorCallback(tws->callbackData, (snError)value);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        
+        snRingBuffer_endRead(&tws->receiveRing);
+        numRecords++;
+    }
+    
+    return numRecords;
+}
+
+int snThreadedWebsocket_wait(snThreadedWebsocket* tws, int timeoutMs)
+{
+    const double deadline = getTime() + timeoutMs / 1000.0;
+    int numChecks = 0;
+    
+    while (snRingBuffer_isEmpty(&tws->receiveRing))
+    {
+        /*reading the clock is comparatively slow, so only do it now and then*/
+        if ((++numChecks & 255) == 0 && getTime() >= deadline)
+        {
+            return 0;
+        }
+        
+        if (tws->waitStrategy == SN_WAIT_STRATEGY_YIELD)
+        {
+            sched_yield();
+        }
+        else if (tws->waitStrategy == SN_WAIT_STRATEGY_FUTEX)
+        {
+#ifdef __linux__
+            /*the I/O thread bumps the sequence after publishing, so either the
+              record is seen here or the futex value no longer matches*/
+            __atomic_store_n(&tws->isApplicationWaiting, 1, __ATOMIC_SEQ_CST);
+            const int sequence = __atomic_load_n(&tws->receiveSequence, __ATOMIC_SEQ_CST);
+            if (snRingBuffer_isEmpty(&tws->receiveRing))
+            {
+                futexWait(&tws->receiveSequence, sequence, timeoutMs);
+            }
+            __atomic_store_n(&tws->isApplicationWaiting, 0, __ATOMIC_SEQ_CST);
+            
+            if (getTime() >= deadline)
+            {
+                break;
+            }
+#else
+            struct timespec sleepTime = {0, 100000};
+            nanosleep(&sleepTime, NULL);
+#endif
+        }
+    }
+    
+    return !snRingBuffer_isEmpty(&tws->receiveRing);
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_THREADED_WEBSOCKET_H
+#define SN_THREADED_WEBSOCKET_H
+
+#include "errorcodes.h"
+#include "websocket.h"
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * How a thread waits for work from another thread.
+     */
+    typedef enum snWaitStrategy
+    {
+        /** Busy wait. Lowest latency, but occupies a core. */
+        SN_WAIT_STRATEGY_SPIN = 0,
+        /** Busy wait, yielding the CPU to other threads between checks. */
+        SN_WAIT_STRATEGY_YIELD,
+        /**
+         * Sleep until woken up. The application waits on a futex and the I/O
+         * thread waits in poll(2), so the thread posting work makes a system
+         * call, but only if the other thread is actually sleeping.
+         * Without futexes, the application sleeps briefly between checks instead.
+         */
+        SN_WAIT_STRATEGY_FUTEX
+    } snWaitStrategy;
+    
+    /**
+     * A websocket whose socket I/O, opening handshake and frame parsing run on
+     * a dedicated background thread. Received messages and state changes are
+     * passed to the application through a lock free single producer single
+     * consumer ring buffer, and outgoing messages are passed to the I/O thread,
+     * which frames, masks and writes them, through another. Neither
+     * \c snThreadedWebsocket_poll nor the send functions make system calls,
+     * unless the wait strategy is \c SN_WAIT_STRATEGY_FUTEX and the I/O
+     * thread is sleeping.
+     *
+     * All functions must be called from the same application thread.
+     */
+    typedef struct snThreadedWebsocket snThreadedWebsocket;
+    
+    /**
+     * Threaded websocket creation options.
+     */
+    typedef struct snThreadedWebsocketOptions
+    {
+        /**
+         * Options for the websocket running on the I/O thread. Callbacks
+         * in these options are invoked on the I/O thread, and
+         * \c messageStreamCallbacks is ignored. May be NULL.
+         */
+        snWebsocketOptions* websocketOptions;
+        /**
+         * How the application and the I/O thread wait for each other.
+         */
+        snWaitStrategy waitStrategy;
+        /**
+         * The size in bytes of the ring buffer carrying received messages.
+         * Grown to fit at least two messages of the maximum message size.
+         * If 0, the default size is used.
+         */
+        int receiveRingBufferSize;
+        /**
+         * The size in bytes of the ring buffer carrying outgoing messages,
+         * which limits the size of a single message to about half of it.
+         * If 0, the default size is used.
+         */
+        int sendRingBufferSize;
+    } snThreadedWebsocketOptions;
+    
+    /**
+     * Creates a threaded websocket and starts its I/O thread.
+     * @param openCallback A function to call when the opening handshake has been completed. Ignored if NULL.
+     * @param messageCallback A function to call when receiving pings, pongs or
+     * full text or binary messages. Ignored if NULL.
+     * @param closeCallback A function to call when the websocket connection is closed. Ignored if NULL.
+     * @param errorCallback A function to call when an error occurs. Ignored if NULL.
+     * @param callbackData A pointer passed to the callbacks.
+     * @param options Creation options, or NULL to use the defaults.
+     * @return The created websocket.
+     */
+    snThreadedWebsocket* snThreadedWebsocket_create(snOpenCallback openCallback,
+                                                    snMessageCallback messageCallback,
+                                                    snCloseCallback closeCallback,
+                                                    snErrorCallback errorCallback,
+                                                    void* callbackData,
+                                                    const snThreadedWebsocketOptions* options);
+    
+    /**
+     * Stops the I/O thread and deletes a threaded websocket, closing the
+     * connection immediately.
+     * @param tws The websocket to delete.
+     */
+    void snThreadedWebsocket_delete(snThreadedWebsocket* tws);
+    
+    /**
+     * Asks the I/O thread to connect to a given URL.
+     * @param tws The websocket.
+     * @param url The URL to connect to.
+     * @return An error code. Connection errors are reported through the callbacks.
+     */
+    snError snThreadedWebsocket_connect(snThreadedWebsocket* tws, const char* url);
+    
+    /**
+     * Asks the I/O thread to disconnect.
+     * @param tws The websocket.
+     * @param disconnectImmediately See \c snWebsocket_disconnect.
+     * @return An error code.
+     */
+    snError snThreadedWebsocket_disconnect(snThreadedWebsocket* tws, int disconnectImmediately);
+    
+    /**
+     * @param tws The websocket.
+     * @return The state of the websocket as last seen by the I/O thread.
+     * Changes to it may be seen before the corresponding callbacks are invoked.
+     */
+    snReadyState snThreadedWebsocket_getState(snThreadedWebsocket* tws);
+    
+    /**
+     * Passes a frame to the I/O thread for sending.
+     * @param tws The websocket.
+     * @param opcode The opcode of the frame to send.
+     * @param payloadSize The size of the payload in bytes.
+     * @param payload The payload data.
+     * @return An error code. \c SN_RING_BUFFER_FULL if the I/O thread
+     * has fallen behind, in which case the frame is not sent.
+     */
+    snError snThreadedWebsocket_sendFrame(snThreadedWebsocket* tws,
+                                          snOpcode opcode,
+                                          int payloadSize,
+                                          const char* payload);
+    
+    /**
+     * Send a text message. The size of the payload is determined by the position of
+     * the first null byte.
+     * @param tws The websocket.
+     * @param payload Null terminated UTF-8 data to send.
+     * @return An error code.
+     */
+    snError snThreadedWebsocket_sendTextData(snThreadedWebsocket* tws, const char* payload);
+    
+    /**
+     * Send a binary message.
+     * @param tws The websocket.
+     * @param payloadSize The size of the payload in bytes.
+     * @param payload The bytes to send.
+     * @return An error code.
+     */
+    snError snThreadedWebsocket_sendBinaryData(snThreadedWebsocket* tws, int payloadSize, const char* payload);
+    
+    /**
+     * Invokes the callbacks for the messages and state changes published
+     * by the I/O thread since the last call. Does not block.
+     * @param tws The websocket.
+     * @return The number of callbacks invoked.
+     */
+    int snThreadedWebsocket_poll(snThreadedWebsocket* tws);
+    
+    /**
+     * Waits, using the websocket's wait strategy, until there is something
+     * for \c snThreadedWebsocket_poll to do.
+     * @param tws The websocket.
+     * @param timeoutMs The maximum time to wait in milliseconds.
+     * @return Non-zero if there is something to poll.
+     */
+    int snThreadedWebsocket_wait(snThreadedWebsocket* tws, int timeoutMs);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_THREADED_WEBSOCKET_H*/
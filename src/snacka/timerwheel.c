@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+/*for clock_gettime*/
+#define _POSIX_C_SOURCE 200112L
+
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+#include "timerwheel.h"
+
+/** The number of ticks spanned by one slot of a level. */
+#define SN_SLOT_SPAN(level) (1LL << (SN_TIMER_WHEEL_SLOT_BITS * (level)))
+
+/** The number of ticks spanned by all slots of a level. */
+#define SN_LEVEL_SPAN(level) SN_SLOT_SPAN((level) + 1)
+
+long long snTimerWheel_getMonotonicTime(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+static void linkTimer(snTimer** head, snTimer* timer)
+{
+    timer->next = *head;
+    if (timer->next)
+    {
+        timer->next->previousNext = &timer->next;
+    }
+    timer->previousNext = head;
+    *head = timer;
+}
+
+static void unlinkTimer(snTimer* timer)
+{
+    *timer->previousNext = timer->next;
+    if (timer->next)
+    {
+        timer->next->previousNext = timer->previousNext;
+    }
+    timer->next = NULL;
+    timer->previousNext = NULL;
+}
+
+/**
+ * Puts a timer in the slot matching its expiry time, on the lowest
+ * level that reaches that far.
+ */
+static void insertTimer(snTimerWheel* wheel, snTimer* timer)
+{
+    long long expiryTime = timer->expiryTime;
+    int level = 0;
+    
+    if (expiryTime < wheel->currentTime)
+    {
+        expiryTime = wheel->currentTime;
+    }
+    
+    while (level < SN_TIMER_WHEEL_NUM_LEVELS - 1 &&
+           expiryTime - wheel->currentTime >= SN_LEVEL_SPAN(level))
+    {
+        level++;
+    }
+    
+    if (expiryTime - wheel->currentTime >= SN_LEVEL_SPAN(level))
+    {
+        /*out of range. moved closer when the slot is cascaded*/
+        expiryTime = wheel->currentTime + SN_LEVEL_SPAN(level) - 1;
+    }
+    
+    const int slot = (int)((expiryTime >> (SN_TIMER_WHEEL_SLOT_BITS * level)) & (SN_TIMER_WHEEL_NUM_SLOTS - 1));
+    linkTimer(&wheel->slots[level][slot], timer);
+    wheel->occupiedSlots[level] |= (uint64_t)1 << slot;
+}
+
+/**
+ * Finds the first slot with timers on a level, starting at a given slot and
+ * wrapping around. Bits of slots emptied by cancelled timers are cleared here.
+ * @return The distance from \c firstSlot to the slot, or -1 if the level is empty.
+ */
+static int findOccupiedSlot(snTimerWheel* wheel, int level, int firstSlot)
+{
+    while (wheel->occupiedSlots[level])
+    {
+        const uint64_t bits = wheel->occupiedSlots[level];
+        const uint64_t rotatedBits = firstSlot == 0 ? bits : (bits >> firstSlot) | (bits << (SN_TIMER_WHEEL_NUM_SLOTS - firstSlot));
+        const int distance = __builtin_ctzll(rotatedBits);
+        const int slot = (firstSlot + distance) & (SN_TIMER_WHEEL_NUM_SLOTS - 1);
+        
+        if (wheel->slots[level][slot])
+        {
+            return distance;
+        }
+        
+        wheel->occupiedSlots[level] &= ~((uint64_t)1 << slot);
+    }
+    
+    return -1;
+}
+
+/**
+ * Detaches the timers of a slot into a separate list.
+ */
+static void takeSlot(snTimerWheel* wheel, int level, int slot, snTimer** list)
+{
+    *list = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    wheel->occupiedSlots[level] &= ~((uint64_t)1 << slot);
+    
+    if (*list)
+    {
+        (*list)->previousNext = list;
+    }
+}
+
+/**
+ * Moves the timers of the slot of a level starting at the current tick
+ * to lower levels.
+ */
+static void cascade(snTimerWheel* wheel, int level)
+{
+    const int slot = (int)((wheel->currentTime >> (SN_TIMER_WHEEL_SLOT_BITS * level)) & (SN_TIMER_WHEEL_NUM_SLOTS - 1));
+    snTimer* timers;
+    
+    takeSlot(wheel, level, slot, &timers);
+    
+    while (timers)
+    {
+        snTimer* timer = timers;
+        unlinkTimer(timer);
+        insertTimer(wheel, timer);
+    }
+}
+
+void snTimerWheel_init(snTimerWheel* wheel)
+{
+    memset(wheel, 0, sizeof(snTimerWheel));
+    wheel->currentTime = snTimerWheel_getMonotonicTime();
+    wheel->advanceTime = wheel->currentTime - 1;
+}
+
+void snTimerWheel_deinit(snTimerWheel* wheel)
+{
+    int level, slot;
+    
+    for (level = 0; level < SN_TIMER_WHEEL_NUM_LEVELS; level++)
+    {
+        for (slot = 0; slot < SN_TIMER_WHEEL_NUM_SLOTS; slot++)
+        {
+            while (wheel->slots[level][slot])
+            {
+                snTimer_cancel(wheel->slots[level][slot]);
+            }
+        }
+    }
+}
+
+int snTimerWheel_advance(snTimerWheel* wheel)
+{
+    const long long now = snTimerWheel_getMonotonicTime();
+    int numFiredTimers = 0;
+    int level;
+    
+    wheel->advanceTime = now;
+    
+    while (wheel->numTimers > 0 && wheel->currentTime <= now)
+    {
+        const long long tick = wheel->currentTime;
+        const int slot = (int)(tick & (SN_TIMER_WHEEL_NUM_SLOTS - 1));
+        
+        /*higher levels first, since their timers may land on lower levels
+          that are cascaded at the same tick*/
+        for (level = SN_TIMER_WHEEL_NUM_LEVELS - 1; level > 0; level--)
+        {
+            if ((tick & (SN_SLOT_SPAN(level) - 1)) == 0)
+            {
+                cascade(wheel, level);
+            }
+        }
+        
+        const int distance = findOccupiedSlot(wheel, 0, slot);
+        
+        if (distance == 0)
+        {
+            snTimer* expiredTimers;
+            takeSlot(wheel, 0, slot, &expiredTimers);
+            
+            wheel->currentTime = tick + 1;
+            
+            while (expiredTimers)
+            {
+                snTimer* timer = expiredTimers;
+                snTimer_cancel(timer);
+                timer->callback(timer->userData);
+                numFiredTimers++;
+            }
+        }
+        else
+        {
+            /*skip to the next timer or the next cascade, whichever comes first*/
+            long long nextTick = (tick | (SN_TIMER_WHEEL_NUM_SLOTS - 1)) + 1;
+            if (distance > 0 && slot + distance < SN_TIMER_WHEEL_NUM_SLOTS)
+            {
+                nextTick = tick + distance;
+            }
+            wheel->currentTime = nextTick < now + 1 ? nextTick : now + 1;
+        }
+    }
+    
+    if (wheel->numTimers == 0 && wheel->currentTime <= now)
+    {
+        wheel->currentTime = now + 1;
+    }
+    
+    return numFiredTimers;
+}
+
+int snTimerWheel_getTimeUntilNextTimer(snTimerWheel* wheel)
+{
+    long long nextTime = LLONG_MAX;
+    int level;
+    
+    if (wheel->numTimers == 0)
+    {
+        return -1;
+    }
+    
+    /*level 0 slots map to exact ticks*/
+    int distance = findOccupiedSlot(wheel, 0, (int)(wheel->currentTime & (SN_TIMER_WHEEL_NUM_SLOTS - 1)));
+    if (distance >= 0)
+    {
+        nextTime = wheel->currentTime + distance;
+    }
+    
+    /*for higher levels, use the time the first occupied slot is cascaded*/
+    for (level = 1; level < SN_TIMER_WHEEL_NUM_LEVELS; level++)
+    {
+        const long long period = wheel->currentTime >> (SN_TIMER_WHEEL_SLOT_BITS * level);
+        const int slot = (int)(period & (SN_TIMER_WHEEL_NUM_SLOTS - 1));
+        
+        distance = findOccupiedSlot(wheel, level, slot);
+        if (distance < 0)
+        {
+            continue;
+        }
+        
+        if (distance == 0 && (wheel->currentTime & (SN_SLOT_SPAN(level) - 1)) != 0)
+        {
+            /*the slot of the current period has been cascaded already, so
+              its timers belong to the next lap. look for an earlier slot.*/
+            const int nextDistance = findOccupiedSlot(wheel, level, (slot + 1) & (SN_TIMER_WHEEL_NUM_SLOTS - 1));
+            distance = nextDistance == SN_TIMER_WHEEL_NUM_SLOTS - 1 ? SN_TIMER_WHEEL_NUM_SLOTS : nextDistance + 1;
+        }
+        
+        const long long cascadeTime = (period + distance) << (SN_TIMER_WHEEL_SLOT_BITS * level);
+        if (cascadeTime < nextTime)
+        {
+            nextTime = cascadeTime;
+        }
+    }
+    
+    const long long timeUntilNextTimer = nextTime - snTimerWheel_getMonotonicTime();
+    
+    if (timeUntilNextTimer <= 0)
+    {
+        return 0;
+    }
+    
+    return timeUntilNextTimer > INT_MAX ? INT_MAX : (int)timeUntilNextTimer;
+}
+
+void snTimerWheel_schedule(snTimerWheel* wheel, snTimer* timer, int delayMs)
+{
+    snTimerWheel_scheduleAt(wheel, timer, snTimerWheel_getMonotonicTime() + delayMs);
+}
+
+void snTimerWheel_scheduleAt(snTimerWheel* wheel, snTimer* timer, long long expiryTime)
+{
+    snTimer_cancel(timer);
+    
+    /*keeps callbacks that reschedule their timers from firing in a loop*/
+    timer->expiryTime = expiryTime > wheel->advanceTime ? expiryTime : wheel->advanceTime + 1;
+    timer->wheel = wheel;
+    wheel->numTimers++;
+    insertTimer(wheel, timer);
+}
+
+void snTimer_init(snTimer* timer, snTimerCallback callback, void* userData)
+{
+    memset(timer, 0, sizeof(snTimer));
+    timer->callback = callback;
+    timer->userData = userData;
+}
+
+void snTimer_cancel(snTimer* timer)
+{
+    if (timer->previousNext == NULL)
+    {
+        return;
+    }
+    
+    /*emptied slots are noticed by findOccupiedSlot*/
+    unlinkTimer(timer);
+    timer->wheel->numTimers--;
+    timer->wheel = NULL;
+}
+
+int snTimer_isScheduled(snTimer* timer)
+{
+    return timer->previousNext != NULL;
+}
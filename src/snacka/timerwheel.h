@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TIMER_WHEEL_H
+#define SN_TIMER_WHEEL_H
+
+#include <stdint.h>
+
+/*! \file */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /** The number of bits of the expiry time used to pick a slot on each level. */
+#define SN_TIMER_WHEEL_SLOT_BITS 6
+    
+    /** */
+#define SN_TIMER_WHEEL_NUM_SLOTS (1 << SN_TIMER_WHEEL_SLOT_BITS)
+    
+    /**
+     * With millisecond ticks, four levels cover about 4.6 hours. Timers
+     * further ahead are kept on the last level until they come within range.
+     */
+#define SN_TIMER_WHEEL_NUM_LEVELS 4
+    
+    /**
+     * A function to invoke when a timer expires.
+     * @param userData The pointer passed to \c snTimer_init.
+     */
+    typedef void (*snTimerCallback)(void* userData);
+    
+    /**
+     * A one shot timer. Timers are owned by the caller, who must cancel
+     * them before freeing them.
+     */
+    typedef struct snTimer
+    {
+        /** The next timer in the same slot. */
+        struct snTimer* next;
+        /** The pointer pointing to this timer, or NULL if the timer is not scheduled. */
+        struct snTimer** previousNext;
+        /** The monotonic time in milliseconds when the timer expires. */
+        long long expiryTime;
+        /** The wheel the timer is scheduled on, or NULL. */
+        struct snTimerWheel* wheel;
+        /** */
+        snTimerCallback callback;
+        /** */
+        void* userData;
+    } snTimer;
+    
+    /**
+     * A hierarchical timing wheel with millisecond ticks, driven by a
+     * monotonic clock. Scheduling and cancelling timers is O(1), and advancing
+     * the wheel costs O(1) per expired timer plus a small amount per level
+     * crossed. A wheel is meant to be shared by all websockets polled by one
+     * thread, which makes a single clock reading per poll or loop iteration
+     * enough for all of them. A wheel may only be used by one thread at a time.
+     */
+    typedef struct snTimerWheel
+    {
+        /** The next tick to process. Every timer expiring earlier has fired. */
+        long long currentTime;
+        /** The clock reading of the latest advance. Timers scheduled by callbacks expire after it. */
+        long long advanceTime;
+        /** */
+        int numTimers;
+        /** Bit i is set if slot i of a level has timers. */
+        uint64_t occupiedSlots[SN_TIMER_WHEEL_NUM_LEVELS];
+        /** */
+        snTimer* slots[SN_TIMER_WHEEL_NUM_LEVELS][SN_TIMER_WHEEL_NUM_SLOTS];
+    } snTimerWheel;
+    
+    /**
+     * @return The time of a monotonic clock in milliseconds, unaffected by
+     * changes to the system time.
+     */
+    long long snTimerWheel_getMonotonicTime(void);
+    
+    /**
+     * Initializes an empty timer wheel.
+     * @param wheel The wheel to initialize.
+     */
+    void snTimerWheel_init(snTimerWheel* wheel);
+    
+    /**
+     * Cancels all timers scheduled on a wheel.
+     * @param wheel The wheel to deinitialize.
+     */
+    void snTimerWheel_deinit(snTimerWheel* wheel);
+    
+    /**
+     * Fires the timers that have expired, in order of expiry. Callbacks may
+     * schedule and cancel any timers, including the one that fired. Timers
+     * scheduled by callbacks fire at the next advance at the earliest.
+     * @param wheel The wheel.
+     * @return The number of timers that fired.
+     */
+    int snTimerWheel_advance(snTimerWheel* wheel);
+    
+    /**
+     * Gets a suitable timeout for waiting for I/O before the wheel
+     * has to be advanced.
+     * @param wheel The wheel.
+     * @return The time in milliseconds until the next timer expires, or -1 if
+     * there are no timers. May be earlier than the actual expiry time for
+     * timers far ahead, in which case the next call gives a later time.
+     */
+    int snTimerWheel_getTimeUntilNextTimer(snTimerWheel* wheel);
+    
+    /**
+     * Schedules a timer to fire after a given delay. If the timer is
+     * already scheduled, it is rescheduled.
+     * @param wheel The wheel.
+     * @param timer The timer.
+     * @param delayMs The delay in milliseconds.
+     */
+    void snTimerWheel_schedule(snTimerWheel* wheel, snTimer* timer, int delayMs);
+    
+    /**
+     * Schedules a timer to fire at a given time. If the timer is
+     * already scheduled, it is rescheduled.
+     * @param wheel The wheel.
+     * @param timer The timer.
+     * @param expiryTime The time as returned by \c snTimerWheel_getMonotonicTime.
+     */
+    void snTimerWheel_scheduleAt(snTimerWheel* wheel, snTimer* timer, long long expiryTime);
+    
+    /**
+     * Initializes a timer that is not scheduled.
+     * @param timer The timer to initialize.
+     * @param callback The function to call when the timer fires.
+     * @param userData A pointer to pass to \c callback.
+     */
+    void snTimer_init(snTimer* timer, snTimerCallback callback, void* userData);
+    
+    /**
+     * Cancels a timer. Does nothing if the timer is not scheduled.
+     * @param timer The timer.
+     */
+    void snTimer_cancel(snTimer* timer);
+    
+    /**
+     * @param timer The timer.
+     * @return Non-zero if the timer is scheduled and has not fired yet.
+     */
+    int snTimer_isScheduled(snTimer* timer);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_TIMER_WHEEL_H*/
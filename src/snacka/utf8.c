@@ -1,6 +1,11 @@
 #include <string.h>
+#include "cpufeatures.h"
 #include "utf8.h"
 
+#ifdef SN_HAS_X86_SIMD_KERNELS
+#include <immintrin.h>
+#endif
+
 /* Copyright (c) 2008-2009 Bjoern Hoehrmann <bjoern@hoehrmann.de>
   See http://bjoern.hoehrmann.de/utf-8/decoder/dfa/ for details. */
 
@@ -39,41 +44,459 @@ static uint32_t decode(uint32_t* state, uint32_t* codep, uint32_t byte)
 }
 
 
-static int countCodePoints(uint8_t* s, size_t* count)
+static int validateDFA(const uint8_t* bytes, int numBytes, uint32_t* state)
 {
-    uint32_t codepoint;
-    uint32_t state = 0;
+    int i;
+    for (i = 0; i < numBytes; i++)
+    {
+        uint32_t codepoint;
+        if (decode(state, &codepoint, bytes[i]) == UTF8_REJECT)
+        {
+            return 0;
+        }
+    }
     
-    for (*count = 0; *s; ++s)
+    return 1;
+}
+
+/**
+ * Runs the state machine without decoding code points, skipping
+ * runs of ASCII bytes eight at a time between code points.
+ */
+static int validateScalar(const uint8_t* bytes, int numBytes, uint32_t* state)
+{
+    uint32_t s = *state;
+    int i = 0;
+    
+    while (i < numBytes)
     {
-        if (!decode(&state, &codepoint, *s))
+        if (s == UTF8_ACCEPT)
+        {
+            while (i + 8 <= numBytes)
+            {
+                uint64_t word;
+                memcpy(&word, &bytes[i], 8);
+                if (word & 0x8080808080808080ULL)
+                {
+                    break;
+                }
+                i += 8;
+            }
+            
+            if (i == numBytes)
+            {
+                break;
+            }
+        }
+        
+        s = utf8d[256 + s * 16 + utf8d[bytes[i]]];
+        if (s == UTF8_REJECT)
         {
-            *count += 1;
+            *state = s;
+            return 0;
         }
+        i++;
     }
     
-    return state != UTF8_ACCEPT;
+    *state = s;
+    return 1;
 }
 
-int snUTF8ValidateStringIncremental(uint8_t* firstByte, int numBytes, uint32_t* state)
+/**
+ * Validates whole blocks of bytes starting at a code point boundary.
+ * A code point at the end of the last block may be incomplete.
+ * @return The number of validated bytes, or -1 if the bytes are not valid UTF-8.
+ */
+typedef int (*snUTF8BlockKernel)(const uint8_t* bytes, int numBytes);
+
+/**
+ * Returns the number of bytes at the end of a block of valid UTF-8 that
+ * belong to an incomplete code point.
+ */
+static int getNumIncompleteBytes(const uint8_t* end)
 {
     int i;
-    for (i = 0; i < numBytes; i++)
+    for (i = 1; i <= 3; i++)
     {
-        uint32_t codepoint;
-        if (decode(state, &codepoint, firstByte[i]) == UTF8_REJECT)
+        const uint8_t b = end[-i];
+        if (b >= 0xc0)
+        {
+            /*a lead byte. does the sequence fit?*/
+            const int sequenceLength = b >= 0xf0 ? 4 : (b >= 0xe0 ? 3 : 2);
+            return i < sequenceLength ? i : 0;
+        }
+        else if (b < 0x80)
         {
             return 0;
         }
     }
     
-    return 1;
+    return 0;
+}
+
+/**
+ * Validates bytes using a block kernel for the bulk of the data and the
+ * state machine for the bytes before the first and after the last code point
+ * boundary, so that code points may be split across calls.
+ */
+static int validateWithBlockKernel(snUTF8BlockKernel kernel,
+                                   int blockSize,
+                                   const uint8_t* bytes,
+                                   int numBytes,
+                                   uint32_t* state)
+{
+    int i = 0;
+    
+    /*finish a code point started in a previous call*/
+    while (i < numBytes && *state != UTF8_ACCEPT)
+    {
+        *state = utf8d[256 + *state * 16 + utf8d[bytes[i]]];
+        if (*state == UTF8_REJECT)
+        {
+            return 0;
+        }
+        i++;
+    }
+    
+    if (numBytes - i >= blockSize)
+    {
+        const int numValidatedBytes = kernel(&bytes[i], numBytes - i);
+        if (numValidatedBytes < 0)
+        {
+            *state = UTF8_REJECT;
+            return 0;
+        }
+        
+        i += numValidatedBytes;
+        i -= getNumIncompleteBytes(&bytes[i]);
+    }
+    
+    return validateScalar(&bytes[i], numBytes - i, state);
+}
+
+#ifdef SN_HAS_X86_SIMD_KERNELS
+
+/*
+ The SIMD kernels implement the lookup algorithm from "Validating UTF-8
+ In Less Than One Instruction Per Byte" by John Keiser and Daniel Lemire.
+ Each byte is classified by looking up the high nibble of the previous byte
+ and both nibbles of the byte itself in three tables. The AND of the results
+ is non-zero for invalid two byte sequences. Three and four byte sequences
+ are checked by comparing the expected and actual continuation bytes.
+ */
+
+/** A lead byte or ASCII followed by a lead byte or ASCII. */
+#define SN_UTF8_TOO_SHORT (1 << 0)
+/** ASCII followed by a continuation byte. */
+#define SN_UTF8_TOO_LONG (1 << 1)
+/** A three byte sequence encoding a code point below U+0800. */
+#define SN_UTF8_OVERLONG_3 (1 << 2)
+/** A code point above U+10FFFF. */
+#define SN_UTF8_TOO_LARGE (1 << 3)
+/** A code point in the surrogate range U+D800 to U+DFFF. */
+#define SN_UTF8_SURROGATE (1 << 4)
+/** A two byte sequence encoding a code point below U+0080. */
+#define SN_UTF8_OVERLONG_2 (1 << 5)
+/** A four byte sequence starting with F4 encoding a code point above U+10FFFF. */
+#define SN_UTF8_TOO_LARGE_1000 (1 << 6)
+/** A four byte sequence encoding a code point below U+10000. Shares a bit with \c SN_UTF8_TOO_LARGE_1000. */
+#define SN_UTF8_OVERLONG_4 (1 << 6)
+/** Two continuation bytes in a row. */
+#define SN_UTF8_TWO_CONTS (1 << 7)
+/** Errors that depend only on the high nibble of the first byte. */
+#define SN_UTF8_CARRY (SN_UTF8_TOO_SHORT | SN_UTF8_TOO_LONG | SN_UTF8_TWO_CONTS)
+
+#define SN_UTF8_BYTE_1_HIGH_TABLE \
+    SN_UTF8_TOO_LONG, SN_UTF8_TOO_LONG, SN_UTF8_TOO_LONG, SN_UTF8_TOO_LONG, \
+    SN_UTF8_TOO_LONG, SN_UTF8_TOO_LONG, SN_UTF8_TOO_LONG, SN_UTF8_TOO_LONG, \
+    SN_UTF8_TWO_CONTS, SN_UTF8_TWO_CONTS, SN_UTF8_TWO_CONTS, SN_UTF8_TWO_CONTS, \
+    SN_UTF8_TOO_SHORT | SN_UTF8_OVERLONG_2, \
+    SN_UTF8_TOO_SHORT, \
+    SN_UTF8_TOO_SHORT | SN_UTF8_OVERLONG_3 | SN_UTF8_SURROGATE, \
+    SN_UTF8_TOO_SHORT | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000 | SN_UTF8_OVERLONG_4
+
+#define SN_UTF8_BYTE_1_LOW_TABLE \
+    SN_UTF8_CARRY | SN_UTF8_OVERLONG_3 | SN_UTF8_OVERLONG_2 | SN_UTF8_OVERLONG_4, \
+    SN_UTF8_CARRY | SN_UTF8_OVERLONG_2, \
+    SN_UTF8_CARRY, \
+    SN_UTF8_CARRY, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000 | SN_UTF8_SURROGATE, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000, \
+    SN_UTF8_CARRY | SN_UTF8_TOO_LARGE | SN_UTF8_TOO_LARGE_1000
+
+#define SN_UTF8_BYTE_2_HIGH_TABLE \
+    SN_UTF8_TOO_SHORT, SN_UTF8_TOO_SHORT, SN_UTF8_TOO_SHORT, SN_UTF8_TOO_SHORT, \
+    SN_UTF8_TOO_SHORT, SN_UTF8_TOO_SHORT, SN_UTF8_TOO_SHORT, SN_UTF8_TOO_SHORT, \
+    SN_UTF8_TOO_LONG | SN_UTF8_OVERLONG_2 | SN_UTF8_TWO_CONTS | SN_UTF8_OVERLONG_3 | SN_UTF8_TOO_LARGE_1000 | SN_UTF8_OVERLONG_4, \
+    SN_UTF8_TOO_LONG | SN_UTF8_OVERLONG_2 | SN_UTF8_TWO_CONTS | SN_UTF8_OVERLONG_3 | SN_UTF8_TOO_LARGE, \
+    SN_UTF8_TOO_LONG | SN_UTF8_OVERLONG_2 | SN_UTF8_TWO_CONTS | SN_UTF8_SURROGATE | SN_UTF8_TOO_LARGE, \
+    SN_UTF8_TOO_LONG | SN_UTF8_OVERLONG_2 | SN_UTF8_TWO_CONTS | SN_UTF8_SURROGATE | SN_UTF8_TOO_LARGE, \
+    SN_UTF8_TOO_SHORT, SN_UTF8_TOO_SHORT, SN_UTF8_TOO_SHORT, SN_UTF8_TOO_SHORT
+
+__attribute__((target("sse4.1")))
+static __m128i checkBlockSSE41(__m128i input, __m128i prevInput)
+{
+    const __m128i byte1HighTable = _mm_setr_epi8(SN_UTF8_BYTE_1_HIGH_TABLE);
+    const __m128i byte1LowTable = _mm_setr_epi8(SN_UTF8_BYTE_1_LOW_TABLE);
+    const __m128i byte2HighTable = _mm_setr_epi8(SN_UTF8_BYTE_2_HIGH_TABLE);
+    const __m128i nibbleMask = _mm_set1_epi8(0x0f);
+    
+    const __m128i prev1 = _mm_alignr_epi8(input, prevInput, 15);
+    const __m128i byte1High = _mm_shuffle_epi8(byte1HighTable, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibbleMask));
+    const __m128i byte1Low = _mm_shuffle_epi8(byte1LowTable, _mm_and_si128(prev1, nibbleMask));
+    const __m128i byte2High = _mm_shuffle_epi8(byte2HighTable, _mm_and_si128(_mm_srli_epi16(input, 4), nibbleMask));
+    const __m128i specialCases = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+    
+    /*the third and fourth bytes of a sequence must be continuation bytes*/
+    const __m128i prev2 = _mm_alignr_epi8(input, prevInput, 14);
+    const __m128i prev3 = _mm_alignr_epi8(input, prevInput, 13);
+    const __m128i isThirdByte = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xe0 - 0x80)));
+    const __m128i isFourthByte = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80)));
+    const __m128i mustBeContinuation = _mm_and_si128(_mm_or_si128(isThirdByte, isFourthByte),
+                                                     _mm_set1_epi8((char)0x80));
+    
+    return _mm_xor_si128(mustBeContinuation, specialCases);
+}
+
+__attribute__((target("sse4.1")))
+static int validateBlocksSSE41(const uint8_t* bytes, int numBytes)
+{
+    const __m128i maxCompleteValue = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+                                                   -1, -1, -1, -1, -1,
+                                                   (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+    __m128i error = _mm_setzero_si128();
+    __m128i prevInput = _mm_setzero_si128();
+    __m128i prevIncomplete = _mm_setzero_si128();
+    int i = 0;
+    
+    while (i + 16 <= numBytes)
+    {
+        /*skip ASCII 64 bytes at a time*/
+        if (i + 64 <= numBytes && _mm_testz_si128(prevIncomplete, prevIncomplete))
+        {
+            const __m128i in0 = _mm_loadu_si128((const __m128i*)&bytes[i]);
+            const __m128i in1 = _mm_loadu_si128((const __m128i*)&bytes[i + 16]);
+            const __m128i in2 = _mm_loadu_si128((const __m128i*)&bytes[i + 32]);
+            const __m128i in3 = _mm_loadu_si128((const __m128i*)&bytes[i + 48]);
+            const __m128i any = _mm_or_si128(_mm_or_si128(in0, in1), _mm_or_si128(in2, in3));
+            if (_mm_movemask_epi8(any) == 0)
+            {
+                prevInput = in3;
+                i += 64;
+                continue;
+            }
+        }
+        
+        const __m128i input = _mm_loadu_si128((const __m128i*)&bytes[i]);
+        if (_mm_movemask_epi8(input) == 0)
+        {
+            /*ASCII. only valid if the previous block ended with a complete code point.*/
+            error = _mm_or_si128(error, prevIncomplete);
+            prevIncomplete = _mm_setzero_si128();
+        }
+        else
+        {
+            error = _mm_or_si128(error, checkBlockSSE41(input, prevInput));
+            prevIncomplete = _mm_subs_epu8(input, maxCompleteValue);
+        }
+        prevInput = input;
+        i += 16;
+    }
+    
+    return _mm_testz_si128(error, error) ? i : -1;
+}
+
+/**
+ * Returns \c input shifted right by N bytes, with the last N bytes
+ * of \c prevInput shifted in.
+ */
+#define SN_UTF8_PREV_AVX2(input, prevInput, N) \
+    _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prevInput, input, 0x21), 16 - (N))
+
+__attribute__((target("avx2")))
+static __m256i checkBlockAVX2(__m256i input, __m256i prevInput)
+{
+    const __m256i byte1HighTable = _mm256_setr_epi8(SN_UTF8_BYTE_1_HIGH_TABLE, SN_UTF8_BYTE_1_HIGH_TABLE);
+    const __m256i byte1LowTable = _mm256_setr_epi8(SN_UTF8_BYTE_1_LOW_TABLE, SN_UTF8_BYTE_1_LOW_TABLE);
+    const __m256i byte2HighTable = _mm256_setr_epi8(SN_UTF8_BYTE_2_HIGH_TABLE, SN_UTF8_BYTE_2_HIGH_TABLE);
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0f);
+    
+    const __m256i prev1 = SN_UTF8_PREV_AVX2(input, prevInput, 1);
+    const __m256i byte1High = _mm256_shuffle_epi8(byte1HighTable, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibbleMask));
+    const __m256i byte1Low = _mm256_shuffle_epi8(byte1LowTable, _mm256_and_si256(prev1, nibbleMask));
+    const __m256i byte2High = _mm256_shuffle_epi8(byte2HighTable, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibbleMask));
+    const __m256i specialCases = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+    
+    /*the third and fourth bytes of a sequence must be continuation bytes*/
+    const __m256i prev2 = SN_UTF8_PREV_AVX2(input, prevInput, 2);
+    const __m256i prev3 = SN_UTF8_PREV_AVX2(input, prevInput, 3);
+    const __m256i isThirdByte = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80)));
+    const __m256i isFourthByte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80)));
+    const __m256i mustBeContinuation = _mm256_and_si256(_mm256_or_si256(isThirdByte, isFourthByte),
+                                                        _mm256_set1_epi8((char)0x80));
+    
+    return _mm256_xor_si256(mustBeContinuation, specialCases);
+}
+
+__attribute__((target("avx2")))
+static int validateBlocksAVX2(const uint8_t* bytes, int numBytes)
+{
+    const __m256i maxCompleteValue = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+                                                      -1, -1, -1, -1, -1, -1, -1, -1,
+                                                      -1, -1, -1, -1, -1, -1, -1, -1,
+                                                      -1, -1, -1, -1, -1,
+                                                      (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+    __m256i error = _mm256_setzero_si256();
+    __m256i prevInput = _mm256_setzero_si256();
+    __m256i prevIncomplete = _mm256_setzero_si256();
+    int i = 0;
+    
+    while (i + 32 <= numBytes)
+    {
+        /*skip ASCII 64 bytes at a time*/
+        if (i + 64 <= numBytes && _mm256_testz_si256(prevIncomplete, prevIncomplete))
+        {
+            const __m256i in0 = _mm256_loadu_si256((const __m256i*)&bytes[i]);
+            const __m256i in1 = _mm256_loadu_si256((const __m256i*)&bytes[i + 32]);
+            if (_mm256_movemask_epi8(_mm256_or_si256(in0, in1)) == 0)
+            {
+                prevInput = in1;
+                i += 64;
+                continue;
+            }
+        }
+        
+        const __m256i input = _mm256_loadu_si256((const __m256i*)&bytes[i]);
+        if (_mm256_movemask_epi8(input) == 0)
+        {
+            /*ASCII. only valid if the previous block ended with a complete code point.*/
+            error = _mm256_or_si256(error, prevIncomplete);
+            prevIncomplete = _mm256_setzero_si256();
+        }
+        else
+        {
+            error = _mm256_or_si256(error, checkBlockAVX2(input, prevInput));
+            prevIncomplete = _mm256_subs_epu8(input, maxCompleteValue);
+        }
+        prevInput = input;
+        i += 32;
+    }
+    
+    return _mm256_testz_si256(error, error) ? i : -1;
+}
+
+#endif /*SN_HAS_X86_SIMD_KERNELS*/
+
+int snUTF8IsKernelSupported(snUTF8Kernel kernel)
+{
+    switch (kernel)
+    {
+        case SN_UTF8_KERNEL_AUTO:
+        case SN_UTF8_KERNEL_DFA:
+        case SN_UTF8_KERNEL_SCALAR:
+        {
+            return 1;
+        }
+#ifdef SN_HAS_X86_SIMD_KERNELS
+        case SN_UTF8_KERNEL_SSE41:
+        {
+            return (snGetCPUFeatures() & SN_CPU_FEATURE_SSE41) != 0;
+        }
+        case SN_UTF8_KERNEL_AVX2:
+        {
+            return (snGetCPUFeatures() & SN_CPU_FEATURE_AVX2) != 0;
+        }
+#endif
+        default:
+            break;
+    }
+    
+    return 0;
+}
+
+/**
+ * Returns the fastest kernel supported by the CPU.
+ */
+static snUTF8Kernel getBestKernel(void)
+{
+    /*concurrent first calls pick the same kernel, so no locking is needed*/
+    static snUTF8Kernel bestKernel = SN_UTF8_KERNEL_AUTO;
+    
+    if (bestKernel == SN_UTF8_KERNEL_AUTO)
+    {
+        if (snUTF8IsKernelSupported(SN_UTF8_KERNEL_AVX2))
+        {
+            bestKernel = SN_UTF8_KERNEL_AVX2;
+        }
+        else if (snUTF8IsKernelSupported(SN_UTF8_KERNEL_SSE41))
+        {
+            bestKernel = SN_UTF8_KERNEL_SSE41;
+        }
+        else
+        {
+            bestKernel = SN_UTF8_KERNEL_SCALAR;
+        }
+    }
+    
+    return bestKernel;
+}
+
+int snUTF8ValidateStringIncrementalWithKernel(snUTF8Kernel kernel,
+                                              uint8_t* firstByte,
+                                              int numBytes,
+                                              uint32_t* state)
+{
+    if (kernel == SN_UTF8_KERNEL_AUTO)
+    {
+        kernel = getBestKernel();
+    }
+    else if (!snUTF8IsKernelSupported(kernel))
+    {
+        kernel = SN_UTF8_KERNEL_SCALAR;
+    }
+    
+    switch (kernel)
+    {
+        case SN_UTF8_KERNEL_DFA:
+        {
+            return validateDFA(firstByte, numBytes, state);
+        }
+#ifdef SN_HAS_X86_SIMD_KERNELS
+        case SN_UTF8_KERNEL_SSE41:
+        {
+            return validateWithBlockKernel(validateBlocksSSE41, 16, firstByte, numBytes, state);
+        }
+        case SN_UTF8_KERNEL_AVX2:
+        {
+            return validateWithBlockKernel(validateBlocksAVX2, 32, firstByte, numBytes, state);
+        }
+#endif
+        default:
+            break;
+    }
+    
+    return validateScalar(firstByte, numBytes, state);
+}
+
+int snUTF8ValidateStringIncremental(uint8_t* firstByte, int numBytes, uint32_t* state)
+{
+    return snUTF8ValidateStringIncrementalWithKernel(SN_UTF8_KERNEL_AUTO, firstByte, numBytes, state);
 }
 
 int snUTF8ValidateString(const char* string)
 {
-    int numCodePoints = 0;
-    int result = countCodePoints(string, &numCodePoints);
+    uint32_t state = UTF8_ACCEPT;
+    
+    snUTF8ValidateStringIncremental((uint8_t*)string, (int)strlen(string), &state);
     
-    return result == 0;
+    return state == UTF8_ACCEPT;
 }
@@ -32,10 +32,7 @@
 
 /*! \file */
 
-typedef unsigned char uint8_t;
-
-typedef unsigned int uint32_t;
-
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -52,6 +49,45 @@ extern "C"
      */
     int snUTF8ValidateStringIncremental(uint8_t* firstByte, int numBytes, uint32_t* state);
     
+    /**
+     * UTF-8 validation implementations.
+     */
+    typedef enum snUTF8Kernel
+    {
+        /** The fastest kernel supported by the CPU. */
+        SN_UTF8_KERNEL_AUTO = 0,
+        /** A byte at a time state machine. */
+        SN_UTF8_KERNEL_DFA,
+        /** The state machine, skipping ASCII eight bytes at a time. */
+        SN_UTF8_KERNEL_SCALAR,
+        /** 16 bytes at a time. Requires SSE4.1. */
+        SN_UTF8_KERNEL_SSE41,
+        /** 32 bytes at a time. Requires AVX2. */
+        SN_UTF8_KERNEL_AVX2
+    } snUTF8Kernel;
+    
+    /**
+     * Like \c snUTF8ValidateStringIncremental, but using a specific kernel.
+     * All kernels give the same results. Useful for testing and benchmarking.
+     * @param kernel The kernel to use. Falls back to \c SN_UTF8_KERNEL_SCALAR
+     * if not supported by the CPU.
+     * @param firstByte The first byte to process.
+     * @param numBytes The number of bytes to process.
+     * @param state On input, the initial validator state. On output, the validator
+     * state after processing the data.
+     */
+    int snUTF8ValidateStringIncrementalWithKernel(snUTF8Kernel kernel,
+                                                  uint8_t* firstByte,
+                                                  int numBytes,
+                                                  uint32_t* state);
+    
+    /**
+     * Checks if a UTF-8 validation kernel can be used on the current CPU.
+     * @param kernel The kernel to check.
+     * @return Non-zero if the kernel is supported.
+     */
+    int snUTF8IsKernelSupported(snUTF8Kernel kernel);
+    
     /** 
      * Checks if a string is valid UTF-8.
      * @param string The null terminated string to validate.
@@ -27,9 +27,14 @@
  * either expressed or implied, of the copyright holders.
  */
 
+/*for clock_gettime*/
+#define _POSIX_C_SOURCE 200112L
+
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
-#include <sys/time.h>
+#include <poll.h>
+#include <time.h>
 
 #include <uriparser/Uri.h>
 
@@ -41,13 +46,67 @@
 #include "logging.h"
 
 #include "frame.h"
+#include "masking.h"
+#include "random.h"
+#include "base64.h"
+#include "eventloop.h"
+#include "dispatcher.h"
+#include "reconnectscheduler.h"
 #include <stdarg.h>
 
 #define SN_DEFAULT_MAX_FRAME_SIZE 1 << 16
 
 #define SN_DEFAULT_WRITE_CHUNK_SIZE 1 << 16
 
-#define SN_CLOSING_HANDSHAKE_TIMEOUT 2.0 /*in seconds*/
+#define SN_DEFAULT_CONNECT_TIMEOUT 10000 /*in milliseconds*/
+
+#define SN_DEFAULT_OPENING_HANDSHAKE_TIMEOUT 10000 /*in milliseconds*/
+
+#define SN_DEFAULT_CLOSING_HANDSHAKE_TIMEOUT 2000 /*in milliseconds*/
+
+#define SN_DEFAULT_MAX_MISSED_PONGS 2
+
+#define SN_DEFAULT_RECONNECT_MIN_DELAY 100 /*in milliseconds*/
+
+#define SN_DEFAULT_RECONNECT_MAX_DELAY 30000 /*in milliseconds*/
+
+/** The size of a keepalive ping payload, a big endian sequence number. */
+#define SN_KEEPALIVE_PAYLOAD_SIZE 8
+
+/** The number of recent keepalive ping send times kept for matching late pongs. */
+#define SN_KEEPALIVE_HISTORY_SIZE 8
+
+#define SN_DEFAULT_READ_BUFFER_SIZE (1 << 14)
+
+#define SN_MIN_READ_BUFFER_SIZE (1 << 10)
+
+#define SN_MAX_READ_BUFFER_SIZE (1 << 20)
+
+#define SN_DEFAULT_MAX_READS_PER_POLL 64
+
+#define SN_DEFAULT_SEND_BUFFER_HIGH_WATERMARK (1 << 20)
+
+#define SN_DEFAULT_CLOSE_DRAIN_TIMEOUT 500 /*in milliseconds*/
+
+#define SN_MIN_SEND_QUEUE_SIZE (1 << 12)
+
+/** Empty send queues bigger than this are freed. */
+#define SN_MAX_RETAINED_SEND_QUEUE_SIZE (1 << 16)
+
+/** The size of the Sec-WebSocket-Key nonce before base64 encoding. */
+#define SN_HANDSHAKE_NONCE_SIZE 16
+
+/** The number of log2 frame size buckets used by the adaptive read buffer. */
+#define SN_FRAME_SIZE_HISTOGRAM_SIZE 32
+
+/** The time in milliseconds to block when there are neither descriptors nor a timeout to wait for. */
+#define SN_MAX_IDLE_WAIT 100
+
+/** The number of descriptors \c snWebsocket_waitForAnyEvents polls without allocating. */
+#define SN_MAX_STACK_POLL_DESCRIPTORS 8
+
+/** Frame size counts are halved when this many frames have been observed. */
+#define SN_FRAME_SIZE_HISTOGRAM_DECAY_COUNT 256
 
 /** */
 struct snWebsocket
@@ -72,20 +131,75 @@ struct snWebsocket
     snMutableString query;
     /** The maximum size of a frame, i.e header + payload. */
     int maxFrameSize;
-    /** Buffer used for storing frames. */
-    char* readBuffer;
+    /** The maximum size of a text or binary message. */
+    int maxMessageSize;
+    /** 
+     * Buffer that incoming socket data is read into. Has room for one
+     * extra byte, used for null terminating text messages in place.
+     */
+    char* receiveBuffer;
+    /** The size of \c receiveBuffer in bytes, not counting the extra byte. */
+    int receiveBufferSize;
+    /** The offset of the first unprocessed byte in \c receiveBuffer. */
+    int receiveBufferReadPosition;
+    /** The offset just past the last received byte in \c receiveBuffer. */
+    int receiveBufferWritePosition;
+    /** If non-zero, messages are delivered straight from \c receiveBuffer when possible. */
+    int zeroCopyReceive;
+    /** If non-zero, \c receiveBuffer is resized based on received frame sizes. */
+    int adaptiveReceiveBufferSize;
+    /** The maximum number of bytes to read per poll, or 0 for no limit. */
+    int maxBytesPerPoll;
+    /** The maximum number of read calls per poll. */
+    int maxReadsPerPoll;
+    /** Decaying counts of received frame sizes, bucketed by log2 of the size. */
+    unsigned int frameSizeHistogram[SN_FRAME_SIZE_HISTOGRAM_SIZE];
+    /** The sum of the counts in \c frameSizeHistogram. */
+    unsigned int numObservedFrames;
     /** */
     int writeChunkSize;
-    /** */
+    /** Buffer used for masking outgoing payloads. Allocated on the first send. */
     char* writeChunkBuffer;
+    /** Outgoing bytes that the I/O object could not accept yet, in order. */
+    char* sendQueue;
+    /** The size of \c sendQueue in bytes. */
+    int sendQueueCapacity;
+    /** The offset of the first unsent byte in \c sendQueue. */
+    int sendQueueStart;
+    /** The offset just past the last queued byte in \c sendQueue. */
+    int sendQueueEnd;
+    /** */
+    int sendBufferHighWatermark;
+    /** */
+    int sendBufferLowWatermark;
+    /** Non-zero if the high watermark has been exceeded and \c writableCallback is pending. */
+    int isAboveSendBufferHighWatermark;
+    /** In milliseconds. */
+    int closeDrainTimeout;
+    /** Non-zero while queued data is sent before dropping the connection. */
+    int isDrainingSendQueue;
+    /** The state when draining started, which decides what callbacks to invoke once closed. */
+    snReadyState stateBeforeDraining;
+    /** */
+    snWritableCallback writableCallback;
+    /** Non-zero if the last poll stopped reading because of the per poll limits. */
+    int hasUnreadInput;
+    /** The event loop driving this websocket, if any. */
+    snEventLoop* eventLoop;
+    /** Owned by \c eventLoop. */
+    void* eventLoopEntry;
+    /** The queue messages are handed to, if any. */
+    snSerialQueue* messageQueue;
+    /** The application's message callback, when messages are handed to \c messageQueue. */
+    snMessageCallback dispatchedMessageCallback;
+    /** Generates masking keys and handshake nonces. */
+    snRandom random;
     /** */
     int isWaitingForSocketConnection;
     /** */
     int hasCompletedOpeningHandshake;
     /** */
     int hasSentCloseFrame;
-    /** Timer used to force disconnect if the closing handshake is too slow. */
-    float closingHandshakeTimer;
     /** */
     snOpeningHandshakeParsingCallback openingHandshakeParsingCallback;
     /** */
@@ -102,9 +216,70 @@ struct snWebsocket
     void* callbackData;
     /** */
     snLogCallback logCallback;
+    /** Drives the timers unless the application provides a shared wheel. */
+    snTimerWheel ownTimerWheel;
+    /** The wheel the timers are scheduled on. */
+    snTimerWheel* timerWheel;
+    /** Runs from connecting until the socket is open. */
+    snTimer connectTimer;
+    /** Runs from sending the opening handshake until it completes. */
+    snTimer openingHandshakeTimer;
+    /** Runs from sending a close frame until the connection is closed. */
+    snTimer closingHandshakeTimer;
+    /** In milliseconds, negative for no timeout. */
+    int connectTimeout;
+    /** In milliseconds, negative for no timeout. */
+    int openingHandshakeTimeout;
+    /** In milliseconds, negative for no timeout. */
+    int closingHandshakeTimeout;
+    /** Sends a keepalive ping every \c keepaliveInterval while open. */
+    snTimer keepaliveTimer;
+    /** In milliseconds, 0 if keepalive pings are disabled. */
+    int keepaliveInterval;
     /** */
-    double prevPollTime;
-    
+    int maxMissedPongs;
+    /** The sequence number of the latest keepalive ping. */
+    unsigned long long keepaliveSequence;
+    /** Non-zero if the latest keepalive ping has not been answered. */
+    int isWaitingForPong;
+    /** Send times in microseconds of recent keepalive pings, indexed by sequence number. */
+    long long keepalivePingTimes[SN_KEEPALIVE_HISTORY_SIZE];
+    /** */
+    snRoundTripStats roundTripStats;
+    /** Non-zero if the websocket reconnects when the connection fails or is lost. */
+    int autoReconnect;
+    /** In milliseconds. */
+    int reconnectMinDelay;
+    /** In milliseconds. */
+    int reconnectMaxDelay;
+    /** The previous reconnect delay in milliseconds, or 0 before the first reconnect. */
+    int reconnectDelay;
+    /** The number of reconnects since the connection was last open. */
+    int numReconnectAttempts;
+    /** Fires when it's time to reconnect. */
+    snTimer reconnectTimer;
+    /** The URL passed to \c snWebsocket_connect. */
+    snMutableString reconnectUrl;
+    /** Non-zero if the application has disconnected, which stops reconnecting. */
+    int isDisconnectRequested;
+    /** Non-zero while a reconnect holds one of the reconnect scheduler's handshake slots. */
+    int isHoldingHandshakeSlot;
+    /** */
+    snReconnectCallback reconnectCallback;
+    /** Non-zero if the opening handshake request is sent in the SYN using TCP Fast Open, if possible. */
+    int tcpFastOpen;
+    /** Non-zero if the I/O object was given the opening handshake request when connecting. */
+    int hasSentOpeningHandshakeEarly;
+    /** Non-zero if permessage-deflate is offered when connecting. */
+    int hasPerMessageDeflateOffer;
+    /** */
+    snPerMessageDeflateOptions perMessageDeflateOffer;
+    /** Non-zero if permessage-deflate was negotiated for the current connection. */
+    int isPerMessageDeflateActive;
+    /** Valid if \c isPerMessageDeflateActive is non-zero. */
+    snPerMessageDeflate perMessageDeflate;
+    /** Non-zero if the websocket is the server end of an accepted connection. */
+    int isServer;
 };
 
 static void log(snWebsocket* sn, const char* message, ...)
@@ -120,256 +295,946 @@ static void log(snWebsocket* sn, const char* message, ...)
 }
 
 static void disconnectWithStatus(snWebsocket* ws, snStatusCode status, snError error);
+void transitionToStateAndInvokeStateCallback(snWebsocket* ws, snReadyState state);
+
+static snError connectToUrl(snWebsocket* ws, const char* url);
+
+static void scheduleTimer(snWebsocket* ws, snTimer* timer, int timeoutMs)
+{
+    if (timeoutMs >= 0)
+    {
+        snTimerWheel_schedule(ws->timerWheel, timer, timeoutMs);
+    }
+}
 
-static int generateMaskingKey()
+static void cancelTimers(snWebsocket* ws)
 {
-    return rand();
+    snTimer_cancel(&ws->connectTimer);
+    snTimer_cancel(&ws->openingHandshakeTimer);
+    snTimer_cancel(&ws->closingHandshakeTimer);
+    snTimer_cancel(&ws->keepaliveTimer);
+    snTimer_cancel(&ws->reconnectTimer);
 }
 
+static void connectTimedOut(void* userData)
+{
+    disconnectWithStatus((snWebsocket*)userData, SN_STATUS_UNEXPECTED_ERROR, SN_CONNECT_TIMED_OUT);
+}
 
-snError snWebsocket_sendFrame(snWebsocket* ws, snOpcode opcode, int numPayloadBytes, const char* payload)
+static void openingHandshakeTimedOut(void* userData)
 {
-    /*TODO: refactor to allow for incremental sending.*/
+    disconnectWithStatus((snWebsocket*)userData, SN_STATUS_UNEXPECTED_ERROR, SN_OPENING_HANDSHAKE_TIMED_OUT);
+}
+
+static void closingHandshakeTimedOut(void* userData)
+{
+    disconnectWithStatus((snWebsocket*)userData, SN_STATUS_ENDPOINT_GOING_AWAY, SN_NO_ERROR);
+}
+
+/** Round trip times need better than millisecond resolution. */
+static long long getTimeMicroseconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void startKeepalive(snWebsocket* ws)
+{
+    memset(&ws->roundTripStats, 0, sizeof(snRoundTripStats));
+    ws->isWaitingForPong = 0;
     
-    if (ws->hasSentCloseFrame)
+    if (ws->keepaliveInterval > 0)
     {
-        return SN_NO_ERROR;
+        snTimerWheel_schedule(ws->timerWheel, &ws->keepaliveTimer, ws->keepaliveInterval);
     }
+}
+
+/**
+ * Counts an unanswered ping as missed and sends a new one, or drops the
+ * connection if too many pings in a row have been missed.
+ */
+static void keepaliveTimerFired(void* userData)
+{
+    snWebsocket* ws = (snWebsocket*)userData;
+    char payload[SN_KEEPALIVE_PAYLOAD_SIZE];
+    int i;
     
-    if (ws->websocketState != SN_STATE_OPEN)
+    if (ws->isWaitingForPong)
     {
-        return SN_WEBSOCKET_CONNECTION_IS_NOT_OPEN;
+        ws->roundTripStats.numMissedPongs++;
+        if (ws->roundTripStats.numMissedPongs >= ws->maxMissedPongs)
+        {
+            /*the peer is gone, so don't wait for a closing handshake*/
+            disconnectWithStatus(ws, SN_STATUS_ENDPOINT_GOING_AWAY, SN_KEEPALIVE_TIMED_OUT);
+            return;
+        }
     }
     
-    snFrame f;
-    f.header.opcode = opcode;
-    f.header.isMasked = 1;
-    f.header.maskingKey = generateMaskingKey();
-    f.header.isFinal = 1;
-    f.header.payloadSize = numPayloadBytes;
+    ws->keepaliveSequence++;
+    for (i = 0; i < SN_KEEPALIVE_PAYLOAD_SIZE; i++)
+    {
+        payload[i] = (char)(ws->keepaliveSequence >> (8 * (SN_KEEPALIVE_PAYLOAD_SIZE - 1 - i)));
+    }
+    ws->keepalivePingTimes[ws->keepaliveSequence % SN_KEEPALIVE_HISTORY_SIZE] = getTimeMicroseconds();
+    ws->isWaitingForPong = 1;
     
-    snError validationResult = snFrameHeader_validate(&f.header);
+    snTimerWheel_schedule(ws->timerWheel, &ws->keepaliveTimer, ws->keepaliveInterval);
+    snWebsocket_sendPing(ws, SN_KEEPALIVE_PAYLOAD_SIZE, payload);
+}
+
+/**
+ * Updates the round trip time statistics if a pong answers one of
+ * the recent keepalive pings. Other pongs are ignored.
+ */
+static void handlePong(snWebsocket* ws, const snFrame* frame)
+{
+    snRoundTripStats* stats = &ws->roundTripStats;
+    unsigned long long sequence = 0;
+    int i;
     
-    if (validationResult != SN_NO_ERROR)
+    if (ws->keepaliveInterval <= 0 ||
+        frame->header.payloadSize != SN_KEEPALIVE_PAYLOAD_SIZE)
     {
-        return validationResult;
+        return;
     }
     
-    f.payload = payload;
+    for (i = 0; i < SN_KEEPALIVE_PAYLOAD_SIZE; i++)
+    {
+        sequence = (sequence << 8) | (unsigned char)frame->payload[i];
+    }
     
-    unsigned long long payloadSize = f.header.payloadSize;
-    char headerBytes[SN_MAX_HEADER_SIZE];
-    int headerSize = 0;
-    snFrameHeader_toBytes(&f.header, headerBytes, &headerSize);
+    if (sequence == 0 ||
+        sequence > ws->keepaliveSequence ||
+        ws->keepaliveSequence - sequence >= SN_KEEPALIVE_HISTORY_SIZE)
+    {
+        return;
+    }
     
-    assert(payloadSize + headerSize <= ws->maxFrameSize);
+    const double roundTripTime = (getTimeMicroseconds() - ws->keepalivePingTimes[sequence % SN_KEEPALIVE_HISTORY_SIZE]) / 1000.0;
     
-    /*send header*/
-    int nBytesWritten = 0;
-    snError sendResult = ws->ioCallbacks.writeCallback(ws->ioObject,
-                                                       headerBytes,
-                                                       headerSize,
-                                                       &nBytesWritten);
-    if (sendResult != SN_NO_ERROR)
+    if (stats->numPongs == 0)
     {
-        disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, sendResult);
-        return sendResult;
+        stats->smoothedRoundTripTime = roundTripTime;
+        stats->jitter = roundTripTime / 2;
+        stats->minRoundTripTime = roundTripTime;
+        stats->maxRoundTripTime = roundTripTime;
     }
-    
-    /*send masked payload in chunks*/
-    int numBytesSent = 0;
-    while (numBytesSent < payloadSize)
+    else
     {
-        const int numBytesLeft = payloadSize - numBytesSent;
-        const int chunkSize = numBytesLeft < ws->writeChunkSize ? numBytesLeft : ws->writeChunkSize;
-        /*copy the current chunk into the write buffer*/
-        memcpy(ws->writeChunkBuffer, &f.payload[numBytesSent], chunkSize);
-        /*apply mask in place*/
-        snFrameHeader_applyMask(&f.header, ws->writeChunkBuffer, chunkSize, numBytesSent);
-        /*send masked bytes*/
-        snError sendResult = ws->ioCallbacks.writeCallback(ws->ioObject,
-                                                           ws->writeChunkBuffer,
-                                                           chunkSize,
-                                                           &nBytesWritten);
-        if (sendResult != SN_NO_ERROR)
+        const double deviation = roundTripTime > stats->smoothedRoundTripTime ?
+                                 roundTripTime - stats->smoothedRoundTripTime :
+                                 stats->smoothedRoundTripTime - roundTripTime;
+        stats->jitter = 0.75 * stats->jitter + 0.25 * deviation;
+        stats->smoothedRoundTripTime = 0.875 * stats->smoothedRoundTripTime + 0.125 * roundTripTime;
+        
+        if (roundTripTime < stats->minRoundTripTime)
         {
-            disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, sendResult);
-            return sendResult;
+            stats->minRoundTripTime = roundTripTime;
+        }
+        if (roundTripTime > stats->maxRoundTripTime)
+        {
+            stats->maxRoundTripTime = roundTripTime;
         }
-        /*move to the next chunk*/
-        numBytesSent += chunkSize;
     }
     
-    return SN_NO_ERROR;
+    stats->latestRoundTripTime = roundTripTime;
+    stats->numPongs++;
+    
+    /*a late pong still shows that the peer is alive*/
+    stats->numMissedPongs = 0;
+    if (sequence == ws->keepaliveSequence)
+    {
+        ws->isWaitingForPong = 0;
+    }
 }
 
-static void sendCloseFrame(snWebsocket* ws, snStatusCode code)
+/**
+ * Returns a new non-zero masking key from the websocket's own generator.
+ * Keys come from a batch of pregenerated random words.
+ */
+static int generateMaskingKey(snWebsocket* ws)
 {
-    if (ws->hasSentCloseFrame)
+    uint32_t key = 0;
+    while (key == 0)
     {
-        return;
+        key = snRandom_next(&ws->random);
     }
     
-    ws->closingHandshakeTimer = 0.0f;
+    return (int)key;
+}
+
+/**
+ * Appends bytes to the send queue, growing it if needed.
+ */
+static void appendToSendQueue(snWebsocket* ws, const char* bytes, int numBytes)
+{
+    if (numBytes == 0)
+    {
+        return;
+    }
     
-    char payload[2] = { (code >> 8) , (code >> 0) };
+    if (ws->sendQueueEnd + numBytes > ws->sendQueueCapacity && ws->sendQueueStart > 0)
+    {
+        /*reclaim the space taken up by bytes that have been sent*/
+        memmove(ws->sendQueue,
+                &ws->sendQueue[ws->sendQueueStart],
+                ws->sendQueueEnd - ws->sendQueueStart);
+        ws->sendQueueEnd -= ws->sendQueueStart;
+        ws->sendQueueStart = 0;
+    }
     
-    snWebsocket_sendFrame(ws, SN_OPCODE_CONNECTION_CLOSE, 2, payload);
+    if (ws->sendQueueEnd + numBytes > ws->sendQueueCapacity)
+    {
+        const int requiredCapacity = ws->sendQueueEnd + numBytes;
+        int newCapacity = ws->sendQueueCapacity > 0 ? ws->sendQueueCapacity : SN_MIN_SEND_QUEUE_SIZE;
+        while (newCapacity < requiredCapacity)
+        {
+            newCapacity = newCapacity <= INT_MAX / 2 ? 2 * newCapacity : requiredCapacity;
+        }
+        
+        ws->sendQueue = realloc(ws->sendQueue, newCapacity);
+        ws->sendQueueCapacity = newCapacity;
+    }
     
-    ws->hasSentCloseFrame = 1;
+    memcpy(&ws->sendQueue[ws->sendQueueEnd], bytes, numBytes);
+    ws->sendQueueEnd += numBytes;
 }
 
 /**
- * Intercepts state changes before passing them on to the user defined callback.
+ * Discards any queued outgoing bytes.
  */
-void transitionToStateAndInvokeStateCallback(snWebsocket* ws, snReadyState state)
+static void clearSendQueue(snWebsocket* ws)
 {
-    const int oldState = ws->websocketState;
-    ws->websocketState = state;
+    free(ws->sendQueue);
+    ws->sendQueue = NULL;
+    ws->sendQueueCapacity = 0;
+    ws->sendQueueStart = 0;
+    ws->sendQueueEnd = 0;
+    ws->isAboveSendBufferHighWatermark = 0;
+}
+
+/**
+ * Invokes the writable callback if the amount of buffered data has dropped
+ * to the low watermark after exceeding the high watermark.
+ */
+static void updateSendBufferWatermarks(snWebsocket* ws)
+{
+    const int bufferedAmount = snWebsocket_getBufferedAmount(ws);
     
-    if (state == SN_STATE_OPEN && ws->openCallback)
-    {
-        ws->openCallback(ws->callbackData);
-    }
-    else if (state == SN_STATE_CLOSED && oldState == SN_STATE_CONNECTING && ws->closeCallback)
+    if (bufferedAmount > ws->sendBufferHighWatermark)
     {
-        /*an error occurred before completing the opening handshake*/
-        ws->closeCallback(ws->callbackData, SN_STATUS_UNEXPECTED_ERROR);
+        ws->isAboveSendBufferHighWatermark = 1;
     }
-    else if (state == SN_STATE_CLOSED && oldState == SN_STATE_OPEN && ws->closeCallback)
+    else if (ws->isAboveSendBufferHighWatermark && bufferedAmount <= ws->sendBufferLowWatermark)
     {
-        ws->closeCallback(ws->callbackData, SN_STATUS_ENDPOINT_GOING_AWAY);
+        ws->isAboveSendBufferHighWatermark = 0;
+        if (ws->writableCallback)
+        {
+            ws->writableCallback(ws->callbackData);
+        }
     }
 }
 
 /**
- *
+ * Writes as much of the send queue as the I/O object accepts without blocking.
  */
-static void disconnectWithStatus(snWebsocket* ws, snStatusCode status, snError error)
+static snError flushSendQueue(snWebsocket* ws)
 {
-    if (error == SN_NO_ERROR)
+    if (ws->sendQueueStart == ws->sendQueueEnd)
     {
-        sendCloseFrame(ws, status);
+        return SN_NO_ERROR;
     }
     
-    ws->ioCallbacks.disconnectCallback(ws->ioObject);
-    
-    /*if (ws->closeCallback)
+    int numBytesWritten = 0;
+    snError result = ws->ioCallbacks.writeCallback(ws->ioObject,
+                                                   &ws->sendQueue[ws->sendQueueStart],
+                                                   ws->sendQueueEnd - ws->sendQueueStart,
+                                                   &numBytesWritten);
+    if (result != SN_NO_ERROR)
     {
-        ws->closeCallback(ws->callbackData, status);
-    }*/
+        return result;
+    }
     
-    transitionToStateAndInvokeStateCallback(ws, SN_STATE_CLOSED);
+    ws->sendQueueStart += numBytesWritten;
     
-    if (error != SN_NO_ERROR && ws->errorCallback)
+    if (ws->sendQueueStart == ws->sendQueueEnd)
     {
-        ws->errorCallback(ws->callbackData, error);
+        ws->sendQueueStart = 0;
+        ws->sendQueueEnd = 0;
+        
+        if (ws->sendQueueCapacity > SN_MAX_RETAINED_SEND_QUEUE_SIZE)
+        {
+            free(ws->sendQueue);
+            ws->sendQueue = NULL;
+            ws->sendQueueCapacity = 0;
+        }
     }
+    
+    updateSendBufferWatermarks(ws);
+    
+    return SN_NO_ERROR;
 }
 
-static int isValidCloseCode(int code)
+/**
+ * Starts sending any queued outgoing bytes before the connection is dropped,
+ * without blocking. The websocket stays in the closing state while the rest
+ * of the queue is flushed by \c snWebsocket_poll as the socket becomes writable,
+ * for at most \c closeDrainTimeout milliseconds.
+ * @return Non-zero if the connection should be kept until the queue has drained.
+ */
+static int startDrainingSendQueue(snWebsocket* ws)
 {
-    switch (code)
+    if (ws->closeDrainTimeout < 0 ||
+        flushSendQueue(ws) != SN_NO_ERROR ||
+        snWebsocket_getBufferedAmount(ws) == 0)
     {
-        case SN_STATUS_NORMAL_CLOSURE:
-        case SN_STATUS_ENDPOINT_GOING_AWAY:
-        case SN_STATUS_PROTOCOL_ERROR:
-        case SN_STATUS_INVALID_DATA:
-        case SN_STATUS_INCONSISTENT_DATA:
-        case SN_STATUS_POLICY_VIOLATION:
-        case SN_STATUS_MESSAGE_TOO_BIG:
-        case SN_STATUS_MISSING_EXTENSION:
-        case SN_STATUS_UNEXPECTED_ERROR:
-        {
-            return 1;
-        }
-        default:
-            break;
+        return 0;
     }
     
-    /*https://tools.ietf.org/html/rfc6455#section-7.4.2*/
+    ws->isDrainingSendQueue = 1;
+    ws->stateBeforeDraining = ws->websocketState;
     
-    if (code >= 3000 && code <= 4999)
-    {
-        return 1;
-    }
+    /*the closing handshake timer doubles as the drain deadline*/
+    snTimerWheel_schedule(ws->timerWheel, &ws->closingHandshakeTimer, ws->closeDrainTimeout);
+    transitionToStateAndInvokeStateCallback(ws, SN_STATE_CLOSING);
     
-    return 0;
+    return 1;
 }
 
 /**
- * Intercepts parsed frames before passing them on to the user defined callback.
+ * Writes a sequence of buffers without blocking. Bytes that the I/O object
+ * does not accept right away are queued and written from \c snWebsocket_poll.
  */
-void invokeFrameCallback(void* data, const snFrame* frame)
+static snError sendBuffers(snWebsocket* ws, const snIOBuffer* buffers, int numBuffers)
 {
-    snWebsocket* ws = (snWebsocket*)data;
-    
-    snError headerValidationResult = snFrameHeader_validate(&frame->header);
-    if (headerValidationResult != SN_NO_ERROR)
-    {
-        disconnectWithStatus(ws, SN_STATUS_PROTOCOL_ERROR, headerValidationResult);
-        return;
-    }
-        
-    if (ws->frameCallback)
-    {
-        ws->frameCallback(ws->callbackData, frame);
-    }
+    int numBytesWritten = 0;
+    int i;
     
-    if (frame->header.opcode == SN_OPCODE_CONNECTION_CLOSE)
+    /*bytes can only be written directly if nothing is queued ahead of them*/
+    if (ws->sendQueueStart == ws->sendQueueEnd)
     {
+        snError result = SN_NO_ERROR;
         
-        int closeCode = SN_STATUS_NORMAL_CLOSURE;
-        if (frame->header.payloadSize == 1)
+        if (numBuffers > 1 && ws->ioCallbacks.writeVectorCallback)
         {
-            closeCode = SN_STATUS_PROTOCOL_ERROR;
+            result = ws->ioCallbacks.writeVectorCallback(ws->ioObject,
+                                                         buffers,
+                                                         numBuffers,
+                                                         &numBytesWritten);
         }
-        else if (frame->header.payloadSize >= 2)
+        else
         {
-            closeCode = (((unsigned char*)frame->payload)[0] << 8) |
-                        (((unsigned char*)frame->payload)[1] << 0);
-            if (!isValidCloseCode(closeCode))
-            {
-                closeCode = SN_STATUS_PROTOCOL_ERROR;
-            }
-            
-            const int messageSize = frame->header.payloadSize - 2;
-            char temp[256];
-            memcpy(temp, &frame->payload[2], messageSize);
-            temp[messageSize] = '\0';
-            if (!snUTF8ValidateString(temp))
+            for (i = 0; i < numBuffers && result == SN_NO_ERROR; i++)
             {
-                closeCode = SN_STATUS_INCONSISTENT_DATA;
+                int n = 0;
+                result = ws->ioCallbacks.writeCallback(ws->ioObject,
+                                                       buffers[i].bytes,
+                                                       buffers[i].numBytes,
+                                                       &n);
+                numBytesWritten += n;
+                if (n < buffers[i].numBytes)
+                {
+                    break;
+                }
             }
         }
         
-        sendCloseFrame(ws, closeCode);
-        disconnectWithStatus(ws, closeCode, SN_NO_ERROR);
+        if (result != SN_NO_ERROR)
+        {
+            return result;
+        }
     }
-    else if (frame->header.opcode == SN_OPCODE_PING)
+    
+    /*queue the bytes that were not written*/
+    for (i = 0; i < numBuffers; i++)
     {
-        snWebsocket_sendFrame(ws, SN_OPCODE_PONG, frame->header.payloadSize, frame->payload);
+        if (numBytesWritten >= buffers[i].numBytes)
+        {
+            numBytesWritten -= buffers[i].numBytes;
+            continue;
+        }
+        
+        appendToSendQueue(ws,
+                          &buffers[i].bytes[numBytesWritten],
+                          buffers[i].numBytes - numBytesWritten);
+        numBytesWritten = 0;
     }
+    
+    updateSendBufferWatermarks(ws);
+    
+    return SN_NO_ERROR;
 }
 
-static void setDefaultIOCallbacks(snIOCallbacks* ioc)
-{
-    ioc->connectCallback = snSocketConnectCallback;
-    ioc->isOpenCallback = snSocketIsOpenCallback;
-    ioc->deinitCallback = snSocketDeinitCallback;
-    ioc->disconnectCallback = snSocketDisconnectCallback;
-    ioc->initCallback = snSocketInitCallback;
-    ioc->readCallback = snSocketReadCallback;
-    ioc->writeCallback = snSocketWriteCallback;
-}
 
-void openingHandshakeParsingCallback(void* userData, snError result)
+snError snWebsocket_sendFrame(snWebsocket* ws, snOpcode opcode, int numPayloadBytes, const char* payload)
 {
-    snWebsocket* ws = (snWebsocket*)userData;
+    /*TODO: refactor to allow for incremental sending.*/
+    
+    if (ws->hasSentCloseFrame)
+    {
+        return SN_NO_ERROR;
+    }
+    
+    if (ws->websocketState != SN_STATE_OPEN)
+    {
+        return SN_WEBSOCKET_CONNECTION_IS_NOT_OPEN;
+    }
+    
+    int isCompressed = 0;
+    if (ws->isPerMessageDeflateActive &&
+        (opcode == SN_OPCODE_TEXT || opcode == SN_OPCODE_BINARY) &&
+        numPayloadBytes >= ws->perMessageDeflate.parameters.compressionThreshold)
+    {
+        const char* compressedPayload = NULL;
+        int numCompressedBytes = 0;
+        snError compressionResult = snPerMessageDeflate_compress(&ws->perMessageDeflate,
+                                                                 payload,
+                                                                 numPayloadBytes,
+                                                                 &compressedPayload,
+                                                                 &numCompressedBytes);
+        if (compressionResult != SN_NO_ERROR)
+        {
+            disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, compressionResult);
+            return compressionResult;
+        }
+        
+        /*with context takeover, the server must see every compressed message
+          to stay in sync. otherwise, messages that don't shrink are sent as they are.*/
+        if (numCompressedBytes < numPayloadBytes || !ws->perMessageDeflate.parameters.clientNoContextTakeover)
+        {
+            payload = compressedPayload;
+            numPayloadBytes = numCompressedBytes;
+            isCompressed = 1;
+        }
+    }
+    
+    snFrame f;
+    f.header.opcode = opcode;
+    f.header.isMasked = !ws->isServer;
+    f.header.maskingKey = ws->isServer ? 0 : generateMaskingKey(ws);
+    f.header.isFinal = 1;
+    f.header.isCompressed = isCompressed;
+    f.header.payloadSize = numPayloadBytes;
+    
+    snError validationResult = snFrameHeader_validate(&f.header);
+    
+    if (validationResult != SN_NO_ERROR)
+    {
+        return validationResult;
+    }
+    
+    f.payload = payload;
+    
+    unsigned long long payloadSize = f.header.payloadSize;
+    char headerBytes[SN_MAX_HEADER_SIZE];
+    int headerSize = 0;
+    snFrameHeader_toBytes(&f.header, headerBytes, &headerSize);
+    
+    assert(payloadSize + headerSize <= ws->maxFrameSize);
+    
+    if (!f.header.isMasked)
+    {
+        /*servers don't mask, so the payload can be sent without copying it*/
+        snIOBuffer buffers[2] =
+        {
+            {headerBytes, headerSize},
+            {f.payload, (int)payloadSize}
+        };
+        snError sendResult = sendBuffers(ws, buffers, 2);
+        if (sendResult != SN_NO_ERROR)
+        {
+            disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, sendResult);
+        }
+        return sendResult;
+    }
+    
+    if (ws->writeChunkBuffer == NULL)
+    {
+        /*leave room for a header in front of the first chunk*/
+        ws->writeChunkBuffer = malloc(SN_MAX_HEADER_SIZE + ws->writeChunkSize);
+    }
+    
+    char* chunkBytes = &ws->writeChunkBuffer[SN_MAX_HEADER_SIZE];
+    
+    /*send masked payload in chunks, the first one together with the header*/
+    int numBytesSent = 0;
+    do
+    {
+        const int numBytesLeft = payloadSize - numBytesSent;
+        const int chunkSize = numBytesLeft < ws->writeChunkSize ? numBytesLeft : ws->writeChunkSize;
+        /*copy and mask the current chunk in a single pass*/
+        snCopyMaskedPayload(f.header.maskingKey, &f.payload[numBytesSent], chunkBytes, chunkSize, numBytesSent);
+        
+        snError sendResult = SN_NO_ERROR;
+        if (numBytesSent > 0)
+        {
+            snIOBuffer buffer = {chunkBytes, chunkSize};
+            sendResult = sendBuffers(ws, &buffer, 1);
+        }
+        else if (ws->ioCallbacks.writeVectorCallback)
+        {
+            snIOBuffer buffers[2] =
+            {
+                {headerBytes, headerSize},
+                {chunkBytes, chunkSize}
+            };
+            sendResult = sendBuffers(ws, buffers, 2);
+        }
+        else
+        {
+            /*put the header right in front of the chunk*/
+            memcpy(chunkBytes - headerSize, headerBytes, headerSize);
+            snIOBuffer buffer = {chunkBytes - headerSize, headerSize + chunkSize};
+            sendResult = sendBuffers(ws, &buffer, 1);
+        }
+        
+        if (sendResult != SN_NO_ERROR)
+        {
+            disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, sendResult);
+            return sendResult;
+        }
+        /*move to the next chunk*/
+        numBytesSent += chunkSize;
+    }
+    while (numBytesSent < payloadSize);
+    
+    return SN_NO_ERROR;
+}
+
+static void sendCloseFrame(snWebsocket* ws, snStatusCode code)
+{
+    if (ws->hasSentCloseFrame)
+    {
+        return;
+    }
+    
+    scheduleTimer(ws, &ws->closingHandshakeTimer, ws->closingHandshakeTimeout);
+    snTimer_cancel(&ws->keepaliveTimer);
+    
+    char payload[2] = { (code >> 8) , (code >> 0) };
+    
+    snWebsocket_sendFrame(ws, SN_OPCODE_CONNECTION_CLOSE, 2, payload);
+    
+    ws->hasSentCloseFrame = 1;
+}
+
+static void releaseHandshakeSlot(snWebsocket* ws)
+{
+    if (ws->isHoldingHandshakeSlot)
+    {
+        ws->isHoldingHandshakeSlot = 0;
+        snReconnectScheduler_release();
+    }
+}
+
+/** @return A random number between \c min and \c max, inclusive. */
+static int randomBetween(snWebsocket* ws, int min, int max)
+{
+    return min + (int)(snRandom_next(&ws->random) % (uint32_t)(max - min + 1));
+}
+
+/**
+ * Schedules a reconnect using decorrelated jitter: each delay is picked at
+ * random between the minimum delay and three times the previous delay, capped
+ * at the maximum. Websockets closed at the same time quickly spread out,
+ * without any coordination between them.
+ */
+static void scheduleReconnect(snWebsocket* ws)
+{
+    const int previousDelay = ws->reconnectDelay > 0 ? ws->reconnectDelay : ws->reconnectMinDelay;
+    int maxDelay = previousDelay < ws->reconnectMaxDelay / 3 ? 3 * previousDelay : ws->reconnectMaxDelay;
+    
+    if (maxDelay < ws->reconnectMinDelay)
+    {
+        maxDelay = ws->reconnectMinDelay;
+    }
+    
+    ws->reconnectDelay = randomBetween(ws, ws->reconnectMinDelay, maxDelay);
+    ws->numReconnectAttempts++;
+    snTimerWheel_schedule(ws->timerWheel, &ws->reconnectTimer, ws->reconnectDelay);
+}
+
+static void reconnectTimerFired(void* userData)
+{
+    snWebsocket* ws = (snWebsocket*)userData;
+    int retryDelay = 0;
+    
+    if (!snReconnectScheduler_acquire(&retryDelay))
+    {
+        /*jitter retries too, so that waiting websockets don't retry in lockstep*/
+        snTimerWheel_schedule(ws->timerWheel, &ws->reconnectTimer, randomBetween(ws, retryDelay, 2 * retryDelay));
+        return;
+    }
+    
+    ws->isHoldingHandshakeSlot = 1;
+    connectToUrl(ws, snMutableString_getString(&ws->reconnectUrl));
+}
+
+/**
+ * Intercepts state changes before passing them on to the user defined callback.
+ */
+void transitionToStateAndInvokeStateCallback(snWebsocket* ws, snReadyState state)
+{
+    int oldState = ws->websocketState;
+    ws->websocketState = state;
+    
+    if (state == SN_STATE_CLOSED && ws->isDrainingSendQueue)
+    {
+        /*closed as if it had happened when the close frame was sent*/
+        oldState = ws->stateBeforeDraining;
+        ws->isDrainingSendQueue = 0;
+    }
+    
+    if (state == SN_STATE_CLOSED)
+    {
+        cancelTimers(ws);
+        releaseHandshakeSlot(ws);
+        
+        if (ws->autoReconnect && !ws->isServer && !ws->isDisconnectRequested && oldState != SN_STATE_CLOSED)
+        {
+            scheduleReconnect(ws);
+        }
+    }
+    else if (state == SN_STATE_OPEN)
+    {
+        snTimer_cancel(&ws->openingHandshakeTimer);
+        releaseHandshakeSlot(ws);
+        startKeepalive(ws);
+    }
+    
+    if (ws->eventLoop && state != oldState)
+    {
+        snEventLoop_updateWebsocket(ws->eventLoop, ws);
+    }
+    
+    if (state == SN_STATE_OPEN)
+    {
+        const int numReconnectAttempts = ws->numReconnectAttempts;
+        ws->numReconnectAttempts = 0;
+        ws->reconnectDelay = 0;
+        
+        if (ws->openCallback)
+        {
+            ws->openCallback(ws->callbackData);
+        }
+        
+        if (numReconnectAttempts > 0 && ws->reconnectCallback)
+        {
+            ws->reconnectCallback(ws->callbackData, numReconnectAttempts);
+        }
+    }
+    else if (state == SN_STATE_CLOSED && oldState == SN_STATE_CONNECTING && ws->closeCallback)
+    {
+        /*an error occurred before completing the opening handshake*/
+        ws->closeCallback(ws->callbackData, SN_STATUS_UNEXPECTED_ERROR);
+    }
+    else if (state == SN_STATE_CLOSED && oldState == SN_STATE_OPEN && ws->closeCallback)
+    {
+        ws->closeCallback(ws->callbackData, SN_STATUS_ENDPOINT_GOING_AWAY);
+    }
+}
+
+/**
+ * Drops the connection right away, discarding any queued data.
+ */
+static void closeConnection(snWebsocket* ws, snError error)
+{
+    ws->ioCallbacks.disconnectCallback(ws->ioObject);
+    clearSendQueue(ws);
+    
+    /*if (ws->closeCallback)
+    {
+        ws->closeCallback(ws->callbackData, status);
+    }*/
+    
+    transitionToStateAndInvokeStateCallback(ws, SN_STATE_CLOSED);
+    
+    if (error != SN_NO_ERROR && ws->errorCallback)
+    {
+        ws->errorCallback(ws->callbackData, error);
+    }
+}
+
+/**
+ *
+ */
+static void disconnectWithStatus(snWebsocket* ws, snStatusCode status, snError error)
+{
+    if (error == SN_NO_ERROR && !ws->isDrainingSendQueue)
+    {
+        sendCloseFrame(ws, status);
+        if (startDrainingSendQueue(ws))
+        {
+            return;
+        }
+    }
+    
+    closeConnection(ws, error);
+}
+
+static int isValidCloseCode(int code)
+{
+    switch (code)
+    {
+        case SN_STATUS_NORMAL_CLOSURE:
+        case SN_STATUS_ENDPOINT_GOING_AWAY:
+        case SN_STATUS_PROTOCOL_ERROR:
+        case SN_STATUS_INVALID_DATA:
+        case SN_STATUS_INCONSISTENT_DATA:
+        case SN_STATUS_POLICY_VIOLATION:
+        case SN_STATUS_MESSAGE_TOO_BIG:
+        case SN_STATUS_MISSING_EXTENSION:
+        case SN_STATUS_UNEXPECTED_ERROR:
+        {
+            return 1;
+        }
+        default:
+            break;
+    }
+    
+    /*https://tools.ietf.org/html/rfc6455#section-7.4.2*/
+    
+    if (code >= 3000 && code <= 4999)
+    {
+        return 1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Adds a received frame size to the frame size histogram
+ * used for adapting the read buffer size.
+ */
+static void observeFrameSize(snWebsocket* ws, unsigned long frameSize)
+{
+    int bucket = 0;
+    while (frameSize > 1 && bucket < SN_FRAME_SIZE_HISTOGRAM_SIZE - 1)
+    {
+        frameSize >>= 1;
+        bucket++;
+    }
+    
+    ws->frameSizeHistogram[bucket]++;
+    ws->numObservedFrames++;
+    
+    if (ws->numObservedFrames >= SN_FRAME_SIZE_HISTOGRAM_DECAY_COUNT)
+    {
+        /*let old observations fade out*/
+        int i;
+        ws->numObservedFrames = 0;
+        for (i = 0; i < SN_FRAME_SIZE_HISTOGRAM_SIZE; i++)
+        {
+            ws->frameSizeHistogram[i] >>= 1;
+            ws->numObservedFrames += ws->frameSizeHistogram[i];
+        }
+    }
+}
+
+/**
+ * Picks a new read buffer size large enough to hold 90% of the recently
+ * received frames in a single read. The buffer is grown if the last poll
+ * filled it up and shrunk if it is much bigger than needed.
+ */
+static void adaptReceiveBufferSize(snWebsocket* ws, int filledBuffer)
+{
+    int targetSize = SN_MIN_READ_BUFFER_SIZE;
+    
+    if (ws->numObservedFrames > 0)
+    {
+        const unsigned int threshold = (ws->numObservedFrames * 9) / 10;
+        unsigned int count = 0;
+        int bucket;
+        for (bucket = 0; bucket < SN_FRAME_SIZE_HISTOGRAM_SIZE - 1; bucket++)
+        {
+            count += ws->frameSizeHistogram[bucket];
+            if (count >= threshold)
+            {
+                break;
+            }
+        }
+        
+        /*round up to the upper bound of the size bucket*/
+        int bucketUpperBound = 1;
+        while (bucketUpperBound < SN_MAX_READ_BUFFER_SIZE && bucket >= 0)
+        {
+            bucketUpperBound <<= 1;
+            bucket--;
+        }
+        
+        if (bucketUpperBound > targetSize)
+        {
+            targetSize = bucketUpperBound;
+        }
+    }
+    
+    if (filledBuffer && targetSize < 2 * ws->receiveBufferSize)
+    {
+        /*more data was waiting. read bigger chunks.*/
+        targetSize = 2 * ws->receiveBufferSize;
+    }
+    
+    if (targetSize > SN_MAX_READ_BUFFER_SIZE)
+    {
+        targetSize = SN_MAX_READ_BUFFER_SIZE;
+    }
+    
+    /*only shrink if the buffer is way too big, to avoid flip-flopping*/
+    if (targetSize > ws->receiveBufferSize ||
+        targetSize * 4 <= ws->receiveBufferSize)
+    {
+        char* receiveBuffer = malloc(targetSize + 1);
+        if (receiveBuffer == NULL)
+        {
+            /*keep reading into the old buffer*/
+            return;
+        }
+        
+        free(ws->receiveBuffer);
+        ws->receiveBuffer = receiveBuffer;
+        ws->receiveBufferSize = targetSize;
+    }
+}
+
+/**
+ * Intercepts parsed frames before passing them on to the user defined callback.
+ */
+void invokeFrameCallback(void* data, const snFrame* frame)
+{
+    snWebsocket* ws = (snWebsocket*)data;
+    
+    if (ws->isDrainingSendQueue)
+    {
+        /*the connection is closing. only outgoing data is of interest.*/
+        return;
+    }
+    
+    snError headerValidationResult = snFrameHeader_validate(&frame->header);
+    if (headerValidationResult != SN_NO_ERROR)
+    {
+        disconnectWithStatus(ws, SN_STATUS_PROTOCOL_ERROR, headerValidationResult);
+        return;
+    }
+        
+    if (ws->adaptiveReceiveBufferSize)
+    {
+        observeFrameSize(ws, frame->header.payloadSize + SN_MAX_HEADER_SIZE);
+    }
+    
+    if (ws->frameCallback)
+    {
+        ws->frameCallback(ws->callbackData, frame);
+    }
+    
+    if (frame->header.opcode == SN_OPCODE_CONNECTION_CLOSE)
+    {
+        
+        int closeCode = SN_STATUS_NORMAL_CLOSURE;
+        if (frame->header.payloadSize == 1)
+        {
+            closeCode = SN_STATUS_PROTOCOL_ERROR;
+        }
+        else if (frame->header.payloadSize >= 2)
+        {
+            closeCode = (((unsigned char*)frame->payload)[0] << 8) |
+                        (((unsigned char*)frame->payload)[1] << 0);
+            if (!isValidCloseCode(closeCode))
+            {
+                closeCode = SN_STATUS_PROTOCOL_ERROR;
+            }
+            
+            const int messageSize = frame->header.payloadSize - 2;
+            char temp[256];
+            memcpy(temp, &frame->payload[2], messageSize);
+            temp[messageSize] = '\0';
+            if (!snUTF8ValidateString(temp))
+            {
+                closeCode = SN_STATUS_INCONSISTENT_DATA;
+            }
+        }
+        
+        sendCloseFrame(ws, closeCode);
+        disconnectWithStatus(ws, closeCode, SN_NO_ERROR);
+    }
+    else if (frame->header.opcode == SN_OPCODE_PING)
+    {
+        snWebsocket_sendFrame(ws, SN_OPCODE_PONG, frame->header.payloadSize, frame->payload);
+    }
+    else if (frame->header.opcode == SN_OPCODE_PONG)
+    {
+        handlePong(ws, frame);
+    }
+}
+
+static void setDefaultIOCallbacks(snIOCallbacks* ioc)
+{
+    ioc->connectCallback = snSocketConnectCallback;
+    ioc->isOpenCallback = snSocketIsOpenCallback;
+    ioc->deinitCallback = snSocketDeinitCallback;
+    ioc->disconnectCallback = snSocketDisconnectCallback;
+    ioc->initCallback = snSocketInitCallback;
+    ioc->readCallback = snSocketReadCallback;
+    ioc->writeCallback = snSocketWriteCallback;
+    ioc->writeVectorCallback = snSocketWriteVectorCallback;
+    ioc->getDescriptorCallback = snSocketGetDescriptorCallback;
+    ioc->connectWithDataCallback = snSocketConnectWithDataCallback;
+    ioc->acceptCallback = snSocketAcceptCallback;
+}
+
+void openingHandshakeParsingCallback(void* userData, snError result)
+{
+    snWebsocket* ws = (snWebsocket*)userData;
+    if (result != SN_NO_ERROR)
+    {
+        disconnectWithStatus(ws, SN_STATUS_PROTOCOL_ERROR, result);
+    }
+    else
+    {
+        ws->hasCompletedOpeningHandshake = 1;
+        
+        if (ws->openingHandshakeParser.hasNegotiatedPerMessageDeflate)
+        {
+            snPerMessageDeflate_init(&ws->perMessageDeflate,
+                                     &ws->openingHandshakeParser.perMessageDeflateParameters);
+            ws->isPerMessageDeflateActive = 1;
+            snFrameParser_setPerMessageDeflate(&ws->frameParser, &ws->perMessageDeflate);
+        }
+    }
+}
+
+/**
+ * Responds to the client's opening handshake request. Extensions are not
+ * negotiated, so a server never compresses messages.
+ */
+static void openingHandshakeRequestParsingCallback(void* userData, snError result)
+{
+    snWebsocket* ws = (snWebsocket*)userData;
+    snMutableString response;
+    snMutableString_init(&response);
+    
+    if (result != SN_NO_ERROR)
+    {
+        snMutableString_append(&response, "HTTP/1.1 400 Bad Request\r\n\r\n");
+    }
+    else
+    {
+        snOpeningHandshakeParser_createOpeningHandshakeResponse(&ws->openingHandshakeParser, &response);
+    }
+    
+    const char* responseStr = snMutableString_getString(&response);
+    snIOBuffer buffer = {responseStr, (int)strlen(responseStr)};
+    snError sendResult = sendBuffers(ws, &buffer, 1);
+    snMutableString_deinit(&response);
+    
     if (result != SN_NO_ERROR)
     {
         disconnectWithStatus(ws, SN_STATUS_PROTOCOL_ERROR, result);
     }
+    else if (sendResult != SN_NO_ERROR)
+    {
+        disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, sendResult);
+    }
     else
     {
         ws->hasCompletedOpeningHandshake = 1;
@@ -388,10 +1253,8 @@ snWebsocket* snWebsocket_create(snOpenCallback openCallback,
     setDefaultIOCallbacks(&ioc);
     
     snWebsocketOptions o;
-    o.frameCallback = NULL;
+    memset(&o, 0, sizeof(snWebsocketOptions));
     o.ioCallbacks = &ioc;
-    o.logCallback = NULL;
-    o.maxFrameSize = 0;
     
     return snWebsocket_createWithSettings(openCallback,
                                           messageCallback,
@@ -401,6 +1264,23 @@ snWebsocket* snWebsocket_create(snOpenCallback openCallback,
                                           &o);
 }
 
+/**
+ * Passed to the frame parser instead of the application's message
+ * callback when messages are handled on a dispatcher. The callback then
+ * runs on a worker thread while this thread keeps polling, so it gets
+ * a copy of the message and must not touch the websocket.
+ */
+static void dispatchMessage(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    snWebsocket* ws = (snWebsocket*)userData;
+    snSerialQueue_postMessage(ws->messageQueue,
+                              ws->dispatchedMessageCallback,
+                              ws->callbackData,
+                              opcode,
+                              bytes,
+                              numBytes);
+}
+
 snWebsocket* snWebsocket_createWithSettings(snOpenCallback openCallback,
                                             snMessageCallback messageCallback,
                                             snCloseCallback closeCallback,
@@ -410,13 +1290,15 @@ snWebsocket* snWebsocket_createWithSettings(snOpenCallback openCallback,
 {
     snIOCallbacks ioCallbacksFallback;
     setDefaultIOCallbacks(&ioCallbacksFallback);
-    snIOCallbacks* ioCallbacks = options->ioCallbacks == NULL ? &ioCallbacksFallback : options->ioCallbacks;
+    snIOCallbacks* ioCallbacks = (options == NULL || options->ioCallbacks == NULL) ? &ioCallbacksFallback : options->ioCallbacks;
     
     snWebsocket* ws = (snWebsocket*)malloc(sizeof(snWebsocket));
     memset(ws, 0, sizeof(snWebsocket));
     memcpy(&ws->ioCallbacks, ioCallbacks, sizeof(snIOCallbacks));
     ws->ioCallbacks.initCallback(&ws->ioObject);
     
+    snRandom_init(&ws->random);
+    
     ws->callbackData = callbackData;
     ws->openCallback = openCallback;
     ws->closeCallback = closeCallback;
@@ -424,6 +1306,34 @@ snWebsocket* snWebsocket_createWithSettings(snOpenCallback openCallback,
     
     ws->maxFrameSize = SN_DEFAULT_MAX_FRAME_SIZE;
     
+    ws->receiveBufferSize = SN_DEFAULT_READ_BUFFER_SIZE;
+    
+    ws->maxReadsPerPoll = SN_DEFAULT_MAX_READS_PER_POLL;
+    
+    ws->sendBufferHighWatermark = SN_DEFAULT_SEND_BUFFER_HIGH_WATERMARK;
+    
+    ws->closeDrainTimeout = SN_DEFAULT_CLOSE_DRAIN_TIMEOUT;
+    
+    ws->connectTimeout = SN_DEFAULT_CONNECT_TIMEOUT;
+    
+    ws->openingHandshakeTimeout = SN_DEFAULT_OPENING_HANDSHAKE_TIMEOUT;
+    
+    ws->closingHandshakeTimeout = SN_DEFAULT_CLOSING_HANDSHAKE_TIMEOUT;
+    
+    ws->maxMissedPongs = SN_DEFAULT_MAX_MISSED_PONGS;
+    
+    ws->reconnectMinDelay = SN_DEFAULT_RECONNECT_MIN_DELAY;
+    
+    ws->reconnectMaxDelay = SN_DEFAULT_RECONNECT_MAX_DELAY;
+    
+    snTimerWheel_init(&ws->ownTimerWheel);
+    ws->timerWheel = &ws->ownTimerWheel;
+    snTimer_init(&ws->connectTimer, connectTimedOut, ws);
+    snTimer_init(&ws->openingHandshakeTimer, openingHandshakeTimedOut, ws);
+    snTimer_init(&ws->closingHandshakeTimer, closingHandshakeTimedOut, ws);
+    snTimer_init(&ws->keepaliveTimer, keepaliveTimerFired, ws);
+    snTimer_init(&ws->reconnectTimer, reconnectTimerFired, ws);
+    
     ws->websocketState = SN_STATE_CLOSED;
     
     ws->logCallback = snSilentLogCallback;
@@ -434,6 +1344,85 @@ snWebsocket* snWebsocket_createWithSettings(snOpenCallback openCallback,
         {
             ws->maxFrameSize = options->maxFrameSize;
         }
+        
+        if (options->maxMessageSize > 0)
+        {
+            ws->maxMessageSize = options->maxMessageSize;
+        }
+        
+        if (options->readBufferSize > 0)
+        {
+            ws->receiveBufferSize = options->readBufferSize;
+        }
+        
+        if (options->maxReadsPerPoll > 0)
+        {
+            ws->maxReadsPerPoll = options->maxReadsPerPoll;
+        }
+        
+        ws->maxBytesPerPoll = options->maxBytesPerPoll;
+        ws->adaptiveReceiveBufferSize = options->adaptiveReadBufferSize;
+        ws->zeroCopyReceive = options->zeroCopyReceive;
+        
+        if (options->sendBufferHighWatermark > 0)
+        {
+            ws->sendBufferHighWatermark = options->sendBufferHighWatermark;
+        }
+        
+        ws->sendBufferLowWatermark = options->sendBufferLowWatermark;
+        ws->writableCallback = options->writableCallback;
+        
+        if (options->closeDrainTimeout != 0)
+        {
+            ws->closeDrainTimeout = options->closeDrainTimeout;
+        }
+        
+        if (options->connectTimeout != 0)
+        {
+            ws->connectTimeout = options->connectTimeout;
+        }
+        
+        if (options->openingHandshakeTimeout != 0)
+        {
+            ws->openingHandshakeTimeout = options->openingHandshakeTimeout;
+        }
+        
+        if (options->closingHandshakeTimeout != 0)
+        {
+            ws->closingHandshakeTimeout = options->closingHandshakeTimeout;
+        }
+        
+        if (options->timerWheel)
+        {
+            ws->timerWheel = options->timerWheel;
+        }
+        
+        ws->keepaliveInterval = options->keepaliveInterval;
+        
+        if (options->maxMissedPongs > 0)
+        {
+            ws->maxMissedPongs = options->maxMissedPongs;
+        }
+        
+        ws->autoReconnect = options->autoReconnect;
+        ws->reconnectCallback = options->reconnectCallback;
+        ws->tcpFastOpen = options->tcpFastOpen;
+        
+        if (options->perMessageDeflate)
+        {
+            ws->hasPerMessageDeflateOffer = 1;
+            memcpy(&ws->perMessageDeflateOffer, options->perMessageDeflate, sizeof(snPerMessageDeflateOptions));
+        }
+        
+        if (options->reconnectMinDelay > 0)
+        {
+            ws->reconnectMinDelay = options->reconnectMinDelay;
+        }
+        
+        if (options->reconnectMaxDelay > 0)
+        {
+            ws->reconnectMaxDelay = options->reconnectMaxDelay;
+        }
                 
         if (options->logCallback)
         {
@@ -444,24 +1433,47 @@ snWebsocket* snWebsocket_createWithSettings(snOpenCallback openCallback,
         {
             ws->frameCallback = options->frameCallback;
         }
+        
+        if (options->messageQueue && messageCallback)
+        {
+            ws->messageQueue = options->messageQueue;
+            ws->dispatchedMessageCallback = messageCallback;
+        }
     }
     
-    if (ws->readBuffer == 0)
+    if (ws->maxMessageSize == 0)
     {
-        ws->readBuffer = malloc(ws->maxFrameSize);
-        memset(ws->readBuffer, 0, ws->maxFrameSize);
+        ws->maxMessageSize = ws->maxFrameSize;
     }
     
+    if (ws->reconnectMaxDelay < ws->reconnectMinDelay)
+    {
+        ws->reconnectMaxDelay = ws->reconnectMinDelay;
+    }
+    
+    if (ws->sendBufferLowWatermark <= 0 || ws->sendBufferLowWatermark > ws->sendBufferHighWatermark)
+    {
+        ws->sendBufferLowWatermark = ws->sendBufferHighWatermark / 4;
+    }
+    
+    ws->receiveBuffer = malloc(ws->receiveBufferSize + 1);
+    
     ws->writeChunkSize = SN_DEFAULT_WRITE_CHUNK_SIZE;
-    ws->writeChunkBuffer = malloc(ws->writeChunkSize);
         
     snFrameParser_init(&ws->frameParser,
                        invokeFrameCallback,
                        ws,
-                       messageCallback,
-                       callbackData,
-                       ws->readBuffer,
-                       ws->maxFrameSize);
+                       ws->messageQueue ? dispatchMessage : messageCallback,
+                       ws->messageQueue ? (void*)ws : callbackData,
+                       ws->maxFrameSize,
+                       ws->maxMessageSize);
+    
+    if (options && options->messageStreamCallbacks)
+    {
+        snFrameParser_setMessageStreamCallbacks(&ws->frameParser,
+                                                options->messageStreamCallbacks,
+                                                callbackData);
+    }
     
     return ws;
 }
@@ -469,7 +1481,14 @@ snWebsocket* snWebsocket_createWithSettings(snOpenCallback openCallback,
 
 void snWebsocket_delete(snWebsocket* ws)
 {
+    if (ws->eventLoop)
+    {
+        snEventLoop_removeWebsocket(ws->eventLoop, ws);
+    }
+    
     snWebsocket_disconnect(ws, 1);
+    cancelTimers(ws);
+    snTimerWheel_deinit(&ws->ownTimerWheel);
     
     if (ws->ioObject)
     {
@@ -479,14 +1498,22 @@ void snWebsocket_delete(snWebsocket* ws)
     snFrameParser_deinit(&ws->frameParser);
     snOpeningHandshakeParser_deinit(&ws->openingHandshakeParser);
     
+    if (ws->isPerMessageDeflateActive)
+    {
+        snPerMessageDeflate_deinit(&ws->perMessageDeflate);
+    }
+    
     snMutableString_deinit(&ws->uriScheme);
     snMutableString_deinit(&ws->host);
     snMutableString_deinit(&ws->pathTail);
     snMutableString_deinit(&ws->query);
+    snMutableString_deinit(&ws->reconnectUrl);
     
-    free(ws->readBuffer);
+    free(ws->receiveBuffer);
     
     free(ws->writeChunkBuffer);
+    
+    free(ws->sendQueue);
 
     free(ws);
 }
@@ -507,41 +1534,87 @@ static int getPort(UriUriA* uri)
     return port;
 }
 
-static void sendOpeningHandshake(snWebsocket* ws)
+static void createOpeningHandshakeRequest(snWebsocket* ws, snMutableString* req)
 {
-    snMutableString req;
-    snMutableString_init(&req);
+    /*a fresh random nonce for every connection*/
+    unsigned char nonce[SN_HANDSHAKE_NONCE_SIZE];
+    char key[SN_BASE64_ENCODED_SIZE(SN_HANDSHAKE_NONCE_SIZE) + 1];
+    snRandom_getBytes(&ws->random, nonce, SN_HANDSHAKE_NONCE_SIZE);
+    snBase64Encode(nonce, SN_HANDSHAKE_NONCE_SIZE, key);
     
     snOpeningHandshakeParser_createOpeningHandshakeRequest(&ws->openingHandshakeParser,
                                                            snMutableString_getString(&ws->host),
                                                            ws->port,
                                                            snMutableString_getString(&ws->pathTail),
                                                            snMutableString_getString(&ws->query),
-                                                           &req);
+                                                           key,
+                                                           req);
+}
+
+static void sendOpeningHandshake(snWebsocket* ws)
+{
+    snMutableString req;
+    snMutableString_init(&req);
+    createOpeningHandshakeRequest(ws, &req);
     
     const char* reqStr = snMutableString_getString(&req);
     
-    int numBytesWritten = 0;
-    ws->ioCallbacks.writeCallback(ws->ioObject,
-                                  reqStr,
-                                  (int)strlen(reqStr),
-                                  &numBytesWritten);
+    snIOBuffer buffer = {reqStr, (int)strlen(reqStr)};
+    snError result = sendBuffers(ws, &buffer, 1);
     
     snMutableString_deinit(&req);
+    
+    if (result != SN_NO_ERROR)
+    {
+        disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, result);
+    }
 }
 
 snError snWebsocket_connect(snWebsocket* ws, const char* url)
+{
+    /*remember the url for reconnecting*/
+    snMutableString_deinit(&ws->reconnectUrl);
+    snMutableString_append(&ws->reconnectUrl, url);
+    ws->isDisconnectRequested = 0;
+    ws->numReconnectAttempts = 0;
+    ws->reconnectDelay = 0;
+    releaseHandshakeSlot(ws);
+    
+    return connectToUrl(ws, url);
+}
+
+static snError connectToUrl(snWebsocket* ws, const char* url)
 {
     snMutableString_deinit(&ws->uriScheme);
     snMutableString_deinit(&ws->host);
     snMutableString_deinit(&ws->pathTail);
     snMutableString_deinit(&ws->query);
     
+    ws->isServer = 0;
     snFrameParser_reset(&ws->frameParser);
+    snFrameParser_setRequireMaskedFrames(&ws->frameParser, 0);
+    cancelTimers(ws);
+    ws->receiveBufferReadPosition = 0;
+    ws->receiveBufferWritePosition = 0;
+    clearSendQueue(ws);
     snOpeningHandshakeParser_init(&ws->openingHandshakeParser,
                                   openingHandshakeParsingCallback,
                                   ws);
     
+    /*extensions are negotiated anew for every connection*/
+    if (ws->isPerMessageDeflateActive)
+    {
+        snFrameParser_setPerMessageDeflate(&ws->frameParser, NULL);
+        snPerMessageDeflate_deinit(&ws->perMessageDeflate);
+        ws->isPerMessageDeflateActive = 0;
+    }
+    
+    if (ws->hasPerMessageDeflateOffer)
+    {
+        snOpeningHandshakeParser_setPerMessageDeflateOffer(&ws->openingHandshakeParser,
+                                                           &ws->perMessageDeflateOffer);
+    }
+    
     transitionToStateAndInvokeStateCallback(ws, SN_STATE_CONNECTING);
     
     /*parse the url*/
@@ -590,25 +1663,117 @@ snError snWebsocket_connect(snWebsocket* ws, const char* url)
     
     ws->hasCompletedOpeningHandshake = 0;
     ws->hasSentCloseFrame = 0;
+    ws->isDrainingSendQueue = 0;
     ws->isWaitingForSocketConnection = 1;
-    snError e = ws->ioCallbacks.connectCallback(ws->ioObject,
-                                                snMutableString_getString(&ws->host),
-                                                ws->port);
+    ws->hasSentOpeningHandshakeEarly = 0;
+    snError e = SN_NO_ERROR;
+    
+    if (ws->tcpFastOpen && ws->ioCallbacks.connectWithDataCallback)
+    {
+        /*let the I/O object send the opening handshake request in the SYN,
+          saving a round trip if the host supports TCP Fast Open*/
+        snMutableString req;
+        snMutableString_init(&req);
+        createOpeningHandshakeRequest(ws, &req);
+        
+        const char* reqStr = snMutableString_getString(&req);
+        e = ws->ioCallbacks.connectWithDataCallback(ws->ioObject,
+                                                    snMutableString_getString(&ws->host),
+                                                    ws->port,
+                                                    reqStr,
+                                                    (int)strlen(reqStr));
+        snMutableString_deinit(&req);
+        ws->hasSentOpeningHandshakeEarly = 1;
+    }
+    else
+    {
+        e = ws->ioCallbacks.connectCallback(ws->ioObject,
+                                            snMutableString_getString(&ws->host),
+                                            ws->port);
+    }
+    
+    if (e != SN_NO_ERROR)
+    {
+        transitionToStateAndInvokeStateCallback(ws, SN_STATE_CLOSED);
+        return e;
+    }
+    
+    scheduleTimer(ws, &ws->connectTimer, ws->connectTimeout);
+    
+    if (ws->eventLoop)
+    {
+        /*there is a new descriptor to watch*/
+        snEventLoop_updateWebsocket(ws->eventLoop, ws);
+    }
+    
+    return SN_NO_ERROR;
+}
+
+snError snWebsocket_accept(snWebsocket* ws, int descriptor)
+{
+    if (ws->ioCallbacks.acceptCallback == NULL)
+    {
+        return SN_SOCKET_FAILED_TO_CONNECT;
+    }
+    
+    ws->isServer = 1;
+    
+    snFrameParser_reset(&ws->frameParser);
+    snFrameParser_setRequireMaskedFrames(&ws->frameParser, 1);
+    cancelTimers(ws);
+    ws->receiveBufferReadPosition = 0;
+    ws->receiveBufferWritePosition = 0;
+    clearSendQueue(ws);
+    snOpeningHandshakeParser_initRequestParser(&ws->openingHandshakeParser,
+                                               openingHandshakeRequestParsingCallback,
+                                               ws);
+    
+    if (ws->isPerMessageDeflateActive)
+    {
+        snFrameParser_setPerMessageDeflate(&ws->frameParser, NULL);
+        snPerMessageDeflate_deinit(&ws->perMessageDeflate);
+        ws->isPerMessageDeflateActive = 0;
+    }
     
+    ws->hasCompletedOpeningHandshake = 0;
+    ws->hasSentCloseFrame = 0;
+    ws->isDrainingSendQueue = 0;
+    ws->isWaitingForSocketConnection = 0;
+    ws->isDisconnectRequested = 0;
+    
+    transitionToStateAndInvokeStateCallback(ws, SN_STATE_CONNECTING);
+    
+    snError e = ws->ioCallbacks.acceptCallback(ws->ioObject, descriptor);
     if (e != SN_NO_ERROR)
     {
         transitionToStateAndInvokeStateCallback(ws, SN_STATE_CLOSED);
         return e;
     }
     
+    /*the client sends its request right away*/
+    scheduleTimer(ws, &ws->openingHandshakeTimer, ws->openingHandshakeTimeout);
+    
+    if (ws->eventLoop)
+    {
+        /*there is a new descriptor to watch*/
+        snEventLoop_updateWebsocket(ws->eventLoop, ws);
+    }
+    
     return SN_NO_ERROR;
 }
 
 void snWebsocket_disconnect(snWebsocket* ws, int disconnectImmediately)
 {
+    ws->isDisconnectRequested = 1;
+    snTimer_cancel(&ws->reconnectTimer);
+    releaseHandshakeSlot(ws);
+    
     if (disconnectImmediately)
     {
-        disconnectWithStatus(ws, SN_STATUS_ENDPOINT_GOING_AWAY, SN_NO_ERROR);
+        /*send what the socket accepts right away, without waiting for the rest to drain*/
+        sendCloseFrame(ws, SN_STATUS_ENDPOINT_GOING_AWAY);
+        flushSendQueue(ws);
+        closeConnection(ws, SN_NO_ERROR);
         transitionToStateAndInvokeStateCallback(ws, SN_STATE_CLOSED);
         assert(snWebsocket_getState(ws) == SN_STATE_CLOSED);
     }
@@ -624,6 +1789,108 @@ snReadyState snWebsocket_getState(snWebsocket* ws)
     return ws->websocketState;
 }
 
+int snWebsocket_getBufferedAmount(snWebsocket* ws)
+{
+    return ws->sendQueueEnd - ws->sendQueueStart;
+}
+
+int snWebsocket_getDescriptor(snWebsocket* ws)
+{
+    int descriptor = -1;
+    
+    if (ws->ioCallbacks.getDescriptorCallback == NULL ||
+        ws->ioCallbacks.getDescriptorCallback(ws->ioObject, &descriptor) != SN_NO_ERROR)
+    {
+        return -1;
+    }
+    
+    return descriptor;
+}
+
+int snWebsocket_getWantedEvents(snWebsocket* ws)
+{
+    if (ws->websocketState == SN_STATE_CLOSED)
+    {
+        return 0;
+    }
+    
+    if (ws->isWaitingForSocketConnection)
+    {
+        /*a non-blocking connect completes when the socket becomes writable.
+          while the host is being resolved, the descriptor becomes readable.*/
+        return SN_IO_EVENT_READ | SN_IO_EVENT_WRITE;
+    }
+    
+    int events = SN_IO_EVENT_READ;
+    
+    if (snWebsocket_getBufferedAmount(ws) > 0)
+    {
+        events |= SN_IO_EVENT_WRITE;
+    }
+    
+    return events;
+}
+
+void snWebsocket_waitForEvents(snWebsocket* ws, int timeoutMs)
+{
+    const int timeUntilNextTimer = snWebsocket_getTimeUntilNextTimer(ws);
+    
+    /*wake up in time to fire the next timer*/
+    if (timeUntilNextTimer >= 0 && (timeoutMs < 0 || timeUntilNextTimer < timeoutMs))
+    {
+        timeoutMs = timeUntilNextTimer;
+    }
+    
+    snWebsocket_waitForAnyEvents(&ws, 1, timeoutMs);
+}
+
+void snWebsocket_waitForAnyEvents(snWebsocket** websockets, int numWebsockets, int timeoutMs)
+{
+    struct pollfd stackDescriptors[SN_MAX_STACK_POLL_DESCRIPTORS];
+    struct pollfd* pfds = stackDescriptors;
+    int numDescriptors = 0;
+    int i;
+    
+    if (numWebsockets > SN_MAX_STACK_POLL_DESCRIPTORS)
+    {
+        pfds = malloc(numWebsockets * sizeof(struct pollfd));
+    }
+    
+    for (i = 0; i < numWebsockets; i++)
+    {
+        if (websockets[i] == NULL)
+        {
+            continue;
+        }
+        
+        const int descriptor = snWebsocket_getDescriptor(websockets[i]);
+        const int events = snWebsocket_getWantedEvents(websockets[i]);
+        if (descriptor >= 0 && events != 0)
+        {
+            pfds[numDescriptors].fd = descriptor;
+            pfds[numDescriptors].events = ((events & SN_IO_EVENT_READ) ? POLLIN : 0) |
+                                          ((events & SN_IO_EVENT_WRITE) ? POLLOUT : 0);
+            pfds[numDescriptors].revents = 0;
+            numDescriptors++;
+        }
+    }
+    
+    if (numDescriptors == 0 && timeoutMs < 0)
+    {
+        /*nothing would wake us up. sleep for a bit so callers
+          waiting in a loop don't spin.*/
+        timeoutMs = SN_MAX_IDLE_WAIT;
+    }
+    
+    /*without descriptors, this just sleeps*/
+    poll(numDescriptors > 0 ? pfds : NULL, numDescriptors, timeoutMs);
+    
+    if (pfds != stackDescriptors)
+    {
+        free(pfds);
+    }
+}
+
 snError snWebsocket_sendPing(snWebsocket* ws, int payloadSize, const char* payload)
 {
     return snWebsocket_sendFrame(ws, SN_OPCODE_PING, payloadSize, payload);
@@ -652,13 +1919,129 @@ static void handlePaserResult(snWebsocket* ws, snError error)
     {
         status = SN_STATUS_INCONSISTENT_DATA;
     }
+    else if (error == SN_EXCEEDED_MAX_MESSAGE_SIZE)
+    {
+        status = SN_STATUS_MESSAGE_TOO_BIG;
+    }
     
     /*invokes error callback if an error occurred. */
     disconnectWithStatus(ws, status, error);
 }
 
+/**
+ * Passes bytes read from the I/O object to the opening handshake
+ * parser or the frame parser. If \c maxDeferredFrameSize is greater than
+ * zero, frames are delivered in place when possible and incomplete frames
+ * up to that size are left unprocessed.
+ * @return The number of processed bytes.
+ */
+static int processReceivedBytes(snWebsocket* ws, char* readBytes, int numBytesRead, int maxDeferredFrameSize)
+{
+    if (0)
+    {
+        log(ws, "bytes from socket:\n");
+        log(ws, "-----------------------\n");
+        int i;
+        for (i = 0; i < numBytesRead; i++)
+        {
+            log(ws, "%c", readBytes[i]);
+        }
+        log(ws, "\n-----------------------\n");
+    }
+    
+    int readOffset = 0;
+    
+    if (ws->hasCompletedOpeningHandshake == 0)
+    {
+        snError result = snOpeningHandshakeParser_processBytes(&ws->openingHandshakeParser,
+                                                               readBytes,
+                                                               numBytesRead,
+                                                               &readOffset);
+        
+        if (result != SN_NO_ERROR)
+        {
+            snOpeningHandshakeParser_deinit(&ws->openingHandshakeParser);
+            handlePaserResult(ws, result);
+            return numBytesRead;
+        }
+        
+        if (ws->hasCompletedOpeningHandshake)
+        {
+            transitionToStateAndInvokeStateCallback(ws, SN_STATE_OPEN);
+            snOpeningHandshakeParser_deinit(&ws->openingHandshakeParser);
+        }
+    }
+    
+    assert(numBytesRead >= readOffset);
+    
+    if (!ws->hasCompletedOpeningHandshake || readOffset == numBytesRead)
+    {
+        return numBytesRead;
+    }
+    
+    if (maxDeferredFrameSize > 0)
+    {
+        int numBytesProcessed = 0;
+        snError result = snFrameParser_processBytesInPlace(&ws->frameParser,
+                                                           &readBytes[readOffset],
+                                                           numBytesRead - readOffset,
+                                                           maxDeferredFrameSize,
+                                                           &numBytesProcessed);
+        handlePaserResult(ws, result);
+        return readOffset + numBytesProcessed;
+    }
+    
+    snError result = snFrameParser_processBytes(&ws->frameParser,
+                                                &readBytes[readOffset],
+                                                numBytesRead - readOffset);
+    handlePaserResult(ws, result);
+    return numBytesRead;
+}
+
+/**
+ * Processes the bytes between the read and write positions of the receive
+ * buffer, delivering messages in place. The start of a frame that has not been
+ * fully received yet is left in the buffer until the rest of it has been read.
+ * When the end of the buffer is reached, such a partial frame is moved to the
+ * start of the buffer.
+ */
+static void processReceiveBufferInPlace(snWebsocket* ws)
+{
+    const int start = ws->receiveBufferReadPosition;
+    const int end = ws->receiveBufferWritePosition;
+    
+    ws->receiveBufferReadPosition += processReceivedBytes(ws,
+                                                          &ws->receiveBuffer[start],
+                                                          end - start,
+                                                          ws->receiveBufferSize);
+    
+    const int numUnprocessedBytes = ws->receiveBufferWritePosition - ws->receiveBufferReadPosition;
+    
+    if (numUnprocessedBytes == 0)
+    {
+        ws->receiveBufferReadPosition = 0;
+        ws->receiveBufferWritePosition = 0;
+    }
+    else if (ws->receiveBufferWritePosition == ws->receiveBufferSize)
+    {
+        /*wrap around. the frame parser only leaves frames that fit
+          in the buffer unprocessed, so there will be room for the rest.*/
+        memmove(ws->receiveBuffer,
+                &ws->receiveBuffer[ws->receiveBufferReadPosition],
+                numUnprocessedBytes);
+        ws->receiveBufferReadPosition = 0;
+        ws->receiveBufferWritePosition = numUnprocessedBytes;
+    }
+}
+
 void snWebsocket_poll(snWebsocket* ws)
 {
+    /*shared wheels are advanced by their owner*/
+    if (ws->timerWheel == &ws->ownTimerWheel)
+    {
+        snTimerWheel_advance(&ws->ownTimerWheel);
+    }
+    
     if (ws->websocketState == SN_STATE_CLOSED)
     {
         return;
@@ -668,136 +2051,192 @@ void snWebsocket_poll(snWebsocket* ws)
     {
         /* Poll to see how the pending connection went */
         int isOpen = 0;
+        const int descriptor = snWebsocket_getDescriptor(ws);
         snError e = ws->ioCallbacks.isOpenCallback(ws->ioObject, &isOpen);
         
+        if (ws->eventLoop && e == SN_NO_ERROR && snWebsocket_getDescriptor(ws) != descriptor)
+        {
+            /*e.g. a socket created once the host was resolved*/
+            snEventLoop_updateWebsocket(ws->eventLoop, ws);
+        }
+        
         if (e != SN_NO_ERROR)
         {
-            /* The underlying socket failed to connect. */
-            if (ws->errorCallback)
-            {
-                ws->websocketState = SN_STATE_CLOSED;
-                ws->errorCallback(ws->callbackData, SN_SOCKET_FAILED_TO_CONNECT);
-                return;
-            }
+            /* The underlying socket failed to connect, e.g. because it was refused. */
+            disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, SN_SOCKET_FAILED_TO_CONNECT);
+            return;
         }
 
         if (isOpen)
         {
             /* The socket is open, send the opening handshake. */
             ws->isWaitingForSocketConnection = 0;
-            sendOpeningHandshake(ws);
+            snTimer_cancel(&ws->connectTimer);
+            scheduleTimer(ws, &ws->openingHandshakeTimer, ws->openingHandshakeTimeout);
+            if (!ws->hasSentOpeningHandshakeEarly)
+            {
+                sendOpeningHandshake(ws);
+            }
         }
         else
         {
             /*The underlying socket is still trying to connect. Nothing further. */
-            //printf("The underlying socket is still trying to connect. Nothing further. \n");
             return;
         }
     }
     
-    /*update timer. TODO: ditch in favor of passing a timestep to poll */
+    /*send data that could not be sent without blocking earlier*/
+    snError flushResult = flushSendQueue(ws);
+    
+    if (ws->isDrainingSendQueue)
     {
-        int firstPoll = ws->prevPollTime == 0.0f;
-        
-        struct timeval time;
-        gettimeofday(&time, NULL);
-        
-        const double newPollTime = time.tv_sec + time.tv_usec / 1000000.0;
-        const double dt = newPollTime - ws->prevPollTime;
-        
-        if (!firstPoll)
+        /*the connection is only kept until the queued data has been sent*/
+        if (flushResult != SN_NO_ERROR || snWebsocket_getBufferedAmount(ws) == 0)
         {
-            if (ws->hasSentCloseFrame)
-            {
-                ws->closingHandshakeTimer += dt;
-                if (ws->closingHandshakeTimer >= SN_CLOSING_HANDSHAKE_TIMEOUT)
-                {
-                    disconnectWithStatus(ws, SN_STATUS_ENDPOINT_GOING_AWAY, SN_NO_ERROR);
-                }
-            }
+            closeConnection(ws, SN_NO_ERROR);
         }
-        
-        ws->prevPollTime = newPollTime;
-    }
-    
-    snFrameParser* fp = &ws->frameParser;
-    const int numBytesLeftInBuffer = fp->maxFrameSize - fp->bufferPosition;
-    int numBytesRead = 0;
-    char readBytes[1024];
-    snError e = ws->ioCallbacks.readCallback(ws->ioObject,
-                                             readBytes,
-                                             1024,
-                                             &numBytesRead);
-    
-    if (e != SN_NO_ERROR)
-    {
-        disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, e);
         return;
     }
     
-    if (numBytesRead == 0)
+    if (flushResult != SN_NO_ERROR)
     {
+        disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, flushResult);
         return;
     }
     
-    if (0)
+    /*read until there is no more data or the per poll limits are reached*/
+    ws->hasUnreadInput = 0;
+    int numReads = 0;
+    int numBytesReadTotal = 0;
+    int filledReceiveBuffer = 0;
+    
+    while (ws->websocketState != SN_STATE_CLOSED && !ws->isDrainingSendQueue)
     {
-        log(ws, "bytes from socket:\n");
-        log(ws, "-----------------------\n");
-        int i;
-        for (i = 0; i < numBytesRead; i++)
+        if (numReads >= ws->maxReadsPerPoll)
         {
-            log(ws, "%c", readBytes[i]);
+            ws->hasUnreadInput = 1;
+            break;
         }
         
-        /*
-        log(ws, "\nhex..................\n");
-        int lbCounter = 0;
-        for (i = 0; i < numBytesRead; i++)
+        const int writePosition = ws->zeroCopyReceive ? ws->receiveBufferWritePosition : 0;
+        int numBytesToRead = ws->receiveBufferSize - writePosition;
+        if (ws->maxBytesPerPoll > 0)
         {
-            log(ws, "%x ", (unsigned char)readBytes[i]);
-            lbCounter = (lbCounter + 1) % 15;
-            if (lbCounter == 0 && i > 0)
+            const int numBytesLeftThisPoll = ws->maxBytesPerPoll - numBytesReadTotal;
+            if (numBytesLeftThisPoll <= 0)
             {
-                log(ws, "\n");
+                ws->hasUnreadInput = 1;
+                break;
+            }
+            
+            if (numBytesLeftThisPoll < numBytesToRead)
+            {
+                numBytesToRead = numBytesLeftThisPoll;
             }
         }
-        */
-        log(ws, "\n-----------------------\n");
-    }
-
-    int readOffset = 0;
-    
-    if (ws->hasCompletedOpeningHandshake == 0)
-    {
-        snError result = snOpeningHandshakeParser_processBytes(&ws->openingHandshakeParser,
-                                                               readBytes,
-                                                               numBytesRead,
-                                                               &readOffset);
         
-        if (result != SN_NO_ERROR)
+        int numBytesRead = 0;
+        snError e = ws->ioCallbacks.readCallback(ws->ioObject,
+                                                 &ws->receiveBuffer[writePosition],
+                                                 numBytesToRead,
+                                                 &numBytesRead);
+        numReads++;
+        
+        if (e != SN_NO_ERROR)
         {
-            snOpeningHandshakeParser_deinit(&ws->openingHandshakeParser);
-            handlePaserResult(ws, result);
+            disconnectWithStatus(ws, SN_STATUS_UNEXPECTED_ERROR, e);
             return;
         }
         
-        if (ws->hasCompletedOpeningHandshake)
+        if (numBytesRead == 0)
         {
-            transitionToStateAndInvokeStateCallback(ws, SN_STATE_OPEN);
-            snOpeningHandshakeParser_deinit(&ws->openingHandshakeParser);
+            /*nothing more to read right now*/
+            break;
+        }
+        
+        if (writePosition + numBytesRead == ws->receiveBufferSize)
+        {
+            filledReceiveBuffer = 1;
         }
         
+        numBytesReadTotal += numBytesRead;
+        
+        if (ws->zeroCopyReceive)
+        {
+            ws->receiveBufferWritePosition += numBytesRead;
+            processReceiveBufferInPlace(ws);
+        }
+        else
+        {
+            processReceivedBytes(ws, ws->receiveBuffer, numBytesRead, 0);
+        }
     }
     
-    assert(numBytesRead >= readOffset);
+    /*the receive buffer can only be resized when it holds no unprocessed bytes*/
+    if (ws->adaptiveReceiveBufferSize &&
+        numBytesReadTotal > 0 &&
+        ws->receiveBufferWritePosition == 0)
+    {
+        adaptReceiveBufferSize(ws, filledReceiveBuffer);
+    }
+}
+
+int snWebsocket_needsPoll(snWebsocket* ws)
+{
+    return ws->hasUnreadInput && ws->websocketState != SN_STATE_CLOSED;
+}
+
+void snWebsocket_setEventLoop(snWebsocket* ws, snEventLoop* eventLoop, void* eventLoopEntry)
+{
+    ws->eventLoop = eventLoop;
+    ws->eventLoopEntry = eventLoopEntry;
+}
+
+void* snWebsocket_getEventLoopEntry(snWebsocket* ws)
+{
+    return ws->eventLoopEntry;
+}
+
+snTimerWheel* snWebsocket_getTimerWheel(snWebsocket* ws)
+{
+    return ws->timerWheel;
+}
+
+void snWebsocket_setTimerWheel(snWebsocket* ws, snTimerWheel* wheel)
+{
+    snTimer* timers[5];
+    int i;
     
-    if (ws->hasCompletedOpeningHandshake && readOffset < numBytesRead)
+    if (wheel == NULL)
     {
-        snError result = snFrameParser_processBytes(&ws->frameParser,
-                                                    &readBytes[readOffset],
-                                                    numBytesRead - readOffset);
-        handlePaserResult(ws, result);
+        wheel = &ws->ownTimerWheel;
+    }
+    
+    timers[0] = &ws->connectTimer;
+    timers[1] = &ws->openingHandshakeTimer;
+    timers[2] = &ws->closingHandshakeTimer;
+    timers[3] = &ws->keepaliveTimer;
+    timers[4] = &ws->reconnectTimer;
+    
+    /*keep the expiry times of running timers*/
+    for (i = 0; i < 5; i++)
+    {
+        if (snTimer_isScheduled(timers[i]))
+        {
+            snTimerWheel_scheduleAt(wheel, timers[i], timers[i]->expiryTime);
+        }
     }
+    
+    ws->timerWheel = wheel;
+}
+
+int snWebsocket_getTimeUntilNextTimer(snWebsocket* ws)
+{
+    return snTimerWheel_getTimeUntilNextTimer(ws->timerWheel);
+}
+
+const snRoundTripStats* snWebsocket_getRoundTripStats(snWebsocket* ws)
+{
+    return &ws->roundTripStats;
 }
 
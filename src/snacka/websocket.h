@@ -41,6 +41,8 @@
 #include "frame.h"
 #include "iocallbacks.h"
 #include "logging.h"
+#include "permessagedeflate.h"
+#include "timerwheel.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -49,6 +51,10 @@ extern "C"
     
     
     typedef struct snWebsocket snWebsocket;
+    
+    struct snEventLoop;
+    
+    struct snSerialQueue;
 
     /**
      * @name Constants
@@ -194,6 +200,49 @@ extern "C"
      */
     typedef void (*snMessageCallback)(void* userData, snOpcode opcode, const char* bytes, int numBytes);
     
+    /**
+     * Called when the first frame of an incoming text or binary message
+     * has been received.
+     * @param userData Custom user data.
+     * @param opcode The message type, \c SN_OPCODE_TEXT or \c SN_OPCODE_BINARY.
+     */
+    typedef void (*snMessageBeginCallback)(void* userData, snOpcode opcode);
+    
+    /**
+     * Called with the next chunk of the payload of an incoming text or
+     * binary message, as soon as it has been received. Text chunks are valid
+     * UTF-8 so far, but may end in the middle of a code point and are not
+     * null terminated.
+     * @param userData Custom user data.
+     * @param opcode The message type, \c SN_OPCODE_TEXT or \c SN_OPCODE_BINARY.
+     * @param bytes The payload bytes. Only valid for the duration of the callback.
+     * @param numBytes The number of payload bytes.
+     */
+    typedef void (*snMessageChunkCallback)(void* userData, snOpcode opcode, const char* bytes, int numBytes);
+    
+    /**
+     * Called when the final frame of an incoming text or binary message has
+     * been received. Not called if the message turned out to be invalid, in
+     * which case the connection is closed.
+     * @param userData Custom user data.
+     * @param opcode The message type, \c SN_OPCODE_TEXT or \c SN_OPCODE_BINARY.
+     */
+    typedef void (*snMessageEndCallback)(void* userData, snOpcode opcode);
+    
+    /**
+     * A set of callbacks that receive text and binary messages incrementally,
+     * without assembling them in memory first.
+     */
+    typedef struct snMessageStreamCallbacks
+    {
+        /** */
+        snMessageBeginCallback beginCallback;
+        /** */
+        snMessageChunkCallback chunkCallback;
+        /** */
+        snMessageEndCallback endCallback;
+    } snMessageStreamCallbacks;
+    
     /**
      * Notifies the application when the opening handshake has been completed.
      * @param userData
@@ -214,9 +263,59 @@ extern "C"
      */
     typedef void (*snErrorCallback)(void* userData, snError error);
     
+    /**
+     * Notifies the application when the amount of buffered outgoing data
+     * has dropped to the low watermark, after having exceeded the high watermark.
+     * @param userData
+     * @see snWebsocket_getBufferedAmount
+     */
+    typedef void (*snWritableCallback)(void* userData);
+    
+    /**
+     * A callback invoked when an automatic reconnect has completed the opening
+     * handshake, e.g. to subscribe to the same data as before.
+     * @param userData The callback data passed to \c snWebsocket_create.
+     * @param numAttempts The number of reconnects it took.
+     */
+    typedef void (*snReconnectCallback)(void* userData, int numAttempts);
+    
         
     /** @} */
     
+    /**
+     * I/O events a websocket can wait for.
+     */
+    typedef enum snIOEvent
+    {
+        /** The descriptor has data to read. */
+        SN_IO_EVENT_READ = 1 << 0,
+        /** The descriptor can be written to, or a pending connection has completed. */
+        SN_IO_EVENT_WRITE = 1 << 1
+    } snIOEvent;
+    
+    /**
+     * Round trip times measured with keepalive pings, in milliseconds.
+     * The smoothed round trip time and the jitter are computed like
+     * SRTT and RTTVAR in RFC 6298.
+     */
+    typedef struct snRoundTripStats
+    {
+        /** The number of keepalive pongs received. The other fields are 0 until the first one. */
+        int numPongs;
+        /** The number of keepalive pings in a row that have gone unanswered. */
+        int numMissedPongs;
+        /** The round trip time of the latest pong. */
+        double latestRoundTripTime;
+        /** An exponentially weighted moving average of the round trip time. */
+        double smoothedRoundTripTime;
+        /** The mean deviation of the round trip time from the smoothed round trip time. */
+        double jitter;
+        /** */
+        double minRoundTripTime;
+        /** */
+        double maxRoundTripTime;
+    } snRoundTripStats;
+    
     /**
      * @name API
      */
@@ -232,12 +331,167 @@ extern "C"
          * max size will be used.
          */
         int maxFrameSize;
+        /**
+         * The maximum size in bytes of a text or binary message, which may
+         * consist of several frames. Memory for assembling messages is allocated
+         * as needed, up to this size. If 0, the max frame size is used.
+         * Ignored for messages passed to \c messageStreamCallbacks.
+         */
+        int maxMessageSize;
+        /**
+         * The size in bytes of the buffer incoming socket data is read into.
+         * If 0, the default size will be used.
+         */
+        int readBufferSize;
+        /**
+         * If non-zero, the read buffer is grown or shrunk between polls
+         * based on the sizes of recently received frames, starting
+         * from \c readBufferSize.
+         */
+        int adaptiveReadBufferSize;
+        /**
+         * The maximum number of bytes to read in a single call to
+         * \c snWebsocket_poll. If 0, there is no limit.
+         */
+        int maxBytesPerPoll;
+        /**
+         * The maximum number of read calls to make in a single call to
+         * \c snWebsocket_poll. If 0, the default limit will be used.
+         */
+        int maxReadsPerPoll;
+        /**
+         * If non-zero, unfragmented text and binary messages that arrive in
+         * one piece are passed to the message callback as pointers into the
+         * read buffer instead of being copied. Such pointers are only valid
+         * for the duration of the callback.
+         */
+        int zeroCopyReceive;
         /** */
         snLogCallback logCallback;
         /** A callback to pass received frames (including continuation frames) to. Ignored if NULL. */
         snFrameCallback frameCallback;
         /** If NULL, default socket I/O is used. */
         snIOCallbacks* ioCallbacks;
+        /**
+         * If not NULL, text and binary messages are passed to these callbacks
+         * chunk by chunk instead of to the message callback, which then only
+         * receives pings and pongs. Messages and frames of any size are accepted,
+         * since they don't have to fit in a buffer. Received text and binary frames
+         * passed to \c frameCallback have a NULL payload.
+         */
+        snMessageStreamCallbacks* messageStreamCallbacks;
+        /**
+         * When more than this many bytes of outgoing data are buffered, the
+         * application should stop sending until \c writableCallback is called.
+         * If 0, the default watermark will be used.
+         */
+        int sendBufferHighWatermark;
+        /**
+         * \c writableCallback is called when the amount of buffered outgoing data
+         * drops to this many bytes, after having exceeded the high watermark.
+         * If 0, a quarter of the high watermark is used.
+         */
+        int sendBufferLowWatermark;
+        /** Called when the websocket can accept more outgoing data. Ignored if NULL. */
+        snWritableCallback writableCallback;
+        /**
+         * When the connection is dropped after sending a close frame, the maximum
+         * time in milliseconds to spend trying to send any buffered outgoing data.
+         * Meanwhile, the websocket is in the closing state and the data is sent
+         * by \c snWebsocket_poll as the socket becomes writable, without blocking.
+         * Disconnecting immediately only sends what the socket accepts right away.
+         * If 0, the default timeout will be used. If negative, buffered data is discarded.
+         */
+        int closeDrainTimeout;
+        /**
+         * If not NULL, \c messageCallback is invoked on a worker thread of the
+         * queue's dispatcher instead of inside \c snWebsocket_poll, with a copy
+         * of the message. Messages are handled in the order they were received.
+         * The queue must outlive the websocket. Message stream callbacks
+         * are not affected.
+         *
+         * The callback runs concurrently with the thread polling the websocket,
+         * and none of the \c snWebsocket functions are safe to call from it.
+         * To reply or disconnect, hand the work to the polling thread, e.g with
+         * \c snEventLoop_sendFrame or \c snEventLoop_post if an event loop drives
+         * the websocket. \c snSerialQueue_post is safe to call from the callback.
+         * Messages may still be handled after the websocket has been deleted,
+         * so the callback data must stay valid until the queue has handled them.
+         */
+        struct snSerialQueue* messageQueue;
+        /**
+         * The maximum time in milliseconds to wait for the socket to connect.
+         * If 0, the default timeout will be used. If negative, there is no timeout.
+         */
+        int connectTimeout;
+        /**
+         * The maximum time in milliseconds from sending the opening handshake
+         * until receiving a valid response. If 0, the default timeout will be used.
+         * If negative, there is no timeout.
+         */
+        int openingHandshakeTimeout;
+        /**
+         * The maximum time in milliseconds from sending a close frame until the
+         * connection is closed. If 0, the default timeout will be used.
+         * If negative, there is no timeout.
+         */
+        int closingHandshakeTimeout;
+        /**
+         * If not NULL, the websocket's timers are scheduled on this wheel, typically
+         * shared by all websockets polled by the same thread. The application is then
+         * responsible for advancing it. Otherwise, the websocket has a wheel of its
+         * own, advanced by \c snWebsocket_poll.
+         */
+        snTimerWheel* timerWheel;
+        /**
+         * If positive, a ping is sent this often in milliseconds while the
+         * connection is open, to measure round trip times and detect dead
+         * connections. If 0, no keepalive pings are sent.
+         */
+        int keepaliveInterval;
+        /**
+         * The connection is dropped with the error \c SN_KEEPALIVE_TIMED_OUT when
+         * this many keepalive pings in a row have not been answered by the time
+         * the next ping is due. If 0, the default will be used.
+         */
+        int maxMissedPongs;
+        /**
+         * If non-zero, the websocket reconnects to the URL it was last connected
+         * to when the connection fails or is lost, until \c snWebsocket_disconnect
+         * is called. Reconnects are spread out using decorrelated jittered
+         * exponential backoff, and limited by the process wide reconnect
+         * scheduler, see \c snReconnectScheduler_setLimits.
+         */
+        int autoReconnect;
+        /**
+         * The minimum time in milliseconds to wait before reconnecting.
+         * If 0, the default will be used.
+         */
+        int reconnectMinDelay;
+        /**
+         * The maximum time in milliseconds to wait before reconnecting.
+         * If 0, the default will be used.
+         */
+        int reconnectMaxDelay;
+        /** Called when an automatic reconnect has opened. Ignored if NULL. */
+        snReconnectCallback reconnectCallback;
+        /**
+         * If non-zero, the opening handshake request is handed to the I/O object
+         * when connecting, so that it can be sent in the SYN using TCP Fast Open,
+         * saving a round trip. This requires a host that supports TCP Fast Open
+         * and that has handed out a cookie on an earlier connection. Otherwise,
+         * the request is sent once connected, as usual. Ignored if the I/O
+         * callbacks have no \c connectWithDataCallback.
+         */
+        int tcpFastOpen;
+        /**
+         * If not NULL, the permessage-deflate extension is offered with these
+         * parameters. If the server accepts, received compressed messages are
+         * decompressed, and text and binary messages of at least the compression
+         * threshold are sent compressed. zlib streams come from a process wide
+         * pool, see \c snPerMessageDeflate_setMaxIdleStreams.
+         */
+        snPerMessageDeflateOptions* perMessageDeflate;
     } snWebsocketOptions;
     
     /**
@@ -288,6 +542,19 @@ extern "C"
      */
     snError snWebsocket_connect(snWebsocket* ws, const char* url);
     
+    /**
+     * Makes a websocket the server end of a connection accepted by a
+     * listening socket. The websocket waits for the client's opening handshake
+     * request, responds to it and then becomes open. It sends unmasked frames,
+     * requires received frames to be masked and never reconnects.
+     * Used by \c snWebsocketServer, but may also be used with descriptors
+     * accepted by the application.
+     * @param ws The websocket. Its I/O callbacks must include an accept callback.
+     * @param descriptor The accepted descriptor. Owned by the websocket on success.
+     * @return An error code.
+     */
+    snError snWebsocket_accept(snWebsocket* ws, int descriptor);
+    
     /**
      * Disconnect from the current host, if any.
      * @param ws The websocket to disconnect.
@@ -304,6 +571,62 @@ extern "C"
      * @return The websocket state.
      */
     snReadyState snWebsocket_getState(snWebsocket* ws);
+    
+    /**
+     * Sending never blocks. Outgoing data that the I/O object can not accept
+     * right away is buffered and sent from \c snWebsocket_poll.
+     * @param ws The websocket.
+     * @return The number of bytes of outgoing data that have been buffered but
+     * not yet sent, like the WebSocket API's bufferedAmount attribute.
+     */
+    int snWebsocket_getBufferedAmount(snWebsocket* ws);
+    
+    /**
+     * Gets the file descriptor of the websocket's I/O object, e.g a socket,
+     * so that \c snWebsocket_poll can be called only when there is something
+     * to do instead of in a busy loop. Call this again after connecting
+     * and after polling a connecting websocket, since the descriptor may
+     * change, e.g. once the host name has been resolved.
+     * @param ws The websocket.
+     * @return The descriptor, or -1 if there is none or the I/O callbacks
+     * don't provide one.
+     * @see snWebsocket_getWantedEvents
+     */
+    int snWebsocket_getDescriptor(snWebsocket* ws);
+    
+    /**
+     * Gets the events the websocket is currently waiting for on its descriptor.
+     * Wait for any of these, e.g using epoll, then call \c snWebsocket_poll.
+     * These change as the connection progresses and data gets queued,
+     * so check again after each poll or send. Connecting and closing time out,
+     * so don't wait longer than \c snWebsocket_getTimeUntilNextTimer.
+     * @param ws The websocket.
+     * @return A combination of \c snIOEvent flags.
+     */
+    int snWebsocket_getWantedEvents(snWebsocket* ws);
+    
+    /**
+     * Waits until the websocket's descriptor is ready for any of the wanted
+     * events, until the next timer of the websocket's timer wheel expires, or
+     * until a timeout. Sleeps until the timer or the timeout if there is
+     * no descriptor, or for a short interval if there is neither.
+     * @param ws The websocket.
+     * @param timeoutMs The maximum time to wait in milliseconds.
+     */
+    void snWebsocket_waitForEvents(snWebsocket* ws, int timeoutMs);
+    
+    /**
+     * Waits until the descriptor of any of a number of websockets is ready
+     * for its wanted events, or until a timeout. Timers are not taken into
+     * account, so pass a timeout no longer than the time until the next timer.
+     * If no websocket has a descriptor, this sleeps for the timeout, or for
+     * a short interval if there is no timeout, so that callers waiting in a loop don't spin.
+     * @param websockets The websockets to wait for. NULL entries are skipped.
+     * @param numWebsockets The number of entries in \c websockets.
+     * @param timeoutMs The maximum time to wait in milliseconds, or a negative
+     * value to wait until a descriptor is ready.
+     */
+    void snWebsocket_waitForAnyEvents(snWebsocket** websockets, int numWebsockets, int timeoutMs);
         
     /**
      * Send a ping message.
@@ -344,11 +667,75 @@ extern "C"
     
     /**
      * Receives incoming data, if any, and notifies the caller of newly available frames
-     * and connection state changes.
+     * and connection state changes. Data is read until the underlying I/O object
+     * has no more data available or until the limits given by the \c maxBytesPerPoll
+     * and \c maxReadsPerPoll options are reached.
      * @param ws The websocket.
      */
     void snWebsocket_poll(snWebsocket* ws);
     
+    /**
+     * Checks if the last call to \c snWebsocket_poll stopped reading because
+     * of the \c maxBytesPerPoll or \c maxReadsPerPoll limits. If so, there may
+     * be more data to read even though the descriptor will not be reported
+     * as readable again, e.g by edge triggered epoll, so poll again soon
+     * without waiting for events.
+     * @param ws The websocket.
+     * @return Non-zero if the websocket should be polled again without waiting.
+     */
+    int snWebsocket_needsPoll(snWebsocket* ws);
+    
+    /**
+     * Used by \c snEventLoop to keep track of the websocket. The loop is
+     * notified when the websocket connects or changes state.
+     * @param ws The websocket.
+     * @param eventLoop The loop driving the websocket, or NULL.
+     * @param eventLoopEntry Data owned by the loop.
+     */
+    void snWebsocket_setEventLoop(snWebsocket* ws, struct snEventLoop* eventLoop, void* eventLoopEntry);
+    
+    /**
+     * @param ws The websocket.
+     * @return The data passed to \c snWebsocket_setEventLoop, or NULL if the
+     * websocket is not driven by an event loop.
+     */
+    void* snWebsocket_getEventLoopEntry(snWebsocket* ws);
+    
+    /**
+     * Gets the wheel that the websocket's timers are scheduled on, which the
+     * application may use for timers of its own.
+     * @param ws The websocket.
+     * @return The wheel.
+     */
+    snTimerWheel* snWebsocket_getTimerWheel(snWebsocket* ws);
+    
+    /**
+     * Moves the websocket's timers to another wheel, keeping their expiry times.
+     * Used by \c snEventLoop to drive the timers of all its websockets with one wheel.
+     * @param ws The websocket.
+     * @param wheel The wheel, or NULL to use the websocket's own wheel,
+     * advanced by \c snWebsocket_poll.
+     */
+    void snWebsocket_setTimerWheel(snWebsocket* ws, snTimerWheel* wheel);
+    
+    /**
+     * Gets the time until \c snWebsocket_poll (or, if the timer wheel is shared,
+     * whatever advances it) has to be called to handle timeouts, so that the
+     * caller can wait for I/O exactly that long.
+     * @param ws The websocket.
+     * @return The time in milliseconds, or -1 if there are no pending timers.
+     */
+    int snWebsocket_getTimeUntilNextTimer(snWebsocket* ws);
+    
+    /**
+     * Gets the round trip times measured with keepalive pings, which are
+     * sent if the \c keepaliveInterval option is set. The pongs answering them
+     * are passed to the message callback like any other pongs.
+     * @param ws The websocket.
+     * @return The measurements for the current connection.
+     */
+    const snRoundTripStats* snWebsocket_getRoundTripStats(snWebsocket* ws);
+    
     /** @} */
     
 #ifdef __cplusplus
@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "websocketserver.h"
+#include "timerwheel.h"
+
+/** The maximum number of connections accepted per listening socket wake up. */
+#define SN_MAX_ACCEPTS_PER_WAKE_UP 64
+
+typedef struct snServerThread snServerThread;
+
+/** An accepted connection. */
+typedef struct snServerConnection
+{
+    /** The thread that accepted the connection and drives it. */
+    snServerThread* thread;
+    /** */
+    snWebsocket* websocket;
+} snServerConnection;
+
+/** An event loop, the thread running it and the listening socket it watches. */
+struct snServerThread
+{
+    /** */
+    snWebsocketServer* server;
+    /** */
+    snEventLoop* loop;
+    /** */
+    pthread_t thread;
+    /** Non-zero once \c thread has been started. */
+    int isStarted;
+    /** This thread's SO_REUSEPORT socket, or -1. */
+    int listenDescriptor;
+    /** The loop's watch of \c listenDescriptor, or NULL. */
+    void* listenWatch;
+    /** Connections accepted by this thread. Only touched by this thread. */
+    snServerConnection** connections;
+    /** */
+    int numConnections;
+    /** */
+    int connectionsCapacity;
+    /** Periodically deletes the websockets of closed connections. */
+    snTimer reapTimer;
+};
+
+struct snWebsocketServer
+{
+    /** */
+    snServerThread* threads;
+    /** */
+    int numThreads;
+    /** */
+    int port;
+    /** Options for the websockets of accepted connections. */
+    snWebsocketOptions websocketOptions;
+    /** */
+    snServerConnectionCallback openCallback;
+    /** */
+    snServerMessageCallback messageCallback;
+    /** */
+    snServerConnectionCallback closeCallback;
+    /** */
+    void* callbackData;
+    /** Updated by all threads. */
+    int numAcceptedConnections;
+};
+
+static void connectionOpenCallback(void* userData)
+{
+    snServerConnection* connection = (snServerConnection*)userData;
+    snWebsocketServer* server = connection->thread->server;
+    
+    if (server->openCallback)
+    {
+        server->openCallback(server->callbackData, connection->websocket);
+    }
+}
+
+static void connectionMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    snServerConnection* connection = (snServerConnection*)userData;
+    snWebsocketServer* server = connection->thread->server;
+    
+    if (server->messageCallback)
+    {
+        server->messageCallback(server->callbackData, connection->websocket, opcode, bytes, numBytes);
+    }
+}
+
+/**
+ * Invokes the close callback and deletes the websocket of a connection.
+ * Connections may close in several ways, some of which don't invoke
+ * any websocket callback, so this is the one place they end up.
+ */
+static void deleteConnection(snServerConnection* connection)
+{
+    snWebsocketServer* server = connection->thread->server;
+    
+    if (server->closeCallback)
+    {
+        server->closeCallback(server->callbackData, connection->websocket);
+    }
+    
+    snWebsocket_delete(connection->websocket);
+    free(connection);
+}
+
+static void scheduleReap(snServerThread* thread)
+{
+    if (!snTimer_isScheduled(&thread->reapTimer))
+    {
+        snTimerWheel_schedule(snEventLoop_getTimerWheel(thread->loop),
+                              &thread->reapTimer,
+                              SN_WEBSOCKET_SERVER_REAP_INTERVAL);
+    }
+}
+
+static void reapClosedConnections(void* userData)
+{
+    snServerThread* thread = (snServerThread*)userData;
+    int i;
+    
+    /*iterate backwards, since deleted connections are replaced by the last one*/
+    for (i = thread->numConnections - 1; i >= 0; i--)
+    {
+        snServerConnection* connection = thread->connections[i];
+        if (snWebsocket_getState(connection->websocket) == SN_STATE_CLOSED)
+        {
+            thread->connections[i] = thread->connections[thread->numConnections - 1];
+            thread->numConnections--;
+            deleteConnection(connection);
+        }
+    }
+    
+    if (thread->numConnections > 0)
+    {
+        scheduleReap(thread);
+    }
+}
+
+static void addConnection(snServerThread* thread, int descriptor)
+{
+    snWebsocketServer* server = thread->server;
+    
+    snServerConnection* connection = malloc(sizeof(snServerConnection));
+    connection->thread = thread;
+    connection->websocket = snWebsocket_createWithSettings(connectionOpenCallback,
+                                                           connectionMessageCallback,
+                                                           NULL,
+                                                           NULL,
+                                                           connection,
+                                                           &server->websocketOptions);
+    
+    snEventLoop_addWebsocket(thread->loop, connection->websocket);
+    
+    if (snWebsocket_accept(connection->websocket, descriptor) != SN_NO_ERROR)
+    {
+        snWebsocket_delete(connection->websocket);
+        free(connection);
+        close(descriptor);
+        return;
+    }
+    
+    if (thread->numConnections == thread->connectionsCapacity)
+    {
+        thread->connectionsCapacity = thread->connectionsCapacity == 0 ? 64 : 2 * thread->connectionsCapacity;
+        thread->connections = realloc(thread->connections,
+                                      thread->connectionsCapacity * sizeof(snServerConnection*));
+    }
+    
+    thread->connections[thread->numConnections++] = connection;
+    __atomic_add_fetch(&server->numAcceptedConnections, 1, __ATOMIC_RELAXED);
+    
+    scheduleReap(thread);
+}
+
+/**
+ * Invoked by the loop when the listening socket has connections waiting.
+ * The watch is level triggered, so connections left after the per wake up
+ * limit are accepted in the next iteration, after polling other websockets.
+ */
+static void acceptConnections(void* userData)
+{
+    snServerThread* thread = (snServerThread*)userData;
+    int i;
+    
+    for (i = 0; i < SN_MAX_ACCEPTS_PER_WAKE_UP; i++)
+    {
+        const int descriptor = accept(thread->listenDescriptor, NULL, NULL);
+        if (descriptor < 0)
+        {
+            /*no more waiting connections, or e.g. out of descriptors*/
+            break;
+        }
+        
+        addConnection(thread, descriptor);
+    }
+}
+
+/**
+ * Creates a non-blocking socket listening on a given address and port.
+ * Several of these may listen on the same port, and the kernel then
+ * spreads incoming connections between them.
+ * @return The descriptor, or -1 on failure.
+ */
+static int listenOnPort(const char* bindAddress, int port, int backlog)
+{
+    const int descriptor = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (descriptor < 0)
+    {
+        return -1;
+    }
+    
+    int set = 1;
+    setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, (void*)&set, sizeof(int));
+    
+#ifdef SO_REUSEPORT
+    if (setsockopt(descriptor, SOL_SOCKET, SO_REUSEPORT, (void*)&set, sizeof(int)) != 0)
+    {
+        close(descriptor);
+        return -1;
+    }
+#endif /*SO_REUSEPORT*/
+    
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    
+    if (bindAddress && inet_pton(AF_INET, bindAddress, &address.sin_addr) != 1)
+    {
+        close(descriptor);
+        return -1;
+    }
+    
+    const int flags = fcntl(descriptor, F_GETFL, 0);
+    
+    if (bind(descriptor, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(descriptor, backlog) != 0 ||
+        flags < 0 ||
+        fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) != 0)
+    {
+        close(descriptor);
+        return -1;
+    }
+    
+    return descriptor;
+}
+
+static void* threadFunction(void* userData)
+{
+    snServerThread* thread = (snServerThread*)userData;
+    
+    snEventLoop_run(thread->loop);
+    
+    return NULL;
+}
+
+/**
+ * Stops the threads, then deletes the connections and loops from the calling thread.
+ */
+static void deleteThreads(snWebsocketServer* server)
+{
+    int i;
+    
+    for (i = 0; i < server->numThreads; i++)
+    {
+        if (server->threads[i].isStarted)
+        {
+            snEventLoop_stop(server->threads[i].loop);
+        }
+    }
+    
+    for (i = 0; i < server->numThreads; i++)
+    {
+        snServerThread* thread = &server->threads[i];
+        
+        if (thread->isStarted)
+        {
+            pthread_join(thread->thread, NULL);
+        }
+        
+        if (thread->listenWatch)
+        {
+            snEventLoop_unwatchDescriptor(thread->loop, thread->listenWatch);
+        }
+        
+        if (thread->listenDescriptor >= 0)
+        {
+            close(thread->listenDescriptor);
+        }
+        
+        while (thread->numConnections > 0)
+        {
+            deleteConnection(thread->connections[--thread->numConnections]);
+        }
+        
+        free(thread->connections);
+        snTimer_cancel(&thread->reapTimer);
+        snEventLoop_delete(thread->loop);
+    }
+    
+    free(server->threads);
+    server->threads = NULL;
+    server->numThreads = 0;
+}
+
+snWebsocketServer* snWebsocketServer_create(const snWebsocketServerOptions* options, snError* error)
+{
+    int numThreads = options->numThreads;
+    int i;
+    
+    if (numThreads <= 0)
+    {
+        const long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = numCPUs > 0 ? (int)numCPUs : 1;
+    }
+    
+    snWebsocketServer* server = malloc(sizeof(snWebsocketServer));
+    memset(server, 0, sizeof(snWebsocketServer));
+    server->port = options->port;
+    server->openCallback = options->openCallback;
+    server->messageCallback = options->messageCallback;
+    server->closeCallback = options->closeCallback;
+    server->callbackData = options->callbackData;
+    
+    if (options->websocketOptions)
+    {
+        memcpy(&server->websocketOptions, options->websocketOptions, sizeof(snWebsocketOptions));
+    }
+    
+    /*the callback data of accepted websockets is the server's connection*/
+    server->websocketOptions.frameCallback = NULL;
+    server->websocketOptions.messageStreamCallbacks = NULL;
+    server->websocketOptions.messageQueue = NULL;
+    server->websocketOptions.writableCallback = NULL;
+    server->websocketOptions.timerWheel = NULL;
+    server->websocketOptions.autoReconnect = 0;
+    server->websocketOptions.reconnectCallback = NULL;
+    server->websocketOptions.tcpFastOpen = 0;
+    server->websocketOptions.perMessageDeflate = NULL;
+    
+    const int backlog = options->backlog > 0 ? options->backlog : SN_WEBSOCKET_SERVER_DEFAULT_BACKLOG;
+    snError result = SN_NO_ERROR;
+    
+    server->threads = malloc(numThreads * sizeof(snServerThread));
+    memset(server->threads, 0, numThreads * sizeof(snServerThread));
+    
+    for (i = 0; i < numThreads && result == SN_NO_ERROR; i++)
+    {
+        snServerThread* thread = &server->threads[i];
+        thread->server = server;
+        thread->listenDescriptor = -1;
+        snTimer_init(&thread->reapTimer, reapClosedConnections, thread);
+        
+        thread->loop = snEventLoop_create();
+        if (thread->loop == NULL)
+        {
+            result = SN_EVENT_LOOP_ERROR;
+            break;
+        }
+        
+        server->numThreads++;
+        
+        /*every thread listens on the port picked for the first one*/
+        thread->listenDescriptor = listenOnPort(options->bindAddress, server->port, backlog);
+        if (thread->listenDescriptor < 0)
+        {
+            result = SN_FAILED_TO_LISTEN;
+            break;
+        }
+        
+        if (server->port == 0)
+        {
+            struct sockaddr_in address;
+            socklen_t addressSize = sizeof(address);
+            getsockname(thread->listenDescriptor, (struct sockaddr*)&address, &addressSize);
+            server->port = ntohs(address.sin_port);
+        }
+        
+        thread->listenWatch = snEventLoop_watchDescriptor(thread->loop,
+                                                          thread->listenDescriptor,
+                                                          acceptConnections,
+                                                          thread);
+        if (thread->listenWatch == NULL)
+        {
+            result = SN_EVENT_LOOP_ERROR;
+        }
+    }
+    
+    if (result != SN_NO_ERROR)
+    {
+        deleteThreads(server);
+        free(server);
+        server = NULL;
+    }
+    else
+    {
+        for (i = 0; i < server->numThreads; i++)
+        {
+            pthread_create(&server->threads[i].thread, NULL, threadFunction, &server->threads[i]);
+            server->threads[i].isStarted = 1;
+        }
+    }
+    
+    if (error)
+    {
+        *error = result;
+    }
+    
+    return server;
+}
+
+void snWebsocketServer_delete(snWebsocketServer* server)
+{
+    if (server == NULL)
+    {
+        return;
+    }
+    
+    deleteThreads(server);
+    free(server);
+}
+
+int snWebsocketServer_getPort(snWebsocketServer* server)
+{
+    return server->port;
+}
+
+int snWebsocketServer_getNumThreads(snWebsocketServer* server)
+{
+    return server->numThreads;
+}
+
+snEventLoop* snWebsocketServer_getLoop(snWebsocketServer* server, int index)
+{
+    return server->threads[index].loop;
+}
+
+int snWebsocketServer_getNumAcceptedConnections(snWebsocketServer* server)
+{
+    return __atomic_load_n(&server->numAcceptedConnections, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_WEBSOCKET_SERVER_H
+#define SN_WEBSOCKET_SERVER_H
+
+#include "errorcodes.h"
+#include "eventloop.h"
+#include "websocket.h"
+
+/*! \file */
+
+/** The default maximum number of connections waiting to be accepted, per thread. */
+#define SN_WEBSOCKET_SERVER_DEFAULT_BACKLOG 1024
+
+/** How often in milliseconds each thread deletes the websockets of closed connections. */
+#define SN_WEBSOCKET_SERVER_REAP_INTERVAL 100
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+    
+    /**
+     * Accepts websocket connections on a TCP port, spreading them across a
+     * number of threads. Each thread runs an event loop and has its own
+     * listening socket bound to the port with SO_REUSEPORT, so the kernel
+     * shards incoming connections between the threads and accepting needs
+     * no locking. A connection stays on the thread that accepted it.
+     *
+     * Accepted connections are driven by \c snWebsocket instances acting as
+     * the server end, see \c snWebsocket_accept. They must only be used from
+     * the server callbacks or through their loop, e.g. using \c snEventLoop_sendFrame.
+     * Only available on Linux.
+     */
+    typedef struct snWebsocketServer snWebsocketServer;
+    
+    /**
+     * Invoked on the thread of a connection.
+     * @param userData The callback data of the server.
+     * @param ws The websocket of the connection.
+     */
+    typedef void (*snServerConnectionCallback)(void* userData, snWebsocket* ws);
+    
+    /**
+     * Invoked on the thread of a connection when it receives a ping, a pong
+     * or a full text or binary message.
+     * @param userData The callback data of the server.
+     * @param ws The websocket of the connection, e.g. for replying.
+     */
+    typedef void (*snServerMessageCallback)(void* userData,
+                                            snWebsocket* ws,
+                                            snOpcode opcode,
+                                            const char* bytes,
+                                            int numBytes);
+    
+    /**
+     * Server settings.
+     */
+    typedef struct snWebsocketServerOptions
+    {
+        /** The port to listen on, or 0 to pick a free one. See \c snWebsocketServer_getPort. */
+        int port;
+        /** The IPv4 address to listen on, or NULL for all interfaces. */
+        const char* bindAddress;
+        /** The number of threads, or 0 for one per online CPU. */
+        int numThreads;
+        /** The listen backlog of each thread, or 0 for \c SN_WEBSOCKET_SERVER_DEFAULT_BACKLOG. */
+        int backlog;
+        /** Invoked when the opening handshake of a connection completes. Ignored if NULL. */
+        snServerConnectionCallback openCallback;
+        /** Ignored if NULL. */
+        snServerMessageCallback messageCallback;
+        /**
+         * Invoked once for every accepted connection when it has closed, for whatever
+         * reason, right before its websocket is deleted. Ignored if NULL.
+         */
+        snServerConnectionCallback closeCallback;
+        /** A pointer to pass to the callbacks. */
+        void* callbackData;
+        /**
+         * Options for the websockets of accepted connections, or NULL for the
+         * defaults. Callbacks, timer wheels, reconnecting and extension offers are ignored.
+         */
+        snWebsocketOptions* websocketOptions;
+    } snWebsocketServerOptions;
+    
+    /**
+     * Creates a server and starts accepting connections.
+     * @param options The server settings.
+     * @param error Set to an error code if not NULL.
+     * @return The new server, or NULL if it could not listen on the given port
+     * or event loops are not supported.
+     */
+    snWebsocketServer* snWebsocketServer_create(const snWebsocketServerOptions* options, snError* error);
+    
+    /**
+     * Stops accepting connections, stops the server threads and deletes the
+     * websockets of all connections, invoking the close callback for each one.
+     * @param server The server to delete.
+     */
+    void snWebsocketServer_delete(snWebsocketServer* server);
+    
+    /**
+     * @param server The server.
+     * @return The port the server is listening on.
+     */
+    int snWebsocketServer_getPort(snWebsocketServer* server);
+    
+    /**
+     * @param server The server.
+     * @return The number of threads accepting connections.
+     */
+    int snWebsocketServer_getNumThreads(snWebsocketServer* server);
+    
+    /**
+     * @param server The server.
+     * @param index The index of the thread.
+     * @return The event loop of the thread.
+     */
+    snEventLoop* snWebsocketServer_getLoop(snWebsocketServer* server, int index);
+    
+    /**
+     * May be called from any thread.
+     * @param server The server.
+     * @return The number of connections accepted so far.
+     */
+    int snWebsocketServer_getNumAcceptedConnections(snWebsocketServer* server);
+    
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /*SN_WEBSOCKET_SERVER_H*/
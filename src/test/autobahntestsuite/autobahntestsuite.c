@@ -77,7 +77,7 @@ void messageCallback(void* userData, snOpcode opcode, const char* data, int numB
  */
 int main(int argc, const char* argv[])
 {
-    const int pollDurationMs = 1;
+    const int pollDurationMs = 100;
     const char* agentName = "snacka";
     const char* baseURL = "ws://localhost:9001/";
     
@@ -113,7 +113,7 @@ int main(int argc, const char* argv[])
                snWebsocket_getState(test.websocket) != SN_STATE_CLOSED)
         {
             snWebsocket_poll(test.websocket);
-            usleep(1000 * pollDurationMs);
+            snWebsocket_waitForEvents(test.websocket, pollDurationMs);
         }
         printf("Fetched test count %d\n", test.testCount);
         printf("\n");
@@ -140,7 +140,7 @@ int main(int argc, const char* argv[])
             while (snWebsocket_getState(test.websocket) != SN_STATE_CLOSED)
             {
                 snWebsocket_poll(test.websocket);
-                usleep(1000 * pollDurationMs);
+                snWebsocket_waitForEvents(test.websocket, pollDurationMs);
             }
         }
         
@@ -159,7 +159,7 @@ int main(int argc, const char* argv[])
         while (snWebsocket_getState(test.websocket) != SN_STATE_CLOSED)
         {
             snWebsocket_poll(test.websocket);
-            usleep(1000 * pollDurationMs);
+            snWebsocket_waitForEvents(test.websocket, pollDurationMs);
         }
         
         printf("Done.\n");
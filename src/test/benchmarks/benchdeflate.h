@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_DEFLATE_H
+#define SN_BENCH_DEFLATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <snacka/frameheader.h>
+#include <snacka/permessagedeflate.h>
+
+#include "benchmark.h"
+#include "bencheventloop.h"
+
+#define DEFLATE_BENCH_NUM_MESSAGES 2000
+
+#define DEFLATE_BENCH_NUM_PASSES 5
+
+#define DEFLATE_BENCH_MAX_MESSAGE_SIZE 512
+
+/**
+ * A permessage-deflate configuration to measure. Window bits of 0 means
+ * messages are sent uncompressed.
+ */
+typedef struct benchDeflateCase
+{
+    const char* name;
+    int clientMaxWindowBits;
+    int clientNoContextTakeover;
+} benchDeflateCase;
+
+/**
+ * Fills a corpus with market data feed like JSON messages: mostly quotes
+ * and trades for a small set of symbols, with an occasional short heartbeat
+ * that stays below the compression threshold.
+ */
+static int benchDeflateCreateCorpus(char** messages, int* messageSizes)
+{
+    static const char* symbols[] = {"AAPL", "MSFT", "AMZN", "GOOG", "TSLA", "NVDA", "META", "NFLX"};
+    unsigned int seed = 12345;
+    int totalSize = 0;
+    int i;
+    
+    for (i = 0; i < DEFLATE_BENCH_NUM_MESSAGES; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        const char* symbol = symbols[(seed >> 16) % 8];
+        const int price = 10000 + (seed >> 8) % 5000;
+        
+        messages[i] = malloc(DEFLATE_BENCH_MAX_MESSAGE_SIZE);
+        if (i % 10 == 9)
+        {
+            messageSizes[i] = snprintf(messages[i], DEFLATE_BENCH_MAX_MESSAGE_SIZE,
+                                       "{\"type\": \"heartbeat\", \"seq\": %d}", i);
+        }
+        else if (i % 3 == 0)
+        {
+            messageSizes[i] = snprintf(messages[i], DEFLATE_BENCH_MAX_MESSAGE_SIZE,
+                                       "{\"type\": \"trade\", \"seq\": %d, \"symbol\": \"%s\", \"price\": %d.%02d, "
+                                       "\"size\": %u, \"side\": \"%s\", \"exchange\": \"XNAS\", "
+                                       "\"conditions\": [\"regular\", \"odd_lot\"], \"timestamp\": %u}",
+                                       i, symbol, price / 100, price % 100, (seed >> 4) % 1000,
+                                       (seed & 1) ? "buy" : "sell", 1700000000 + i);
+        }
+        else
+        {
+            messageSizes[i] = snprintf(messages[i], DEFLATE_BENCH_MAX_MESSAGE_SIZE,
+                                       "{\"type\": \"quote\", \"seq\": %d, \"symbol\": \"%s\", "
+                                       "\"bid\": {\"price\": %d.%02d, \"size\": %u}, "
+                                       "\"ask\": {\"price\": %d.%02d, \"size\": %u}, "
+                                       "\"exchange\": \"XNAS\", \"timestamp\": %u}",
+                                       i, symbol, price / 100, price % 100, (seed >> 3) % 500,
+                                       (price + 5) / 100, (price + 5) % 100, (seed >> 5) % 500,
+                                       1700000000 + i);
+        }
+        totalSize += messageSizes[i];
+    }
+    
+    return totalSize;
+}
+
+/** The size of the header of a masked client frame with a given payload size. */
+static int benchDeflateHeaderSize(int payloadSize)
+{
+    return 2 + 4 + (payloadSize < 126 ? 0 : (payloadSize < (1 << 16) ? 2 : 8));
+}
+
+/**
+ * Compresses the corpus like \c snWebsocket_sendFrame does and decompresses
+ * it like the receiving end would, reporting bytes on the wire and CPU time.
+ */
+static void benchDeflateRun(const benchDeflateCase* c, char** messages, int* messageSizes)
+{
+    snPerMessageDeflateOptions parameters;
+    snPerMessageDeflateOptions peerParameters;
+    snPerMessageDeflate sender;
+    snPerMessageDeflate receiver;
+    snDeflateStreamPoolStats stats;
+    char** payloads = malloc(DEFLATE_BENCH_NUM_MESSAGES * sizeof(char*));
+    int* payloadSizes = malloc(DEFLATE_BENCH_NUM_MESSAGES * sizeof(int));
+    int* isCompressed = malloc(DEFLATE_BENCH_NUM_MESSAGES * sizeof(int));
+    double compressTime = 0;
+    double decompressTime = 0;
+    long long numWireBytes = 0;
+    int numHeldStreams = 0;
+    int pass;
+    int i;
+    
+    memset(&parameters, 0, sizeof(snPerMessageDeflateOptions));
+    parameters.clientMaxWindowBits = c->clientMaxWindowBits;
+    parameters.clientNoContextTakeover = c->clientNoContextTakeover;
+    memset(&peerParameters, 0, sizeof(snPerMessageDeflateOptions));
+    peerParameters.serverMaxWindowBits = c->clientMaxWindowBits;
+    peerParameters.serverNoContextTakeover = c->clientNoContextTakeover;
+    
+    for (pass = 0; pass < DEFLATE_BENCH_NUM_PASSES; pass++)
+    {
+        snPerMessageDeflate_init(&sender, &parameters);
+        snPerMessageDeflate_init(&receiver, &peerParameters);
+        
+        double startTime = benchmarkThreadCPUTime();
+        for (i = 0; i < DEFLATE_BENCH_NUM_MESSAGES; i++)
+        {
+            const char* compressed = NULL;
+            int numCompressedBytes = 0;
+            
+            payloads[i] = messages[i];
+            payloadSizes[i] = messageSizes[i];
+            isCompressed[i] = 0;
+            
+            if (c->clientMaxWindowBits == 0 || messageSizes[i] < sender.parameters.compressionThreshold ||
+                snPerMessageDeflate_compress(&sender, messages[i], messageSizes[i],
+                                             &compressed, &numCompressedBytes) != SN_NO_ERROR)
+            {
+                continue;
+            }
+            
+            if (numCompressedBytes < messageSizes[i] || !c->clientNoContextTakeover)
+            {
+                /*the compressed message is overwritten by the next one*/
+                payloads[i] = malloc(numCompressedBytes);
+                memcpy(payloads[i], compressed, numCompressedBytes);
+                payloadSizes[i] = numCompressedBytes;
+                isCompressed[i] = 1;
+            }
+        }
+        compressTime += benchmarkThreadCPUTime() - startTime;
+        
+        snPerMessageDeflate_getPoolStats(&stats);
+        numHeldStreams = stats.numStreams - stats.numIdleStreams;
+        
+        startTime = benchmarkThreadCPUTime();
+        for (i = 0; i < DEFLATE_BENCH_NUM_MESSAGES; i++)
+        {
+            const char* message = NULL;
+            int messageSize = 0;
+            
+            if (isCompressed[i] &&
+                (snPerMessageDeflate_decompress(&receiver, payloads[i], payloadSizes[i], 1 << 16,
+                                                &message, &messageSize) != SN_NO_ERROR ||
+                 messageSize != messageSizes[i]))
+            {
+                printf("  %s: decompression failed\n", c->name);
+                break;
+            }
+        }
+        decompressTime += benchmarkThreadCPUTime() - startTime;
+        
+        for (i = 0; i < DEFLATE_BENCH_NUM_MESSAGES; i++)
+        {
+            if (pass == 0)
+            {
+                numWireBytes += benchDeflateHeaderSize(payloadSizes[i]) + payloadSizes[i];
+            }
+            
+            if (isCompressed[i])
+            {
+                free(payloads[i]);
+            }
+        }
+        
+        snPerMessageDeflate_deinit(&sender);
+        snPerMessageDeflate_deinit(&receiver);
+    }
+    
+    const double numMessages = (double)DEFLATE_BENCH_NUM_MESSAGES;
+    char name[256];
+    
+    printf("%s\n", c->name);
+    benchmarkReport("wire bytes per message", numWireBytes / numMessages, "B");
+    sprintf(name, "compress CPU per message");
+    benchmarkReport(name, 1000000.0 * compressTime / (numMessages * DEFLATE_BENCH_NUM_PASSES), "us");
+    sprintf(name, "decompress CPU per message");
+    benchmarkReport(name, 1000000.0 * decompressTime / (numMessages * DEFLATE_BENCH_NUM_PASSES), "us");
+    benchmarkReport("sender zlib streams held between messages", numHeldStreams, "");
+    
+    free(payloads);
+    free(payloadSizes);
+    free(isCompressed);
+}
+
+/**
+ * Measures what permessage-deflate saves on the wire for a JSON market data
+ * feed and what it costs in CPU time per message on the sending and receiving
+ * side, for different window sizes, with and without context takeover.
+ * Messages below the default compression threshold are sent uncompressed.
+ */
+static void benchmarkDeflate(void)
+{
+    static const benchDeflateCase cases[] =
+    {
+        {"uncompressed", 0, 0},
+        {"permessage-deflate, 32K window", 15, 0},
+        {"permessage-deflate, 32K window, no context takeover", 15, 1},
+        {"permessage-deflate, 1K window", 10, 0},
+        {"permessage-deflate, 1K window, no context takeover", 10, 1}
+    };
+    char* messages[DEFLATE_BENCH_NUM_MESSAGES];
+    int messageSizes[DEFLATE_BENCH_NUM_MESSAGES];
+    int i;
+    
+    const int totalSize = benchDeflateCreateCorpus(messages, messageSizes);
+    printf("permessage-deflate on %d JSON messages, %.1f bytes on average\n",
+           DEFLATE_BENCH_NUM_MESSAGES, totalSize / (double)DEFLATE_BENCH_NUM_MESSAGES);
+    
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        benchDeflateRun(&cases[i], messages, messageSizes);
+    }
+    
+    for (i = 0; i < DEFLATE_BENCH_NUM_MESSAGES; i++)
+    {
+        free(messages[i]);
+    }
+}
+
+#endif /*SN_BENCH_DEFLATE_H*/
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_DISPATCHER_H
+#define SN_BENCH_DISPATCHER_H
+
+#ifdef __linux__
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <snacka/dispatcher.h>
+#include <snacka/websocket.h>
+
+#include "benchmark.h"
+#include "bencheventloop.h"
+
+#define DISPATCHER_BENCH_NUM_CONNECTIONS 64
+
+/** The number of messages each connection keeps in flight. */
+#define DISPATCHER_BENCH_WINDOW 4
+
+#define DISPATCHER_BENCH_HANDLER_DURATION 0.00005 /*in seconds*/
+
+#define DISPATCHER_BENCH_DURATION 1.0 /*in seconds*/
+
+typedef struct benchDispatcherConnection
+{
+    snWebsocket* websocket;
+    int isOpen;
+    int numSent;
+    /** Written by the thread handling messages. */
+    int numHandled;
+} benchDispatcherConnection;
+
+static void benchDispatcherOpenCallback(void* userData)
+{
+    ((benchDispatcherConnection*)userData)->isOpen = 1;
+}
+
+/** Stands in for decompression or parsing. */
+static void benchDispatcherMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    benchDispatcherConnection* c = (benchDispatcherConnection*)userData;
+    const double startTime = benchmarkThreadCPUTime();
+    
+    while (benchmarkThreadCPUTime() - startTime < DISPATCHER_BENCH_HANDLER_DURATION) {}
+    
+    __atomic_add_fetch(&c->numHandled, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Drives echoing connections from one polling thread, handling messages
+ * inline if \c numThreads is 0, and reports the number of handled
+ * messages per second and the longest pass over all websockets.
+ */
+static void benchDispatcherRun(const char* url, int numThreads, const char* name)
+{
+    snDispatcher* dispatcher = numThreads > 0 ? snDispatcher_create(numThreads) : NULL;
+    benchDispatcherConnection connections[DISPATCHER_BENCH_NUM_CONNECTIONS];
+    snSerialQueue* queues[DISPATCHER_BENCH_NUM_CONNECTIONS];
+    snWebsocketOptions options;
+    char rowName[256];
+    double maxPassDuration = 0;
+    int numOpen = 0;
+    int numHandled = 0;
+    int i;
+    
+    memset(connections, 0, sizeof(connections));
+    
+    for (i = 0; i < DISPATCHER_BENCH_NUM_CONNECTIONS; i++)
+    {
+        memset(&options, 0, sizeof(options));
+        queues[i] = dispatcher ? snSerialQueue_create(dispatcher) : NULL;
+        options.messageQueue = queues[i];
+        
+        connections[i].websocket = snWebsocket_createWithSettings(benchDispatcherOpenCallback,
+                                                                  benchDispatcherMessageCallback,
+                                                                  NULL,
+                                                                  NULL,
+                                                                  &connections[i],
+                                                                  &options);
+        snWebsocket_connect(connections[i].websocket, url);
+    }
+    
+    const double connectDeadline = benchmarkTime() + 10.0;
+    while (numOpen < DISPATCHER_BENCH_NUM_CONNECTIONS && benchmarkTime() < connectDeadline)
+    {
+        numOpen = 0;
+        for (i = 0; i < DISPATCHER_BENCH_NUM_CONNECTIONS; i++)
+        {
+            snWebsocket_poll(connections[i].websocket);
+            numOpen += connections[i].isOpen;
+        }
+    }
+    
+    const double startTime = benchmarkTime();
+    double passStartTime = startTime;
+    while (passStartTime - startTime < DISPATCHER_BENCH_DURATION)
+    {
+        for (i = 0; i < DISPATCHER_BENCH_NUM_CONNECTIONS; i++)
+        {
+            benchDispatcherConnection* c = &connections[i];
+            
+            while (c->isOpen &&
+                   c->numSent - __atomic_load_n(&c->numHandled, __ATOMIC_ACQUIRE) < DISPATCHER_BENCH_WINDOW)
+            {
+                snWebsocket_sendTextData(c->websocket, "{\"type\": \"tick\", \"value\": 12345}");
+                c->numSent++;
+            }
+            
+            snWebsocket_poll(c->websocket);
+        }
+        
+        const double now = benchmarkTime();
+        if (now - passStartTime > maxPassDuration)
+        {
+            maxPassDuration = now - passStartTime;
+        }
+        passStartTime = now;
+    }
+    const double duration = benchmarkTime() - startTime;
+    
+    for (i = 0; i < DISPATCHER_BENCH_NUM_CONNECTIONS; i++)
+    {
+        numHandled += __atomic_load_n(&connections[i].numHandled, __ATOMIC_ACQUIRE);
+        snWebsocket_delete(connections[i].websocket);
+        if (queues[i])
+        {
+            snSerialQueue_delete(queues[i]);
+        }
+    }
+    
+    /*wait for the workers to stop touching the connections*/
+    if (dispatcher)
+    {
+        snDispatcher_delete(dispatcher);
+    }
+    
+    printf("%s\n", name);
+    sprintf(rowName, "handled messages per second");
+    benchmarkReport(rowName, numHandled / duration, "1/s");
+    sprintf(rowName, "longest pass over all websockets");
+    benchmarkReport(rowName, 1000.0 * maxPassDuration, "ms");
+}
+
+/**
+ * Measures the throughput of websockets with an expensive message handler,
+ * run inline by snWebsocket_poll and on dispatchers with different numbers
+ * of worker threads, up to the number of online CPUs.
+ */
+static void benchmarkDispatcher(void)
+{
+    benchEchoServer server;
+    char url[256];
+    char name[256];
+    const long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+    int numThreads;
+    
+    if (!benchEchoServerStart(&server))
+    {
+        printf("Failed to set up the dispatcher benchmark\n");
+        return;
+    }
+    
+    sprintf(url, "ws://127.0.0.1:%d/", server.port);
+    printf("%d connections, %d messages in flight each, %.0f us handler\n\n",
+           DISPATCHER_BENCH_NUM_CONNECTIONS,
+           DISPATCHER_BENCH_WINDOW,
+           1000000.0 * DISPATCHER_BENCH_HANDLER_DURATION);
+    
+    benchDispatcherRun(url, 0, "inline in snWebsocket_poll");
+    
+    for (numThreads = 1; numThreads <= (numCPUs > 1 ? numCPUs : 1); numThreads *= 2)
+    {
+        sprintf(name, "snDispatcher, %d worker thread%s", numThreads, numThreads > 1 ? "s" : "");
+        printf("\n");
+        benchDispatcherRun(url, numThreads, name);
+    }
+    
+    benchEchoServerStop(&server);
+}
+
+#else /*__linux__*/
+
+static void benchmarkDispatcher(void)
+{
+    printf("The dispatcher benchmark requires Linux\n");
+}
+
+#endif /*__linux__*/
+
+#endif /*SN_BENCH_DISPATCHER_H*/
@@ -0,0 +1,507 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_EVENT_LOOP_H
+#define SN_BENCH_EVENT_LOOP_H
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <snacka/eventloop.h>
+#include <snacka/websocket.h>
+
+#include "benchmark.h"
+
+#define EVENT_LOOP_BENCH_MAX_CONNECTIONS 10000
+
+#define EVENT_LOOP_BENCH_NUM_ACTIVE_CONNECTIONS 100
+
+#define EVENT_LOOP_BENCH_DURATION 2.0 /*in seconds*/
+
+#define EVENT_LOOP_BENCH_MAX_LATENCIES (1 << 20)
+
+/** A connection accepted by the echo server. */
+typedef struct benchEchoConnection
+{
+    int descriptor;
+    int hasCompletedHandshake;
+    struct benchEchoConnection* previous;
+    struct benchEchoConnection* next;
+    int numBytes;
+    unsigned char buffer[2048];
+} benchEchoConnection;
+
+/** A minimal websocket echo server, running on its own thread. */
+typedef struct benchEchoServer
+{
+    pthread_t thread;
+    int listenDescriptor;
+    int stopPipe[2];
+    int port;
+} benchEchoServer;
+
+typedef struct benchEventLoopState
+{
+    int numOpen;
+    int isSending;
+    double* latencies;
+    int numLatencies;
+} benchEventLoopState;
+
+typedef struct benchEventLoopClient
+{
+    snWebsocket* websocket;
+    benchEventLoopState* state;
+    double sendTime;
+} benchEventLoopClient;
+
+static double benchmarkThreadCPUTime(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+/**
+ * Completes the opening handshake or echoes complete frames, unmasked.
+ * The benchmark only sends small frames, so there is no need to handle
+ * frames that don't fit in the connection buffer.
+ */
+static void benchEchoConnectionProcess(benchEchoConnection* c)
+{
+    int position = 0;
+    
+    if (!c->hasCompletedHandshake)
+    {
+        static const char response[] =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n";
+        unsigned char* end;
+        
+        c->buffer[c->numBytes < sizeof(c->buffer) ? c->numBytes : sizeof(c->buffer) - 1] = '\0';
+        end = (unsigned char*)strstr((const char*)c->buffer, "\r\n\r\n");
+        if (end == NULL)
+        {
+            return;
+        }
+        
+        c->hasCompletedHandshake = 1;
+        position = (int)(end - c->buffer) + 4;
+        if (send(c->descriptor, response, sizeof(response) - 1, MSG_NOSIGNAL) < 0)
+        {
+            return;
+        }
+    }
+    
+    while (c->numBytes - position >= 6)
+    {
+        unsigned char* frame = &c->buffer[position];
+        const int payloadSize = frame[1] & 0x7f;
+        const int frameSize = 6 + payloadSize;
+        unsigned char reply[2 + 125];
+        int i;
+        
+        if (c->numBytes - position < frameSize)
+        {
+            break;
+        }
+        
+        /*answer pings, so that keepalive pings don't time out*/
+        reply[0] = (frame[0] & 0x0f) == SN_OPCODE_PING ? (0x80 | SN_OPCODE_PONG) : frame[0];
+        reply[1] = payloadSize;
+        for (i = 0; i < payloadSize; i++)
+        {
+            reply[2 + i] = frame[6 + i] ^ frame[2 + (i % 4)];
+        }
+        
+        if (send(c->descriptor, reply, 2 + payloadSize, MSG_NOSIGNAL) < 0)
+        {
+            return;
+        }
+        
+        position += frameSize;
+    }
+    
+    memmove(c->buffer, &c->buffer[position], c->numBytes - position);
+    c->numBytes -= position;
+}
+
+static void* benchEchoServerThreadFunction(void* userData)
+{
+    benchEchoServer* server = (benchEchoServer*)userData;
+    const int epollDescriptor = epoll_create1(0);
+    struct epoll_event events[256];
+    struct epoll_event event;
+    benchEchoConnection* connections = NULL;
+    int isRunning = 1;
+    int i;
+    
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = &server->listenDescriptor;
+    epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, server->listenDescriptor, &event);
+    event.data.ptr = server->stopPipe;
+    epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, server->stopPipe[0], &event);
+    
+    while (isRunning)
+    {
+        const int numEvents = epoll_wait(epollDescriptor, events, 256, -1);
+        
+        for (i = 0; i < numEvents; i++)
+        {
+            if (events[i].data.ptr == server->stopPipe)
+            {
+                isRunning = 0;
+            }
+            else if (events[i].data.ptr == &server->listenDescriptor)
+            {
+                const int descriptor = accept(server->listenDescriptor, NULL, NULL);
+                if (descriptor >= 0)
+                {
+                    int flag = 1;
+                    benchEchoConnection* c = calloc(1, sizeof(benchEchoConnection));
+                    c->descriptor = descriptor;
+                    c->next = connections;
+                    if (connections)
+                    {
+                        connections->previous = c;
+                    }
+                    connections = c;
+                    setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+                    event.data.ptr = c;
+                    epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event);
+                }
+            }
+            else
+            {
+                benchEchoConnection* c = (benchEchoConnection*)events[i].data.ptr;
+                const int numBytesRead = (int)read(c->descriptor,
+                                                   &c->buffer[c->numBytes],
+                                                   sizeof(c->buffer) - 1 - c->numBytes);
+                if (numBytesRead <= 0)
+                {
+                    if (c->previous)
+                    {
+                        c->previous->next = c->next;
+                    }
+                    else
+                    {
+                        connections = c->next;
+                    }
+                    if (c->next)
+                    {
+                        c->next->previous = c->previous;
+                    }
+                    close(c->descriptor);
+                    free(c);
+                    continue;
+                }
+                
+                c->numBytes += numBytesRead;
+                benchEchoConnectionProcess(c);
+            }
+        }
+    }
+    
+    /*close connections still open, like a server going down would*/
+    while (connections)
+    {
+        benchEchoConnection* next = connections->next;
+        close(connections->descriptor);
+        free(connections);
+        connections = next;
+    }
+    close(epollDescriptor);
+    return NULL;
+}
+
+/** Starts an echo server on a given port, or on any free port if 0. */
+static int benchEchoServerStartOnPort(benchEchoServer* server, int port)
+{
+    struct sockaddr_in address;
+    socklen_t addressSize = sizeof(address);
+    int flag = 1;
+    
+    memset(server, 0, sizeof(benchEchoServer));
+    server->listenDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(server->listenDescriptor, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    
+#ifdef TCP_FASTOPEN
+    /*accept opening handshakes in the SYN, if enabled in net.ipv4.tcp_fastopen*/
+    int fastOpenQueueLength = 256;
+    setsockopt(server->listenDescriptor, IPPROTO_TCP, TCP_FASTOPEN, &fastOpenQueueLength, sizeof(fastOpenQueueLength));
+#endif /*TCP_FASTOPEN*/
+    
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    
+    if (bind(server->listenDescriptor, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server->listenDescriptor, 4096) != 0 ||
+        getsockname(server->listenDescriptor, (struct sockaddr*)&address, &addressSize) != 0 ||
+        pipe(server->stopPipe) != 0)
+    {
+        close(server->listenDescriptor);
+        return 0;
+    }
+    
+    server->port = ntohs(address.sin_port);
+    pthread_create(&server->thread, NULL, benchEchoServerThreadFunction, server);
+    
+    return 1;
+}
+
+static int benchEchoServerStart(benchEchoServer* server)
+{
+    return benchEchoServerStartOnPort(server, 0);
+}
+
+static void benchEchoServerStop(benchEchoServer* server)
+{
+    const char stop = 1;
+    if (write(server->stopPipe[1], &stop, 1) == 1)
+    {
+        pthread_join(server->thread, NULL);
+    }
+    close(server->stopPipe[0]);
+    close(server->stopPipe[1]);
+    close(server->listenDescriptor);
+}
+
+static void benchEventLoopOpenCallback(void* userData)
+{
+    benchEventLoopClient* client = (benchEventLoopClient*)userData;
+    client->state->numOpen++;
+}
+
+static void benchEventLoopSend(benchEventLoopClient* client)
+{
+    client->sendTime = benchmarkTime();
+    snWebsocket_sendTextData(client->websocket, "{\"type\": \"tick\", \"value\": 12345}");
+}
+
+static void benchEventLoopMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    benchEventLoopClient* client = (benchEventLoopClient*)userData;
+    benchEventLoopState* state = client->state;
+    
+    if (state->numLatencies < EVENT_LOOP_BENCH_MAX_LATENCIES)
+    {
+        state->latencies[state->numLatencies] = benchmarkTime() - client->sendTime;
+        state->numLatencies++;
+    }
+    
+    if (state->isSending)
+    {
+        benchEventLoopSend(client);
+    }
+}
+
+static int compareLatencies(const void* a, const void* b)
+{
+    const double d = *(const double*)a - *(const double*)b;
+    return d < 0 ? -1 : (d > 0 ? 1 : 0);
+}
+
+/**
+ * Measures the CPU usage of the thread driving thousands of idle connections,
+ * with an event loop and by polling every websocket every millisecond, and the
+ * round trip latency of a few busy connections among the idle ones.
+ */
+static void benchmarkEventLoop(void)
+{
+    benchEchoServer server;
+    benchEventLoopState state;
+    benchEventLoopClient* clients;
+    snWebsocketOptions options;
+    struct rlimit limit;
+    char url[256];
+    char name[256];
+    int numConnections = EVENT_LOOP_BENCH_MAX_CONNECTIONS;
+    int i;
+    
+    /*each connection uses a descriptor on both ends*/
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if ((int)((limit.rlim_cur - 64) / 2) < numConnections)
+    {
+        numConnections = (int)((limit.rlim_cur - 64) / 2);
+    }
+    
+    snEventLoop* loop = snEventLoop_create();
+    if (loop == NULL || !benchEchoServerStart(&server))
+    {
+        printf("Failed to set up the event loop benchmark\n");
+        snEventLoop_delete(loop);
+        return;
+    }
+    
+    memset(&state, 0, sizeof(state));
+    state.latencies = malloc(EVENT_LOOP_BENCH_MAX_LATENCIES * sizeof(double));
+    clients = calloc(numConnections, sizeof(benchEventLoopClient));
+    
+    /*idle connections don't need big receive buffers*/
+    memset(&options, 0, sizeof(options));
+    options.readBufferSize = 1024;
+    
+    sprintf(url, "ws://127.0.0.1:%d/", server.port);
+    for (i = 0; i < numConnections; i++)
+    {
+        clients[i].state = &state;
+        clients[i].websocket = snWebsocket_createWithSettings(benchEventLoopOpenCallback,
+                                                              benchEventLoopMessageCallback,
+                                                              NULL,
+                                                              NULL,
+                                                              &clients[i],
+                                                              &options);
+        snEventLoop_addWebsocket(loop, clients[i].websocket);
+        snWebsocket_connect(clients[i].websocket, url);
+        
+        /*keep the listen backlog short*/
+        if (i % 256 == 255)
+        {
+            while (snEventLoop_runOnce(loop, 10) > 0) {}
+        }
+    }
+    
+    const double connectDeadline = benchmarkTime() + 30.0;
+    while (state.numOpen < numConnections && benchmarkTime() < connectDeadline)
+    {
+        snEventLoop_runOnce(loop, 100);
+    }
+    
+    printf("Thread CPU usage with %d idle connections (%d open)\n", numConnections, state.numOpen);
+    
+    /*idle, event loop*/
+    {
+        const double startTime = benchmarkTime();
+        const double startCPUTime = benchmarkThreadCPUTime();
+        while (benchmarkTime() - startTime < EVENT_LOOP_BENCH_DURATION)
+        {
+            snEventLoop_runOnce(loop, 100);
+        }
+        const double cpuTime = benchmarkThreadCPUTime() - startCPUTime;
+        benchmarkReport("snEventLoop", 100.0 * cpuTime / (benchmarkTime() - startTime), "%");
+    }
+    
+    /*idle, polling every websocket every millisecond*/
+    {
+        const double startTime = benchmarkTime();
+        const double startCPUTime = benchmarkThreadCPUTime();
+        while (benchmarkTime() - startTime < EVENT_LOOP_BENCH_DURATION)
+        {
+            struct timespec sleepTime = {0, 1000000};
+            for (i = 0; i < numConnections; i++)
+            {
+                snWebsocket_poll(clients[i].websocket);
+            }
+            nanosleep(&sleepTime, NULL);
+        }
+        const double cpuTime = benchmarkThreadCPUTime() - startCPUTime;
+        benchmarkReport("snWebsocket_poll every 1 ms", 100.0 * cpuTime / (benchmarkTime() - startTime), "%");
+    }
+    
+    printf("\n");
+    printf("Round trips with %d busy connections among the idle ones\n", EVENT_LOOP_BENCH_NUM_ACTIVE_CONNECTIONS);
+    
+    /*latency under load*/
+    {
+        const int numActive = numConnections < EVENT_LOOP_BENCH_NUM_ACTIVE_CONNECTIONS ?
+                              numConnections : EVENT_LOOP_BENCH_NUM_ACTIVE_CONNECTIONS;
+        double sum = 0;
+        
+        state.isSending = 1;
+        for (i = 0; i < numActive; i++)
+        {
+            benchEventLoopSend(&clients[i * (numConnections / numActive)]);
+        }
+        
+        const double startTime = benchmarkTime();
+        while (benchmarkTime() - startTime < EVENT_LOOP_BENCH_DURATION)
+        {
+            snEventLoop_runOnce(loop, 10);
+        }
+        const double duration = benchmarkTime() - startTime;
+        
+        state.isSending = 0;
+        while (snEventLoop_runOnce(loop, 100) > 0) {}
+        
+        qsort(state.latencies, state.numLatencies, sizeof(double), compareLatencies);
+        for (i = 0; i < state.numLatencies; i++)
+        {
+            sum += state.latencies[i];
+        }
+        
+        benchmarkReport("round trips per second", state.numLatencies / duration, "1/s");
+        if (state.numLatencies > 0)
+        {
+            sprintf(name, "mean latency");
+            benchmarkReport(name, 1000000.0 * sum / state.numLatencies, "us");
+            sprintf(name, "99th percentile latency");
+            benchmarkReport(name, 1000000.0 * state.latencies[(int)(0.99 * (state.numLatencies - 1))], "us");
+        }
+    }
+    
+    for (i = 0; i < numConnections; i++)
+    {
+        snWebsocket_delete(clients[i].websocket);
+    }
+    
+    snEventLoop_delete(loop);
+    benchEchoServerStop(&server);
+    free(clients);
+    free(state.latencies);
+}
+
+#else /*__linux__*/
+
+static void benchmarkEventLoop(void)
+{
+    printf("The event loop benchmark requires Linux\n");
+}
+
+#endif /*__linux__*/
+
+#endif /*SN_BENCH_EVENT_LOOP_H*/
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_EVENT_LOOP_POOL_H
+#define SN_BENCH_EVENT_LOOP_POOL_H
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <snacka/eventlooppool.h>
+#include <snacka/websocket.h>
+
+#include "benchmark.h"
+
+#define EVENT_LOOP_POOL_BENCH_NUM_CONNECTIONS 64
+
+#define EVENT_LOOP_POOL_BENCH_MAX_THREADS 8
+
+#define EVENT_LOOP_POOL_BENCH_FRAME_SIZE 64
+
+#define EVENT_LOOP_POOL_BENCH_BLOCK_SIZE (1 << 16)
+
+#define EVENT_LOOP_POOL_BENCH_DURATION 1.0 /*in seconds*/
+
+/** A server thread flooding a share of the connections with binary frames. */
+typedef struct benchFloodThread
+{
+    pthread_t thread;
+    const char* block;
+    int* descriptors;
+    int* offsets;
+    int numDescriptors;
+    int isStopped;
+} benchFloodThread;
+
+typedef struct benchPoolClient
+{
+    snWebsocket* websocket;
+    snEventLoop* loop;
+    int* numOpen;
+    int numMessages;
+} benchPoolClient;
+
+static void* benchFloodThreadFunction(void* userData)
+{
+    benchFloodThread* t = (benchFloodThread*)userData;
+    const int epollDescriptor = epoll_create1(0);
+    struct epoll_event events[64];
+    int i;
+    
+    for (i = 0; i < t->numDescriptors; i++)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLOUT;
+        event.data.u32 = i;
+        epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, t->descriptors[i], &event);
+    }
+    
+    while (!__atomic_load_n(&t->isStopped, __ATOMIC_RELAXED))
+    {
+        const int numEvents = epoll_wait(epollDescriptor, events, 64, 10);
+        
+        for (i = 0; i < numEvents; i++)
+        {
+            const int index = events[i].data.u32;
+            /*keep frames intact across partial writes*/
+            const ssize_t numBytesWritten = write(t->descriptors[index],
+                                                  &t->block[t->offsets[index]],
+                                                  EVENT_LOOP_POOL_BENCH_BLOCK_SIZE - t->offsets[index]);
+            if (numBytesWritten > 0)
+            {
+                t->offsets[index] = (t->offsets[index] + (int)numBytesWritten) % EVENT_LOOP_POOL_BENCH_BLOCK_SIZE;
+            }
+        }
+    }
+    
+    close(epollDescriptor);
+    return NULL;
+}
+
+static void benchPoolOpenCallback(void* userData)
+{
+    benchPoolClient* client = (benchPoolClient*)userData;
+    __atomic_add_fetch(client->numOpen, 1, __ATOMIC_RELAXED);
+}
+
+static void benchPoolMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    benchPoolClient* client = (benchPoolClient*)userData;
+    /*only the owning loop thread writes the count*/
+    __atomic_store_n(&client->numMessages, client->numMessages + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Accepts a connection and completes the opening handshake, without
+ * validating the request.
+ */
+static int benchPoolAccept(int listenDescriptor)
+{
+    static const char response[] =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n";
+    char request[2048];
+    int numBytes = 0;
+    
+    const int descriptor = accept(listenDescriptor, NULL, NULL);
+    if (descriptor < 0)
+    {
+        return -1;
+    }
+    
+    while (numBytes < (int)sizeof(request) - 1)
+    {
+        const ssize_t numBytesRead = read(descriptor, &request[numBytes], sizeof(request) - 1 - numBytes);
+        if (numBytesRead <= 0)
+        {
+            break;
+        }
+        numBytes += (int)numBytesRead;
+        request[numBytes] = '\0';
+        if (strstr(request, "\r\n\r\n"))
+        {
+            break;
+        }
+    }
+    
+    if (write(descriptor, response, sizeof(response) - 1) < 0)
+    {
+        close(descriptor);
+        return -1;
+    }
+    
+    return descriptor;
+}
+
+static long long benchPoolCountMessages(benchPoolClient* clients, int numClients)
+{
+    long long numMessages = 0;
+    int i;
+    for (i = 0; i < numClients; i++)
+    {
+        numMessages += __atomic_load_n(&clients[i].numMessages, __ATOMIC_RELAXED);
+    }
+    return numMessages;
+}
+
+/**
+ * Measures the rate of small incoming messages a pool of event loops handles,
+ * by thread count. Each loop thread has its share of the connections, and
+ * as many server threads flood them with frames.
+ */
+static void benchmarkEventLoopPool(void)
+{
+    const int numThreadCounts[] = {1, 2, 4, 8};
+    const int numConnections = EVENT_LOOP_POOL_BENCH_NUM_CONNECTIONS;
+    benchPoolClient clients[EVENT_LOOP_POOL_BENCH_NUM_CONNECTIONS];
+    int descriptors[EVENT_LOOP_POOL_BENCH_NUM_CONNECTIONS];
+    benchFloodThread floodThreads[EVENT_LOOP_POOL_BENCH_MAX_THREADS];
+    char* block = malloc(EVENT_LOOP_POOL_BENCH_BLOCK_SIZE);
+    int i, j;
+    
+    /*a block of unmasked binary frames*/
+    memset(block, 'x', EVENT_LOOP_POOL_BENCH_BLOCK_SIZE);
+    for (i = 0; i < EVENT_LOOP_POOL_BENCH_BLOCK_SIZE; i += EVENT_LOOP_POOL_BENCH_FRAME_SIZE)
+    {
+        block[i] = (char)0x82;
+        block[i + 1] = EVENT_LOOP_POOL_BENCH_FRAME_SIZE - 2;
+    }
+    
+    printf("Incoming %d byte messages per second by loop thread count, millions\n",
+           EVENT_LOOP_POOL_BENCH_FRAME_SIZE - 2);
+    
+    for (i = 0; i < sizeof(numThreadCounts) / sizeof(numThreadCounts[0]); i++)
+    {
+        const int numThreads = numThreadCounts[i];
+        struct sockaddr_in address;
+        socklen_t addressSize = sizeof(address);
+        int numOpen = 0;
+        char url[256];
+        char name[256];
+        
+        const int listenDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listenDescriptor, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(listenDescriptor, numConnections) != 0 ||
+            getsockname(listenDescriptor, (struct sockaddr*)&address, &addressSize) != 0)
+        {
+            printf("Failed to set up the event loop pool benchmark\n");
+            close(listenDescriptor);
+            break;
+        }
+        
+        snEventLoopPool* pool = snEventLoopPool_create(numThreads, SN_LOAD_BALANCING_ROUND_ROBIN, 0);
+        if (pool == NULL)
+        {
+            printf("Failed to set up the event loop pool benchmark\n");
+            close(listenDescriptor);
+            break;
+        }
+        
+        sprintf(url, "ws://127.0.0.1:%d/", ntohs(address.sin_port));
+        for (j = 0; j < numConnections; j++)
+        {
+            memset(&clients[j], 0, sizeof(benchPoolClient));
+            clients[j].numOpen = &numOpen;
+            clients[j].websocket = snWebsocket_create(benchPoolOpenCallback,
+                                                      benchPoolMessageCallback,
+                                                      NULL,
+                                                      NULL,
+                                                      &clients[j]);
+            clients[j].loop = snEventLoopPool_addWebsocket(pool, clients[j].websocket, url);
+            descriptors[j] = benchPoolAccept(listenDescriptor);
+        }
+        
+        while (__atomic_load_n(&numOpen, __ATOMIC_RELAXED) < numConnections)
+        {
+            struct timespec sleepTime = {0, 1000000};
+            nanosleep(&sleepTime, NULL);
+        }
+        
+        /*connections are assigned round robin, so give each server
+          thread the connections of one loop thread*/
+        for (j = 0; j < numThreads; j++)
+        {
+            benchFloodThread* t = &floodThreads[j];
+            int k;
+            memset(t, 0, sizeof(benchFloodThread));
+            t->block = block;
+            t->descriptors = malloc(numConnections * sizeof(int));
+            t->offsets = malloc(numConnections * sizeof(int));
+            for (k = j; k < numConnections; k += numThreads)
+            {
+                t->descriptors[t->numDescriptors] = descriptors[k];
+                t->offsets[t->numDescriptors] = 0;
+                t->numDescriptors++;
+            }
+            pthread_create(&t->thread, NULL, benchFloodThreadFunction, t);
+        }
+        
+        /*let the flood get going before measuring*/
+        {
+            struct timespec sleepTime = {0, 100000000};
+            nanosleep(&sleepTime, NULL);
+        }
+        
+        const long long startCount = benchPoolCountMessages(clients, numConnections);
+        const double startTime = benchmarkTime();
+        while (benchmarkTime() - startTime < EVENT_LOOP_POOL_BENCH_DURATION)
+        {
+            struct timespec sleepTime = {0, 10000000};
+            nanosleep(&sleepTime, NULL);
+        }
+        const long long numMessages = benchPoolCountMessages(clients, numConnections) - startCount;
+        const double duration = benchmarkTime() - startTime;
+        
+        for (j = 0; j < numThreads; j++)
+        {
+            __atomic_store_n(&floodThreads[j].isStopped, 1, __ATOMIC_RELAXED);
+            pthread_join(floodThreads[j].thread, NULL);
+            free(floodThreads[j].descriptors);
+            free(floodThreads[j].offsets);
+        }
+        
+        for (j = 0; j < numConnections; j++)
+        {
+            snEventLoop_deleteWebsocket(clients[j].loop, clients[j].websocket);
+        }
+        snEventLoopPool_delete(pool);
+        
+        for (j = 0; j < numConnections; j++)
+        {
+            close(descriptors[j]);
+        }
+        close(listenDescriptor);
+        
+        sprintf(name, "%d thread(s)", numThreads);
+        benchmarkReport(name, numMessages / duration / 1000000.0, "M/s");
+    }
+    
+    free(block);
+}
+
+#else /*__linux__*/
+
+static void benchmarkEventLoopPool(void)
+{
+    printf("The event loop pool benchmark requires Linux\n");
+}
+
+#endif /*__linux__*/
+
+#endif /*SN_BENCH_EVENT_LOOP_POOL_H*/
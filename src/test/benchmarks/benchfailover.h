@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_FAILOVER_H
+#define SN_BENCH_FAILOVER_H
+
+#ifdef __linux__
+
+#include <string.h>
+
+#include <snacka/failoverwebsocket.h>
+#include <snacka/websocket.h>
+
+#include "benchmark.h"
+#include "bencheventloop.h"
+
+#define FAILOVER_BENCH_NUM_ROUNDS 20
+
+#define FAILOVER_BENCH_STREAM_DURATION 0.05 /*in seconds*/
+
+#define FAILOVER_BENCH_TIMEOUT 2.0 /*in seconds*/
+
+typedef struct benchFailoverState
+{
+    snFailoverWebsocket* fws;
+    snWebsocket* websocket;
+    int isOpen;
+    int numStandbyOpens;
+    int hasFailedOver;
+    double lastEchoTime;
+    double failoverTime;
+    double firstEchoTime;
+} benchFailoverState;
+
+static void benchFailoverSend(benchFailoverState* state)
+{
+    static const char message[] = "{\"type\": \"tick\", \"value\": 12345}";
+    if (state->fws)
+    {
+        snFailoverWebsocket_sendTextData(state->fws, message);
+    }
+    else
+    {
+        snWebsocket_sendTextData(state->websocket, message);
+    }
+}
+
+static void benchFailoverOpenCallback(void* userData)
+{
+    ((benchFailoverState*)userData)->isOpen = 1;
+}
+
+static void benchFailoverStandbyOpenCallback(void* userData, snWebsocket* websocket)
+{
+    ((benchFailoverState*)userData)->numStandbyOpens++;
+}
+
+static void benchFailoverFailoverCallback(void* userData, snWebsocket* websocket)
+{
+    benchFailoverState* state = (benchFailoverState*)userData;
+    state->hasFailedOver = 1;
+    state->failoverTime = benchmarkTime();
+    
+    /*the message in flight on the lost connection is gone*/
+    benchFailoverSend(state);
+}
+
+static void benchFailoverMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    benchFailoverState* state = (benchFailoverState*)userData;
+    
+    if (opcode != SN_OPCODE_TEXT)
+    {
+        return;
+    }
+    
+    if (!state->hasFailedOver)
+    {
+        state->lastEchoTime = benchmarkTime();
+    }
+    else if (state->firstEchoTime == 0)
+    {
+        state->firstEchoTime = benchmarkTime();
+    }
+    
+    benchFailoverSend(state);
+}
+
+static void benchFailoverRunFor(benchFailoverState* state, double duration, int* condition)
+{
+    const double startTime = benchmarkTime();
+    while ((condition == NULL || !*condition) && benchmarkTime() - startTime < duration)
+    {
+        snFailoverWebsocket_waitForEvents(state->fws, 1);
+        snFailoverWebsocket_poll(state->fws);
+    }
+}
+
+/**
+ * Streams echoed messages over a failover websocket connected to two local
+ * servers, stops the server of the active connection and measures how long
+ * the stream is interrupted. For comparison, also measures the time from
+ * starting to connect a websocket until its first echo, which is roughly
+ * what an application without a standby would have to wait after noticing
+ * a lost connection.
+ */
+static void benchmarkFailover(void)
+{
+    double failoverTimes = 0;
+    double maxFailoverTime = 0;
+    double gaps = 0;
+    double maxGap = 0;
+    double reconnectTimes = 0;
+    int numFailovers = 0;
+    int numReconnects = 0;
+    char primaryUrl[64];
+    char standbyUrl[64];
+    benchFailoverState state;
+    int round;
+    
+    memset(&state, 0, sizeof(state));
+    state.fws = snFailoverWebsocket_create(benchFailoverOpenCallback,
+                                           benchFailoverMessageCallback,
+                                           NULL,
+                                           NULL,
+                                           benchFailoverStandbyOpenCallback,
+                                           benchFailoverFailoverCallback,
+                                           &state,
+                                           NULL);
+    snWebsocket* primaryWebsocket = snFailoverWebsocket_getActiveWebsocket(state.fws);
+    
+    for (round = 0; round < FAILOVER_BENCH_NUM_ROUNDS; round++)
+    {
+        benchEchoServer servers[2];
+        
+        if (!benchEchoServerStart(&servers[0]))
+        {
+            break;
+        }
+        if (!benchEchoServerStart(&servers[1]))
+        {
+            benchEchoServerStop(&servers[0]);
+            break;
+        }
+        
+        state.isOpen = 0;
+        state.numStandbyOpens = 0;
+        state.hasFailedOver = 0;
+        state.firstEchoTime = 0;
+        sprintf(primaryUrl, "ws://127.0.0.1:%d/", servers[0].port);
+        sprintf(standbyUrl, "ws://127.0.0.1:%d/", servers[1].port);
+        snFailoverWebsocket_connect(state.fws, primaryUrl, standbyUrl);
+        
+        benchFailoverRunFor(&state, FAILOVER_BENCH_TIMEOUT, &state.numStandbyOpens);
+        if (!state.isOpen || state.numStandbyOpens == 0)
+        {
+            benchEchoServerStop(&servers[0]);
+            benchEchoServerStop(&servers[1]);
+            continue;
+        }
+        
+        benchFailoverSend(&state);
+        benchFailoverRunFor(&state, FAILOVER_BENCH_STREAM_DURATION, NULL);
+        
+        /*take down the server of the active connection, whichever opened first*/
+        const int activeServer = snFailoverWebsocket_getActiveWebsocket(state.fws) == primaryWebsocket ? 0 : 1;
+        const double stopTime = benchmarkTime();
+        benchEchoServerStop(&servers[activeServer]);
+        
+        benchFailoverRunFor(&state, FAILOVER_BENCH_TIMEOUT, &state.hasFailedOver);
+        while (state.hasFailedOver && state.firstEchoTime == 0 && benchmarkTime() - stopTime < FAILOVER_BENCH_TIMEOUT)
+        {
+            snFailoverWebsocket_waitForEvents(state.fws, 1);
+            snFailoverWebsocket_poll(state.fws);
+        }
+        
+        if (state.firstEchoTime > 0)
+        {
+            const double timeToFailover = state.failoverTime - stopTime;
+            const double gap = state.firstEchoTime - state.lastEchoTime;
+            failoverTimes += timeToFailover;
+            gaps += gap;
+            maxFailoverTime = timeToFailover > maxFailoverTime ? timeToFailover : maxFailoverTime;
+            maxGap = gap > maxGap ? gap : maxGap;
+            numFailovers++;
+        }
+        
+        snFailoverWebsocket_disconnect(state.fws);
+        
+        /*connect a websocket without a standby to the remaining server*/
+        benchFailoverState coldState;
+        memset(&coldState, 0, sizeof(coldState));
+        coldState.hasFailedOver = 1;
+        coldState.websocket = snWebsocket_create(NULL, benchFailoverMessageCallback, NULL, NULL, &coldState);
+        
+        const double connectTime = benchmarkTime();
+        snWebsocket_connect(coldState.websocket, activeServer == 0 ? standbyUrl : primaryUrl);
+        while (coldState.firstEchoTime == 0 && benchmarkTime() - connectTime < FAILOVER_BENCH_TIMEOUT)
+        {
+            snWebsocket_waitForEvents(coldState.websocket, 1);
+            snWebsocket_poll(coldState.websocket);
+            if (!coldState.isOpen && snWebsocket_getState(coldState.websocket) == SN_STATE_OPEN)
+            {
+                coldState.isOpen = 1;
+                benchFailoverSend(&coldState);
+            }
+        }
+        
+        if (coldState.firstEchoTime > 0)
+        {
+            reconnectTimes += coldState.firstEchoTime - connectTime;
+            numReconnects++;
+        }
+        
+        snWebsocket_delete(coldState.websocket);
+        benchEchoServerStop(&servers[1 - activeServer]);
+    }
+    
+    snFailoverWebsocket_delete(state.fws);
+    
+    if (numFailovers == 0)
+    {
+        printf("Failed to run the failover benchmark\n");
+        return;
+    }
+    
+    printf("%d failovers between two local servers\n", numFailovers);
+    benchmarkReport("mean time from stopping the server to failover", 1000000.0 * failoverTimes / numFailovers, "us");
+    benchmarkReport("max time from stopping the server to failover", 1000000.0 * maxFailoverTime, "us");
+    benchmarkReport("mean gap between echoes", 1000000.0 * gaps / numFailovers, "us");
+    benchmarkReport("max gap between echoes", 1000000.0 * maxGap, "us");
+    if (numReconnects > 0)
+    {
+        benchmarkReport("mean time to first echo without a standby", 1000000.0 * reconnectTimes / numReconnects, "us");
+    }
+}
+
+#else
+
+static void benchmarkFailover(void)
+{
+    printf("The failover benchmark requires Linux\n");
+}
+
+#endif /*__linux__*/
+
+#endif /*SN_BENCH_FAILOVER_H*/
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_FAST_OPEN_H
+#define SN_BENCH_FAST_OPEN_H
+
+#ifdef __linux__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <snacka/eventloop.h>
+#include <snacka/websocket.h>
+
+#include "benchmark.h"
+#include "bencheventloop.h"
+
+#define FAST_OPEN_BENCH_NUM_CONNECTIONS 50
+
+#define FAST_OPEN_BENCH_TIMEOUT 5.0 /*in seconds*/
+
+/**
+ * Gets the number of connections this host has opened with data in the SYN
+ * accepted by the peer, i.e the TCPFastOpenActive counter in /proc/net/netstat.
+ * @return The counter, or -1 if it is not available.
+ */
+static long long benchFastOpenNumActive(void)
+{
+    char names[8192];
+    char values[8192];
+    long long result = -1;
+    FILE* file = fopen("/proc/net/netstat", "r");
+    
+    if (!file)
+    {
+        return -1;
+    }
+    
+    /*the file consists of pairs of lines, with counter names and values*/
+    while (fgets(names, sizeof(names), file) && fgets(values, sizeof(values), file))
+    {
+        char* nameContext = NULL;
+        char* valueContext = NULL;
+        const char* name = strtok_r(names, " \n", &nameContext);
+        const char* value = strtok_r(values, " \n", &valueContext);
+        
+        if (!name || strcmp(name, "TcpExt:") != 0)
+        {
+            continue;
+        }
+        
+        while ((name = strtok_r(NULL, " \n", &nameContext)) &&
+               (value = strtok_r(NULL, " \n", &valueContext)))
+        {
+            if (strcmp(name, "TCPFastOpenActive") == 0)
+            {
+                result = strtoll(value, NULL, 10);
+            }
+        }
+    }
+    
+    fclose(file);
+    return result;
+}
+
+/**
+ * Opens websockets to a local echo server one at a time and reports
+ * the time from connecting until the opening handshake has completed.
+ */
+static void benchFastOpenRun(const char* name, int tcpFastOpen, int port)
+{
+    snEventLoop* loop = snEventLoop_create();
+    double connectTimes[FAST_OPEN_BENCH_NUM_CONNECTIONS];
+    snWebsocketOptions o;
+    char url[64];
+    int numOpened = 0;
+    int i;
+    
+    memset(&o, 0, sizeof(o));
+    o.tcpFastOpen = tcpFastOpen;
+    sprintf(url, "ws://127.0.0.1:%d/", port);
+    
+    const long long numActiveBefore = benchFastOpenNumActive();
+    
+    for (i = 0; i < FAST_OPEN_BENCH_NUM_CONNECTIONS; i++)
+    {
+        snWebsocket* ws = snWebsocket_createWithSettings(NULL, NULL, NULL, NULL, NULL, &o);
+        snEventLoop_addWebsocket(loop, ws);
+        
+        const double startTime = benchmarkTime();
+        snWebsocket_connect(ws, url);
+        while (snWebsocket_getState(ws) == SN_STATE_CONNECTING &&
+               benchmarkTime() - startTime < FAST_OPEN_BENCH_TIMEOUT)
+        {
+            snEventLoop_runOnce(loop, 10);
+        }
+        
+        if (snWebsocket_getState(ws) == SN_STATE_OPEN)
+        {
+            connectTimes[numOpened] = 1000.0 * (benchmarkTime() - startTime);
+            numOpened++;
+        }
+        
+        snEventLoop_removeWebsocket(loop, ws);
+        snWebsocket_delete(ws);
+    }
+    
+    const long long numActiveAfter = benchFastOpenNumActive();
+    snEventLoop_delete(loop);
+    
+    printf("%s\n", name);
+    if (numOpened == 0)
+    {
+        printf("    no connections opened\n");
+        return;
+    }
+    
+    qsort(connectTimes, numOpened, sizeof(double), compareLatencies);
+    benchmarkReport("median connect to open time", connectTimes[numOpened / 2], "ms");
+    benchmarkReport("max connect to open time", connectTimes[numOpened - 1], "ms");
+    if (numActiveBefore >= 0 && numActiveAfter >= 0)
+    {
+        benchmarkReport("handshakes sent in the SYN", (double)(numActiveAfter - numActiveBefore), "");
+    }
+}
+
+/**
+ * Measures the time to open a websocket to a local server, with and without
+ * sending the opening handshake request using TCP Fast Open. The loopback
+ * round trip is too short for the saved round trip to show, so a delay should
+ * be induced, e.g using tc qdisc add dev lo root netem delay 10ms. Server side
+ * TCP Fast Open must be enabled, e.g using sysctl -w net.ipv4.tcp_fastopen=3.
+ */
+static void benchmarkFastOpen(void)
+{
+    benchEchoServer server;
+    
+    if (!benchEchoServerStart(&server))
+    {
+        printf("Failed to set up the TCP Fast Open benchmark\n");
+        return;
+    }
+    
+    printf("%d websockets opened one at a time\n\n", FAST_OPEN_BENCH_NUM_CONNECTIONS);
+    benchFastOpenRun("opening handshake sent once connected", 0, server.port);
+    printf("\n");
+    benchFastOpenRun("opening handshake sent in the SYN using TCP Fast Open", 1, server.port);
+    
+    benchEchoServerStop(&server);
+}
+
+#else
+
+static void benchmarkFastOpen(void)
+{
+    printf("The TCP Fast Open benchmark requires Linux\n");
+}
+
+#endif /*__linux__*/
+
+#endif /*SN_BENCH_FAST_OPEN_H*/
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_FRAME_PARSER_H
+#define SN_BENCH_FRAME_PARSER_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <snacka/frameparser.h>
+
+#include "benchmark.h"
+
+#define NUM_FRAME_PARSER_BENCH_PAYLOAD_SIZES 5
+
+static void benchFrameParserFrameCallback(void* userData, const snFrame* frame)
+{
+    (*(int*)userData)++;
+}
+
+/**
+ * Parses a stream of frames in a given number of chunks.
+ * If \c splitHeaders is non-zero, every header is split across two
+ * chunks, forcing the byte-by-byte header parsing path.
+ */
+static double benchFrameParserRun(snFrameParser* p,
+                                  const char* stream,
+                                  int streamSize,
+                                  int frameSize,
+                                  int splitHeaders,
+                                  int* numParsedFrames)
+{
+    const double startTime = benchmarkTime();
+    
+    if (splitHeaders)
+    {
+        /*feed [first header byte], [rest of frame + first byte of next header], ...*/
+        int pos = 1;
+        snFrameParser_processBytes(p, stream, 1);
+        while (pos < streamSize)
+        {
+            const int n = streamSize - pos < frameSize ? streamSize - pos : frameSize;
+            snFrameParser_processBytes(p, &stream[pos], n);
+            pos += n;
+        }
+    }
+    else
+    {
+        /*feed socket sized chunks. most headers are contiguous.*/
+        const int chunkSize = 1 << 14;
+        int pos = 0;
+        while (pos < streamSize)
+        {
+            const int n = streamSize - pos < chunkSize ? streamSize - pos : chunkSize;
+            snFrameParser_processBytes(p, &stream[pos], n);
+            pos += n;
+        }
+    }
+    
+    return benchmarkTime() - startTime;
+}
+
+/**
+ * Measures frames per second for small unmasked binary frames, with
+ * headers split across reads (byte-wise header parsing) and with
+ * contiguous headers (bulk header decoding).
+ */
+static void benchmarkFrameParser(void)
+{
+    const int payloadSizes[NUM_FRAME_PARSER_BENCH_PAYLOAD_SIZES] = {2, 16, 64, 100, 125};
+    const int streamCapacity = 1 << 24;
+    const int maxFrameSize = 1 << 16;
+    char* stream = malloc(streamCapacity);
+    int i;
+    
+    printf("snFrameParser_processBytes, frames/s\n");
+    
+    for (i = 0; i < NUM_FRAME_PARSER_BENCH_PAYLOAD_SIZES; i++)
+    {
+        snFrameHeader h;
+        char headerBytes[SN_MAX_HEADER_SIZE];
+        int headerSize = 0;
+        int streamSize = 0;
+        int numFrames = 0;
+        int split;
+        
+        memset(&h, 0, sizeof(snFrameHeader));
+        h.opcode = SN_OPCODE_BINARY;
+        h.isFinal = 1;
+        h.payloadSize = payloadSizes[i];
+        snFrameHeader_toBytes(&h, headerBytes, &headerSize);
+        
+        while (streamSize + headerSize + payloadSizes[i] <= streamCapacity)
+        {
+            memcpy(&stream[streamSize], headerBytes, headerSize);
+            memset(&stream[streamSize + headerSize], 'x', payloadSizes[i]);
+            streamSize += headerSize + payloadSizes[i];
+            numFrames++;
+        }
+        
+        for (split = 1; split >= 0; split--)
+        {
+            snFrameParser p;
+            int numParsedFrames = 0;
+            char name[256];
+            
+            double bestDuration = 0;
+            int run;
+            
+            /*report the best of a few runs to reduce noise*/
+            for (run = 0; run < 9; run++)
+            {
+                snFrameParser_init(&p, benchFrameParserFrameCallback, &numParsedFrames, NULL, NULL, maxFrameSize, maxFrameSize);
+                const double duration = benchFrameParserRun(&p,
+                                                            stream,
+                                                            streamSize,
+                                                            headerSize + payloadSizes[i],
+                                                            split,
+                                                            &numParsedFrames);
+                snFrameParser_deinit(&p);
+                if (run == 0 || duration < bestDuration)
+                {
+                    bestDuration = duration;
+                }
+            }
+            
+            sprintf(name, "%d byte payload, %s headers", payloadSizes[i], split ? "split" : "contiguous");
+            benchmarkReport(name, numFrames / bestDuration, "frames/s");
+        }
+    }
+    
+    free(stream);
+}
+
+#endif /*SN_BENCH_FRAME_PARSER_H*/
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_IN_PLACE_H
+#define SN_BENCH_IN_PLACE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <snacka/frameparser.h>
+
+#include "benchmark.h"
+
+#define NUM_IN_PLACE_BENCH_PAYLOAD_SIZES 4
+
+static void benchInPlaceMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    /*touch the message like a consumer would*/
+    *(int*)userData += bytes[numBytes - 1];
+}
+
+/**
+ * Feeds a stream of frames through a ring buffer in socket sized reads,
+ * the way \c snWebsocket_poll does, and parses it with or without
+ * in place delivery.
+ */
+static double benchInPlaceRun(snFrameParser* p,
+                              const char* stream,
+                              int streamSize,
+                              char* ring,
+                              int ringSize,
+                              int inPlace)
+{
+    const int readSize = 1 << 14;
+    int readPosition = 0;
+    int writePosition = 0;
+    int pos = 0;
+    
+    const double startTime = benchmarkTime();
+    
+    while (pos < streamSize)
+    {
+        int n = ringSize - writePosition;
+        n = n < readSize ? n : readSize;
+        n = n < streamSize - pos ? n : streamSize - pos;
+        memcpy(&ring[writePosition], &stream[pos], n);
+        writePosition += n;
+        pos += n;
+        
+        if (inPlace)
+        {
+            int numBytesProcessed = 0;
+            snFrameParser_processBytesInPlace(p,
+                                              &ring[readPosition],
+                                              writePosition - readPosition,
+                                              ringSize,
+                                              &numBytesProcessed);
+            readPosition += numBytesProcessed;
+        }
+        else
+        {
+            snFrameParser_processBytes(p, &ring[readPosition], writePosition - readPosition);
+            readPosition = writePosition;
+        }
+        
+        if (readPosition == writePosition)
+        {
+            readPosition = 0;
+            writePosition = 0;
+        }
+        else if (writePosition == ringSize)
+        {
+            memmove(ring, &ring[readPosition], writePosition - readPosition);
+            writePosition -= readPosition;
+            readPosition = 0;
+        }
+    }
+    
+    return benchmarkTime() - startTime;
+}
+
+/**
+ * Measures message throughput for unfragmented binary messages,
+ * copied into the parser buffer or delivered in place.
+ */
+static void benchmarkInPlace(void)
+{
+    const int payloadSizes[NUM_IN_PLACE_BENCH_PAYLOAD_SIZES] = {128, 1024, 8192, 32768};
+    const int streamCapacity = 1 << 26;
+    const int maxFrameSize = 1 << 16;
+    const int ringSize = 1 << 16;
+    char* stream = malloc(streamCapacity);
+    char* ring = malloc(ringSize + 1);
+    int i;
+    
+    printf("snFrameParser_processBytes vs snFrameParser_processBytesInPlace, MB/s\n");
+    
+    for (i = 0; i < NUM_IN_PLACE_BENCH_PAYLOAD_SIZES; i++)
+    {
+        snFrameHeader h;
+        char headerBytes[SN_MAX_HEADER_SIZE];
+        int headerSize = 0;
+        int streamSize = 0;
+        int inPlace;
+        
+        memset(&h, 0, sizeof(snFrameHeader));
+        h.opcode = SN_OPCODE_BINARY;
+        h.isFinal = 1;
+        h.payloadSize = payloadSizes[i];
+        snFrameHeader_toBytes(&h, headerBytes, &headerSize);
+        
+        while (streamSize + headerSize + payloadSizes[i] <= streamCapacity)
+        {
+            memcpy(&stream[streamSize], headerBytes, headerSize);
+            memset(&stream[streamSize + headerSize], 'x', payloadSizes[i]);
+            streamSize += headerSize + payloadSizes[i];
+        }
+        
+        for (inPlace = 0; inPlace <= 1; inPlace++)
+        {
+            snFrameParser p;
+            int checksum = 0;
+            char name[256];
+            
+            double bestDuration = 0;
+            int run;
+            
+            /*report the best of a few runs to reduce noise*/
+            for (run = 0; run < 5; run++)
+            {
+                snFrameParser_init(&p, NULL, NULL, benchInPlaceMessageCallback, &checksum, maxFrameSize, maxFrameSize);
+                const double duration = benchInPlaceRun(&p, stream, streamSize, ring, ringSize, inPlace);
+                snFrameParser_deinit(&p);
+                if (run == 0 || duration < bestDuration)
+                {
+                    bestDuration = duration;
+                }
+            }
+            
+            sprintf(name, "%d byte payload, %s", payloadSizes[i], inPlace ? "in place" : "copied");
+            benchmarkReport(name, streamSize / bestDuration / (1 << 20), "MB/s");
+        }
+    }
+    
+    free(stream);
+    free(ring);
+}
+
+#endif /*SN_BENCH_IN_PLACE_H*/
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+
+#include "benchmark.h"
+#include "benchframeparser.h"
+#include "benchinplace.h"
+#include "benchmasking.h"
+#include "benchutf8.h"
+#include "benchrandom.h"
+#include "bencheventloop.h"
+#include "bencheventlooppool.h"
+#include "benchthreaded.h"
+#include "benchdispatcher.h"
+#include "benchtimerwheel.h"
+#include "benchresolver.h"
+#include "benchfailover.h"
+#include "benchreconnect.h"
+#include "benchfastopen.h"
+#include "benchdeflate.h"
+#include "benchserver.h"
+
+typedef void (*benchmarkFunction)(void);
+
+static void runBenchmark(const char* selectedName, const char* name, benchmarkFunction f)
+{
+    if (selectedName == NULL || strcmp(selectedName, name) == 0)
+    {
+        f();
+        printf("\n");
+    }
+}
+
+/**
+ * Runs all benchmarks, or only the one named by the first argument.
+ */
+int main(int argc, const char* argv[])
+{
+    const char* selectedName = argc > 1 ? argv[1] : NULL;
+    
+    runBenchmark(selectedName, "frameparser", benchmarkFrameParser);
+    runBenchmark(selectedName, "inplace", benchmarkInPlace);
+    runBenchmark(selectedName, "masking", benchmarkMasking);
+    runBenchmark(selectedName, "utf8", benchmarkUTF8);
+    runBenchmark(selectedName, "random", benchmarkRandom);
+    runBenchmark(selectedName, "eventloop", benchmarkEventLoop);
+    runBenchmark(selectedName, "eventlooppool", benchmarkEventLoopPool);
+    runBenchmark(selectedName, "threaded", benchmarkThreaded);
+    runBenchmark(selectedName, "dispatcher", benchmarkDispatcher);
+    runBenchmark(selectedName, "timerwheel", benchmarkTimerWheel);
+    runBenchmark(selectedName, "resolver", benchmarkResolver);
+    runBenchmark(selectedName, "failover", benchmarkFailover);
+    runBenchmark(selectedName, "reconnect", benchmarkReconnect);
+    runBenchmark(selectedName, "fastopen", benchmarkFastOpen);
+    runBenchmark(selectedName, "deflate", benchmarkDeflate);
+    runBenchmark(selectedName, "server", benchmarkServer);
+    
+    return 0;
+}
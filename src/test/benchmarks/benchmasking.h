@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_MASKING_H
+#define SN_BENCH_MASKING_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <snacka/masking.h>
+
+#include "benchmark.h"
+
+#define NUM_MASKING_BENCH_PAYLOAD_SIZES 7
+
+/**
+ * Measures masking throughput for each kernel supported by the CPU,
+ * and of masking while copying, for payloads from 16 bytes to 16 MB.
+ */
+static void benchmarkMasking(void)
+{
+    const int payloadSizes[NUM_MASKING_BENCH_PAYLOAD_SIZES] =
+    {
+        16, 128, 1 << 10, 1 << 14, 1 << 17, 1 << 20, 1 << 24
+    };
+    const char* kernelNames[] = {"auto", "bytewise", "word", "sse2", "avx2"};
+    const snMaskingKernel kernels[] =
+    {
+        SN_MASKING_KERNEL_AUTO,
+        SN_MASKING_KERNEL_BYTEWISE,
+        SN_MASKING_KERNEL_WORD,
+        SN_MASKING_KERNEL_SSE2,
+        SN_MASKING_KERNEL_AVX2
+    };
+    /*mask at least this many bytes per run, so small payloads are repeated*/
+    const long long minBytesPerRun = 1 << 26;
+    char* payload = malloc(payloadSizes[NUM_MASKING_BENCH_PAYLOAD_SIZES - 1]);
+    char* destination = malloc(payloadSizes[NUM_MASKING_BENCH_PAYLOAD_SIZES - 1]);
+    int i, k;
+    
+    memset(payload, 'x', payloadSizes[NUM_MASKING_BENCH_PAYLOAD_SIZES - 1]);
+    memset(destination, 0, payloadSizes[NUM_MASKING_BENCH_PAYLOAD_SIZES - 1]);
+    
+    printf("snMaskPayloadWithKernel, GB/s\n");
+    
+    for (i = 0; i < NUM_MASKING_BENCH_PAYLOAD_SIZES; i++)
+    {
+        const int numRepetitions = (int)(minBytesPerRun / payloadSizes[i]) + 1;
+        
+        for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+        {
+            double bestDuration = 0;
+            char name[256];
+            int run;
+            
+            if (!snMaskIsKernelSupported(kernels[k]))
+            {
+                continue;
+            }
+            
+            /*report the best of a few runs to reduce noise*/
+            for (run = 0; run < 5; run++)
+            {
+                const double startTime = benchmarkTime();
+                int r;
+                for (r = 0; r < numRepetitions; r++)
+                {
+                    /*vary the offset like consecutive chunks of a frame would*/
+                    snMaskPayloadWithKernel(kernels[k], 0x37fa213d, payload, payloadSizes[i], r);
+                }
+                const double duration = benchmarkTime() - startTime;
+                if (run == 0 || duration < bestDuration)
+                {
+                    bestDuration = duration;
+                }
+            }
+            
+            sprintf(name, "%d byte payload, %s", payloadSizes[i], kernelNames[k]);
+            benchmarkReport(name, (double)numRepetitions * payloadSizes[i] / bestDuration / (1 << 30), "GB/s");
+        }
+        
+        /*copying then masking, as snWebsocket_sendFrame used to, vs doing both in one pass*/
+        int fused;
+        for (fused = 0; fused <= 1; fused++)
+        {
+            double bestDuration = 0;
+            char name[256];
+            int run;
+            
+            for (run = 0; run < 5; run++)
+            {
+                const double startTime = benchmarkTime();
+                int r;
+                for (r = 0; r < numRepetitions; r++)
+                {
+                    if (fused)
+                    {
+                        snCopyMaskedPayload(0x37fa213d, payload, destination, payloadSizes[i], r);
+                    }
+                    else
+                    {
+                        memcpy(destination, payload, payloadSizes[i]);
+                        snMaskPayload(0x37fa213d, destination, payloadSizes[i], r);
+                    }
+                }
+                const double duration = benchmarkTime() - startTime;
+                if (run == 0 || duration < bestDuration)
+                {
+                    bestDuration = duration;
+                }
+            }
+            
+            sprintf(name, "%d byte payload, %s", payloadSizes[i], fused ? "fused copy+mask" : "memcpy then mask");
+            benchmarkReport(name, (double)numRepetitions * payloadSizes[i] / bestDuration / (1 << 30), "GB/s");
+        }
+    }
+    
+    free(payload);
+    free(destination);
+}
+
+#endif /*SN_BENCH_MASKING_H*/
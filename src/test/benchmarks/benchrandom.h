@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_RANDOM_H
+#define SN_BENCH_RANDOM_H
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <snacka/frameheader.h>
+#include <snacka/masking.h>
+#include <snacka/random.h>
+
+#include "benchmark.h"
+
+#define NUM_RANDOM_BENCH_SENDS_PER_THREAD 2000000
+
+#define MAX_RANDOM_BENCH_THREADS 8
+
+typedef struct benchRandomThread
+{
+    pthread_t thread;
+    int useRand;
+    int checksum;
+} benchRandomThread;
+
+/**
+ * Does the CPU work of sending small masked frames, like \c snWebsocket_sendFrame
+ * minus the I/O, with masking keys from rand() or from a per thread generator.
+ */
+static void* benchRandomThreadFunction(void* userData)
+{
+    benchRandomThread* t = (benchRandomThread*)userData;
+    const char payload[64] = "{\"type\": \"tick\", \"value\": 12345}";
+    char frameBytes[SN_MAX_HEADER_SIZE + sizeof(payload)];
+    snRandom random;
+    snFrameHeader h;
+    int i;
+    
+    snRandom_init(&random);
+    memset(&h, 0, sizeof(snFrameHeader));
+    h.opcode = SN_OPCODE_TEXT;
+    h.isFinal = 1;
+    h.isMasked = 1;
+    h.payloadSize = sizeof(payload);
+    
+    for (i = 0; i < NUM_RANDOM_BENCH_SENDS_PER_THREAD; i++)
+    {
+        int headerSize = 0;
+        h.maskingKey = t->useRand ? rand() : (int)snRandom_next(&random);
+        snFrameHeader_toBytes(&h, frameBytes, &headerSize);
+        snCopyMaskedPayload(h.maskingKey, payload, &frameBytes[headerSize], sizeof(payload), 0);
+        t->checksum += frameBytes[headerSize];
+    }
+    
+    return NULL;
+}
+
+/**
+ * Measures how the number of frames per second that can be prepared for
+ * sending scales with the number of threads, with masking keys from
+ * rand(), which takes a global lock, and from per connection generators.
+ */
+static void benchmarkRandom(void)
+{
+    const int numThreadCounts[] = {1, 2, 4, 8};
+    benchRandomThread threads[MAX_RANDOM_BENCH_THREADS];
+    int useRand;
+    int i, j;
+    
+    printf("Masked frames per second by thread count, millions\n");
+    
+    for (useRand = 1; useRand >= 0; useRand--)
+    {
+        for (i = 0; i < sizeof(numThreadCounts) / sizeof(numThreadCounts[0]); i++)
+        {
+            const int numThreads = numThreadCounts[i];
+            double bestDuration = 0;
+            char name[256];
+            int run;
+            
+            /*report the best of a few runs to reduce noise*/
+            for (run = 0; run < 3; run++)
+            {
+                const double startTime = benchmarkTime();
+                for (j = 0; j < numThreads; j++)
+                {
+                    threads[j].useRand = useRand;
+                    threads[j].checksum = 0;
+                    pthread_create(&threads[j].thread, NULL, benchRandomThreadFunction, &threads[j]);
+                }
+                for (j = 0; j < numThreads; j++)
+                {
+                    pthread_join(threads[j].thread, NULL);
+                }
+                const double duration = benchmarkTime() - startTime;
+                if (run == 0 || duration < bestDuration)
+                {
+                    bestDuration = duration;
+                }
+            }
+            
+            sprintf(name, "%d thread(s), %s", numThreads, useRand ? "rand()" : "snRandom");
+            benchmarkReport(name,
+                            (double)numThreads * NUM_RANDOM_BENCH_SENDS_PER_THREAD / bestDuration / 1000000.0,
+                            "M/s");
+        }
+    }
+}
+
+#endif /*SN_BENCH_RANDOM_H*/
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_RECONNECT_H
+#define SN_BENCH_RECONNECT_H
+
+#ifdef __linux__
+
+#include <string.h>
+
+#include <snacka/eventloop.h>
+#include <snacka/reconnectscheduler.h>
+#include <snacka/websocket.h>
+
+#include "benchmark.h"
+#include "bencheventloop.h"
+
+#define RECONNECT_BENCH_NUM_CONNECTIONS 500
+
+#define RECONNECT_BENCH_TIMEOUT 20.0 /*in seconds*/
+
+static int benchReconnectCountOpen(snWebsocket** websockets)
+{
+    int numOpen = 0;
+    int i;
+    for (i = 0; i < RECONNECT_BENCH_NUM_CONNECTIONS; i++)
+    {
+        numOpen += snWebsocket_getState(websockets[i]) == SN_STATE_OPEN;
+    }
+    return numOpen;
+}
+
+/**
+ * Opens a number of websockets to a local server, restarts the server
+ * and measures how the websockets reconnect.
+ */
+static void benchReconnectRun(const char* name,
+                              int minDelay,
+                              int maxDelay,
+                              int maxHandshakes,
+                              double maxReconnectsPerSecond)
+{
+    snEventLoop* loop = snEventLoop_create();
+    snWebsocket* websockets[RECONNECT_BENCH_NUM_CONNECTIONS];
+    snWebsocketOptions o;
+    snReconnectSchedulerStats stats;
+    benchEchoServer server;
+    char url[64];
+    int maxNumConnecting = 0;
+    int i;
+    
+    if (!benchEchoServerStart(&server))
+    {
+        printf("Failed to set up the reconnect benchmark\n");
+        snEventLoop_delete(loop);
+        return;
+    }
+    const int port = server.port;
+    
+    memset(&o, 0, sizeof(o));
+    o.autoReconnect = 1;
+    o.reconnectMinDelay = minDelay;
+    o.reconnectMaxDelay = maxDelay;
+    snReconnectScheduler_setLimits(maxHandshakes, maxReconnectsPerSecond, maxHandshakes);
+    
+    sprintf(url, "ws://127.0.0.1:%d/", port);
+    for (i = 0; i < RECONNECT_BENCH_NUM_CONNECTIONS; i++)
+    {
+        websockets[i] = snWebsocket_createWithSettings(NULL, NULL, NULL, NULL, NULL, &o);
+        snEventLoop_addWebsocket(loop, websockets[i]);
+        snWebsocket_connect(websockets[i], url);
+    }
+    
+    double startTime = benchmarkTime();
+    while (benchReconnectCountOpen(websockets) < RECONNECT_BENCH_NUM_CONNECTIONS &&
+           benchmarkTime() - startTime < RECONNECT_BENCH_TIMEOUT)
+    {
+        snEventLoop_runOnce(loop, 10);
+    }
+    
+    /*restart the server, dropping all connections at once*/
+    snReconnectScheduler_resetStats();
+    startTime = benchmarkTime();
+    benchEchoServerStop(&server);
+    const int hasRestarted = benchEchoServerStartOnPort(&server, port);
+    
+    int numOpen = 0;
+    while (hasRestarted &&
+           numOpen < RECONNECT_BENCH_NUM_CONNECTIONS &&
+           benchmarkTime() - startTime < RECONNECT_BENCH_TIMEOUT)
+    {
+        snEventLoop_runOnce(loop, 10);
+        
+        int numConnecting = 0;
+        numOpen = 0;
+        for (i = 0; i < RECONNECT_BENCH_NUM_CONNECTIONS; i++)
+        {
+            const snReadyState state = snWebsocket_getState(websockets[i]);
+            numConnecting += state == SN_STATE_CONNECTING;
+            numOpen += state == SN_STATE_OPEN;
+        }
+        if (numConnecting > maxNumConnecting)
+        {
+            maxNumConnecting = numConnecting;
+        }
+    }
+    const double duration = benchmarkTime() - startTime;
+    snReconnectScheduler_getStats(&stats);
+    
+    for (i = 0; i < RECONNECT_BENCH_NUM_CONNECTIONS; i++)
+    {
+        snWebsocket_delete(websockets[i]);
+    }
+    snEventLoop_delete(loop);
+    if (hasRestarted)
+    {
+        benchEchoServerStop(&server);
+    }
+    
+    printf("%s\n", name);
+    benchmarkReport("reconnected websockets", numOpen, "");
+    benchmarkReport("total recovery time", 1000.0 * duration, "ms");
+    benchmarkReport("max reconnects in flight", stats.maxNumHandshakes, "");
+    benchmarkReport("max websockets connecting", maxNumConnecting, "");
+    benchmarkReport("reconnect attempts", stats.numReconnects, "");
+    benchmarkReport("deferred by the limits", stats.numDeferrals, "");
+}
+
+/**
+ * Measures a reconnect storm after a server restart, with all websockets
+ * reconnecting right away, and with jittered backoff and limits on the
+ * number of reconnects in flight and reconnects per second.
+ */
+static void benchmarkReconnect(void)
+{
+    printf("%d websockets reconnecting after a server restart\n\n", RECONNECT_BENCH_NUM_CONNECTIONS);
+    benchReconnectRun("immediate reconnects, no limits", 1, 1, 0, 0);
+    printf("\n");
+    benchReconnectRun("jittered backoff, 32 in flight, 5000 per second", 10, 1000, 32, 5000);
+    
+    snReconnectScheduler_setLimits(SN_RECONNECT_DEFAULT_MAX_HANDSHAKES, 0, 1);
+}
+
+#else
+
+static void benchmarkReconnect(void)
+{
+    printf("The reconnect benchmark requires Linux\n");
+}
+
+#endif /*__linux__*/
+
+#endif /*SN_BENCH_RECONNECT_H*/
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_RESOLVER_H
+#define SN_BENCH_RESOLVER_H
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <snacka/eventloop.h>
+#include <snacka/resolver.h>
+#include <snacka/websocket.h>
+
+#include "benchmark.h"
+#include "bencheventloop.h"
+
+#define RESOLVER_BENCH_NUM_CONNECTIONS 64
+
+#define RESOLVER_BENCH_LOOKUP_DURATION 20 /*in milliseconds*/
+
+/** Stands in for a slow name server, resolving every host to the loopback address. */
+static snError benchSlowResolveFunction(void* userData,
+                                        const char* host,
+                                        snResolvedAddress* addresses,
+                                        int maxNumAddresses,
+                                        int* numAddresses,
+                                        int* timeToLive)
+{
+    struct timespec sleepTime;
+    sleepTime.tv_sec = 0;
+    sleepTime.tv_nsec = RESOLVER_BENCH_LOOKUP_DURATION * 1000000L;
+    nanosleep(&sleepTime, NULL);
+    
+    struct sockaddr_in* address = (struct sockaddr_in*)&addresses[0].address;
+    memset(&addresses[0], 0, sizeof(snResolvedAddress));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addresses[0].addressSize = sizeof(struct sockaddr_in);
+    *numAddresses = 1;
+    *timeToLive = -1;
+    
+    return SN_NO_ERROR;
+}
+
+/**
+ * Connects websockets to distinct uncached hosts, one per loop iteration,
+ * while another websocket on the same loop echoes messages. If \c blocking
+ * is non-zero, each host is looked up on the loop thread before connecting,
+ * like a synchronous getaddrinfo call would.
+ */
+static void benchResolverRun(int port, int blocking, const char* name)
+{
+    snEventLoop* loop = snEventLoop_create();
+    benchEventLoopClient clients[RESOLVER_BENCH_NUM_CONNECTIONS + 1];
+    benchEventLoopState state;
+    char url[256];
+    double maxIterationDuration = 0;
+    int numConnects = 0;
+    int i;
+    
+    memset(&state, 0, sizeof(state));
+    state.latencies = malloc(EVENT_LOOP_BENCH_MAX_LATENCIES * sizeof(double));
+    snResolver_clearCache();
+    
+    for (i = 0; i <= RESOLVER_BENCH_NUM_CONNECTIONS; i++)
+    {
+        clients[i].state = &state;
+        clients[i].websocket = snWebsocket_create(benchEventLoopOpenCallback,
+                                                  benchEventLoopMessageCallback,
+                                                  NULL,
+                                                  NULL,
+                                                  &clients[i]);
+        snEventLoop_addWebsocket(loop, clients[i].websocket);
+    }
+    
+    /*the echoing websocket*/
+    sprintf(url, "ws://127.0.0.1:%d/", port);
+    snWebsocket_connect(clients[0].websocket, url);
+    while (state.numOpen < 1)
+    {
+        snEventLoop_runOnce(loop, 100);
+    }
+    state.isSending = 1;
+    benchEventLoopSend(&clients[0]);
+    
+    const double startTime = benchmarkTime();
+    while (state.numOpen < RESOLVER_BENCH_NUM_CONNECTIONS + 1 && benchmarkTime() - startTime < 10.0)
+    {
+        const double iterationStartTime = benchmarkTime();
+        
+        if (numConnects < RESOLVER_BENCH_NUM_CONNECTIONS)
+        {
+            numConnects++;
+            if (blocking)
+            {
+                snResolvedAddress addresses[SN_RESOLVER_MAX_ADDRESSES];
+                int numAddresses;
+                int timeToLive;
+                benchSlowResolveFunction(NULL, "", addresses, SN_RESOLVER_MAX_ADDRESSES, &numAddresses, &timeToLive);
+                sprintf(url, "ws://127.0.0.1:%d/", port);
+            }
+            else
+            {
+                sprintf(url, "ws://gateway%d.test:%d/", numConnects, port);
+            }
+            snWebsocket_connect(clients[numConnects].websocket, url);
+        }
+        
+        snEventLoop_runOnce(loop, 1);
+        
+        const double iterationDuration = benchmarkTime() - iterationStartTime;
+        if (iterationDuration > maxIterationDuration)
+        {
+            maxIterationDuration = iterationDuration;
+        }
+    }
+    const double duration = benchmarkTime() - startTime;
+    
+    state.isSending = 0;
+    for (i = 0; i <= RESOLVER_BENCH_NUM_CONNECTIONS; i++)
+    {
+        snWebsocket_delete(clients[i].websocket);
+    }
+    snEventLoop_delete(loop);
+    
+    qsort(state.latencies, state.numLatencies, sizeof(double), compareLatencies);
+    
+    printf("%s\n", name);
+    benchmarkReport("connects per second", (state.numOpen - 1) / duration, "1/s");
+    benchmarkReport("longest loop iteration", 1000.0 * maxIterationDuration, "ms");
+    benchmarkReport("echo round trips during connects", state.numLatencies, "");
+    if (state.numLatencies > 0)
+    {
+        benchmarkReport("99th percentile echo latency",
+                        1000000.0 * state.latencies[(int)(0.99 * (state.numLatencies - 1))],
+                        "us");
+    }
+    
+    free(state.latencies);
+}
+
+/**
+ * Measures how a slow name server affects an event loop connecting
+ * websockets to uncached hosts, with lookups blocking the loop thread
+ * and with lookups on the resolver threads.
+ */
+static void benchmarkResolver(void)
+{
+    benchEchoServer server;
+    
+    if (!benchEchoServerStart(&server))
+    {
+        printf("Failed to set up the resolver benchmark\n");
+        return;
+    }
+    
+    snResolver_setResolveFunction(benchSlowResolveFunction, NULL);
+    
+    printf("%d connects to distinct hosts, %d ms per lookup\n\n",
+           RESOLVER_BENCH_NUM_CONNECTIONS,
+           RESOLVER_BENCH_LOOKUP_DURATION);
+    benchResolverRun(server.port, 1, "lookups on the loop thread");
+    benchResolverRun(server.port, 0, "lookups on resolver threads");
+    
+    snResolver_setResolveFunction(NULL, NULL);
+    benchEchoServerStop(&server);
+}
+
+#else
+
+static void benchmarkResolver(void)
+{
+    printf("The resolver benchmark requires Linux\n");
+}
+
+#endif /*__linux__*/
+
+#endif /*SN_BENCH_RESOLVER_H*/
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_SERVER_H
+#define SN_BENCH_SERVER_H
+
+#ifdef __linux__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <snacka/eventlooppool.h>
+#include <snacka/websocket.h>
+#include <snacka/websocketserver.h>
+
+#include "benchmark.h"
+
+#define SERVER_BENCH_NUM_CONNECTIONS 256
+
+#define SERVER_BENCH_NUM_CLIENT_THREADS 2
+
+#define SERVER_BENCH_DURATION 2.0 /*in seconds*/
+
+#define SERVER_BENCH_TIMEOUT 10.0 /*in seconds*/
+
+static const char serverBenchMessage[] = "{\"type\": \"tick\", \"value\": 12345}";
+
+typedef struct benchServerState
+{
+    int numOpen;
+    int numMessages;
+    int isSending;
+} benchServerState;
+
+typedef struct benchServerClient
+{
+    snWebsocket* websocket;
+    snEventLoop* loop;
+    benchServerState* state;
+} benchServerClient;
+
+static void benchServerEchoCallback(void* userData, snWebsocket* ws, snOpcode opcode, const char* bytes, int numBytes)
+{
+    snWebsocket_sendFrame(ws, opcode, numBytes, bytes);
+}
+
+static void benchServerClientOpenCallback(void* userData)
+{
+    benchServerClient* client = (benchServerClient*)userData;
+    __atomic_add_fetch(&client->state->numOpen, 1, __ATOMIC_RELAXED);
+}
+
+static void benchServerClientMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    benchServerClient* client = (benchServerClient*)userData;
+    __atomic_add_fetch(&client->state->numMessages, 1, __ATOMIC_RELAXED);
+    
+    /*keep one message in flight per connection*/
+    if (__atomic_load_n(&client->state->isSending, __ATOMIC_RELAXED))
+    {
+        snWebsocket_sendTextData(client->websocket, serverBenchMessage);
+    }
+}
+
+static void benchServerSleep(void)
+{
+    struct timespec sleepTime = {0, 1000000};
+    nanosleep(&sleepTime, NULL);
+}
+
+/**
+ * Measures the rate at which a server with a given number of SO_REUSEPORT
+ * listener threads accepts connections from a pool of client threads, and
+ * the number of messages per second it echoes back to them.
+ */
+static void benchmarkServerWithThreads(int numThreads)
+{
+    snWebsocketServerOptions options;
+    benchServerState state;
+    benchServerClient* clients;
+    char url[256];
+    char name[256];
+    int i;
+    
+    memset(&options, 0, sizeof(options));
+    options.bindAddress = "127.0.0.1";
+    options.numThreads = numThreads;
+    options.messageCallback = benchServerEchoCallback;
+    
+    snWebsocketServer* server = snWebsocketServer_create(&options, NULL);
+    snEventLoopPool* pool = snEventLoopPool_create(SERVER_BENCH_NUM_CLIENT_THREADS, SN_LOAD_BALANCING_ROUND_ROBIN, 0);
+    if (server == NULL || pool == NULL)
+    {
+        printf("Failed to set up the server benchmark\n");
+        snWebsocketServer_delete(server);
+        if (pool)
+        {
+            snEventLoopPool_delete(pool);
+        }
+        return;
+    }
+    
+    memset(&state, 0, sizeof(state));
+    clients = calloc(SERVER_BENCH_NUM_CONNECTIONS, sizeof(benchServerClient));
+    sprintf(url, "ws://127.0.0.1:%d/", snWebsocketServer_getPort(server));
+    
+    /*connections per second*/
+    {
+        const double startTime = benchmarkTime();
+        for (i = 0; i < SERVER_BENCH_NUM_CONNECTIONS; i++)
+        {
+            clients[i].state = &state;
+            clients[i].websocket = snWebsocket_create(benchServerClientOpenCallback,
+                                                      benchServerClientMessageCallback,
+                                                      NULL,
+                                                      NULL,
+                                                      &clients[i]);
+            clients[i].loop = snEventLoopPool_addWebsocket(pool, clients[i].websocket, url);
+        }
+        
+        while (__atomic_load_n(&state.numOpen, __ATOMIC_RELAXED) < SERVER_BENCH_NUM_CONNECTIONS &&
+               benchmarkTime() - startTime < SERVER_BENCH_TIMEOUT)
+        {
+            benchServerSleep();
+        }
+        const double duration = benchmarkTime() - startTime;
+        
+        sprintf(name, "%d server thread(s), connections per second", numThreads);
+        benchmarkReport(name, __atomic_load_n(&state.numOpen, __ATOMIC_RELAXED) / duration, "1/s");
+    }
+    
+    /*messages per second, with one message in flight per connection*/
+    {
+        __atomic_store_n(&state.isSending, 1, __ATOMIC_RELAXED);
+        for (i = 0; i < SERVER_BENCH_NUM_CONNECTIONS; i++)
+        {
+            snEventLoop_sendFrame(clients[i].loop, clients[i].websocket, SN_OPCODE_TEXT,
+                                  sizeof(serverBenchMessage) - 1, serverBenchMessage);
+        }
+        
+        const int startNumMessages = __atomic_load_n(&state.numMessages, __ATOMIC_RELAXED);
+        const double startTime = benchmarkTime();
+        while (benchmarkTime() - startTime < SERVER_BENCH_DURATION)
+        {
+            benchServerSleep();
+        }
+        const double duration = benchmarkTime() - startTime;
+        const int numMessages = __atomic_load_n(&state.numMessages, __ATOMIC_RELAXED) - startNumMessages;
+        __atomic_store_n(&state.isSending, 0, __ATOMIC_RELAXED);
+        
+        sprintf(name, "%d server thread(s), echoed messages per second", numThreads);
+        benchmarkReport(name, numMessages / duration, "1/s");
+    }
+    
+    /*the pool leaves its websockets to the caller*/
+    snEventLoopPool_delete(pool);
+    for (i = 0; i < SERVER_BENCH_NUM_CONNECTIONS; i++)
+    {
+        snWebsocket_delete(clients[i].websocket);
+    }
+    
+    snWebsocketServer_delete(server);
+    free(clients);
+}
+
+static void benchmarkServer(void)
+{
+    static const int numThreads[] = {1, 2, 4};
+    int i;
+    
+    printf("Server throughput with %d connections from %d client threads\n",
+           SERVER_BENCH_NUM_CONNECTIONS, SERVER_BENCH_NUM_CLIENT_THREADS);
+    
+    for (i = 0; i < (int)(sizeof(numThreads) / sizeof(numThreads[0])); i++)
+    {
+        benchmarkServerWithThreads(numThreads[i]);
+    }
+}
+
+#else /*__linux__*/
+
+static void benchmarkServer(void)
+{
+    printf("The server benchmark requires Linux\n");
+}
+
+#endif /*__linux__*/
+
+#endif /*SN_BENCH_SERVER_H*/
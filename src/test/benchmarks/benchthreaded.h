@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_THREADED_H
+#define SN_BENCH_THREADED_H
+
+#ifdef __linux__
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <snacka/threadedwebsocket.h>
+#include <snacka/websocket.h>
+
+#include "benchmark.h"
+#include "bencheventloop.h"
+
+#define THREADED_BENCH_DURATION 1.0 /*in seconds*/
+
+#define THREADED_BENCH_MAX_ROUND_TRIPS (1 << 20)
+
+static const char threadedBenchMessage[] = "{\"type\": \"tick\", \"value\": 12345}";
+
+typedef struct benchThreadedState
+{
+    int isOpen;
+    int hasReceivedEcho;
+    int hasFailed;
+} benchThreadedState;
+
+static void benchThreadedOpenCallback(void* userData)
+{
+    ((benchThreadedState*)userData)->isOpen = 1;
+}
+
+static void benchThreadedMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    ((benchThreadedState*)userData)->hasReceivedEcho = 1;
+}
+
+static void benchThreadedErrorCallback(void* userData, snError error)
+{
+    ((benchThreadedState*)userData)->hasFailed = 1;
+}
+
+/**
+ * Prints the mean time spent in the send call and round trip latency percentiles.
+ */
+static void benchThreadedReport(const char* name, double sendTime, double* latencies, int numLatencies)
+{
+    char rowName[256];
+    
+    if (numLatencies == 0)
+    {
+        printf("  %s: no round trips\n", name);
+        return;
+    }
+    
+    qsort(latencies, numLatencies, sizeof(double), compareLatencies);
+    
+    printf("%s (%d round trips)\n", name, numLatencies);
+    sprintf(rowName, "send call");
+    benchmarkReport(rowName, 1000000000.0 * sendTime / numLatencies, "ns");
+    sprintf(rowName, "median round trip");
+    benchmarkReport(rowName, 1000000.0 * latencies[(int)(0.5 * (numLatencies - 1))], "us");
+    sprintf(rowName, "99th percentile round trip");
+    benchmarkReport(rowName, 1000000.0 * latencies[(int)(0.99 * (numLatencies - 1))], "us");
+    sprintf(rowName, "99.9th percentile round trip");
+    benchmarkReport(rowName, 1000000.0 * latencies[(int)(0.999 * (numLatencies - 1))], "us");
+}
+
+/**
+ * Round trips driven by polling the websocket on the application thread.
+ */
+static void benchThreadedInline(const char* url, double* latencies)
+{
+    benchThreadedState state;
+    double sendTime = 0;
+    int numLatencies = 0;
+    
+    memset(&state, 0, sizeof(state));
+    snWebsocket* ws = snWebsocket_create(benchThreadedOpenCallback,
+                                         benchThreadedMessageCallback,
+                                         NULL,
+                                         benchThreadedErrorCallback,
+                                         &state);
+    snWebsocket_connect(ws, url);
+    while (!state.isOpen && !state.hasFailed)
+    {
+        snWebsocket_poll(ws);
+    }
+    
+    const double startTime = benchmarkTime();
+    while (state.isOpen && !state.hasFailed &&
+           benchmarkTime() - startTime < THREADED_BENCH_DURATION &&
+           numLatencies < THREADED_BENCH_MAX_ROUND_TRIPS)
+    {
+        const double t0 = benchmarkTime();
+        state.hasReceivedEcho = 0;
+        snWebsocket_sendTextData(ws, threadedBenchMessage);
+        sendTime += benchmarkTime() - t0;
+        
+        while (!state.hasReceivedEcho && !state.hasFailed)
+        {
+            snWebsocket_poll(ws);
+        }
+        latencies[numLatencies++] = benchmarkTime() - t0;
+    }
+    
+    snWebsocket_delete(ws);
+    benchThreadedReport("snWebsocket_poll on the application thread", sendTime, latencies, numLatencies);
+}
+
+/**
+ * Round trips through a threaded websocket using a given wait strategy.
+ */
+static void benchThreadedStrategy(const char* url, double* latencies, snWaitStrategy waitStrategy, const char* name)
+{
+    snThreadedWebsocketOptions options;
+    benchThreadedState state;
+    double sendTime = 0;
+    int numLatencies = 0;
+    
+    memset(&state, 0, sizeof(state));
+    memset(&options, 0, sizeof(options));
+    options.waitStrategy = waitStrategy;
+    
+    snThreadedWebsocket* tws = snThreadedWebsocket_create(benchThreadedOpenCallback,
+                                                          benchThreadedMessageCallback,
+                                                          NULL,
+                                                          benchThreadedErrorCallback,
+                                                          &state,
+                                                          &options);
+    snThreadedWebsocket_connect(tws, url);
+    while (!state.isOpen && !state.hasFailed)
+    {
+        snThreadedWebsocket_wait(tws, 100);
+        snThreadedWebsocket_poll(tws);
+    }
+    
+    const double startTime = benchmarkTime();
+    while (state.isOpen && !state.hasFailed &&
+           benchmarkTime() - startTime < THREADED_BENCH_DURATION &&
+           numLatencies < THREADED_BENCH_MAX_ROUND_TRIPS)
+    {
+        const double t0 = benchmarkTime();
+        state.hasReceivedEcho = 0;
+        snThreadedWebsocket_sendTextData(tws, threadedBenchMessage);
+        sendTime += benchmarkTime() - t0;
+        
+        while (!state.hasReceivedEcho && !state.hasFailed)
+        {
+            snThreadedWebsocket_wait(tws, 100);
+            snThreadedWebsocket_poll(tws);
+        }
+        latencies[numLatencies++] = benchmarkTime() - t0;
+    }
+    
+    snThreadedWebsocket_delete(tws);
+    benchThreadedReport(name, sendTime, latencies, numLatencies);
+}
+
+/**
+ * Compares the cost of sending on the application thread and the round trip
+ * latency of websockets polled inline with threaded websockets using
+ * different wait strategies. The spinning strategies need a free core
+ * for the I/O thread to be meaningful.
+ */
+static void benchmarkThreaded(void)
+{
+    benchEchoServer server;
+    char url[256];
+    
+    if (!benchEchoServerStart(&server))
+    {
+        printf("Failed to set up the threaded websocket benchmark\n");
+        return;
+    }
+    
+    double* latencies = malloc(THREADED_BENCH_MAX_ROUND_TRIPS * sizeof(double));
+    sprintf(url, "ws://127.0.0.1:%d/", server.port);
+    
+    benchThreadedInline(url, latencies);
+    printf("\n");
+    benchThreadedStrategy(url, latencies, SN_WAIT_STRATEGY_SPIN, "snThreadedWebsocket, spin");
+    printf("\n");
+    benchThreadedStrategy(url, latencies, SN_WAIT_STRATEGY_YIELD, "snThreadedWebsocket, yield");
+    printf("\n");
+    benchThreadedStrategy(url, latencies, SN_WAIT_STRATEGY_FUTEX, "snThreadedWebsocket, futex");
+    
+    benchEchoServerStop(&server);
+    free(latencies);
+}
+
+#else /*__linux__*/
+
+static void benchmarkThreaded(void)
+{
+    printf("The threaded websocket benchmark requires Linux\n");
+}
+
+#endif /*__linux__*/
+
+#endif /*SN_BENCH_THREADED_H*/
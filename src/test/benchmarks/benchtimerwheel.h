@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_TIMER_WHEEL_H
+#define SN_BENCH_TIMER_WHEEL_H
+
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <snacka/timerwheel.h>
+
+#include "benchmark.h"
+
+#define NUM_TIMER_WHEEL_BENCH_TIMERS 10000
+
+#define NUM_TIMER_WHEEL_BENCH_RESCHEDULES 2000000
+
+#define NUM_TIMER_WHEEL_BENCH_ITERATIONS 2000
+
+static void benchTimerWheelCallback(void* userData)
+{
+    (*(int*)userData)++;
+}
+
+/**
+ * The per websocket bookkeeping timeouts used to need: a wall clock
+ * reading on every poll, accumulated into a float timer.
+ */
+typedef struct benchPolledTimeout
+{
+    double prevPollTime;
+    float timer;
+} benchPolledTimeout;
+
+static double benchWallClockTime(void)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec / 1000000.0;
+}
+
+/**
+ * Measures the cost of rescheduling timers, as done for every sent or
+ * received keepalive, and the per iteration cost of keeping track of the
+ * timeouts of many idle websockets, by polling each one for elapsed time
+ * versus advancing a shared timer wheel once.
+ */
+static void benchmarkTimerWheel(void)
+{
+    static snTimer timers[NUM_TIMER_WHEEL_BENCH_TIMERS];
+    static benchPolledTimeout polledTimeouts[NUM_TIMER_WHEEL_BENCH_TIMERS];
+    snTimerWheel wheel;
+    int numFirings = 0;
+    int numExpired = 0;
+    int i, j;
+    
+    snTimerWheel_init(&wheel);
+    for (i = 0; i < NUM_TIMER_WHEEL_BENCH_TIMERS; i++)
+    {
+        snTimer_init(&timers[i], benchTimerWheelCallback, &numFirings);
+        snTimerWheel_schedule(&wheel, &timers[i], 1000 + rand() % 60000);
+    }
+    
+    printf("Timer operations with %d scheduled timers\n", NUM_TIMER_WHEEL_BENCH_TIMERS);
+    
+    double startTime = benchmarkTime();
+    for (i = 0; i < NUM_TIMER_WHEEL_BENCH_RESCHEDULES; i++)
+    {
+        snTimerWheel_scheduleAt(&wheel,
+                                &timers[i % NUM_TIMER_WHEEL_BENCH_TIMERS],
+                                wheel.currentTime + 1000 + (i % 60000) * 7919 % 60000);
+    }
+    double duration = benchmarkTime() - startTime;
+    benchmarkReport("reschedule", duration / NUM_TIMER_WHEEL_BENCH_RESCHEDULES * 1000000000.0, "ns");
+    
+    printf("Timeout bookkeeping per loop iteration, %d idle websockets\n", NUM_TIMER_WHEEL_BENCH_TIMERS);
+    
+    const double now = benchWallClockTime();
+    for (i = 0; i < NUM_TIMER_WHEEL_BENCH_TIMERS; i++)
+    {
+        polledTimeouts[i].prevPollTime = now;
+        polledTimeouts[i].timer = 60.0f;
+    }
+    
+    startTime = benchmarkTime();
+    for (j = 0; j < NUM_TIMER_WHEEL_BENCH_ITERATIONS; j++)
+    {
+        for (i = 0; i < NUM_TIMER_WHEEL_BENCH_TIMERS; i++)
+        {
+            const double pollTime = benchWallClockTime();
+            polledTimeouts[i].timer -= (float)(pollTime - polledTimeouts[i].prevPollTime);
+            polledTimeouts[i].prevPollTime = pollTime;
+            numExpired += polledTimeouts[i].timer < 0;
+        }
+    }
+    duration = benchmarkTime() - startTime;
+    benchmarkReport("poll every websocket", duration / NUM_TIMER_WHEEL_BENCH_ITERATIONS * 1000000.0, "us");
+    
+    startTime = benchmarkTime();
+    for (j = 0; j < NUM_TIMER_WHEEL_BENCH_ITERATIONS; j++)
+    {
+        snTimerWheel_advance(&wheel);
+        numExpired += snTimerWheel_getTimeUntilNextTimer(&wheel) == 0;
+    }
+    duration = benchmarkTime() - startTime;
+    benchmarkReport("advance shared wheel", duration / NUM_TIMER_WHEEL_BENCH_ITERATIONS * 1000000.0, "us");
+    
+    if (numFirings + numExpired > 0)
+    {
+        printf("  (%d timeouts expired during the benchmark)\n", numFirings + numExpired);
+    }
+    
+    snTimerWheel_deinit(&wheel);
+}
+
+#endif /*SN_BENCH_TIMER_WHEEL_H*/
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_BENCH_UTF8_H
+#define SN_BENCH_UTF8_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <snacka/utf8.h>
+
+#include "benchmark.h"
+
+#define NUM_UTF8_BENCH_INPUTS 3
+
+/**
+ * Fills a buffer by repeating a UTF-8 string, without splitting code points.
+ * @return The number of bytes written.
+ */
+static int benchUTF8Fill(uint8_t* bytes, int capacity, const char* pattern)
+{
+    const int patternLength = (int)strlen(pattern);
+    int numBytes = 0;
+    
+    while (numBytes + patternLength <= capacity)
+    {
+        memcpy(&bytes[numBytes], pattern, patternLength);
+        numBytes += patternLength;
+    }
+    
+    return numBytes;
+}
+
+/**
+ * Measures UTF-8 validation throughput for each kernel supported by
+ * the CPU, on mostly ASCII, mixed and mostly multi byte text.
+ */
+static void benchmarkUTF8(void)
+{
+    const char* inputNames[NUM_UTF8_BENCH_INPUTS] = {"json", "mixed", "cjk"};
+    const char* inputPatterns[NUM_UTF8_BENCH_INPUTS] =
+    {
+        "{\"id\": 12345, \"name\": \"snacka\", \"tags\": [\"websocket\", \"client\"], \"ok\": true}\n",
+        "Sm\xc3\xb6rg\xc3\xa5sbord med k\xc3\xb6ttbullar \xe2\x82\xac 12, \xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5 \xf0\x9f\x98\x80\n",
+        "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88\xe4\xb8\xad\xe6\x96\x87"
+    };
+    const char* kernelNames[] = {"auto", "dfa", "scalar", "sse4.1", "avx2"};
+    const snUTF8Kernel kernels[] =
+    {
+        SN_UTF8_KERNEL_AUTO,
+        SN_UTF8_KERNEL_DFA,
+        SN_UTF8_KERNEL_SCALAR,
+        SN_UTF8_KERNEL_SSE41,
+        SN_UTF8_KERNEL_AVX2
+    };
+    const int capacity = 1 << 24;
+    uint8_t* bytes = malloc(capacity);
+    int i, k;
+    
+    printf("snUTF8ValidateStringIncrementalWithKernel, GB/s\n");
+    
+    for (i = 0; i < NUM_UTF8_BENCH_INPUTS; i++)
+    {
+        const int numBytes = benchUTF8Fill(bytes, capacity, inputPatterns[i]);
+        
+        for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+        {
+            double bestDuration = 0;
+            char name[256];
+            int run;
+            
+            if (!snUTF8IsKernelSupported(kernels[k]))
+            {
+                continue;
+            }
+            
+            /*report the best of a few runs to reduce noise*/
+            for (run = 0; run < 5; run++)
+            {
+                uint32_t state = 0;
+                const double startTime = benchmarkTime();
+                snUTF8ValidateStringIncrementalWithKernel(kernels[k], bytes, numBytes, &state);
+                const double duration = benchmarkTime() - startTime;
+                if (state != 0)
+                {
+                    printf("%s input was rejected by the %s kernel\n", inputNames[i], kernelNames[k]);
+                }
+                if (run == 0 || duration < bestDuration)
+                {
+                    bestDuration = duration;
+                }
+            }
+            
+            sprintf(name, "%s, %s", inputNames[i], kernelNames[k]);
+            benchmarkReport(name, numBytes / bestDuration / (1 << 30), "GB/s");
+        }
+    }
+    
+    free(bytes);
+}
+
+#endif /*SN_BENCH_UTF8_H*/
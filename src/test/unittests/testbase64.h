@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_BASE64_H
+#define SN_TEST_BASE64_H
+
+#include <string.h>
+
+#include "sput.h"
+#include "base64.h"
+
+static void testBase64Encode()
+{
+    /*https://tools.ietf.org/html/rfc4648#section-10*/
+    const char* input[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+    const char* expected[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+    int numMismatches = 0;
+    int i;
+    
+    for (i = 0; i < sizeof(input) / sizeof(input[0]); i++)
+    {
+        char encoded[16];
+        const int length = snBase64Encode((const unsigned char*)input[i], (int)strlen(input[i]), encoded);
+        if (strcmp(encoded, expected[i]) != 0 ||
+            length != strlen(expected[i]) ||
+            length != SN_BASE64_ENCODED_SIZE(strlen(input[i])))
+        {
+            numMismatches++;
+        }
+    }
+    
+    sput_fail_unless(numMismatches == 0, "Encoded strings should match the RFC 4648 test vectors");
+    
+    /*the sample nonce from RFC 6455*/
+    {
+        const unsigned char nonce[16] =
+        {
+            0xc7, 0x72, 0x49, 0x1c, 0xc6, 0xc3, 0x2f, 0x51,
+            0x33, 0x2e, 0x48, 0x7d, 0x18, 0x18, 0x57, 0x0f
+        };
+        char encoded[SN_BASE64_ENCODED_SIZE(16) + 1];
+        snBase64Encode(nonce, 16, encoded);
+        sput_fail_unless(strcmp(encoded, "x3JJHMbDL1EzLkh9GBhXDw==") == 0,
+                         "Encoded nonce should match the RFC 6455 example");
+    }
+}
+
+#endif /*SN_TEST_BASE64_H*/
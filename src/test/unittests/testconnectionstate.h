@@ -36,9 +36,12 @@
 #include "sput.h"
 #include "websocket.h"
 
+static snError lastConnectionStateError = SN_NO_ERROR;
+
 static void errorCallback(void* userData, snError errorCode)
 {
     printf("Websocket error, code %d\n", errorCode);
+    lastConnectionStateError = errorCode;
 }
 
 static void messageCallback(void* userData, snOpcode opcode, const char* data, int numBytes)
@@ -59,11 +62,22 @@ static void testConnectionState()
     {
         const char* bogusURL = "htttp://lol.face";
         snWebsocket* ws = snWebsocket_create(NULL, messageCallback, NULL, errorCallback, NULL);
+        lastConnectionStateError = SN_NO_ERROR;
         snError connectionResult = snWebsocket_connect(ws, bogusURL);
-        sput_fail_unless(connectionResult == SN_SOCKET_FAILED_TO_CONNECT,
+        
+        /*unless the failed lookup is cached, the host is resolved in the
+          background and the failure is reported when polling*/
+        while (connectionResult == SN_NO_ERROR && snWebsocket_getState(ws) == SN_STATE_CONNECTING)
+        {
+            snWebsocket_waitForEvents(ws, 100);
+            snWebsocket_poll(ws);
+        }
+        
+        sput_fail_unless(connectionResult == SN_SOCKET_FAILED_TO_CONNECT ||
+                         lastConnectionStateError == SN_SOCKET_FAILED_TO_CONNECT,
                          "Bogus URL should result in a socket connect failed error");
         sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_CLOSED,
-                         "Websocket should be in the 'not connected' state immediately after socket connect error");
+                         "Websocket should be in the 'not connected' state after socket connect error");
         snWebsocket_disconnect(ws, 1);
         sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_CLOSED,
                          "Disconnected websocket should remain in the 'not connected' state after additional disconnect calls");
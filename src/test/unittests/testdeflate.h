@@ -0,0 +1,516 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_DEFLATE_H
+#define SN_TEST_DEFLATE_H
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sput.h"
+#include "frameparser.h"
+#include "permessagedeflate.h"
+#include "testeventloop.h"
+#include "testkeepalive.h"
+#include "websocket.h"
+
+/** "Hello" compressed, from https://tools.ietf.org/html/rfc7692#section-7.2.3.1 */
+static const char deflateTestHello[] = {(char)0xf2, 0x48, (char)0xcd, (char)0xc9, (char)0xc9, 0x07, 0x00};
+
+typedef struct deflateTestState
+{
+    int numMessages;
+    snOpcode opcode;
+    char message[1024];
+    int messageSize;
+} deflateTestState;
+
+static void deflateTestMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    deflateTestState* s = (deflateTestState*)userData;
+    s->numMessages++;
+    s->opcode = opcode;
+    s->messageSize = numBytes < (int)sizeof(s->message) ? numBytes : (int)sizeof(s->message);
+    memcpy(s->message, bytes, s->messageSize);
+}
+
+static void deflateTestChunkCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    deflateTestState* s = (deflateTestState*)userData;
+    if (s->messageSize + numBytes <= (int)sizeof(s->message))
+    {
+        memcpy(&s->message[s->messageSize], bytes, numBytes);
+        s->messageSize += numBytes;
+    }
+}
+
+static void deflateTestEndCallback(void* userData, snOpcode opcode)
+{
+    deflateTestState* s = (deflateTestState*)userData;
+    s->numMessages++;
+    s->opcode = opcode;
+}
+
+static int deflateTestReceivedHello(const deflateTestState* s, int numMessages)
+{
+    return s->numMessages == numMessages &&
+           s->opcode == SN_OPCODE_TEXT &&
+           s->messageSize == 5 &&
+           memcmp(s->message, "Hello", 5) == 0;
+}
+
+/** Initializes the state of a peer that decompresses what the client compresses. */
+static void deflateTestInitPeer(snPerMessageDeflate* peer, const snPerMessageDeflateOptions* parameters)
+{
+    snPerMessageDeflateOptions p;
+    memset(&p, 0, sizeof(snPerMessageDeflateOptions));
+    p.serverMaxWindowBits = parameters->clientMaxWindowBits;
+    p.serverNoContextTakeover = parameters->clientNoContextTakeover;
+    snPerMessageDeflate_init(peer, &p);
+}
+
+static void testPerMessageDeflateNegotiation()
+{
+    snPerMessageDeflateOptions offer;
+    snPerMessageDeflateOptions p;
+    snMutableString s;
+    
+    memset(&offer, 0, sizeof(snPerMessageDeflateOptions));
+    snMutableString_init(&s);
+    snPerMessageDeflate_createOffer(&offer, &s);
+    sput_fail_unless(strcmp(snMutableString_getString(&s), "permessage-deflate; client_max_window_bits=15") == 0,
+                     "The default offer should let the server limit the client window");
+    snMutableString_deinit(&s);
+    
+    offer.clientMaxWindowBits = 10;
+    offer.serverMaxWindowBits = 12;
+    offer.clientNoContextTakeover = 1;
+    offer.serverNoContextTakeover = 1;
+    snPerMessageDeflate_createOffer(&offer, &s);
+    sput_fail_unless(strcmp(snMutableString_getString(&s),
+                            "permessage-deflate; client_max_window_bits=10; server_max_window_bits=12; "
+                            "client_no_context_takeover; server_no_context_takeover") == 0,
+                     "All parameters should be offered");
+    snMutableString_deinit(&s);
+    
+    memset(&offer, 0, sizeof(snPerMessageDeflateOptions));
+    sput_fail_unless(snPerMessageDeflate_parseResponse("permessage-deflate", &offer, &p) == SN_NO_ERROR &&
+                     p.clientMaxWindowBits == 15 && p.serverMaxWindowBits == 15 &&
+                     !p.clientNoContextTakeover && !p.serverNoContextTakeover,
+                     "A response without parameters should use the largest windows and context takeover");
+    
+    sput_fail_unless(snPerMessageDeflate_parseResponse(" permessage-deflate ; server_no_context_takeover;"
+                                                       "client_max_window_bits=\"9\"; server_max_window_bits=10",
+                                                       &offer, &p) == SN_NO_ERROR &&
+                     p.clientMaxWindowBits == 9 && p.serverMaxWindowBits == 10 &&
+                     !p.clientNoContextTakeover && p.serverNoContextTakeover,
+                     "Parameters chosen by the server should be accepted");
+    
+    sput_fail_unless(snPerMessageDeflate_parseResponse("x-webkit-deflate-frame", &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED,
+                     "Extensions that were not offered should be rejected");
+    sput_fail_unless(snPerMessageDeflate_parseResponse("permessage-deflate, permessage-deflate", &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED,
+                     "More than one accepted extension should be rejected");
+    sput_fail_unless(snPerMessageDeflate_parseResponse("permessage-deflate; foo", &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED,
+                     "Unknown parameters should be rejected");
+    sput_fail_unless(snPerMessageDeflate_parseResponse("permessage-deflate; server_no_context_takeover; server_no_context_takeover",
+                                                       &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED,
+                     "Repeated parameters should be rejected");
+    sput_fail_unless(snPerMessageDeflate_parseResponse("permessage-deflate; server_max_window_bits=16", &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED &&
+                     snPerMessageDeflate_parseResponse("permessage-deflate; server_max_window_bits", &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED,
+                     "Invalid window sizes should be rejected");
+    sput_fail_unless(snPerMessageDeflate_parseResponse("permessage-deflate; client_max_window_bits=8", &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED,
+                     "A client window too small for zlib should be rejected");
+    
+    offer.clientMaxWindowBits = 10;
+    offer.serverMaxWindowBits = 12;
+    offer.serverNoContextTakeover = 1;
+    sput_fail_unless(snPerMessageDeflate_parseResponse("permessage-deflate; server_max_window_bits=13; server_no_context_takeover",
+                                                       &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED &&
+                     snPerMessageDeflate_parseResponse("permessage-deflate; server_max_window_bits=12; server_no_context_takeover; "
+                                                       "client_max_window_bits=11", &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED,
+                     "Windows larger than offered should be rejected");
+    sput_fail_unless(snPerMessageDeflate_parseResponse("permessage-deflate; server_no_context_takeover", &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED &&
+                     snPerMessageDeflate_parseResponse("permessage-deflate; server_max_window_bits=12", &offer, &p) == SN_EXTENSION_NEGOTIATION_FAILED,
+                     "Offered server parameters left out of the response should be rejected");
+    sput_fail_unless(snPerMessageDeflate_parseResponse("permessage-deflate; server_max_window_bits=8; server_no_context_takeover",
+                                                       &offer, &p) == SN_NO_ERROR &&
+                     p.clientMaxWindowBits == 10 && p.serverMaxWindowBits == 8 && p.serverNoContextTakeover,
+                     "The server should be allowed to pick smaller windows than offered");
+}
+
+static void testPerMessageDeflateCompression()
+{
+    static const char message[] =
+    "{\"symbol\": \"ABC\", \"bid\": 101.25, \"ask\": 101.5, \"volume\": 1200, \"exchange\": \"XNAS\"}";
+    const int messageSize = sizeof(message) - 1;
+    snPerMessageDeflateOptions parameters;
+    snPerMessageDeflate sender;
+    snPerMessageDeflate receiver;
+    const char* decompressed = NULL;
+    int decompressedSize = 0;
+    int noContextTakeover;
+    
+    for (noContextTakeover = 0; noContextTakeover < 2; noContextTakeover++)
+    {
+        int compressedSizes[3];
+        int numRoundTrips = 0;
+        int i;
+        
+        memset(&parameters, 0, sizeof(snPerMessageDeflateOptions));
+        parameters.clientNoContextTakeover = noContextTakeover;
+        snPerMessageDeflate_init(&sender, &parameters);
+        deflateTestInitPeer(&receiver, &parameters);
+        
+        for (i = 0; i < 3; i++)
+        {
+            const char* compressed = NULL;
+            compressedSizes[i] = 0;
+            if (snPerMessageDeflate_compress(&sender, message, messageSize, &compressed, &compressedSizes[i]) == SN_NO_ERROR &&
+                snPerMessageDeflate_decompress(&receiver, compressed, compressedSizes[i], 1024,
+                                               &decompressed, &decompressedSize) == SN_NO_ERROR &&
+                decompressedSize == messageSize &&
+                memcmp(decompressed, message, messageSize) == 0 &&
+                decompressed[decompressedSize] == '\0')
+            {
+                numRoundTrips++;
+            }
+        }
+        
+        sput_fail_unless(numRoundTrips == 3, "Compressed messages should decompress to the original");
+        
+        if (noContextTakeover)
+        {
+            sput_fail_unless(compressedSizes[1] == compressedSizes[0] && compressedSizes[2] == compressedSizes[0],
+                             "Without context takeover, every message should be compressed on its own");
+        }
+        else
+        {
+            sput_fail_unless(compressedSizes[1] < compressedSizes[0] / 2,
+                             "With context takeover, repeated messages should compress better");
+        }
+        
+        snPerMessageDeflate_deinit(&sender);
+        snPerMessageDeflate_deinit(&receiver);
+    }
+    
+    memset(&parameters, 0, sizeof(snPerMessageDeflateOptions));
+    snPerMessageDeflate_init(&receiver, &parameters);
+    sput_fail_unless(snPerMessageDeflate_decompress(&receiver, deflateTestHello, sizeof(deflateTestHello), 1024,
+                                                    &decompressed, &decompressedSize) == SN_NO_ERROR &&
+                     decompressedSize == 5 && strcmp(decompressed, "Hello") == 0,
+                     "The RFC 7692 example should decompress");
+    snPerMessageDeflate_deinit(&receiver);
+    
+    snPerMessageDeflate_init(&receiver, &parameters);
+    sput_fail_unless(snPerMessageDeflate_decompress(&receiver, deflateTestHello, sizeof(deflateTestHello), 4,
+                                                    &decompressed, &decompressedSize) == SN_EXCEEDED_MAX_MESSAGE_SIZE,
+                     "Messages decompressing to more than the max message size should be rejected");
+    snPerMessageDeflate_deinit(&receiver);
+    
+    snPerMessageDeflate_init(&receiver, &parameters);
+    sput_fail_unless(snPerMessageDeflate_decompress(&receiver, "\xff\xff\xff", 3, 1024,
+                                                    &decompressed, &decompressedSize) == SN_DECOMPRESSION_FAILED,
+                     "Invalid compressed data should be rejected");
+    snPerMessageDeflate_deinit(&receiver);
+}
+
+static void testFrameParserDeflate()
+{
+    static const char fragments[] = {0x41, 0x03, (char)0xf2, 0x48, (char)0xcd, (char)0x80, 0x04, (char)0xc9, (char)0xc9, 0x07, 0x00};
+    static const char compressedPing[] = {(char)0xc9, 0x00};
+    char frame[2 + sizeof(deflateTestHello) + 1];
+    snFrameParser parser;
+    snPerMessageDeflateOptions parameters;
+    snPerMessageDeflate d;
+    deflateTestState state;
+    snMessageStreamCallbacks streamCallbacks;
+    int numBytesProcessed = 0;
+    int i;
+    
+    frame[0] = (char)0xc1;
+    frame[1] = sizeof(deflateTestHello);
+    memcpy(&frame[2], deflateTestHello, sizeof(deflateTestHello));
+    
+    memset(&state, 0, sizeof(deflateTestState));
+    memset(&parameters, 0, sizeof(snPerMessageDeflateOptions));
+    snPerMessageDeflate_init(&d, &parameters);
+    snFrameParser_init(&parser, NULL, NULL, deflateTestMessageCallback, &state, 1 << 16, 1 << 16);
+    
+    sput_fail_unless(snFrameParser_processBytes(&parser, frame, sizeof(frame) - 1) == SN_NONZERO_RESVERVED_BIT,
+                     "RSV1 should be rejected unless permessage-deflate was negotiated");
+    
+    snFrameParser_reset(&parser);
+    snFrameParser_setPerMessageDeflate(&parser, &d);
+    
+    sput_fail_unless(snFrameParser_processBytes(&parser, frame, sizeof(frame) - 1) == SN_NO_ERROR &&
+                     deflateTestReceivedHello(&state, 1),
+                     "A compressed frame should be decompressed");
+    
+    sput_fail_unless(snFrameParser_processBytesInPlace(&parser, frame, sizeof(frame) - 1, 0, &numBytesProcessed) == SN_NO_ERROR &&
+                     numBytesProcessed == sizeof(frame) - 1 &&
+                     deflateTestReceivedHello(&state, 2),
+                     "A compressed frame delivered in place should be decompressed");
+    
+    for (i = 0; i < sizeof(fragments); i++)
+    {
+        snFrameParser_processBytes(&parser, &fragments[i], 1);
+    }
+    sput_fail_unless(deflateTestReceivedHello(&state, 3), "A fragmented compressed message should be decompressed");
+    
+    memset(&streamCallbacks, 0, sizeof(snMessageStreamCallbacks));
+    streamCallbacks.chunkCallback = deflateTestChunkCallback;
+    streamCallbacks.endCallback = deflateTestEndCallback;
+    snFrameParser_setMessageStreamCallbacks(&parser, &streamCallbacks, &state);
+    state.messageSize = 0;
+    sput_fail_unless(snFrameParser_processBytes(&parser, fragments, sizeof(fragments)) == SN_NO_ERROR &&
+                     deflateTestReceivedHello(&state, 4),
+                     "A streamed compressed message should be decompressed chunk by chunk");
+    
+    sput_fail_unless(snFrameParser_processBytes(&parser, compressedPing, sizeof(compressedPing)) == SN_NONZERO_RESVERVED_BIT,
+                     "Compressed control frames should be rejected");
+    
+    snFrameParser_setMessageStreamCallbacks(&parser, NULL, NULL);
+    snFrameParser_reset(&parser);
+    frame[2] = (char)0xff;
+    frame[3] = (char)0xff;
+    sput_fail_unless(snFrameParser_processBytes(&parser, frame, sizeof(frame) - 1) == SN_DECOMPRESSION_FAILED,
+                     "Invalid compressed data should be rejected");
+    
+    snFrameParser_deinit(&parser);
+    snPerMessageDeflate_deinit(&d);
+}
+
+/** Plays the server, answering the opening handshake with a given extensions header field value. */
+static void deflateTestRespond(testSocketPair* p, const char* extensions)
+{
+    char response[512];
+    
+    snprintf(response, sizeof(response),
+             "HTTP/1.1 101 Switching Protocols\r\n"
+             "Upgrade: websocket\r\n"
+             "Connection: Upgrade\r\n"
+             "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"
+             "Sec-WebSocket-Extensions: %s\r\n\r\n", extensions);
+    
+    if (write(p->descriptors[1], response, strlen(response)) < 0)
+    {
+        return;
+    }
+}
+
+/**
+ * Reads a frame sent by the client and unmasks its payload in place.
+ * @return A pointer to the payload, or NULL on failure.
+ */
+static char* deflateTestReceiveFrame(testSocketPair* p, char* buffer, int bufferSize, snFrameHeader* header)
+{
+    int headerSize = 0;
+    const ssize_t numBytes = recv(p->descriptors[1], buffer, bufferSize, MSG_DONTWAIT);
+    if (numBytes < 2 ||
+        snFrameHeader_fromBytes(header, buffer, &headerSize) != SN_NO_ERROR ||
+        headerSize + header->payloadSize != numBytes)
+    {
+        return NULL;
+    }
+    
+    snFrameHeader_applyMask(header, &buffer[headerSize], (int)header->payloadSize, 0);
+    return &buffer[headerSize];
+}
+
+static void testWebsocketDeflate()
+{
+    static const char hello[] = {(char)0xc1, 0x07, (char)0xf2, 0x48, (char)0xcd, (char)0xc9, (char)0xc9, 0x07, 0x00};
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    snPerMessageDeflateOptions deflateOptions;
+    snPerMessageDeflate peer;
+    snFrameHeader header;
+    deflateTestState state;
+    char buffer[4096];
+    char text[201];
+    const char* decompressed = NULL;
+    int decompressedSize = 0;
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = testSocketPairDeinit;
+    ioc.connectCallback = testSocketPairConnect;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = testSocketPairDisconnect;
+    ioc.readCallback = testSocketPairRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(&deflateOptions, 0, sizeof(snPerMessageDeflateOptions));
+    deflateOptions.compressionThreshold = 32;
+    
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.ioCallbacks = &ioc;
+    o.perMessageDeflate = &deflateOptions;
+    
+    memset(&state, 0, sizeof(deflateTestState));
+    numTestSocketPairs = 0;
+    snWebsocket* ws = snWebsocket_createWithSettings(NULL, deflateTestMessageCallback, NULL, NULL, &state, &o);
+    testSocketPair* p = testSocketPairs[0];
+    snWebsocket_connect(ws, "ws://localhost/");
+    snWebsocket_poll(ws);
+    
+    const ssize_t numRequestBytes = recv(p->descriptors[1], buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
+    buffer[numRequestBytes > 0 ? numRequestBytes : 0] = '\0';
+    sput_fail_unless(strstr(buffer, "\r\nSec-WebSocket-Extensions: permessage-deflate; client_max_window_bits=15\r\n") != NULL,
+                     "The opening handshake should offer permessage-deflate");
+    
+    deflateTestRespond(p, "permessage-deflate; client_no_context_takeover");
+    if (write(p->descriptors[1], hello, sizeof(hello)) < 0)
+    {
+        sput_fail_unless(0, "Failed to write a compressed frame");
+    }
+    snWebsocket_poll(ws);
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_OPEN && deflateTestReceivedHello(&state, 1),
+                     "Compressed messages should be received once permessage-deflate is accepted");
+    
+    memset(text, 'a', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    snWebsocket_sendTextData(ws, text);
+    
+    memset(&deflateOptions, 0, sizeof(snPerMessageDeflateOptions));
+    deflateOptions.clientNoContextTakeover = 1;
+    deflateTestInitPeer(&peer, &deflateOptions);
+    const char* payload = deflateTestReceiveFrame(p, buffer, sizeof(buffer), &header);
+    sput_fail_unless(payload && header.isCompressed && header.payloadSize < sizeof(text) - 1 &&
+                     snPerMessageDeflate_decompress(&peer, payload, (int)header.payloadSize, 1024,
+                                                    &decompressed, &decompressedSize) == SN_NO_ERROR &&
+                     strcmp(decompressed, text) == 0,
+                     "Messages above the compression threshold should be sent compressed");
+    snPerMessageDeflate_deinit(&peer);
+    
+    snWebsocket_sendTextData(ws, "Hello");
+    payload = deflateTestReceiveFrame(p, buffer, sizeof(buffer), &header);
+    sput_fail_unless(payload && !header.isCompressed && header.payloadSize == 5 && memcmp(payload, "Hello", 5) == 0,
+                     "Messages below the compression threshold should be sent as they are");
+    
+    snWebsocket_delete(ws);
+    
+    /*invalid parameters in the response fail the connection*/
+    numTestSocketPairs = 0;
+    ws = snWebsocket_createWithSettings(NULL, deflateTestMessageCallback, NULL, NULL, &state, &o);
+    p = testSocketPairs[0];
+    snWebsocket_connect(ws, "ws://localhost/");
+    snWebsocket_poll(ws);
+    testDiscardSentBytes(p);
+    deflateTestRespond(p, "permessage-deflate; server_max_window_bits=16");
+    snWebsocket_poll(ws);
+    sput_fail_unless(snWebsocket_getState(ws) != SN_STATE_OPEN,
+                     "A response with invalid permessage-deflate parameters should fail the connection");
+    snWebsocket_delete(ws);
+    
+    /*without the extension, RSV1 is a protocol error*/
+    o.perMessageDeflate = NULL;
+    numTestSocketPairs = 0;
+    state.numMessages = 0;
+    ws = snWebsocket_createWithSettings(NULL, deflateTestMessageCallback, NULL, NULL, &state, &o);
+    p = testSocketPairs[0];
+    snWebsocket_connect(ws, "ws://localhost/");
+    snWebsocket_poll(ws);
+    testSocketPairRespond(p, 0);
+    if (write(p->descriptors[1], hello, sizeof(hello)) < 0)
+    {
+        sput_fail_unless(0, "Failed to write a compressed frame");
+    }
+    snWebsocket_poll(ws);
+    sput_fail_unless(snWebsocket_getState(ws) != SN_STATE_OPEN && state.numMessages == 0,
+                     "Compressed frames should fail the connection unless permessage-deflate was negotiated");
+    snWebsocket_delete(ws);
+}
+
+static void testDeflateStreamPool()
+{
+    static const char message[] = "permessage-deflate streams are pooled, permessage-deflate streams are pooled";
+    snPerMessageDeflateOptions parameters;
+    snPerMessageDeflate connections[4];
+    snDeflateStreamPoolStats before;
+    snDeflateStreamPoolStats stats;
+    const char* compressed = NULL;
+    int numCompressedBytes = 0;
+    int i;
+    int j;
+    
+    memset(&parameters, 0, sizeof(snPerMessageDeflateOptions));
+    parameters.clientNoContextTakeover = 1;
+    
+    snPerMessageDeflate_setMaxIdleStreams(4);
+    snPerMessageDeflate_getPoolStats(&before);
+    
+    /*without context takeover, streams are only held while compressing*/
+    for (i = 0; i < 4; i++)
+    {
+        snPerMessageDeflate_init(&connections[i], &parameters);
+    }
+    for (j = 0; j < 10; j++)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            snPerMessageDeflate_compress(&connections[i], message, sizeof(message) - 1, &compressed, &numCompressedBytes);
+        }
+    }
+    snPerMessageDeflate_getPoolStats(&stats);
+    sput_fail_unless(stats.numCreatedStreams - before.numCreatedStreams <= 1 &&
+                     stats.numStreams == stats.numIdleStreams,
+                     "Connections without context takeover should share pooled streams");
+    
+    /*with context takeover, every connection holds on to its stream*/
+    parameters.clientNoContextTakeover = 0;
+    for (i = 0; i < 4; i++)
+    {
+        snPerMessageDeflate_deinit(&connections[i]);
+        snPerMessageDeflate_init(&connections[i], &parameters);
+        snPerMessageDeflate_compress(&connections[i], message, sizeof(message) - 1, &compressed, &numCompressedBytes);
+    }
+    snPerMessageDeflate_getPoolStats(&stats);
+    sput_fail_unless(stats.numStreams - stats.numIdleStreams == 4,
+                     "Connections with context takeover should hold a stream each");
+    
+    for (i = 0; i < 4; i++)
+    {
+        snPerMessageDeflate_deinit(&connections[i]);
+    }
+    snPerMessageDeflate_getPoolStats(&stats);
+    sput_fail_unless(stats.numStreams == stats.numIdleStreams && stats.numIdleStreams <= 4,
+                     "Released streams should return to the pool, up to the idle limit");
+    
+    snPerMessageDeflate_setMaxIdleStreams(0);
+    snPerMessageDeflate_getPoolStats(&stats);
+    sput_fail_unless(stats.numStreams == 0 && stats.numIdleStreams == 0,
+                     "Lowering the idle limit should free idle streams");
+    
+    snPerMessageDeflate_setMaxIdleStreams(SN_DEFAULT_MAX_IDLE_DEFLATE_STREAMS);
+}
+
+#endif /*SN_TEST_DEFLATE_H*/
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_DISPATCHER_H
+#define SN_TEST_DISPATCHER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sput.h"
+#include "dispatcher.h"
+
+#define NUM_DISPATCHER_TEST_QUEUES 16
+
+#define NUM_DISPATCHER_TEST_MESSAGES_PER_QUEUE 5000
+
+typedef struct testDispatcherConnection
+{
+    int numMessages;
+    int numOrderErrors;
+    int numContentErrors;
+} testDispatcherConnection;
+
+/**
+ * Each message is the decimal sequence number of the message
+ * on its queue, padded with a varying number of dashes.
+ */
+static void testDispatcherMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    testDispatcherConnection* c = (testDispatcherConnection*)userData;
+    int i;
+    
+    if (atoi(bytes) != c->numMessages)
+    {
+        c->numOrderErrors++;
+    }
+    
+    if (opcode != SN_OPCODE_TEXT || (int)strlen(bytes) != numBytes)
+    {
+        c->numContentErrors++;
+    }
+    
+    for (i = (int)strspn(bytes, "0123456789"); i < numBytes; i++)
+    {
+        if (bytes[i] != '-')
+        {
+            c->numContentErrors++;
+            break;
+        }
+    }
+    
+    c->numMessages++;
+}
+
+static void testDispatcher()
+{
+    testDispatcherConnection connections[NUM_DISPATCHER_TEST_QUEUES];
+    snSerialQueue* queues[NUM_DISPATCHER_TEST_QUEUES];
+    char message[256];
+    int numMessages = 0;
+    int numOrderErrors = 0;
+    int numContentErrors = 0;
+    int i, j;
+    
+    snDispatcher* dispatcher = snDispatcher_create(4);
+    sput_fail_unless(snDispatcher_getNumThreads(dispatcher) == 4,
+                     "A dispatcher should have the requested number of threads");
+    
+    memset(connections, 0, sizeof(connections));
+    for (i = 0; i < NUM_DISPATCHER_TEST_QUEUES; i++)
+    {
+        queues[i] = snSerialQueue_create(dispatcher);
+    }
+    
+    /*interleave the queues and reuse the message buffer,
+      which must be copied by the dispatcher*/
+    for (j = 0; j < NUM_DISPATCHER_TEST_MESSAGES_PER_QUEUE; j++)
+    {
+        for (i = 0; i < NUM_DISPATCHER_TEST_QUEUES; i++)
+        {
+            const int numDigits = sprintf(message, "%d", j);
+            const int numBytes = numDigits + (i + j) % 100;
+            memset(&message[numDigits], '-', numBytes - numDigits);
+            snSerialQueue_postMessage(queues[i],
+                                      testDispatcherMessageCallback,
+                                      &connections[i],
+                                      SN_OPCODE_TEXT,
+                                      message,
+                                      numBytes);
+            memset(message, 'x', sizeof(message));
+        }
+    }
+    
+    /*pending messages are handled before the queues and the dispatcher are deleted*/
+    for (i = 0; i < NUM_DISPATCHER_TEST_QUEUES; i++)
+    {
+        snSerialQueue_delete(queues[i]);
+    }
+    snDispatcher_delete(dispatcher);
+    
+    for (i = 0; i < NUM_DISPATCHER_TEST_QUEUES; i++)
+    {
+        numMessages += connections[i].numMessages;
+        numOrderErrors += connections[i].numOrderErrors;
+        numContentErrors += connections[i].numContentErrors;
+    }
+    
+    sput_fail_unless(numMessages == NUM_DISPATCHER_TEST_QUEUES * NUM_DISPATCHER_TEST_MESSAGES_PER_QUEUE,
+                     "Every posted message should be handled exactly once");
+    sput_fail_unless(numOrderErrors == 0,
+                     "Messages posted to the same queue should be handled in order");
+    sput_fail_unless(numContentErrors == 0,
+                     "Handled messages should be null terminated copies of the posted messages");
+}
+
+#endif /*SN_TEST_DISPATCHER_H*/
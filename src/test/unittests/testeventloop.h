@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_EVENT_LOOP_H
+#define SN_TEST_EVENT_LOOP_H
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sput.h"
+#include "eventloop.h"
+#include "iocallbacks.h"
+#include "websocket.h"
+
+#define NUM_EVENT_LOOP_TEST_WEBSOCKETS 3
+
+/**
+ * An I/O object connecting a websocket to one end of a socket pair.
+ * The test plays the server at the other end.
+ */
+typedef struct testSocketPair
+{
+    int descriptors[2];
+} testSocketPair;
+
+/** The I/O objects of the test websockets, in creation order. */
+static testSocketPair* testSocketPairs[NUM_EVENT_LOOP_TEST_WEBSOCKETS];
+
+static int numTestSocketPairs = 0;
+
+static snError testSocketPairInit(void** ioObject)
+{
+    testSocketPair* p = malloc(sizeof(testSocketPair));
+    p->descriptors[0] = -1;
+    p->descriptors[1] = -1;
+    testSocketPairs[numTestSocketPairs++] = p;
+    *ioObject = p;
+    return SN_NO_ERROR;
+}
+
+static snError testSocketPairDisconnect(void* ioObject)
+{
+    testSocketPair* p = (testSocketPair*)ioObject;
+    if (p->descriptors[0] >= 0)
+    {
+        close(p->descriptors[0]);
+        close(p->descriptors[1]);
+    }
+    p->descriptors[0] = -1;
+    p->descriptors[1] = -1;
+    return SN_NO_ERROR;
+}
+
+static snError testSocketPairDeinit(void* ioObject)
+{
+    testSocketPairDisconnect(ioObject);
+    free(ioObject);
+    return SN_NO_ERROR;
+}
+
+static snError testSocketPairConnect(void* ioObject, const char* host, int port)
+{
+    testSocketPair* p = (testSocketPair*)ioObject;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, p->descriptors) != 0)
+    {
+        return SN_SOCKET_FAILED_TO_CONNECT;
+    }
+    fcntl(p->descriptors[0], F_SETFL, fcntl(p->descriptors[0], F_GETFL, 0) | O_NONBLOCK);
+    return SN_NO_ERROR;
+}
+
+static snError testSocketPairIsOpen(void* ioObject, int* result)
+{
+    *result = 1;
+    return SN_NO_ERROR;
+}
+
+static snError testSocketPairRead(void* ioObject, char* buffer, int bufferSize, int* numBytesRead)
+{
+    testSocketPair* p = (testSocketPair*)ioObject;
+    const ssize_t result = read(p->descriptors[0], buffer, bufferSize);
+    *numBytesRead = result > 0 ? (int)result : 0;
+    return SN_NO_ERROR;
+}
+
+static snError testSocketPairWrite(void* ioObject, const char* buffer, int bufferSize, int* numBytesWritten)
+{
+    testSocketPair* p = (testSocketPair*)ioObject;
+    const ssize_t result = write(p->descriptors[0], buffer, bufferSize);
+    *numBytesWritten = result > 0 ? (int)result : 0;
+    return SN_NO_ERROR;
+}
+
+static snError testSocketPairGetDescriptor(void* ioObject, int* descriptor)
+{
+    *descriptor = ((testSocketPair*)ioObject)->descriptors[0];
+    return SN_NO_ERROR;
+}
+
+/** Plays the server, sending a handshake response followed by unmasked text frames. */
+static void testSocketPairRespond(testSocketPair* p, int numFrames)
+{
+    static const char response[] =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n";
+    static const char frame[] = {(char)0x81, 5, 'h', 'e', 'l', 'l', 'o'};
+    int i;
+    
+    if (write(p->descriptors[1], response, sizeof(response) - 1) < 0)
+    {
+        return;
+    }
+    
+    for (i = 0; i < numFrames; i++)
+    {
+        if (write(p->descriptors[1], frame, sizeof(frame)) < 0)
+        {
+            return;
+        }
+    }
+}
+
+static void eventLoopTestMessageCallback(void* userData, snOpcode opcode, const char* data, int numBytes)
+{
+    int* numMessages = (int*)userData;
+    (*numMessages)++;
+}
+
+static void testEventLoop()
+{
+    snEventLoop* loop = snEventLoop_create();
+    snWebsocket* websockets[NUM_EVENT_LOOP_TEST_WEBSOCKETS];
+    int numMessages[NUM_EVENT_LOOP_TEST_WEBSOCKETS] = {0};
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    int numPolls;
+    int i;
+    
+    if (loop == NULL)
+    {
+        /*event loops are not available on this platform*/
+        return;
+    }
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = testSocketPairDeinit;
+    ioc.connectCallback = testSocketPairConnect;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = testSocketPairDisconnect;
+    ioc.readCallback = testSocketPairRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    /*the first websocket reads at most 64 bytes per poll*/
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.ioCallbacks = &ioc;
+    o.readBufferSize = 64;
+    o.maxReadsPerPoll = 1;
+    
+    numTestSocketPairs = 0;
+    for (i = 0; i < NUM_EVENT_LOOP_TEST_WEBSOCKETS; i++)
+    {
+        websockets[i] = snWebsocket_createWithSettings(NULL,
+                                                       eventLoopTestMessageCallback,
+                                                       NULL,
+                                                       NULL,
+                                                       &numMessages[i],
+                                                       &o);
+        o.readBufferSize = 0;
+        o.maxReadsPerPoll = 0;
+        
+        sput_fail_unless(snEventLoop_addWebsocket(loop, websockets[i]) == SN_NO_ERROR,
+                         "Adding a websocket to an event loop should succeed");
+        snWebsocket_connect(websockets[i], "ws://localhost/");
+    }
+    
+    sput_fail_unless(snEventLoop_addWebsocket(loop, websockets[0]) == SN_EVENT_LOOP_ERROR,
+                     "Adding a websocket twice should fail");
+    
+    numPolls = snEventLoop_runOnce(loop, 0);
+    sput_fail_unless(numPolls == NUM_EVENT_LOOP_TEST_WEBSOCKETS,
+                     "Newly connected websockets should be polled once");
+    numPolls = snEventLoop_runOnce(loop, 0);
+    sput_fail_unless(numPolls == 0, "Idle websockets should not be polled");
+    
+    testSocketPairRespond(testSocketPairs[1], 1);
+    numPolls = snEventLoop_runOnce(loop, 0);
+    sput_fail_unless(numPolls == 1, "Only websockets with incoming data should be polled");
+    sput_fail_unless(snWebsocket_getState(websockets[1]) == SN_STATE_OPEN &&
+                     numMessages[1] == 1,
+                     "A polled websocket should open and receive messages");
+    
+    snEventLoop_removeWebsocket(loop, websockets[2]);
+    testSocketPairRespond(testSocketPairs[2], 1);
+    numPolls = snEventLoop_runOnce(loop, 0);
+    sput_fail_unless(numPolls == 0 && numMessages[2] == 0,
+                     "Removed websockets should not be polled");
+    
+    /*the response and frames take several polls for the first websocket. with
+      edge triggered epoll, the loop has to keep polling without new events.*/
+    testSocketPairRespond(testSocketPairs[0], 20);
+    for (i = 0; i < 20 && numMessages[0] < 20; i++)
+    {
+        snEventLoop_runOnce(loop, 0);
+    }
+    sput_fail_unless(numMessages[0] == 20,
+                     "Websockets that stop at the per poll read limits should be polled until all data is read");
+    
+    for (i = 0; i < NUM_EVENT_LOOP_TEST_WEBSOCKETS; i++)
+    {
+        snWebsocket_delete(websockets[i]);
+    }
+    
+    snEventLoop_delete(loop);
+}
+
+#endif /*SN_TEST_EVENT_LOOP_H*/
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_EVENT_LOOP_POOL_H
+#define SN_TEST_EVENT_LOOP_POOL_H
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sput.h"
+#include "eventloop.h"
+#include "eventlooppool.h"
+#include "timerwheel.h"
+
+#define NUM_EVENT_LOOP_POOL_TEST_THREADS 4
+
+#define NUM_EVENT_LOOP_POOL_TEST_SUBMITTERS 4
+
+#define NUM_EVENT_LOOP_POOL_TEST_TASKS_PER_SUBMITTER 5000
+
+/** A task posted to one of the loops of the pool. */
+typedef struct testEventLoopPoolTask
+{
+    snEventLoop* loop;
+    /** The number of times the task has run. */
+    int numRuns;
+    /** The number of times the task ran on another thread than the loop's. */
+    int numRunsOutsideLoop;
+} testEventLoopPoolTask;
+
+/** The tasks posted by one submitting thread. */
+typedef struct testEventLoopPoolSubmitter
+{
+    snEventLoopPool* pool;
+    testEventLoopPoolTask* tasks;
+    pthread_t thread;
+} testEventLoopPoolSubmitter;
+
+static void eventLoopPoolTestTask(void* userData)
+{
+    testEventLoopPoolTask* task = (testEventLoopPoolTask*)userData;
+    __atomic_add_fetch(&task->numRuns, 1, __ATOMIC_SEQ_CST);
+    if (!snEventLoop_isInLoopThread(task->loop))
+    {
+        __atomic_add_fetch(&task->numRunsOutsideLoop, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/** Posts tasks to the loops of the pool in turn. */
+static void* eventLoopPoolTestSubmit(void* userData)
+{
+    testEventLoopPoolSubmitter* s = (testEventLoopPoolSubmitter*)userData;
+    const int numLoops = snEventLoopPool_getNumLoops(s->pool);
+    int i;
+    
+    for (i = 0; i < NUM_EVENT_LOOP_POOL_TEST_TASKS_PER_SUBMITTER; i++)
+    {
+        s->tasks[i].loop = snEventLoopPool_getLoop(s->pool, i % numLoops);
+        snEventLoop_post(s->tasks[i].loop, eventLoopPoolTestTask, &s->tasks[i]);
+    }
+    
+    return NULL;
+}
+
+/**
+ * Tasks posted to the loops of a pool from several threads at once should
+ * each run exactly once, on the thread of their loop, and deleting the
+ * pool should stop and join its threads.
+ */
+static void testEventLoopPool()
+{
+    testEventLoopPoolSubmitter submitters[NUM_EVENT_LOOP_POOL_TEST_SUBMITTERS];
+    const int numTasks = NUM_EVENT_LOOP_POOL_TEST_SUBMITTERS * NUM_EVENT_LOOP_POOL_TEST_TASKS_PER_SUBMITTER;
+    int numTasksRun = 0;
+    int numTasksRunOnce = 0;
+    int numTasksRunOutsideLoop = 0;
+    int i;
+    int j;
+    
+    snEventLoopPool* pool = snEventLoopPool_create(NUM_EVENT_LOOP_POOL_TEST_THREADS,
+                                                   SN_LOAD_BALANCING_ROUND_ROBIN,
+                                                   0);
+    if (pool == NULL)
+    {
+        /*event loops are not available on this platform*/
+        return;
+    }
+    
+    sput_fail_unless(snEventLoopPool_getNumLoops(pool) == NUM_EVENT_LOOP_POOL_TEST_THREADS,
+                     "The pool should have one loop per thread");
+    
+    for (i = 0; i < NUM_EVENT_LOOP_POOL_TEST_SUBMITTERS; i++)
+    {
+        submitters[i].pool = pool;
+        submitters[i].tasks = calloc(NUM_EVENT_LOOP_POOL_TEST_TASKS_PER_SUBMITTER,
+                                     sizeof(testEventLoopPoolTask));
+        pthread_create(&submitters[i].thread, NULL, eventLoopPoolTestSubmit, &submitters[i]);
+    }
+    
+    for (i = 0; i < NUM_EVENT_LOOP_POOL_TEST_SUBMITTERS; i++)
+    {
+        pthread_join(submitters[i].thread, NULL);
+    }
+    
+    /*give the loops time to run the tasks*/
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    while (numTasksRun < numTasks && snTimerWheel_getMonotonicTime() - startTime < 2000)
+    {
+        numTasksRun = 0;
+        for (i = 0; i < NUM_EVENT_LOOP_POOL_TEST_SUBMITTERS; i++)
+        {
+            for (j = 0; j < NUM_EVENT_LOOP_POOL_TEST_TASKS_PER_SUBMITTER; j++)
+            {
+                numTasksRun += __atomic_load_n(&submitters[i].tasks[j].numRuns, __ATOMIC_SEQ_CST) > 0;
+            }
+        }
+    }
+    
+    snEventLoopPool_delete(pool);
+    
+    for (i = 0; i < NUM_EVENT_LOOP_POOL_TEST_SUBMITTERS; i++)
+    {
+        for (j = 0; j < NUM_EVENT_LOOP_POOL_TEST_TASKS_PER_SUBMITTER; j++)
+        {
+            numTasksRunOnce += submitters[i].tasks[j].numRuns == 1;
+            numTasksRunOutsideLoop += submitters[i].tasks[j].numRunsOutsideLoop;
+        }
+        free(submitters[i].tasks);
+    }
+    
+    sput_fail_unless(numTasksRunOnce == numTasks,
+                     "Every task posted from several threads should run exactly once");
+    sput_fail_unless(numTasksRunOutsideLoop == 0,
+                     "Tasks should run on the thread of their loop");
+}
+
+#endif /*SN_TEST_EVENT_LOOP_POOL_H*/
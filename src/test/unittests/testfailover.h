@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_FAILOVER_H
+#define SN_TEST_FAILOVER_H
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "failoverwebsocket.h"
+#include "sput.h"
+#include "testeventloop.h"
+#include "testkeepalive.h"
+#include "timerwheel.h"
+
+typedef struct failoverTestState
+{
+    int numOpens;
+    int numCloses;
+    int numMessages;
+    int numStandbyOpens;
+    int numFailovers;
+    snWebsocket* failoverWebsocket;
+} failoverTestState;
+
+static void failoverTestOpenCallback(void* userData)
+{
+    ((failoverTestState*)userData)->numOpens++;
+}
+
+static void failoverTestCloseCallback(void* userData, snStatusCode status)
+{
+    ((failoverTestState*)userData)->numCloses++;
+}
+
+static void failoverTestMessageCallback(void* userData, snOpcode opcode, const char* data, int numBytes)
+{
+    ((failoverTestState*)userData)->numMessages++;
+}
+
+static void failoverTestStandbyOpenCallback(void* userData, snWebsocket* websocket)
+{
+    ((failoverTestState*)userData)->numStandbyOpens++;
+}
+
+static void failoverTestFailoverCallback(void* userData, snWebsocket* websocket)
+{
+    failoverTestState* state = (failoverTestState*)userData;
+    state->numFailovers++;
+    state->failoverWebsocket = websocket;
+}
+
+/** Plays the server, sending a single unmasked text frame. */
+static void testSocketPairSendMessage(testSocketPair* p)
+{
+    static const char frame[] = {(char)0x81, 2, 'h', 'i'};
+    if (write(p->descriptors[1], frame, sizeof(frame)) < 0)
+    {
+        return;
+    }
+}
+
+/** Plays the server, closing the connection with a close frame. */
+static void testSocketPairSendClose(testSocketPair* p)
+{
+    static const char frame[] = {(char)0x88, 2, 0x03, (char)0xe9};
+    if (write(p->descriptors[1], frame, sizeof(frame)) < 0)
+    {
+        return;
+    }
+}
+
+static void testFailover()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    failoverTestState state;
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = testSocketPairDeinit;
+    ioc.connectCallback = testSocketPairConnect;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = testSocketPairDisconnect;
+    ioc.readCallback = testSocketPairRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.ioCallbacks = &ioc;
+    o.keepaliveInterval = 60000;
+    
+    memset(&state, 0, sizeof(failoverTestState));
+    numTestSocketPairs = 0;
+    snFailoverWebsocket* fws = snFailoverWebsocket_create(failoverTestOpenCallback,
+                                                          failoverTestMessageCallback,
+                                                          failoverTestCloseCallback,
+                                                          NULL,
+                                                          failoverTestStandbyOpenCallback,
+                                                          failoverTestFailoverCallback,
+                                                          &state,
+                                                          &o);
+    testSocketPair* primary = testSocketPairs[0];
+    testSocketPair* standby = testSocketPairs[1];
+    snWebsocket* primaryWebsocket = snFailoverWebsocket_getActiveWebsocket(fws);
+    snWebsocket* standbyWebsocket = snFailoverWebsocket_getStandbyWebsocket(fws);
+    
+    snFailoverWebsocket_connect(fws, "ws://primary/", "ws://standby/");
+    snFailoverWebsocket_poll(fws);
+    testDiscardSentBytes(primary);
+    testDiscardSentBytes(standby);
+    testSocketPairRespond(primary, 0);
+    testSocketPairRespond(standby, 0);
+    snFailoverWebsocket_poll(fws);
+    
+    sput_fail_unless(snFailoverWebsocket_getState(fws) == SN_STATE_OPEN &&
+                     state.numOpens == 1 && state.numStandbyOpens == 1,
+                     "Both the active and the standby websocket should open");
+    
+    testSocketPairSendMessage(standby);
+    snFailoverWebsocket_poll(fws);
+    sput_fail_unless(state.numMessages == 0, "Messages received by the standby should be dropped");
+    
+    testSocketPairSendMessage(primary);
+    snFailoverWebsocket_poll(fws);
+    sput_fail_unless(state.numMessages == 1, "Messages received by the active websocket should be delivered");
+    
+    /*lose the primary connection*/
+    testSocketPairSendClose(primary);
+    snFailoverWebsocket_poll(fws);
+    
+    sput_fail_unless(snFailoverWebsocket_getActiveWebsocket(fws) == standbyWebsocket &&
+                     snFailoverWebsocket_getState(fws) == SN_STATE_OPEN &&
+                     state.numFailovers == 1 &&
+                     state.failoverWebsocket == standbyWebsocket &&
+                     snFailoverWebsocket_getNumFailovers(fws) == 1 &&
+                     state.numCloses == 0,
+                     "A lost connection should fail over to the standby in the same poll");
+    
+    testSocketPairSendMessage(standby);
+    snFailoverWebsocket_poll(fws);
+    sput_fail_unless(state.numMessages == 2, "Messages should be delivered from the new active websocket");
+    
+    /*the lost connection should be reestablished as the new standby*/
+    long long startTime = snTimerWheel_getMonotonicTime();
+    while (snWebsocket_getState(primaryWebsocket) == SN_STATE_CLOSED &&
+           snTimerWheel_getMonotonicTime() - startTime < 500)
+    {
+        snFailoverWebsocket_waitForEvents(fws, 10);
+        snFailoverWebsocket_poll(fws);
+    }
+    testDiscardSentBytes(primary);
+    testSocketPairRespond(primary, 0);
+    snFailoverWebsocket_poll(fws);
+    
+    sput_fail_unless(snFailoverWebsocket_getStandbyWebsocket(fws) == primaryWebsocket &&
+                     snWebsocket_getState(primaryWebsocket) == SN_STATE_OPEN &&
+                     state.numStandbyOpens == 2,
+                     "A new standby should be established in the background");
+    
+    /*lose both connections*/
+    testSocketPairSendClose(primary);
+    testSocketPairSendClose(standby);
+    snFailoverWebsocket_poll(fws);
+    
+    sput_fail_unless(snFailoverWebsocket_getState(fws) != SN_STATE_OPEN &&
+                     state.numCloses == 1 &&
+                     state.numFailovers == 1,
+                     "Losing both connections should close the failover websocket");
+    
+    snFailoverWebsocket_delete(fws);
+}
+
+/**
+ * If the standby opens while the primary is still connecting, the standby
+ * should become active without cutting the primary's connect short.
+ */
+static void testFailoverStandbyOpensFirst()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    failoverTestState state;
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = testSocketPairDeinit;
+    ioc.connectCallback = testSocketPairConnect;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = testSocketPairDisconnect;
+    ioc.readCallback = testSocketPairRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.ioCallbacks = &ioc;
+    o.keepaliveInterval = 60000;
+    
+    memset(&state, 0, sizeof(failoverTestState));
+    numTestSocketPairs = 0;
+    snFailoverWebsocket* fws = snFailoverWebsocket_create(failoverTestOpenCallback,
+                                                          failoverTestMessageCallback,
+                                                          failoverTestCloseCallback,
+                                                          NULL,
+                                                          failoverTestStandbyOpenCallback,
+                                                          failoverTestFailoverCallback,
+                                                          &state,
+                                                          &o);
+    testSocketPair* primary = testSocketPairs[0];
+    testSocketPair* standby = testSocketPairs[1];
+    snWebsocket* primaryWebsocket = snFailoverWebsocket_getActiveWebsocket(fws);
+    snWebsocket* standbyWebsocket = snFailoverWebsocket_getStandbyWebsocket(fws);
+    
+    snFailoverWebsocket_connect(fws, "ws://primary/", "ws://standby/");
+    snFailoverWebsocket_poll(fws);
+    testDiscardSentBytes(primary);
+    testDiscardSentBytes(standby);
+    testSocketPairRespond(standby, 0);
+    snFailoverWebsocket_poll(fws);
+    
+    sput_fail_unless(snFailoverWebsocket_getActiveWebsocket(fws) == standbyWebsocket &&
+                     snFailoverWebsocket_getState(fws) == SN_STATE_OPEN &&
+                     state.numOpens == 1 &&
+                     state.numFailovers == 0 &&
+                     snFailoverWebsocket_getNumFailovers(fws) == 0,
+                     "A standby that opens first should become active without failing over");
+    sput_fail_unless(snWebsocket_getState(primaryWebsocket) == SN_STATE_CONNECTING && primary->descriptors[1] >= 0,
+                     "The primary's connect in progress should not be torn down");
+    
+    testSocketPairRespond(primary, 0);
+    snFailoverWebsocket_poll(fws);
+    sput_fail_unless(snFailoverWebsocket_getStandbyWebsocket(fws) == primaryWebsocket &&
+                     snWebsocket_getState(primaryWebsocket) == SN_STATE_OPEN &&
+                     state.numStandbyOpens == 1 &&
+                     numTestSocketPairs == 2,
+                     "The primary should open as the standby on its first connection");
+    
+    snFailoverWebsocket_delete(fws);
+}
+
+#endif /*SN_TEST_FAILOVER_H*/
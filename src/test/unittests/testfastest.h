@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_FASTEST_H
+#define SN_TEST_FASTEST_H
+
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "fastestwebsocket.h"
+#include "sput.h"
+#include "testeventloop.h"
+#include "testfailover.h"
+#include "timerwheel.h"
+
+typedef struct fastestTestState
+{
+    int numOpens;
+    int numMessages;
+    int numMigrations;
+    snWebsocket* migrationWebsocket;
+} fastestTestState;
+
+static void fastestTestOpenCallback(void* userData)
+{
+    ((fastestTestState*)userData)->numOpens++;
+}
+
+static void fastestTestMessageCallback(void* userData, snOpcode opcode, const char* data, int numBytes)
+{
+    ((fastestTestState*)userData)->numMessages++;
+}
+
+static void fastestTestMigrationCallback(void* userData, snWebsocket* websocket)
+{
+    fastestTestState* state = (fastestTestState*)userData;
+    state->numMigrations++;
+    state->migrationWebsocket = websocket;
+}
+
+/** Polls until the websocket at the end of a socket pair has sent its opening handshake. */
+static int testWaitForHandshakeRequest(snFastestWebsocket* fws, testSocketPair* p)
+{
+    char c;
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    while (snTimerWheel_getMonotonicTime() - startTime < 1000)
+    {
+        if (p->descriptors[1] >= 0 && recv(p->descriptors[1], &c, 1, MSG_DONTWAIT | MSG_PEEK) == 1)
+        {
+            return 1;
+        }
+        snFastestWebsocket_waitForEvents(fws, 5);
+        snFastestWebsocket_poll(fws);
+    }
+    return 0;
+}
+
+/** Lets one probe complete right away and the other a few milliseconds later. */
+static void testCompleteProbes(snFastestWebsocket* fws, testSocketPair* fast, testSocketPair* slow)
+{
+    struct timespec delay;
+    delay.tv_sec = 0;
+    delay.tv_nsec = 5000000L;
+    
+    testSocketPairRespond(fast, 0);
+    snFastestWebsocket_poll(fws);
+    nanosleep(&delay, NULL);
+    testSocketPairRespond(slow, 0);
+    snFastestWebsocket_poll(fws);
+}
+
+static void testFastestEndpoint()
+{
+    const char* urls[2] = {"ws://a/", "ws://b/"};
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    snFastestWebsocketOptions fo;
+    fastestTestState state;
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = testSocketPairDeinit;
+    ioc.connectCallback = testSocketPairConnect;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = testSocketPairDisconnect;
+    ioc.readCallback = testSocketPairRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.ioCallbacks = &ioc;
+    
+    memset(&fo, 0, sizeof(snFastestWebsocketOptions));
+    fo.websocketOptions = &o;
+    fo.reprobeInterval = 10;
+    fo.numRoundsToMigrate = 2;
+    
+    memset(&state, 0, sizeof(fastestTestState));
+    numTestSocketPairs = 0;
+    snFastestWebsocket* fws = snFastestWebsocket_create(fastestTestOpenCallback,
+                                                        fastestTestMessageCallback,
+                                                        NULL,
+                                                        NULL,
+                                                        fastestTestMigrationCallback,
+                                                        &state,
+                                                        &fo);
+    
+    snFastestWebsocket_connect(fws, urls, 2);
+    sput_fail_unless(snFastestWebsocket_getState(fws) == SN_STATE_CONNECTING &&
+                     numTestSocketPairs == 2,
+                     "Connecting should probe all endpoints at the same time");
+    
+    snFastestWebsocket_poll(fws);
+    testCompleteProbes(fws, testSocketPairs[1], testSocketPairs[0]);
+    
+    sput_fail_unless(snFastestWebsocket_getState(fws) == SN_STATE_OPEN &&
+                     state.numOpens == 1 &&
+                     snFastestWebsocket_getEndpointIndex(fws) == 1,
+                     "The first endpoint to complete the opening handshake should be used");
+    sput_fail_unless(snFastestWebsocket_getEndpointProbeTime(fws, 1) >= 0 &&
+                     snFastestWebsocket_getEndpointProbeTime(fws, 0) > snFastestWebsocket_getEndpointProbeTime(fws, 1),
+                     "The probe times of all endpoints should be measured");
+    
+    testSocketPairSendMessage(testSocketPairs[1]);
+    snFastestWebsocket_poll(fws);
+    sput_fail_unless(state.numMessages == 1, "Messages should be delivered from the chosen endpoint");
+    
+    /*endpoint 0 is faster in the next round. pair 2 probes endpoint 1 again*/
+    int isProbing = testWaitForHandshakeRequest(fws, testSocketPairs[0]) &&
+                    testWaitForHandshakeRequest(fws, testSocketPairs[2]);
+    testCompleteProbes(fws, testSocketPairs[0], testSocketPairs[2]);
+    
+    sput_fail_unless(isProbing &&
+                     snFastestWebsocket_getEndpointProbeTime(fws, 0) < snFastestWebsocket_getEndpointProbeTime(fws, 1) &&
+                     state.numMigrations == 0 &&
+                     snFastestWebsocket_getEndpointIndex(fws) == 1,
+                     "A single faster probe round should not cause a migration");
+    
+    isProbing = testWaitForHandshakeRequest(fws, testSocketPairs[0]) &&
+                testWaitForHandshakeRequest(fws, testSocketPairs[2]);
+    testCompleteProbes(fws, testSocketPairs[0], testSocketPairs[2]);
+    
+    snWebsocket* websocket = snFastestWebsocket_getWebsocket(fws);
+    sput_fail_unless(isProbing &&
+                     state.numMigrations == 1 &&
+                     state.migrationWebsocket == websocket &&
+                     snFastestWebsocket_getNumMigrations(fws) == 1 &&
+                     snFastestWebsocket_getEndpointIndex(fws) == 0 &&
+                     snWebsocket_getState(websocket) == SN_STATE_OPEN,
+                     "The connection should migrate to an endpoint that is consistently faster");
+    
+    testSocketPairSendMessage(testSocketPairs[1]);
+    testSocketPairSendMessage(testSocketPairs[0]);
+    snFastestWebsocket_poll(fws);
+    sput_fail_unless(state.numMessages == 2 && state.numOpens == 1,
+                     "Messages should only be delivered from the new endpoint after migrating");
+    
+    snFastestWebsocket_delete(fws);
+}
+
+#endif /*SN_TEST_FASTEST_H*/
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_FAST_OPEN_H
+#define SN_TEST_FAST_OPEN_H
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sput.h"
+#include "testeventloop.h"
+#include "testresolver.h"
+#include "timerwheel.h"
+#include "websocket.h"
+
+static int fastOpenTestNumEarlyBytes = 0;
+
+/** Connects a socket pair and writes the early data right away, like a SYN carrying it would. */
+static snError testSocketPairConnectWithData(void* ioObject, const char* host, int port,
+                                             const char* data, int numBytes)
+{
+    testSocketPair* p = (testSocketPair*)ioObject;
+    snError e = testSocketPairConnect(ioObject, host, port);
+    if (e == SN_NO_ERROR)
+    {
+        fastOpenTestNumEarlyBytes = numBytes;
+        if (write(p->descriptors[0], data, numBytes) != numBytes)
+        {
+            e = SN_SOCKET_FAILED_TO_CONNECT;
+        }
+    }
+    return e;
+}
+
+/** Counts the opening handshake requests a socket pair peer has received. */
+static int testCountHandshakeRequests(testSocketPair* p)
+{
+    char buffer[4096];
+    int numRequests = 0;
+    const ssize_t numBytes = recv(p->descriptors[1], buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
+    const char* request = buffer;
+    
+    buffer[numBytes > 0 ? numBytes : 0] = '\0';
+    while ((request = strstr(request, "GET /")) != NULL)
+    {
+        numRequests++;
+        request++;
+    }
+    return numRequests;
+}
+
+static void testFastOpenHandshake()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = testSocketPairDeinit;
+    ioc.connectCallback = testSocketPairConnect;
+    ioc.connectWithDataCallback = testSocketPairConnectWithData;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = testSocketPairDisconnect;
+    ioc.readCallback = testSocketPairRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.ioCallbacks = &ioc;
+    
+    /*without the option, the request is written once connected*/
+    numTestSocketPairs = 0;
+    fastOpenTestNumEarlyBytes = 0;
+    snWebsocket* ws = snWebsocket_createWithSettings(NULL, NULL, NULL, NULL, NULL, &o);
+    testSocketPair* p = testSocketPairs[0];
+    snWebsocket_connect(ws, "ws://localhost/");
+    snWebsocket_poll(ws);
+    sput_fail_unless(fastOpenTestNumEarlyBytes == 0 && testCountHandshakeRequests(p) == 1,
+                     "The opening handshake should not be sent early by default");
+    snWebsocket_delete(ws);
+    
+    /*with the option, the request is handed to the I/O object when connecting*/
+    o.tcpFastOpen = 1;
+    numTestSocketPairs = 0;
+    ws = snWebsocket_createWithSettings(NULL, NULL, NULL, NULL, NULL, &o);
+    p = testSocketPairs[0];
+    snWebsocket_connect(ws, "ws://localhost/");
+    sput_fail_unless(fastOpenTestNumEarlyBytes > 0, "The opening handshake should be passed to the I/O object when connecting");
+    
+    snWebsocket_poll(ws);
+    sput_fail_unless(testCountHandshakeRequests(p) == 1, "The opening handshake should be sent exactly once");
+    
+    testSocketPairRespond(p, 0);
+    snWebsocket_poll(ws);
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_OPEN, "The connection should open");
+    snWebsocket_delete(ws);
+    
+    /*I/O objects without early data support are connected as usual*/
+    ioc.connectWithDataCallback = NULL;
+    numTestSocketPairs = 0;
+    fastOpenTestNumEarlyBytes = 0;
+    ws = snWebsocket_createWithSettings(NULL, NULL, NULL, NULL, NULL, &o);
+    p = testSocketPairs[0];
+    snWebsocket_connect(ws, "ws://localhost/");
+    snWebsocket_poll(ws);
+    sput_fail_unless(fastOpenTestNumEarlyBytes == 0 && testCountHandshakeRequests(p) == 1,
+                     "The opening handshake should be sent once connected without a connect with data callback");
+    snWebsocket_delete(ws);
+}
+
+/**
+ * Opens a few connections in a row to a loopback listener with TCP Fast Open
+ * enabled. The first one gets a cookie, so later ones may carry the opening
+ * handshake in the SYN. Either way, all of them should open.
+ */
+static void testFastOpenLoopback()
+{
+    static const char response[] =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n";
+    snWebsocketOptions o;
+    char url[256];
+    int numOpened = 0;
+    int port = 0;
+    int i;
+    
+    const int listenDescriptor = testListen("127.0.0.1", &port, 16);
+    if (listenDescriptor < 0)
+    {
+        sput_fail_unless(0, "Failed to set up a local listening socket");
+        return;
+    }
+    
+#ifdef TCP_FASTOPEN
+    int queueLength = 16;
+    setsockopt(listenDescriptor, IPPROTO_TCP, TCP_FASTOPEN, &queueLength, sizeof(queueLength));
+#endif /*TCP_FASTOPEN*/
+    
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.tcpFastOpen = 1;
+    sprintf(url, "ws://127.0.0.1:%d/", port);
+    
+    for (i = 0; i < 3; i++)
+    {
+        char request[4096];
+        int numRequestBytes = 0;
+        int serverDescriptor = -1;
+        request[0] = '\0';
+        
+        snWebsocket* ws = snWebsocket_createWithSettings(NULL, NULL, NULL, NULL, NULL, &o);
+        snWebsocket_connect(ws, url);
+        
+        const long long startTime = snTimerWheel_getMonotonicTime();
+        while (snTimerWheel_getMonotonicTime() - startTime < 2000 &&
+               snWebsocket_getState(ws) == SN_STATE_CONNECTING)
+        {
+            if (serverDescriptor < 0)
+            {
+                struct pollfd pfd;
+                pfd.fd = listenDescriptor;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                if (poll(&pfd, 1, 0) > 0)
+                {
+                    serverDescriptor = accept(listenDescriptor, NULL, NULL);
+                }
+            }
+            
+            if (serverDescriptor >= 0 && numRequestBytes < (int)sizeof(request) - 1)
+            {
+                const ssize_t n = recv(serverDescriptor, &request[numRequestBytes],
+                                       sizeof(request) - 1 - numRequestBytes, MSG_DONTWAIT);
+                if (n > 0)
+                {
+                    numRequestBytes += (int)n;
+                    request[numRequestBytes] = '\0';
+                    if (strstr(request, "\r\n\r\n") &&
+                        write(serverDescriptor, response, sizeof(response) - 1) < 0)
+                    {
+                        break;
+                    }
+                }
+            }
+            
+            snWebsocket_waitForEvents(ws, 1);
+            snWebsocket_poll(ws);
+        }
+        
+        if (snWebsocket_getState(ws) == SN_STATE_OPEN &&
+            strncmp(request, "GET /", 5) == 0)
+        {
+            numOpened++;
+        }
+        
+        snWebsocket_delete(ws);
+        if (serverDescriptor >= 0)
+        {
+            close(serverDescriptor);
+        }
+    }
+    
+    close(listenDescriptor);
+    
+    sput_fail_unless(numOpened == 3, "Connections using TCP Fast Open should open, with or without a cookie");
+}
+
+#endif /*SN_TEST_FAST_OPEN_H*/
@@ -31,10 +31,12 @@
 #define SN_TEST_WEBSOCKET_FRAME_H
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "sput.h"
 #include "websocket.h"
+#include "masking.h"
 #include "testframe.h"
 
 #define NUM_CASES 5
@@ -104,9 +106,92 @@ static void testFrameHeaderValidation()
     /*TODO*/
 }
 
+/**
+ * The masking loop that \c snFrameHeader_applyMask originally used.
+ */
+static void referenceMask(int maskingKey, char* payload, int numBytes, int offset)
+{
+    unsigned char* maskBytes = (unsigned char*)(&maskingKey);
+    int i;
+    for (i = 0; i < numBytes; i++)
+    {
+        payload[i] = payload[i] ^ maskBytes[3 - ((i + offset) % 4)];
+    }
+}
+
 static void testMasking()
 {
-    /*TODO*/
+    const snMaskingKernel kernels[] =
+    {
+        SN_MASKING_KERNEL_AUTO,
+        SN_MASKING_KERNEL_BYTEWISE,
+        SN_MASKING_KERNEL_WORD,
+        SN_MASKING_KERNEL_SSE2,
+        SN_MASKING_KERNEL_AVX2
+    };
+    const int maxNumBytes = 1000;
+    char original[1000 + 3];
+    char reference[1000 + 3];
+    char masked[1000 + 3];
+    int numMismatches = 0;
+    int i, k;
+    
+    srand(4321);
+    
+    for (i = 0; i < sizeof(original); i++)
+    {
+        original[i] = rand() % 256;
+    }
+    
+    for (i = 0; i < 2000; i++)
+    {
+        /*random lengths, payload offsets and buffer alignments*/
+        const int numBytes = i < 100 ? i : rand() % maxNumBytes;
+        const int offset = rand() % 1000;
+        const int alignment = rand() % 4;
+        const int maskingKey = 1 + rand();
+        
+        memcpy(reference, original, sizeof(original));
+        referenceMask(maskingKey, &reference[alignment], numBytes, offset);
+        
+        for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+        {
+            memcpy(masked, original, sizeof(original));
+            snMaskPayloadWithKernel(kernels[k], maskingKey, &masked[alignment], numBytes, offset);
+            if (memcmp(masked, reference, sizeof(original)) != 0)
+            {
+                numMismatches++;
+            }
+            
+            /*copying while masking should give the same result*/
+            memcpy(masked, original, sizeof(original));
+            snCopyMaskedPayloadWithKernel(kernels[k], maskingKey, &original[alignment], &masked[alignment], numBytes, offset);
+            if (memcmp(masked, reference, sizeof(original)) != 0)
+            {
+                numMismatches++;
+            }
+        }
+        
+        snFrameHeader h;
+        memset(&h, 0, sizeof(snFrameHeader));
+        h.isMasked = 1;
+        h.maskingKey = maskingKey;
+        memcpy(masked, original, sizeof(original));
+        snFrameHeader_applyMask(&h, &masked[alignment], numBytes, offset);
+        if (memcmp(masked, reference, sizeof(original)) != 0)
+        {
+            numMismatches++;
+        }
+    }
+    
+    sput_fail_unless(numMismatches == 0, "All masking kernels should match the reference");
+    
+    /*masking twice should restore the payload*/
+    memcpy(masked, original, sizeof(original));
+    snMaskPayload(0x12345678, masked, maxNumBytes, 3);
+    sput_fail_if(memcmp(masked, original, maxNumBytes) == 0, "Masking should change the payload");
+    snMaskPayload(0x12345678, masked, maxNumBytes, 3);
+    sput_fail_unless(memcmp(masked, original, maxNumBytes) == 0, "Masking twice should restore the payload");
 }
 
 #endif /*SN_TEST_WEBSOCKET_FRAME_H*/
@@ -31,7 +31,9 @@
 #define SN_TEST_FRAME_PARSER_H
 
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "sput.h"
@@ -51,10 +53,9 @@ static void frameCallback(void* userData, const snFrame* frame)
 
 static void testFrameParserHeaderEquality()
 {
-    const int bufferSize = 1 << 10;
-    char buffer[bufferSize];
+    const int maxFrameSize = 1 << 10;
     snFrameParser p;
-    snFrameParser_init(&p, frameCallback, NULL, NULL, NULL, buffer, bufferSize);
+    snFrameParser_init(&p, frameCallback, NULL, NULL, NULL, maxFrameSize, maxFrameSize);
     
     
     int maskFlags[NUM_FRAME_PARSER_TEST_CASES] = {0, 1, 1, 1, 1};
@@ -81,6 +82,7 @@ static void testFrameParserHeaderEquality()
         h.maskingKey = maskingKeys[i];
         h.isMasked = maskFlags[i];
         h.isFinal = finalFlags[i];
+        h.isCompressed = 0;
         h.opcode = opcodes[i];
         h.payloadSize = 0;
         
@@ -100,4 +102,450 @@ static void testFrameParserHeaderEquality()
     snFrameParser_deinit(&p);
 }
 
+static int numChunkingTestFrames = 0;
+static unsigned long chunkingTestChecksum = 0;
+
+static void chunkingTestFrameCallback(void* userData, const snFrame* frame)
+{
+    int i;
+    
+    numChunkingTestFrames++;
+    chunkingTestChecksum = chunkingTestChecksum * 31 + frame->header.opcode;
+    chunkingTestChecksum = chunkingTestChecksum * 31 + frame->header.payloadSize;
+    chunkingTestChecksum = chunkingTestChecksum * 31 + (unsigned int)frame->header.maskingKey;
+    for (i = 0; i < frame->header.payloadSize; i++)
+    {
+        chunkingTestChecksum = chunkingTestChecksum * 31 + (unsigned char)frame->payload[i];
+    }
+}
+
+#define NUM_CHUNKING_TEST_FRAMES 6
+
+static void testFrameParserChunking()
+{
+    const int maxFrameSize = 1 << 17;
+    char* stream = malloc(maxFrameSize * 2);
+    int streamSize = 0;
+    snFrameParser p;
+    snFrameParser_init(&p, chunkingTestFrameCallback, NULL, NULL, NULL, maxFrameSize, maxFrameSize);
+    
+    /*covers all payload size encodings, with and without masking keys*/
+    unsigned long payloadSizes[NUM_CHUNKING_TEST_FRAMES] = {0, 2, 125, 126, 1000, (1 << 16) + 3};
+    int maskingKeys[NUM_CHUNKING_TEST_FRAMES] = {0, 0x12345678, 0, 99, 0, 0};
+    
+    int i;
+    for (i = 0; i < NUM_CHUNKING_TEST_FRAMES; i++)
+    {
+        snFrameHeader h;
+        memset(&h, 0, sizeof(snFrameHeader));
+        h.opcode = SN_OPCODE_BINARY;
+        h.isFinal = 1;
+        h.isMasked = maskingKeys[i] != 0;
+        h.maskingKey = maskingKeys[i];
+        h.payloadSize = payloadSizes[i];
+        
+        int headerSize = 0;
+        snFrameHeader_toBytes(&h, &stream[streamSize], &headerSize);
+        streamSize += headerSize;
+        
+        int j;
+        for (j = 0; j < payloadSizes[i]; j++)
+        {
+            stream[streamSize++] = (char)(i + j);
+        }
+    }
+    
+    /*parse the whole stream in one go as reference*/
+    numChunkingTestFrames = 0;
+    chunkingTestChecksum = 0;
+    snError result = snFrameParser_processBytes(&p, stream, streamSize);
+    sput_fail_unless(result == SN_NO_ERROR, "Parsing a valid frame stream should succeed");
+    sput_fail_unless(numChunkingTestFrames == NUM_CHUNKING_TEST_FRAMES, "All frames should be parsed");
+    const unsigned long referenceChecksum = chunkingTestChecksum;
+    
+    /*headers split across chunks must give the same result*/
+    int chunkSize;
+    for (chunkSize = 1; chunkSize <= SN_MAX_HEADER_SIZE + 3; chunkSize++)
+    {
+        snFrameParser_reset(&p);
+        numChunkingTestFrames = 0;
+        chunkingTestChecksum = 0;
+        
+        int pos = 0;
+        while (pos < streamSize)
+        {
+            const int n = streamSize - pos < chunkSize ? streamSize - pos : chunkSize;
+            snFrameParser_processBytes(&p, &stream[pos], n);
+            pos += n;
+        }
+        
+        sput_fail_unless(numChunkingTestFrames == NUM_CHUNKING_TEST_FRAMES &&
+                         chunkingTestChecksum == referenceChecksum,
+                         "Parsing in chunks should give the same frames as parsing in one go");
+    }
+    
+    snFrameParser_deinit(&p);
+    free(stream);
+}
+
+static int numInPlaceTestMessages = 0;
+static int numInPlaceTestMessagesInRing = 0;
+static unsigned long inPlaceTestChecksum = 0;
+static const char* inPlaceTestRing = NULL;
+static int inPlaceTestRingSize = 0;
+
+static void inPlaceTestMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    int i;
+    
+    numInPlaceTestMessages++;
+    if (bytes >= inPlaceTestRing && bytes < inPlaceTestRing + inPlaceTestRingSize)
+    {
+        numInPlaceTestMessagesInRing++;
+    }
+    
+    if (opcode == SN_OPCODE_TEXT && bytes[numBytes] != '\0')
+    {
+        /*make the checksum comparison fail*/
+        inPlaceTestChecksum++;
+    }
+    
+    inPlaceTestChecksum = inPlaceTestChecksum * 31 + opcode;
+    inPlaceTestChecksum = inPlaceTestChecksum * 31 + numBytes;
+    for (i = 0; i < numBytes; i++)
+    {
+        inPlaceTestChecksum = inPlaceTestChecksum * 31 + (unsigned char)bytes[i];
+    }
+}
+
+static void addInPlaceTestFrame(char* stream, int* streamSize, snOpcode opcode, int isFinal, int payloadSize)
+{
+    snFrameHeader h;
+    memset(&h, 0, sizeof(snFrameHeader));
+    h.opcode = opcode;
+    h.isFinal = isFinal;
+    h.payloadSize = payloadSize;
+    
+    int headerSize = 0;
+    snFrameHeader_toBytes(&h, &stream[*streamSize], &headerSize);
+    *streamSize += headerSize;
+    
+    int i;
+    for (i = 0; i < payloadSize; i++)
+    {
+        const char byte = 'a' + (*streamSize + i) % 26;
+        stream[*streamSize] = byte;
+        (*streamSize)++;
+    }
+}
+
+static void testFrameParserInPlace()
+{
+    const int maxFrameSize = 1 << 16;
+    char* stream = malloc(maxFrameSize);
+    int streamSize = 0;
+    snFrameParser p;
+    snFrameParser_init(&p, NULL, NULL, inPlaceTestMessageCallback, NULL, maxFrameSize, maxFrameSize);
+    
+    int i;
+    for (i = 0; i < 20; i++)
+    {
+        addInPlaceTestFrame(stream, &streamSize, i % 2 ? SN_OPCODE_TEXT : SN_OPCODE_BINARY, 1, (i * 37) % 300);
+    }
+    
+    /*a fragmented message with a ping in between and a frame too big for the ring*/
+    addInPlaceTestFrame(stream, &streamSize, SN_OPCODE_TEXT, 0, 10);
+    addInPlaceTestFrame(stream, &streamSize, SN_OPCODE_PING, 1, 3);
+    addInPlaceTestFrame(stream, &streamSize, SN_OPCODE_CONTINUATION, 1, 20);
+    addInPlaceTestFrame(stream, &streamSize, SN_OPCODE_BINARY, 1, 5000);
+    addInPlaceTestFrame(stream, &streamSize, SN_OPCODE_TEXT, 1, 50);
+    
+    /*parse a copy of the stream without in place delivery as reference*/
+    char* streamCopy = malloc(streamSize);
+    memcpy(streamCopy, stream, streamSize);
+    numInPlaceTestMessages = 0;
+    inPlaceTestChecksum = 0;
+    snFrameParser_processBytes(&p, streamCopy, streamSize);
+    const int referenceNumMessages = numInPlaceTestMessages;
+    const unsigned long referenceChecksum = inPlaceTestChecksum;
+    free(streamCopy);
+    
+    /*feed the stream in chunks through a ring, the way snWebsocket_poll does*/
+    const int ringSize = 1024;
+    char* ring = malloc(ringSize + 1);
+    inPlaceTestRing = ring;
+    inPlaceTestRingSize = ringSize;
+    
+    int chunkSize;
+    for (chunkSize = 1; chunkSize <= ringSize; chunkSize *= 3)
+    {
+        snFrameParser_reset(&p);
+        numInPlaceTestMessages = 0;
+        numInPlaceTestMessagesInRing = 0;
+        inPlaceTestChecksum = 0;
+        
+        int readPosition = 0;
+        int writePosition = 0;
+        int pos = 0;
+        snError result = SN_NO_ERROR;
+        while (pos < streamSize && result == SN_NO_ERROR)
+        {
+            int n = ringSize - writePosition;
+            n = n < chunkSize ? n : chunkSize;
+            n = n < streamSize - pos ? n : streamSize - pos;
+            memcpy(&ring[writePosition], &stream[pos], n);
+            writePosition += n;
+            pos += n;
+            
+            int numBytesProcessed = 0;
+            result = snFrameParser_processBytesInPlace(&p,
+                                                       &ring[readPosition],
+                                                       writePosition - readPosition,
+                                                       ringSize,
+                                                       &numBytesProcessed);
+            readPosition += numBytesProcessed;
+            if (readPosition == writePosition)
+            {
+                readPosition = 0;
+                writePosition = 0;
+            }
+            else if (writePosition == ringSize)
+            {
+                memmove(ring, &ring[readPosition], writePosition - readPosition);
+                writePosition -= readPosition;
+                readPosition = 0;
+            }
+        }
+        
+        sput_fail_unless(result == SN_NO_ERROR &&
+                         numInPlaceTestMessages == referenceNumMessages &&
+                         inPlaceTestChecksum == referenceChecksum,
+                         "In place parsing should give the same messages as copying");
+        sput_fail_unless(numInPlaceTestMessagesInRing == 21,
+                         "Unfragmented messages that fit in the ring should be delivered in place");
+    }
+    
+    snFrameParser_deinit(&p);
+    free(ring);
+    free(stream);
+}
+
+static int numStreamTestBegins = 0;
+static int numStreamTestEnds = 0;
+static int numStreamTestPings = 0;
+static char* streamTestMessage = NULL;
+static int streamTestMessageSize = 0;
+
+static void streamTestBeginCallback(void* userData, snOpcode opcode)
+{
+    numStreamTestBegins++;
+}
+
+static void streamTestChunkCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    memcpy(&streamTestMessage[streamTestMessageSize], bytes, numBytes);
+    streamTestMessageSize += numBytes;
+}
+
+static void streamTestEndCallback(void* userData, snOpcode opcode)
+{
+    numStreamTestEnds++;
+}
+
+static void streamTestMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    if (opcode == SN_OPCODE_PING)
+    {
+        numStreamTestPings++;
+    }
+}
+
+static void testFrameParserStreaming()
+{
+    /*much smaller than the streamed message*/
+    const int maxFrameSize = 1 << 10;
+    const int messageSize = 100000;
+    char* message = malloc(messageSize);
+    char* stream = malloc(2 * messageSize);
+    int streamSize = 0;
+    streamTestMessage = malloc(messageSize);
+    
+    snMessageStreamCallbacks callbacks;
+    callbacks.beginCallback = streamTestBeginCallback;
+    callbacks.chunkCallback = streamTestChunkCallback;
+    callbacks.endCallback = streamTestEndCallback;
+    
+    snFrameParser p;
+    snFrameParser_init(&p, NULL, NULL, streamTestMessageCallback, NULL, maxFrameSize, maxFrameSize);
+    snFrameParser_setMessageStreamCallbacks(&p, &callbacks, NULL);
+    
+    /*a text message of two byte code points, in frames that split code points*/
+    int i;
+    for (i = 0; i < messageSize; i += 2)
+    {
+        message[i] = (char)0xc3;
+        message[i + 1] = (char)0xa5;
+    }
+    
+    const int frameSizes[4] = {3, 40001, 7, messageSize - 40011};
+    int messagePos = 0;
+    for (i = 0; i < 4; i++)
+    {
+        snFrameHeader h;
+        memset(&h, 0, sizeof(snFrameHeader));
+        h.opcode = i == 0 ? SN_OPCODE_TEXT : SN_OPCODE_CONTINUATION;
+        h.isFinal = i == 3;
+        h.isMasked = i == 1;
+        h.maskingKey = 0x01020304;
+        h.payloadSize = frameSizes[i];
+        
+        int headerSize = 0;
+        snFrameHeader_toBytes(&h, &stream[streamSize], &headerSize);
+        streamSize += headerSize;
+        memcpy(&stream[streamSize], &message[messagePos], frameSizes[i]);
+        if (h.isMasked)
+        {
+            snFrameHeader_applyMask(&h, &stream[streamSize], frameSizes[i], 0);
+        }
+        streamSize += frameSizes[i];
+        messagePos += frameSizes[i];
+        
+        if (i == 1)
+        {
+            /*a ping in between fragments*/
+            memset(&h, 0, sizeof(snFrameHeader));
+            h.opcode = SN_OPCODE_PING;
+            h.isFinal = 1;
+            h.payloadSize = 2;
+            snFrameHeader_toBytes(&h, &stream[streamSize], &headerSize);
+            streamSize += headerSize;
+            stream[streamSize++] = 'h';
+            stream[streamSize++] = 'i';
+        }
+    }
+    
+    int chunkSize;
+    for (chunkSize = 1; chunkSize <= streamSize; chunkSize *= 7)
+    {
+        snFrameParser_reset(&p);
+        numStreamTestBegins = 0;
+        numStreamTestEnds = 0;
+        numStreamTestPings = 0;
+        streamTestMessageSize = 0;
+        
+        snError result = SN_NO_ERROR;
+        int pos = 0;
+        while (pos < streamSize && result == SN_NO_ERROR)
+        {
+            const int n = streamSize - pos < chunkSize ? streamSize - pos : chunkSize;
+            result = snFrameParser_processBytes(&p, &stream[pos], n);
+            pos += n;
+        }
+        
+        sput_fail_unless(result == SN_NO_ERROR, "Streaming a message bigger than the max frame size should succeed");
+        sput_fail_unless(numStreamTestBegins == 1 && numStreamTestEnds == 1 && numStreamTestPings == 1,
+                         "A streamed message should begin and end once, with pings passed to the message callback");
+        sput_fail_unless(streamTestMessageSize == messageSize &&
+                         memcmp(streamTestMessage, message, messageSize) == 0,
+                         "Streamed chunks should add up to the unmasked message");
+    }
+    
+    /*a message that ends in the middle of a code point*/
+    {
+        snFrameHeader h;
+        memset(&h, 0, sizeof(snFrameHeader));
+        h.opcode = SN_OPCODE_TEXT;
+        h.isFinal = 1;
+        h.payloadSize = 3;
+        int headerSize = 0;
+        snFrameHeader_toBytes(&h, stream, &headerSize);
+        memcpy(&stream[headerSize], message, 3);
+        
+        snFrameParser_reset(&p);
+        numStreamTestEnds = 0;
+        streamTestMessageSize = 0;
+        snError result = snFrameParser_processBytes(&p, stream, headerSize + 3);
+        sput_fail_unless(result == SN_INVALID_UTF8 && numStreamTestEnds == 0,
+                         "A streamed text message ending in the middle of a code point should be rejected");
+    }
+    
+    snFrameParser_deinit(&p);
+    free(streamTestMessage);
+    free(stream);
+    free(message);
+}
+
+static int messageSizeTestMessageSize = 0;
+
+static void messageSizeTestMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    messageSizeTestMessageSize = numBytes;
+}
+
+/**
+ * Parses a binary message made up of a number of equally sized fragments.
+ */
+static snError parseFragmentedTestMessage(snFrameParser* p, int numFragments, int fragmentSize)
+{
+    char* stream = malloc(numFragments * (fragmentSize + SN_MAX_HEADER_SIZE));
+    int streamSize = 0;
+    
+    int i;
+    for (i = 0; i < numFragments; i++)
+    {
+        snFrameHeader h;
+        memset(&h, 0, sizeof(snFrameHeader));
+        h.opcode = i == 0 ? SN_OPCODE_BINARY : SN_OPCODE_CONTINUATION;
+        h.isFinal = i == numFragments - 1;
+        h.payloadSize = fragmentSize;
+        
+        int headerSize = 0;
+        snFrameHeader_toBytes(&h, &stream[streamSize], &headerSize);
+        streamSize += headerSize;
+        memset(&stream[streamSize], i, fragmentSize);
+        streamSize += fragmentSize;
+    }
+    
+    messageSizeTestMessageSize = 0;
+    snError result = snFrameParser_processBytes(p, stream, streamSize);
+    free(stream);
+    
+    return result;
+}
+
+static void testFrameParserMessageSize()
+{
+    const int maxFrameSize = 1 << 10;
+    const int maxMessageSize = 1 << 20;
+    snFrameParser p;
+    snFrameParser_init(&p, NULL, NULL, messageSizeTestMessageCallback, NULL, maxFrameSize, maxMessageSize);
+    
+    sput_fail_unless(p.bufferSize == 0, "No message buffer should be allocated before receiving a message");
+    
+    snError result = parseFragmentedTestMessage(&p, 4, 100);
+    sput_fail_unless(result == SN_NO_ERROR && messageSizeTestMessageSize == 400,
+                     "A small fragmented message should be assembled");
+    sput_fail_unless(p.bufferSize > 400 && p.bufferSize <= maxFrameSize,
+                     "The message buffer should only grow as much as needed");
+    
+    result = parseFragmentedTestMessage(&p, 1000, 1000);
+    sput_fail_unless(result == SN_NO_ERROR && messageSizeTestMessageSize == 1000000,
+                     "A fragmented message bigger than the max frame size should be assembled");
+    sput_fail_unless(p.bufferSize == 0,
+                     "The message buffer should be released after an unusually big message");
+    
+    result = parseFragmentedTestMessage(&p, 1100, 1000);
+    sput_fail_unless(result == SN_EXCEEDED_MAX_MESSAGE_SIZE && messageSizeTestMessageSize == 0,
+                     "A fragmented message bigger than the max message size should be rejected");
+    
+    snFrameParser_deinit(&p);
+    
+    /*the largest possible limit must not overflow when making room for the null terminator*/
+    snFrameParser_init(&p, NULL, NULL, messageSizeTestMessageCallback, NULL, maxFrameSize, INT_MAX);
+    result = parseFragmentedTestMessage(&p, 4, 100);
+    sput_fail_unless(result == SN_NO_ERROR && messageSizeTestMessageSize == 400 && p.bufferSize > 400,
+                     "Messages should be assembled without a practical max message size");
+    snFrameParser_deinit(&p);
+}
+
 #endif /*SN_TEST_FRAME_PARSER_H*/
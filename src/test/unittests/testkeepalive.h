@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_KEEPALIVE_H
+#define SN_TEST_KEEPALIVE_H
+
+#include <string.h>
+#include <sys/socket.h>
+
+#include "sput.h"
+#include "testeventloop.h"
+#include "timerwheel.h"
+#include "websocket.h"
+
+/** The size of a masked keepalive ping: header, masking key and sequence number. */
+#define KEEPALIVE_TEST_PING_SIZE 14
+
+static snError keepaliveTestError = SN_NO_ERROR;
+
+static void keepaliveTestErrorCallback(void* userData, snError error)
+{
+    keepaliveTestError = error;
+}
+
+/**
+ * Plays the server end of a socket pair, answering the keepalive pings
+ * sent by the websocket.
+ * @return The number of pings answered.
+ */
+static int testAnswerPings(testSocketPair* p)
+{
+    char ping[KEEPALIVE_TEST_PING_SIZE];
+    char pong[10];
+    int numPings = 0;
+    int i;
+    
+    while (recv(p->descriptors[1], ping, sizeof(ping), MSG_DONTWAIT | MSG_PEEK) == sizeof(ping))
+    {
+        if (recv(p->descriptors[1], ping, sizeof(ping), 0) != sizeof(ping) ||
+            (unsigned char)ping[0] != 0x89)
+        {
+            return numPings;
+        }
+        
+        pong[0] = (char)0x8a;
+        pong[1] = 8;
+        for (i = 0; i < 8; i++)
+        {
+            pong[2 + i] = ping[6 + i] ^ ping[2 + (i % 4)];
+        }
+        
+        if (write(p->descriptors[1], pong, sizeof(pong)) != sizeof(pong))
+        {
+            return numPings;
+        }
+        numPings++;
+    }
+    
+    return numPings;
+}
+
+/** Reads and discards everything the websocket has sent. */
+static void testDiscardSentBytes(testSocketPair* p)
+{
+    char buffer[1024];
+    while (recv(p->descriptors[1], buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+    {
+    }
+}
+
+static void testKeepalive()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    int numAnsweredPings = 0;
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = testSocketPairDeinit;
+    ioc.connectCallback = testSocketPairConnect;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = testSocketPairDisconnect;
+    ioc.readCallback = testSocketPairRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.ioCallbacks = &ioc;
+    o.keepaliveInterval = 10;
+    o.maxMissedPongs = 3;
+    
+    numTestSocketPairs = 0;
+    keepaliveTestError = SN_NO_ERROR;
+    snWebsocket* ws = snWebsocket_createWithSettings(NULL, NULL, NULL, keepaliveTestErrorCallback, NULL, &o);
+    testSocketPair* p = testSocketPairs[0];
+    
+    snWebsocket_connect(ws, "ws://localhost/");
+    snWebsocket_poll(ws);
+    testDiscardSentBytes(p);
+    testSocketPairRespond(p, 0);
+    snWebsocket_poll(ws);
+    
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_OPEN &&
+                     snWebsocket_getRoundTripStats(ws)->numPongs == 0,
+                     "A newly opened websocket should have no round trip times");
+    
+    /*answer a few pings*/
+    long long startTime = snTimerWheel_getMonotonicTime();
+    while (numAnsweredPings < 5 && snTimerWheel_getMonotonicTime() - startTime < 2000)
+    {
+        snWebsocket_waitForEvents(ws, 100);
+        snWebsocket_poll(ws);
+        numAnsweredPings += testAnswerPings(p);
+        snWebsocket_poll(ws);
+    }
+    
+    const snRoundTripStats* stats = snWebsocket_getRoundTripStats(ws);
+    sput_fail_unless(numAnsweredPings == 5 && stats->numPongs == 5 && stats->numMissedPongs == 0,
+                     "Keepalive pings should be sent periodically and their pongs matched");
+    sput_fail_unless(stats->minRoundTripTime >= 0 &&
+                     stats->minRoundTripTime <= stats->smoothedRoundTripTime &&
+                     stats->smoothedRoundTripTime <= stats->maxRoundTripTime &&
+                     stats->jitter >= 0,
+                     "Round trip times should be consistent");
+    
+    /*stop answering*/
+    startTime = snTimerWheel_getMonotonicTime();
+    while (snWebsocket_getState(ws) == SN_STATE_OPEN &&
+           snTimerWheel_getMonotonicTime() - startTime < 2000)
+    {
+        snWebsocket_waitForEvents(ws, 100);
+        snWebsocket_poll(ws);
+        testDiscardSentBytes(p);
+    }
+    const long long duration = snTimerWheel_getMonotonicTime() - startTime;
+    
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_CLOSED &&
+                     keepaliveTestError == SN_KEEPALIVE_TIMED_OUT,
+                     "Unanswered keepalive pings should close the connection");
+    sput_fail_unless(duration >= 20 && duration < 500,
+                     "A dead connection should be detected after the given number of missed pongs");
+    
+    snWebsocket_delete(ws);
+}
+
+#endif /*SN_TEST_KEEPALIVE_H*/
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_RANDOM_H
+#define SN_TEST_RANDOM_H
+
+#include <string.h>
+
+#include "sput.h"
+#include "random.h"
+
+static void testRandomKnownOutput()
+{
+    /*the first bytes of the ChaCha8 keystream for an all zero key and nonce*/
+    const unsigned char expected[32] =
+    {
+        0x3e, 0x00, 0xef, 0x2f, 0x89, 0x5f, 0x40, 0xd6,
+        0x7f, 0x5b, 0xb8, 0xe8, 0x1f, 0x09, 0xa5, 0xa1,
+        0x2c, 0x84, 0x0e, 0xc3, 0xce, 0x9a, 0x7f, 0x3b,
+        0x18, 0x1b, 0xe1, 0x88, 0xef, 0x71, 0x1a, 0x1e
+    };
+    unsigned char seed[32];
+    unsigned char bytes[32];
+    snRandom r;
+    
+    memset(seed, 0, sizeof(seed));
+    snRandom_initWithSeed(&r, seed);
+    snRandom_getBytes(&r, bytes, sizeof(bytes));
+    
+    sput_fail_unless(memcmp(bytes, expected, sizeof(expected)) == 0,
+                     "Output should match the ChaCha8 keystream");
+}
+
+static void testRandomSequences()
+{
+    unsigned char seed[32];
+    snRandom r1, r2, r3;
+    int numDifferences = 0;
+    int numBitsSet = 0;
+    int i;
+    
+    for (i = 0; i < 32; i++)
+    {
+        seed[i] = i;
+    }
+    
+    snRandom_initWithSeed(&r1, seed);
+    snRandom_initWithSeed(&r2, seed);
+    seed[31] ^= 1;
+    snRandom_initWithSeed(&r3, seed);
+    
+    /*cover several refills*/
+    for (i = 0; i < 1000; i++)
+    {
+        const uint32_t a = snRandom_next(&r1);
+        const uint32_t b = snRandom_next(&r2);
+        const uint32_t c = snRandom_next(&r3);
+        int bit;
+        
+        if (a != b)
+        {
+            numDifferences++;
+        }
+        
+        for (bit = 0; bit < 32; bit++)
+        {
+            numBitsSet += (a >> bit) & 1;
+        }
+        
+        if (a == c)
+        {
+            numDifferences++;
+        }
+    }
+    
+    sput_fail_unless(numDifferences == 0,
+                     "Equal seeds should give equal sequences, different seeds different sequences");
+    /*32000 bits. allow for about 10 standard deviations.*/
+    sput_fail_unless(numBitsSet > 15100 && numBitsSet < 16900, "About half of the bits should be set");
+    
+    /*seeded from the operating system*/
+    snRandom_init(&r1);
+    snRandom_init(&r2);
+    sput_fail_if(snRandom_next(&r1) == snRandom_next(&r2) && snRandom_next(&r1) == snRandom_next(&r2),
+                 "Generators seeded by the system should differ");
+}
+
+#endif /*SN_TEST_RANDOM_H*/
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_RECEIVE_BUFFER_H
+#define SN_TEST_RECEIVE_BUFFER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sput.h"
+#include "testeventloop.h"
+#include "websocket.h"
+
+/** The read buffer size the test websocket starts with, the smallest one allowed. */
+#define RECEIVE_BUFFER_TEST_INITIAL_SIZE (1 << 10)
+
+/** The payload size of the large frames, which need a bigger buffer. */
+#define RECEIVE_BUFFER_TEST_LARGE_PAYLOAD_SIZE (1 << 15)
+
+/** The size of the buffer passed to the last read. */
+static int receiveBufferTestReadSize = 0;
+
+static int receiveBufferTestNumMessages = 0;
+
+/** Reads from the socket pair and records how much the websocket asked for. */
+static snError receiveBufferTestRead(void* ioObject, char* buffer, int bufferSize, int* numBytesRead)
+{
+    receiveBufferTestReadSize = bufferSize;
+    return testSocketPairRead(ioObject, buffer, bufferSize, numBytesRead);
+}
+
+static void receiveBufferTestMessageCallback(void* userData, snOpcode opcode, const char* data, int numBytes)
+{
+    receiveBufferTestNumMessages++;
+}
+
+/** Plays the server, sending an unmasked binary frame. */
+static void receiveBufferTestSendFrame(testSocketPair* p, const char* payload, int payloadSize)
+{
+    char header[4];
+    int headerSize = 2;
+    
+    header[0] = (char)0x82;
+    if (payloadSize < 126)
+    {
+        header[1] = (char)payloadSize;
+    }
+    else
+    {
+        header[1] = 126;
+        header[2] = (char)(payloadSize >> 8);
+        header[3] = (char)(payloadSize & 0xff);
+        headerSize = 4;
+    }
+    
+    if (write(p->descriptors[1], header, headerSize) < 0 ||
+        write(p->descriptors[1], payload, payloadSize) < 0)
+    {
+        return;
+    }
+}
+
+/**
+ * The adaptive read buffer should grow while large frames keep filling it,
+ * and shrink back once only small frames arrive.
+ */
+static void testAdaptiveReceiveBuffer()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    int i;
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = testSocketPairDeinit;
+    ioc.connectCallback = testSocketPairConnect;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = testSocketPairDisconnect;
+    ioc.readCallback = receiveBufferTestRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.ioCallbacks = &ioc;
+    o.readBufferSize = RECEIVE_BUFFER_TEST_INITIAL_SIZE;
+    o.adaptiveReadBufferSize = 1;
+    o.maxFrameSize = 2 * RECEIVE_BUFFER_TEST_LARGE_PAYLOAD_SIZE;
+    
+    char* payload = calloc(1, RECEIVE_BUFFER_TEST_LARGE_PAYLOAD_SIZE);
+    numTestSocketPairs = 0;
+    receiveBufferTestNumMessages = 0;
+    snWebsocket* ws = snWebsocket_createWithSettings(NULL, receiveBufferTestMessageCallback, NULL, NULL, NULL, &o);
+    testSocketPair* p = testSocketPairs[0];
+    
+    snWebsocket_connect(ws, "ws://localhost/");
+    snWebsocket_poll(ws);
+    testSocketPairRespond(p, 0);
+    snWebsocket_poll(ws);
+    
+    /*large reads*/
+    for (i = 0; i < 32; i++)
+    {
+        receiveBufferTestSendFrame(p, payload, RECEIVE_BUFFER_TEST_LARGE_PAYLOAD_SIZE);
+        snWebsocket_poll(ws);
+    }
+    const int largeReadSize = receiveBufferTestReadSize;
+    
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_OPEN &&
+                     receiveBufferTestNumMessages == 32 &&
+                     largeReadSize > RECEIVE_BUFFER_TEST_LARGE_PAYLOAD_SIZE,
+                     "The read buffer should grow to fit large frames");
+    
+    /*small reads, until the large frames have been forgotten*/
+    for (i = 0; i < 128; i++)
+    {
+        int j;
+        for (j = 0; j < 8; j++)
+        {
+            receiveBufferTestSendFrame(p, payload, 16);
+        }
+        snWebsocket_poll(ws);
+    }
+    
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_OPEN &&
+                     receiveBufferTestNumMessages == 32 + 128 * 8 &&
+                     receiveBufferTestReadSize == RECEIVE_BUFFER_TEST_INITIAL_SIZE,
+                     "The read buffer should shrink when only small frames arrive");
+    
+    snWebsocket_delete(ws);
+    free(payload);
+}
+
+#endif /*SN_TEST_RECEIVE_BUFFER_H*/
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_RECONNECT_H
+#define SN_TEST_RECONNECT_H
+
+#include <string.h>
+#include <sys/socket.h>
+
+#include "reconnectscheduler.h"
+#include "sput.h"
+#include "testeventloop.h"
+#include "testfailover.h"
+#include "timerwheel.h"
+#include "websocket.h"
+
+#define RECONNECT_TEST_MAX_CONNECTS 64
+
+static int reconnectTestNumConnects = 0;
+
+static long long reconnectTestConnectTimes[RECONNECT_TEST_MAX_CONNECTS];
+
+static int reconnectTestNumAttempts = 0;
+
+static void reconnectTestReconnectCallback(void* userData, int numAttempts)
+{
+    reconnectTestNumAttempts = numAttempts;
+}
+
+/** A connect callback that records when it was called and always fails. */
+static snError reconnectTestFailingConnect(void* ioObject, const char* host, int port)
+{
+    if (reconnectTestNumConnects < RECONNECT_TEST_MAX_CONNECTS)
+    {
+        reconnectTestConnectTimes[reconnectTestNumConnects] = snTimerWheel_getMonotonicTime();
+    }
+    reconnectTestNumConnects++;
+    return SN_SOCKET_FAILED_TO_CONNECT;
+}
+
+static int reconnectTestNumRefusals = 0;
+
+static int reconnectTestNumErrors = 0;
+
+/** Reports the first few connects as refused once they have been started, like an unreachable port. */
+static snError reconnectTestRefusingIsOpen(void* ioObject, int* result)
+{
+    *result = 0;
+    if (reconnectTestNumRefusals > 0)
+    {
+        reconnectTestNumRefusals--;
+        return SN_SOCKET_FAILED_TO_CONNECT;
+    }
+    *result = 1;
+    return SN_NO_ERROR;
+}
+
+static void reconnectTestErrorCallback(void* userData, snError error)
+{
+    reconnectTestNumErrors++;
+}
+
+static void reconnectTestInitOptions(snWebsocketOptions* o, snIOCallbacks* ioc)
+{
+    memset(ioc, 0, sizeof(snIOCallbacks));
+    ioc->initCallback = testSocketPairInit;
+    ioc->deinitCallback = testSocketPairDeinit;
+    ioc->connectCallback = testSocketPairConnect;
+    ioc->isOpenCallback = testSocketPairIsOpen;
+    ioc->disconnectCallback = testSocketPairDisconnect;
+    ioc->readCallback = testSocketPairRead;
+    ioc->writeCallback = testSocketPairWrite;
+    ioc->getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(o, 0, sizeof(snWebsocketOptions));
+    o->ioCallbacks = ioc;
+    o->autoReconnect = 1;
+    o->reconnectMinDelay = 5;
+    o->reconnectMaxDelay = 40;
+    o->reconnectCallback = reconnectTestReconnectCallback;
+}
+
+/** Polls until the websocket has sent its opening handshake on a socket pair. */
+static int testWaitForOpeningHandshake(snWebsocket* ws, testSocketPair* p, int timeoutMs)
+{
+    char c;
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    while (snTimerWheel_getMonotonicTime() - startTime < timeoutMs)
+    {
+        snWebsocket_poll(ws);
+        if (p->descriptors[1] >= 0 && recv(p->descriptors[1], &c, 1, MSG_DONTWAIT | MSG_PEEK) == 1)
+        {
+            return 1;
+        }
+        snWebsocket_waitForEvents(ws, 1);
+    }
+    return 0;
+}
+
+static void testAutoReconnect()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    
+    reconnectTestInitOptions(&o, &ioc);
+    numTestSocketPairs = 0;
+    reconnectTestNumAttempts = 0;
+    snWebsocket* ws = snWebsocket_createWithSettings(NULL, NULL, NULL, NULL, NULL, &o);
+    testSocketPair* p = testSocketPairs[0];
+    
+    snWebsocket_connect(ws, "ws://localhost/");
+    testWaitForOpeningHandshake(ws, p, 100);
+    testSocketPairRespond(p, 0);
+    snWebsocket_poll(ws);
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_OPEN &&
+                     reconnectTestNumAttempts == 0,
+                     "Connecting should not count as reconnecting");
+    
+    /*the server goes away*/
+    testSocketPairSendClose(p);
+    snWebsocket_poll(ws);
+    const long long closeTime = snTimerWheel_getMonotonicTime();
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_CLOSED, "The connection should be closed by the server");
+    
+    const int hasReconnected = testWaitForOpeningHandshake(ws, p, 500);
+    const long long delay = snTimerWheel_getMonotonicTime() - closeTime;
+    testSocketPairRespond(p, 0);
+    snWebsocket_poll(ws);
+    
+    sput_fail_unless(hasReconnected && delay >= 5 &&
+                     snWebsocket_getState(ws) == SN_STATE_OPEN &&
+                     reconnectTestNumAttempts == 1,
+                     "A lost connection should be reestablished after a delay");
+    
+    /*closing by the application should not reconnect*/
+    snWebsocket_disconnect(ws, 1);
+    const int hasReconnectedAfterDisconnect = testWaitForOpeningHandshake(ws, p, 100);
+    sput_fail_unless(!hasReconnectedAfterDisconnect && snWebsocket_getState(ws) == SN_STATE_CLOSED,
+                     "Disconnecting should stop reconnecting");
+    
+    snWebsocket_delete(ws);
+}
+
+static void testReconnectBackoff()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    int isWithinBounds = 1;
+    int i;
+    
+    reconnectTestInitOptions(&o, &ioc);
+    ioc.connectCallback = reconnectTestFailingConnect;
+    numTestSocketPairs = 0;
+    reconnectTestNumConnects = 0;
+    snWebsocket* ws = snWebsocket_createWithSettings(NULL, NULL, NULL, NULL, NULL, &o);
+    
+    snWebsocket_connect(ws, "ws://localhost/");
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    while (snTimerWheel_getMonotonicTime() - startTime < 400)
+    {
+        snWebsocket_waitForEvents(ws, 10);
+        snWebsocket_poll(ws);
+    }
+    const int numConnects = reconnectTestNumConnects;
+    
+    for (i = 1; i < numConnects && i < RECONNECT_TEST_MAX_CONNECTS; i++)
+    {
+        const long long interval = reconnectTestConnectTimes[i] - reconnectTestConnectTimes[i - 1];
+        if (interval < 5 || interval > 40 + 20)
+        {
+            isWithinBounds = 0;
+        }
+    }
+    
+    sput_fail_unless(numConnects >= 8 && isWithinBounds,
+                     "Failed connects should be retried with delays between the minimum and maximum delay");
+    
+    snWebsocket_disconnect(ws, 1);
+    const long long stopTime = snTimerWheel_getMonotonicTime();
+    while (snTimerWheel_getMonotonicTime() - stopTime < 100)
+    {
+        snWebsocket_waitForEvents(ws, 10);
+        snWebsocket_poll(ws);
+    }
+    sput_fail_unless(reconnectTestNumConnects == numConnects, "Disconnecting should stop retrying");
+    
+    snWebsocket_delete(ws);
+}
+
+/**
+ * Connects that fail after being started, e.g. refused while the server
+ * restarts, should be retried without holding on to a reconnect slot.
+ */
+static void testReconnectAfterRefusedConnect()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    snReconnectSchedulerStats stats;
+    
+    reconnectTestInitOptions(&o, &ioc);
+    ioc.isOpenCallback = reconnectTestRefusingIsOpen;
+    snReconnectScheduler_setLimits(1, 0, 1);
+    snReconnectScheduler_resetStats();
+    
+    numTestSocketPairs = 0;
+    reconnectTestNumAttempts = 0;
+    reconnectTestNumErrors = 0;
+    reconnectTestNumRefusals = 3;
+    snWebsocket* ws = snWebsocket_createWithSettings(NULL, NULL, NULL, reconnectTestErrorCallback, NULL, &o);
+    testSocketPair* p = testSocketPairs[0];
+    
+    snWebsocket_connect(ws, "ws://localhost/");
+    snWebsocket_poll(ws);
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_CLOSED && reconnectTestNumErrors == 1,
+                     "A refused connect should close the websocket and report an error");
+    
+    const int hasReconnected = testWaitForOpeningHandshake(ws, p, 1000);
+    testSocketPairRespond(p, 0);
+    snWebsocket_poll(ws);
+    
+    snReconnectScheduler_getStats(&stats);
+    sput_fail_unless(hasReconnected &&
+                     snWebsocket_getState(ws) == SN_STATE_OPEN &&
+                     reconnectTestNumErrors == 3 &&
+                     reconnectTestNumAttempts == 3 &&
+                     stats.numHandshakes == 0,
+                     "Refused connects should be retried and release their reconnect slots");
+    
+    snReconnectScheduler_setLimits(SN_RECONNECT_DEFAULT_MAX_HANDSHAKES, 0, 1);
+    snWebsocket_delete(ws);
+}
+
+static void testReconnectLimits()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    snReconnectSchedulerStats stats;
+    snWebsocket* websockets[2];
+    int i;
+    
+    reconnectTestInitOptions(&o, &ioc);
+    numTestSocketPairs = 0;
+    for (i = 0; i < 2; i++)
+    {
+        websockets[i] = snWebsocket_createWithSettings(NULL, NULL, NULL, NULL, NULL, &o);
+        snWebsocket_connect(websockets[i], "ws://localhost/");
+        testWaitForOpeningHandshake(websockets[i], testSocketPairs[i], 100);
+        testSocketPairRespond(testSocketPairs[i], 0);
+        snWebsocket_poll(websockets[i]);
+    }
+    
+    snReconnectScheduler_setLimits(1, 0, 1);
+    snReconnectScheduler_resetStats();
+    
+    /*both connections are lost at once*/
+    for (i = 0; i < 2; i++)
+    {
+        testSocketPairSendClose(testSocketPairs[i]);
+        snWebsocket_poll(websockets[i]);
+    }
+    
+    /*complete each reconnect's handshake as soon as it has been sent*/
+    int numConcurrentHandshakes = 0;
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    while ((snWebsocket_getState(websockets[0]) != SN_STATE_OPEN ||
+            snWebsocket_getState(websockets[1]) != SN_STATE_OPEN) &&
+           snTimerWheel_getMonotonicTime() - startTime < 1000)
+    {
+        int numConnecting = 0;
+        for (i = 0; i < 2; i++)
+        {
+            snWebsocket_waitForEvents(websockets[i], 1);
+            snWebsocket_poll(websockets[i]);
+            numConnecting += snWebsocket_getState(websockets[i]) == SN_STATE_CONNECTING;
+        }
+        if (numConnecting > numConcurrentHandshakes)
+        {
+            numConcurrentHandshakes = numConnecting;
+        }
+        
+        for (i = 0; i < 2; i++)
+        {
+            char c;
+            testSocketPair* p = testSocketPairs[i];
+            if (snWebsocket_getState(websockets[i]) == SN_STATE_CONNECTING &&
+                p->descriptors[1] >= 0 &&
+                recv(p->descriptors[1], &c, 1, MSG_DONTWAIT | MSG_PEEK) == 1)
+            {
+                testDiscardSentBytes(p);
+                testSocketPairRespond(p, 0);
+            }
+        }
+    }
+    
+    snReconnectScheduler_getStats(&stats);
+    sput_fail_unless(snWebsocket_getState(websockets[0]) == SN_STATE_OPEN &&
+                     snWebsocket_getState(websockets[1]) == SN_STATE_OPEN,
+                     "All connections should be reestablished");
+    sput_fail_unless(numConcurrentHandshakes == 1 &&
+                     stats.maxNumHandshakes == 1 &&
+                     stats.numReconnects == 2 &&
+                     stats.numHandshakes == 0,
+                     "The number of reconnects in flight should be limited");
+    
+    snReconnectScheduler_setLimits(SN_RECONNECT_DEFAULT_MAX_HANDSHAKES, 0, 1);
+    for (i = 0; i < 2; i++)
+    {
+        snWebsocket_delete(websockets[i]);
+    }
+}
+
+#endif /*SN_TEST_RECONNECT_H*/
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_RESOLVER_H
+#define SN_TEST_RESOLVER_H
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sput.h"
+#include "resolver.h"
+#include "timerwheel.h"
+#include "websocket.h"
+
+/** How long the stand-in resolver takes per lookup. */
+#define SLOW_RESOLVER_DELAY 50
+
+/** The time to live reported by the stand-in resolver. */
+#define SLOW_RESOLVER_TIME_TO_LIVE 200
+
+static int numSlowResolverLookups = 0;
+
+/**
+ * A slow local stand-in for a name server. Hosts starting with "fail"
+ * don't exist, and all other hosts resolve to the loopback address.
+ */
+static snError slowResolveFunction(void* userData,
+                                   const char* host,
+                                   snResolvedAddress* addresses,
+                                   int maxNumAddresses,
+                                   int* numAddresses,
+                                   int* timeToLive)
+{
+    struct timespec sleepTime;
+    sleepTime.tv_sec = 0;
+    sleepTime.tv_nsec = SLOW_RESOLVER_DELAY * 1000000L;
+    nanosleep(&sleepTime, NULL);
+    
+    __atomic_add_fetch(&numSlowResolverLookups, 1, __ATOMIC_SEQ_CST);
+    
+    *numAddresses = 0;
+    *timeToLive = SLOW_RESOLVER_TIME_TO_LIVE;
+    
+    if (strncmp(host, "fail", 4) == 0)
+    {
+        return SN_NAME_RESOLUTION_FAILED;
+    }
+    
+    struct sockaddr_in* address = (struct sockaddr_in*)&addresses[0].address;
+    memset(&addresses[0], 0, sizeof(snResolvedAddress));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addresses[0].addressSize = sizeof(struct sockaddr_in);
+    *numAddresses = 1;
+    
+    return SN_NO_ERROR;
+}
+
+static int numFastResolverLookups = 0;
+
+/** A stand-in resolver that resolves all hosts right away and for a long time. */
+static snError fastResolveFunction(void* userData,
+                                   const char* host,
+                                   snResolvedAddress* addresses,
+                                   int maxNumAddresses,
+                                   int* numAddresses,
+                                   int* timeToLive)
+{
+    __atomic_add_fetch(&numFastResolverLookups, 1, __ATOMIC_SEQ_CST);
+    
+    struct sockaddr_in* address = (struct sockaddr_in*)&addresses[0].address;
+    memset(&addresses[0], 0, sizeof(snResolvedAddress));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addresses[0].addressSize = sizeof(struct sockaddr_in);
+    *numAddresses = 1;
+    *timeToLive = 60000;
+    
+    return SN_NO_ERROR;
+}
+
+/** Waits for a request to complete using its descriptor. */
+static snResolveStatus waitForResolveRequest(snResolveRequest* request)
+{
+    struct pollfd pfd;
+    pfd.fd = snResolveRequest_getDescriptor(request);
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    
+    if (pfd.fd >= 0)
+    {
+        poll(&pfd, 1, 2000);
+    }
+    
+    return snResolveRequest_getStatus(request);
+}
+
+static void testResolver()
+{
+    snResolveRequest* requests[10];
+    int numAddresses = 0;
+    int numCoalescedRequests = 0;
+    int i;
+    
+    snResolver_setResolveFunction(slowResolveFunction, NULL);
+    numSlowResolverLookups = 0;
+    
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    snResolveRequest* request = snResolver_resolve("gateway.test");
+    sput_fail_unless(snResolveRequest_getStatus(request) == SN_RESOLVE_PENDING &&
+                     snTimerWheel_getMonotonicTime() - startTime < SLOW_RESOLVER_DELAY,
+                     "Resolving an uncached host should not block");
+    sput_fail_unless(waitForResolveRequest(request) == SN_RESOLVE_SUCCEEDED,
+                     "The descriptor of a request should become readable when the request completes");
+    const snResolvedAddress* addresses = snResolveRequest_getAddresses(request, &numAddresses);
+    sput_fail_unless(numAddresses == 1 && addresses[0].address.ss_family == AF_INET,
+                     "A request should get the addresses of the host");
+    snResolveRequest_delete(request);
+    
+    request = snResolver_resolve("gateway.test");
+    sput_fail_unless(snResolveRequest_getStatus(request) == SN_RESOLVE_SUCCEEDED &&
+                     snResolveRequest_getDescriptor(request) == -1 &&
+                     numSlowResolverLookups == 1,
+                     "Resolving a cached host should complete right away");
+    snResolveRequest_delete(request);
+    
+    request = snResolver_resolve("127.0.0.1");
+    sput_fail_unless(snResolveRequest_getStatus(request) == SN_RESOLVE_SUCCEEDED &&
+                     numSlowResolverLookups == 1,
+                     "IP addresses should not be looked up");
+    snResolveRequest_delete(request);
+    
+    /*a reconnect storm*/
+    for (i = 0; i < 10; i++)
+    {
+        requests[i] = snResolver_resolve("storm.test");
+    }
+    for (i = 0; i < 10; i++)
+    {
+        numCoalescedRequests += waitForResolveRequest(requests[i]) == SN_RESOLVE_SUCCEEDED;
+        snResolveRequest_delete(requests[i]);
+    }
+    sput_fail_unless(numCoalescedRequests == 10 && numSlowResolverLookups == 2,
+                     "Concurrent requests for the same host should share one lookup");
+    
+    request = snResolver_resolve("fail.test");
+    sput_fail_unless(waitForResolveRequest(request) == SN_RESOLVE_FAILED,
+                     "Resolving a missing host should fail");
+    snResolveRequest_delete(request);
+    request = snResolver_resolve("fail.test");
+    sput_fail_unless(snResolveRequest_getStatus(request) == SN_RESOLVE_FAILED &&
+                     numSlowResolverLookups == 3,
+                     "Failed lookups should be cached");
+    snResolveRequest_delete(request);
+    
+    /*deleting pending requests is allowed*/
+    snResolveRequest_delete(snResolver_resolve("deleted.test"));
+    
+    struct timespec sleepTime;
+    sleepTime.tv_sec = 0;
+    sleepTime.tv_nsec = (SLOW_RESOLVER_TIME_TO_LIVE + 10) * 1000000L;
+    nanosleep(&sleepTime, NULL);
+    
+    request = snResolver_resolve("gateway.test");
+    sput_fail_unless(snResolveRequest_getStatus(request) == SN_RESOLVE_PENDING,
+                     "Expired results should be looked up again");
+    waitForResolveRequest(request);
+    snResolveRequest_delete(request);
+    
+    snResolver_setResolveFunction(NULL, NULL);
+}
+
+static void testResolverCacheEviction()
+{
+    /*more hosts than the cache holds, none of which expire during the test*/
+    const int numHosts = 300;
+    char host[32];
+    int numSucceeded = 0;
+    int i;
+    
+    snResolver_setResolveFunction(fastResolveFunction, NULL);
+    numFastResolverLookups = 0;
+    
+    for (i = 0; i < numHosts; i++)
+    {
+        snprintf(host, sizeof(host), "host%d.test", i);
+        snResolveRequest* request = snResolver_resolve(host);
+        numSucceeded += waitForResolveRequest(request) == SN_RESOLVE_SUCCEEDED;
+        snResolveRequest_delete(request);
+    }
+    sput_fail_unless(numSucceeded == numHosts,
+                     "All hosts should be resolved");
+    
+    snprintf(host, sizeof(host), "host%d.test", numHosts - 1);
+    snResolveRequest* request = snResolver_resolve(host);
+    sput_fail_unless(snResolveRequest_getStatus(request) == SN_RESOLVE_SUCCEEDED &&
+                     numFastResolverLookups == numHosts,
+                     "The latest host should still be cached when the cache is full");
+    snResolveRequest_delete(request);
+    
+    request = snResolver_resolve("host0.test");
+    waitForResolveRequest(request);
+    sput_fail_unless(numFastResolverLookups == numHosts + 1,
+                     "The oldest entry should be evicted when the cache is full");
+    snResolveRequest_delete(request);
+    
+    snResolver_setResolveFunction(NULL, NULL);
+}
+
+/**
+ * Connects a websocket to a local listening socket through a slow resolver.
+ */
+static void testResolvingConnect()
+{
+    struct sockaddr_in address;
+    socklen_t addressSize = sizeof(address);
+    char url[256];
+    
+    const int listenDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    if (bind(listenDescriptor, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listenDescriptor, 4) != 0 ||
+        getsockname(listenDescriptor, (struct sockaddr*)&address, &addressSize) != 0)
+    {
+        close(listenDescriptor);
+        sput_fail_unless(0, "Failed to set up a local listening socket");
+        return;
+    }
+    
+    snResolver_setResolveFunction(slowResolveFunction, NULL);
+    
+    snWebsocket* ws = snWebsocket_create(NULL, NULL, NULL, NULL, NULL);
+    sprintf(url, "ws://slow.test:%d/", ntohs(address.sin_port));
+    
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    sput_fail_unless(snWebsocket_connect(ws, url) == SN_NO_ERROR &&
+                     snTimerWheel_getMonotonicTime() - startTime < SLOW_RESOLVER_DELAY &&
+                     snWebsocket_getDescriptor(ws) >= 0,
+                     "Connecting should not wait for the host to be resolved");
+    
+    struct pollfd pfd;
+    pfd.fd = listenDescriptor;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    
+    while (snTimerWheel_getMonotonicTime() - startTime < 2000 && poll(&pfd, 1, 0) == 0)
+    {
+        snWebsocket_waitForEvents(ws, 100);
+        snWebsocket_poll(ws);
+    }
+    
+    sput_fail_unless(pfd.revents & POLLIN,
+                     "A websocket should connect once the host has been resolved");
+    
+    snWebsocket_delete(ws);
+    close(listenDescriptor);
+    snResolver_setResolveFunction(NULL, NULL);
+}
+
+/** The addresses returned by \c listResolveFunction, in the IPv4 loopback range. */
+static const char* testResolvedAddresses[SN_RESOLVER_MAX_ADDRESSES];
+
+static int numTestResolvedAddresses = 0;
+
+static snError listResolveFunction(void* userData,
+                                   const char* host,
+                                   snResolvedAddress* addresses,
+                                   int maxNumAddresses,
+                                   int* numAddresses,
+                                   int* timeToLive)
+{
+    int i;
+    
+    for (i = 0; i < numTestResolvedAddresses; i++)
+    {
+        struct sockaddr_in* address = (struct sockaddr_in*)&addresses[i].address;
+        memset(&addresses[i], 0, sizeof(snResolvedAddress));
+        address->sin_family = AF_INET;
+        inet_pton(AF_INET, testResolvedAddresses[i], &address->sin_addr);
+        addresses[i].addressSize = sizeof(struct sockaddr_in);
+    }
+    
+    *numAddresses = numTestResolvedAddresses;
+    *timeToLive = 0;
+    
+    return SN_NO_ERROR;
+}
+
+/**
+ * Creates a socket listening on a loopback address.
+ * @param address The address.
+ * @param port The port, or 0 to pick one.
+ * @param backlog The listen backlog.
+ * @return The socket, or -1 on failure.
+ */
+static int testListen(const char* address, int* port, int backlog)
+{
+    struct sockaddr_in a;
+    socklen_t addressSize = sizeof(a);
+    
+    const int descriptor = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(*port);
+    inet_pton(AF_INET, address, &a.sin_addr);
+    
+    if (bind(descriptor, (struct sockaddr*)&a, sizeof(a)) != 0 ||
+        listen(descriptor, backlog) != 0 ||
+        getsockname(descriptor, (struct sockaddr*)&a, &addressSize) != 0)
+    {
+        close(descriptor);
+        return -1;
+    }
+    
+    *port = ntohs(a.sin_port);
+    return descriptor;
+}
+
+/**
+ * Connects a websocket to a host with several addresses and waits until
+ * a local listening socket has a connection to accept.
+ * @return The time in milliseconds until the listening socket had a
+ * connection, or -1 if it never had one.
+ */
+static int testConnectToAddresses(int listenDescriptor, int port)
+{
+    char url[256];
+    int result = -1;
+    
+    snWebsocket* ws = snWebsocket_create(NULL, NULL, NULL, NULL, NULL);
+    sprintf(url, "ws://eyeballs.test:%d/", port);
+    
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    snWebsocket_connect(ws, url);
+    
+    struct pollfd pfd;
+    pfd.fd = listenDescriptor;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    
+    while (snTimerWheel_getMonotonicTime() - startTime < 3000 &&
+           snWebsocket_getState(ws) == SN_STATE_CONNECTING)
+    {
+        if (poll(&pfd, 1, 0) > 0)
+        {
+            result = (int)(snTimerWheel_getMonotonicTime() - startTime);
+            break;
+        }
+        snWebsocket_waitForEvents(ws, 1000);
+        snWebsocket_poll(ws);
+    }
+    
+    snWebsocket_delete(ws);
+    return result;
+}
+
+/**
+ * Connects to hosts whose first address does not respond or refuses
+ * connections, with a working address after it.
+ */
+static void testHappyEyeballs()
+{
+    int clientDescriptors[4];
+    int port = 0;
+    int i;
+    
+    /*a listening socket with a full accept queue drops new connection attempts*/
+    const int workingDescriptor = testListen("127.0.0.1", &port, 16);
+    const int unresponsiveDescriptor = workingDescriptor < 0 ? -1 : testListen("127.0.0.2", &port, 0);
+    if (unresponsiveDescriptor < 0)
+    {
+        if (workingDescriptor >= 0)
+        {
+            close(workingDescriptor);
+        }
+        sput_fail_unless(0, "Failed to set up local listening sockets");
+        return;
+    }
+    
+    for (i = 0; i < 4; i++)
+    {
+        struct sockaddr_in a;
+        memset(&a, 0, sizeof(a));
+        a.sin_family = AF_INET;
+        a.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.2", &a.sin_addr);
+        clientDescriptors[i] = socket(AF_INET, SOCK_STREAM, 0);
+        fcntl(clientDescriptors[i], F_SETFL, O_NONBLOCK);
+        connect(clientDescriptors[i], (struct sockaddr*)&a, sizeof(a));
+    }
+    
+    snResolver_setResolveFunction(listResolveFunction, NULL);
+    
+    testResolvedAddresses[0] = "127.0.0.2";
+    testResolvedAddresses[1] = "127.0.0.1";
+    numTestResolvedAddresses = 2;
+    const int delayedConnectTime = testConnectToAddresses(workingDescriptor, port);
+    sput_fail_unless(delayedConnectTime >= 200 && delayedConnectTime < 1000,
+                     "A connection attempt to the next address should start when the first one is slow");
+    
+    /*nothing listens on 127.0.0.3*/
+    close(accept(workingDescriptor, NULL, NULL));
+    testResolvedAddresses[0] = "127.0.0.3";
+    testResolvedAddresses[1] = "127.0.0.1";
+    numTestResolvedAddresses = 2;
+    const int fallbackConnectTime = testConnectToAddresses(workingDescriptor, port);
+    sput_fail_unless(fallbackConnectTime >= 0 && fallbackConnectTime < 200,
+                     "A connection attempt to the next address should start when the first one fails");
+    
+    snResolver_setResolveFunction(NULL, NULL);
+    
+    for (i = 0; i < 4; i++)
+    {
+        close(clientDescriptors[i]);
+    }
+    close(unresponsiveDescriptor);
+    close(workingDescriptor);
+}
+
+#endif /*SN_TEST_RESOLVER_H*/
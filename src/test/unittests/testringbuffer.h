@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_RING_BUFFER_H
+#define SN_TEST_RING_BUFFER_H
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "sput.h"
+#include "ringbuffer.h"
+
+#define NUM_RING_BUFFER_TEST_RECORDS 200000
+
+/** Small enough to make the records wrap around often. */
+#define RING_BUFFER_TEST_CAPACITY 4096
+
+/**
+ * The size of the i:th record. Varies so that records end up
+ * at all kinds of offsets relative to the end of the buffer.
+ */
+static int testRingBufferRecordSize(int i)
+{
+    return (i * 7919) % 1000;
+}
+
+static char testRingBufferRecordByte(int i, int j)
+{
+    return (char)(i + j * 31);
+}
+
+static void* testRingBufferProducerFunction(void* userData)
+{
+    snRingBuffer* ring = (snRingBuffer*)userData;
+    int i, j;
+    
+    for (i = 0; i < NUM_RING_BUFFER_TEST_RECORDS; i++)
+    {
+        const int size = testRingBufferRecordSize(i);
+        char* record;
+        
+        while ((record = snRingBuffer_beginWrite(ring, size)) == NULL)
+        {
+            sched_yield();
+        }
+        
+        for (j = 0; j < size; j++)
+        {
+            record[j] = testRingBufferRecordByte(i, j);
+        }
+        
+        snRingBuffer_endWrite(ring, size, i);
+    }
+    
+    return NULL;
+}
+
+static void testRingBuffer()
+{
+    snRingBuffer ring;
+    pthread_t producer;
+    int numRecords = 0;
+    int numSizeErrors = 0;
+    int numOrderErrors = 0;
+    int numContentErrors = 0;
+    int size, tag, j;
+    
+    snRingBuffer_init(&ring, RING_BUFFER_TEST_CAPACITY);
+    sput_fail_unless(snRingBuffer_isEmpty(&ring) &&
+                     snRingBuffer_beginRead(&ring, &size, &tag) == NULL,
+                     "A new ring buffer should be empty");
+    sput_fail_unless(snRingBuffer_beginWrite(&ring, snRingBuffer_getMaxRecordSize(&ring) + 1) == NULL,
+                     "Records bigger than the max record size should be rejected");
+    
+    pthread_create(&producer, NULL, testRingBufferProducerFunction, &ring);
+    
+    /*consume while the producer is writing*/
+    while (numRecords < NUM_RING_BUFFER_TEST_RECORDS)
+    {
+        const char* record = snRingBuffer_beginRead(&ring, &size, &tag);
+        if (record == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+        
+        if (tag != numRecords)
+        {
+            numOrderErrors++;
+        }
+        
+        if (size != testRingBufferRecordSize(tag))
+        {
+            numSizeErrors++;
+        }
+        else
+        {
+            for (j = 0; j < size; j++)
+            {
+                if (record[j] != testRingBufferRecordByte(tag, j))
+                {
+                    numContentErrors++;
+                    break;
+                }
+            }
+        }
+        
+        snRingBuffer_endRead(&ring);
+        numRecords++;
+    }
+    
+    pthread_join(producer, NULL);
+    
+    sput_fail_unless(numOrderErrors == 0, "Records should be read in the order they were written");
+    sput_fail_unless(numSizeErrors == 0 && numContentErrors == 0,
+                     "Records should be read back unchanged");
+    sput_fail_unless(snRingBuffer_isEmpty(&ring), "A ring buffer should be empty after reading all records");
+    
+    snRingBuffer_deinit(&ring);
+}
+
+#endif /*SN_TEST_RING_BUFFER_H*/
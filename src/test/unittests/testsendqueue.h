@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_SEND_QUEUE_H
+#define SN_TEST_SEND_QUEUE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sput.h"
+#include "testeventloop.h"
+#include "testkeepalive.h"
+#include "timerwheel.h"
+#include "websocket.h"
+
+/** Bigger than a socket pair's buffers, so most of it stays queued. */
+#define SEND_QUEUE_TEST_PAYLOAD_SIZE (4 << 20)
+
+static int sendQueueTestNumCloses = 0;
+
+/** The peer's end of the last disconnected socket pair, left open to read what was sent before closing. */
+static int sendQueueTestPeerDescriptor = -1;
+
+static snError sendQueueTestDisconnect(void* ioObject)
+{
+    testSocketPair* p = (testSocketPair*)ioObject;
+    if (p->descriptors[0] >= 0)
+    {
+        close(p->descriptors[0]);
+        if (sendQueueTestPeerDescriptor >= 0)
+        {
+            close(sendQueueTestPeerDescriptor);
+        }
+        sendQueueTestPeerDescriptor = p->descriptors[1];
+    }
+    p->descriptors[0] = -1;
+    p->descriptors[1] = -1;
+    return SN_NO_ERROR;
+}
+
+static void sendQueueTestCloseCallback(void* userData, snStatusCode status)
+{
+    sendQueueTestNumCloses++;
+}
+
+/** Opens a websocket on a socket pair and queues a big message that the peer doesn't read. */
+static void sendQueueTestOpenAndQueue(snWebsocket* ws, testSocketPair* p, const char* payload)
+{
+    snWebsocket_connect(ws, "ws://localhost/");
+    snWebsocket_poll(ws);
+    testDiscardSentBytes(p);
+    testSocketPairRespond(p, 0);
+    snWebsocket_poll(ws);
+    snWebsocket_sendBinaryData(ws, SEND_QUEUE_TEST_PAYLOAD_SIZE, payload);
+}
+
+/** Has the peer close the connection, and returns how long polling took in milliseconds. */
+static long long sendQueueTestReceiveClose(snWebsocket* ws, testSocketPair* p)
+{
+    static const char frame[] = {(char)0x88, 2, 0x03, (char)0xe8};
+    if (write(p->descriptors[1], frame, sizeof(frame)) < 0)
+    {
+        return -1;
+    }
+    
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    snWebsocket_poll(ws);
+    return snTimerWheel_getMonotonicTime() - startTime;
+}
+
+/**
+ * Closing a connection with queued outgoing data should not block the
+ * polling thread. The queue, ending with the close frame, should be sent
+ * as the peer reads it, or discarded once the drain timeout has passed.
+ */
+static void testCloseDrain()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    char buffer[1 << 16];
+    char lastBytes[8];
+    int numBytesReceived = 0;
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = testSocketPairDeinit;
+    ioc.connectCallback = testSocketPairConnect;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = sendQueueTestDisconnect;
+    ioc.readCallback = testSocketPairRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.ioCallbacks = &ioc;
+    o.closeDrainTimeout = 200;
+    o.maxFrameSize = 2 * SEND_QUEUE_TEST_PAYLOAD_SIZE;
+    
+    char* payload = calloc(1, SEND_QUEUE_TEST_PAYLOAD_SIZE);
+    numTestSocketPairs = 0;
+    sendQueueTestNumCloses = 0;
+    snWebsocket* ws = snWebsocket_createWithSettings(NULL, NULL, sendQueueTestCloseCallback, NULL, NULL, &o);
+    testSocketPair* p = testSocketPairs[0];
+    
+    /*the peer reads everything*/
+    sendQueueTestOpenAndQueue(ws, p, payload);
+    long long pollTime = sendQueueTestReceiveClose(ws, p);
+    sput_fail_unless(pollTime >= 0 && pollTime < 50 &&
+                     snWebsocket_getState(ws) == SN_STATE_CLOSING &&
+                     snWebsocket_getBufferedAmount(ws) > 0,
+                     "Closing with queued data should not block");
+    
+    memset(lastBytes, 0, sizeof(lastBytes));
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    while (snTimerWheel_getMonotonicTime() - startTime < 1000)
+    {
+        /*keep reading what was sent after the websocket has closed*/
+        const int isClosed = snWebsocket_getState(ws) == SN_STATE_CLOSED;
+        const ssize_t n = recv(isClosed ? sendQueueTestPeerDescriptor : p->descriptors[1],
+                               buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (isClosed && n <= 0)
+        {
+            break;
+        }
+        
+        if (n > 0)
+        {
+            /*keep the last bytes, where the close frame should be*/
+            if (n >= (ssize_t)sizeof(lastBytes))
+            {
+                memcpy(lastBytes, &buffer[n - sizeof(lastBytes)], sizeof(lastBytes));
+            }
+            else
+            {
+                memmove(lastBytes, &lastBytes[n], sizeof(lastBytes) - n);
+                memcpy(&lastBytes[sizeof(lastBytes) - n], buffer, n);
+            }
+            numBytesReceived += (int)n;
+        }
+        snWebsocket_poll(ws);
+    }
+    
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_CLOSED &&
+                     numBytesReceived > SEND_QUEUE_TEST_PAYLOAD_SIZE &&
+                     (unsigned char)lastBytes[0] == 0x88 &&
+                     sendQueueTestNumCloses == 1,
+                     "Queued data and the close frame should be sent before closing");
+    
+    /*the peer reads nothing*/
+    sendQueueTestOpenAndQueue(ws, p, payload);
+    const long long closeTime = snTimerWheel_getMonotonicTime();
+    pollTime = sendQueueTestReceiveClose(ws, p);
+    while (snWebsocket_getState(ws) != SN_STATE_CLOSED && snTimerWheel_getMonotonicTime() - closeTime < 1000)
+    {
+        snWebsocket_waitForEvents(ws, 10);
+        snWebsocket_poll(ws);
+    }
+    const long long closeDuration = snTimerWheel_getMonotonicTime() - closeTime;
+    
+    sput_fail_unless(pollTime >= 0 && pollTime < 50 &&
+                     snWebsocket_getState(ws) == SN_STATE_CLOSED &&
+                     closeDuration >= 190 && closeDuration < 1000 &&
+                     sendQueueTestNumCloses == 2,
+                     "Queued data should be discarded after the drain timeout");
+    
+    snWebsocket_delete(ws);
+    close(sendQueueTestPeerDescriptor);
+    sendQueueTestPeerDescriptor = -1;
+    free(payload);
+}
+
+/**
+ * A websocket should want to write to its descriptor only while
+ * there is queued outgoing data.
+ */
+static void testWantedEvents()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions o;
+    char buffer[1 << 16];
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = testSocketPairDeinit;
+    ioc.connectCallback = testSocketPairConnect;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = testSocketPairDisconnect;
+    ioc.readCallback = testSocketPairRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(&o, 0, sizeof(snWebsocketOptions));
+    o.ioCallbacks = &ioc;
+    o.maxFrameSize = 2 * SEND_QUEUE_TEST_PAYLOAD_SIZE;
+    
+    char* payload = calloc(1, SEND_QUEUE_TEST_PAYLOAD_SIZE);
+    numTestSocketPairs = 0;
+    snWebsocket* ws = snWebsocket_createWithSettings(NULL, NULL, NULL, NULL, NULL, &o);
+    testSocketPair* p = testSocketPairs[0];
+    
+    sput_fail_unless(snWebsocket_getWantedEvents(ws) == 0,
+                     "A closed websocket should not want any events");
+    
+    snWebsocket_connect(ws, "ws://localhost/");
+    sput_fail_unless(snWebsocket_getDescriptor(ws) == p->descriptors[0] &&
+                     snWebsocket_getWantedEvents(ws) == (SN_IO_EVENT_READ | SN_IO_EVENT_WRITE),
+                     "A connecting websocket should wait for its descriptor to become writable");
+    
+    snWebsocket_poll(ws);
+    testDiscardSentBytes(p);
+    testSocketPairRespond(p, 0);
+    snWebsocket_poll(ws);
+    sput_fail_unless(snWebsocket_getState(ws) == SN_STATE_OPEN &&
+                     snWebsocket_getBufferedAmount(ws) == 0 &&
+                     snWebsocket_getWantedEvents(ws) == SN_IO_EVENT_READ,
+                     "An open websocket without queued data should only want to read");
+    
+    snWebsocket_sendBinaryData(ws, SEND_QUEUE_TEST_PAYLOAD_SIZE, payload);
+    sput_fail_unless(snWebsocket_getBufferedAmount(ws) > 0 &&
+                     snWebsocket_getWantedEvents(ws) == (SN_IO_EVENT_READ | SN_IO_EVENT_WRITE),
+                     "A websocket with queued data should want to write");
+    
+    /*the peer reads everything*/
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    while (snWebsocket_getBufferedAmount(ws) > 0 && snTimerWheel_getMonotonicTime() - startTime < 1000)
+    {
+        if (recv(p->descriptors[1], buffer, sizeof(buffer), MSG_DONTWAIT) < 0)
+        {
+            snWebsocket_waitForEvents(ws, 1);
+        }
+        snWebsocket_poll(ws);
+    }
+    
+    sput_fail_unless(snWebsocket_getBufferedAmount(ws) == 0 &&
+                     snWebsocket_getWantedEvents(ws) == SN_IO_EVENT_READ,
+                     "A websocket should only want to read once its queue has drained");
+    
+    snWebsocket_delete(ws);
+    free(payload);
+}
+
+#endif /*SN_TEST_SEND_QUEUE_H*/
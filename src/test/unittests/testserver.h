@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_SERVER_H
+#define SN_TEST_SERVER_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sput.h"
+#include "frameparser.h"
+#include "masking.h"
+#include "openinghandshakeparser.h"
+#include "sha1.h"
+#include "timerwheel.h"
+#include "websocket.h"
+#include "websocketserver.h"
+
+static void testSHA1()
+{
+    static const char* inputs[3] =
+    {
+        "abc",
+        "",
+        "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+    };
+    static const char* expectedDigests[3] =
+    {
+        "a9993e364706816aba3e25717850c26c9cd0d89d",
+        "da39a3ee5e6b4b0d3255bfef95601890afd80709",
+        "84983e441c3bd26ebaae4aa1f95129e5e54670f1"
+    };
+    int i;
+    
+    for (i = 0; i < 3; i++)
+    {
+        unsigned char digest[SN_SHA1_DIGEST_SIZE];
+        char hexDigest[2 * SN_SHA1_DIGEST_SIZE + 1];
+        int j;
+        
+        snSHA1((const unsigned char*)inputs[i], (int)strlen(inputs[i]), digest);
+        for (j = 0; j < SN_SHA1_DIGEST_SIZE; j++)
+        {
+            sprintf(&hexDigest[2 * j], "%02x", digest[j]);
+        }
+        
+        sput_fail_unless(strcmp(hexDigest, expectedDigests[i]) == 0, "The SHA-1 digest should match the FIPS 180 test vector");
+    }
+    
+    char acceptKey[SN_HANDSHAKE_ACCEPT_KEY_SIZE];
+    snOpeningHandshakeParser_computeAcceptKey("dGhlIHNhbXBsZSBub25jZQ==", acceptKey);
+    sput_fail_unless(strcmp(acceptKey, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == 0,
+                     "The accept key should match the example in RFC 6455");
+}
+
+static snError serverTestParsingResult = SN_NO_ERROR;
+static int serverTestNumParsingCallbacks = 0;
+
+static void serverTestParsingCallback(void* userData, snError result)
+{
+    serverTestParsingResult = result;
+    serverTestNumParsingCallbacks++;
+}
+
+/** Parses a request byte by byte and returns the result passed to the parsing callback. */
+static snError testParseRequest(snOpeningHandshakeParser* p, const char* request)
+{
+    const int numBytes = (int)strlen(request);
+    int i;
+    
+    serverTestParsingResult = SN_NO_ERROR;
+    serverTestNumParsingCallbacks = 0;
+    snOpeningHandshakeParser_initRequestParser(p, serverTestParsingCallback, NULL);
+    
+    for (i = 0; i < numBytes && serverTestNumParsingCallbacks == 0; i++)
+    {
+        int numBytesProcessed = 0;
+        if (snOpeningHandshakeParser_processBytes(p, &request[i], 1, &numBytesProcessed) != SN_NO_ERROR &&
+            serverTestNumParsingCallbacks == 0)
+        {
+            return SN_FAILED_TO_PARSE_OPENING_HANDSHAKE_REQUEST;
+        }
+    }
+    
+    return serverTestNumParsingCallbacks == 1 ? serverTestParsingResult : SN_OPENING_HANDSHAKE_TIMED_OUT;
+}
+
+static void testOpeningHandshakeRequestParser()
+{
+    snOpeningHandshakeParser p;
+    snMutableString response;
+    
+    const snError result = testParseRequest(&p,
+                                            "GET /chat HTTP/1.1\r\n"
+                                            "Host: server.example.com\r\n"
+                                            "upgrade: WebSocket\r\n"
+                                            "Connection: keep-alive, Upgrade\r\n"
+                                            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                            "Sec-WebSocket-Version: 13\r\n\r\n");
+    sput_fail_unless(result == SN_NO_ERROR, "A valid request should be accepted");
+    
+    snMutableString_init(&response);
+    snOpeningHandshakeParser_createOpeningHandshakeResponse(&p, &response);
+    sput_fail_unless(strncmp(snMutableString_getString(&response), "HTTP/1.1 101 ", 13) == 0 &&
+                     strstr(snMutableString_getString(&response),
+                            "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != NULL,
+                     "The response should switch protocols and contain the accept key");
+    snMutableString_deinit(&response);
+    snOpeningHandshakeParser_deinit(&p);
+    
+    sput_fail_unless(testParseRequest(&p,
+                                      "GET / HTTP/1.1\r\n"
+                                      "Upgrade: websocket\r\n"
+                                      "Connection: Upgrade\r\n"
+                                      "Sec-WebSocket-Version: 13\r\n\r\n") != SN_NO_ERROR,
+                     "A request without a key should be rejected");
+    snOpeningHandshakeParser_deinit(&p);
+    
+    sput_fail_unless(testParseRequest(&p,
+                                      "GET / HTTP/1.1\r\n"
+                                      "Upgrade: websocket\r\n"
+                                      "Connection: Upgrade\r\n"
+                                      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                      "Sec-WebSocket-Version: 8\r\n\r\n") != SN_NO_ERROR,
+                     "A request for an unsupported version should be rejected");
+    snOpeningHandshakeParser_deinit(&p);
+    
+    sput_fail_unless(testParseRequest(&p,
+                                      "GET / HTTP/1.1\r\n"
+                                      "Connection: close\r\n"
+                                      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                      "Sec-WebSocket-Version: 13\r\n\r\n") != SN_NO_ERROR,
+                     "A request without an upgrade should be rejected");
+    snOpeningHandshakeParser_deinit(&p);
+    
+    sput_fail_unless(testParseRequest(&p,
+                                      "POST / HTTP/1.1\r\n"
+                                      "Upgrade: websocket\r\n"
+                                      "Connection: Upgrade\r\n"
+                                      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                      "Sec-WebSocket-Version: 13\r\n\r\n") != SN_NO_ERROR,
+                     "A request with a method other than GET should be rejected");
+    snOpeningHandshakeParser_deinit(&p);
+}
+
+static char serverTestMessage[256];
+static int serverTestMessageSize = 0;
+
+static void serverTestMessageCallback(void* userData, snOpcode opcode, const char* bytes, int numBytes)
+{
+    serverTestMessageSize = numBytes < (int)sizeof(serverTestMessage) ? numBytes : (int)sizeof(serverTestMessage);
+    memcpy(serverTestMessage, bytes, serverTestMessageSize);
+}
+
+/** Writes a frame the way a client would, with a masked payload. */
+static int testCreateClientFrame(const char* message, int isMasked, char* frame)
+{
+    snFrameHeader h;
+    int headerSize = 0;
+    const int messageSize = (int)strlen(message);
+    
+    memset(&h, 0, sizeof(snFrameHeader));
+    h.isFinal = 1;
+    h.isMasked = isMasked;
+    h.maskingKey = isMasked ? 0x37fa213d : 0;
+    h.opcode = SN_OPCODE_TEXT;
+    h.payloadSize = messageSize;
+    snFrameHeader_toBytes(&h, frame, &headerSize);
+    
+    memcpy(&frame[headerSize], message, messageSize);
+    if (isMasked)
+    {
+        snMaskPayload((uint32_t)h.maskingKey, &frame[headerSize], messageSize, 0);
+    }
+    
+    return headerSize + messageSize;
+}
+
+static void testFrameParserUnmasking()
+{
+    static const char message[] = "A masked message from a client, long enough for the wide kernels.";
+    char frame[256];
+    snFrameParser p;
+    int numBytesProcessed = 0;
+    int frameSize;
+    
+    snFrameParser_init(&p, NULL, NULL, serverTestMessageCallback, NULL, 1 << 10, 1 << 10);
+    snFrameParser_setRequireMaskedFrames(&p, 1);
+    
+    /*byte by byte, through the parser's buffers*/
+    frameSize = testCreateClientFrame(message, 1, frame);
+    serverTestMessageSize = 0;
+    int i;
+    for (i = 0; i < frameSize; i++)
+    {
+        snFrameParser_processBytes(&p, &frame[i], 1);
+    }
+    sput_fail_unless(serverTestMessageSize == (int)strlen(message) &&
+                     memcmp(serverTestMessage, message, serverTestMessageSize) == 0,
+                     "Masked frames should be unmasked when buffered");
+    
+    /*all at once, in place*/
+    frameSize = testCreateClientFrame(message, 1, frame);
+    serverTestMessageSize = 0;
+    snFrameParser_processBytesInPlace(&p, frame, frameSize, 0, &numBytesProcessed);
+    sput_fail_unless(numBytesProcessed == frameSize &&
+                     serverTestMessageSize == (int)strlen(message) &&
+                     memcmp(serverTestMessage, message, serverTestMessageSize) == 0,
+                     "Masked frames should be unmasked in place");
+    
+    frameSize = testCreateClientFrame(message, 0, frame);
+    sput_fail_unless(snFrameParser_processBytes(&p, frame, frameSize) == SN_UNMASKED_CLIENT_FRAME,
+                     "Unmasked frames should be rejected when masking is required");
+    
+    snFrameParser_reset(&p);
+    snFrameParser_setRequireMaskedFrames(&p, 0);
+    serverTestMessageSize = 0;
+    sput_fail_unless(snFrameParser_processBytes(&p, frame, frameSize) == SN_NO_ERROR &&
+                     serverTestMessageSize == (int)strlen(message),
+                     "Unmasked frames should be accepted by default");
+    
+    snFrameParser_deinit(&p);
+}
+
+#ifdef __linux__
+
+typedef struct serverTestState
+{
+    int numOpened;
+    int numMessages;
+    int numClosed;
+} serverTestState;
+
+static void serverTestOpenCallback(void* userData, snWebsocket* ws)
+{
+    serverTestState* s = (serverTestState*)userData;
+    __atomic_add_fetch(&s->numOpened, 1, __ATOMIC_SEQ_CST);
+}
+
+static void serverTestEchoCallback(void* userData, snWebsocket* ws, snOpcode opcode, const char* bytes, int numBytes)
+{
+    serverTestState* s = (serverTestState*)userData;
+    __atomic_add_fetch(&s->numMessages, 1, __ATOMIC_SEQ_CST);
+    snWebsocket_sendFrame(ws, opcode, numBytes, bytes);
+}
+
+static void serverTestCloseCallback(void* userData, snWebsocket* ws)
+{
+    serverTestState* s = (serverTestState*)userData;
+    __atomic_add_fetch(&s->numClosed, 1, __ATOMIC_SEQ_CST);
+}
+
+/** Polls some clients until a condition holds or two seconds have passed. */
+#define SERVER_TEST_POLL_UNTIL(clients, numClients, condition) \
+{ \
+    const long long startTime = snTimerWheel_getMonotonicTime(); \
+    while (!(condition) && snTimerWheel_getMonotonicTime() - startTime < 2000) \
+    { \
+        int k; \
+        for (k = 0; k < (numClients); k++) \
+        { \
+            snWebsocket_waitForEvents((clients)[k], 1); \
+            snWebsocket_poll((clients)[k]); \
+        } \
+    } \
+}
+
+/**
+ * Connects a few clients to a server with several listener threads on
+ * a loopback port, echoes a message on each and disconnects them.
+ */
+static void testWebsocketServerEcho()
+{
+    static const char message[] = "Echo";
+    snWebsocketServerOptions o;
+    serverTestState s;
+    snWebsocket* clients[4];
+    char url[256];
+    snError error = SN_NO_ERROR;
+    int i;
+    
+    memset(&s, 0, sizeof(serverTestState));
+    memset(&o, 0, sizeof(snWebsocketServerOptions));
+    o.bindAddress = "127.0.0.1";
+    o.numThreads = 2;
+    o.openCallback = serverTestOpenCallback;
+    o.messageCallback = serverTestEchoCallback;
+    o.closeCallback = serverTestCloseCallback;
+    o.callbackData = &s;
+    
+    snWebsocketServer* server = snWebsocketServer_create(&o, &error);
+    if (server == NULL)
+    {
+        sput_fail_unless(0, "Failed to create a loopback server");
+        return;
+    }
+    
+    sput_fail_unless(snWebsocketServer_getPort(server) > 0 && snWebsocketServer_getNumThreads(server) == 2,
+                     "The server should pick a free port for all of its threads");
+    
+    sprintf(url, "ws://127.0.0.1:%d/", snWebsocketServer_getPort(server));
+    serverTestMessageSize = 0;
+    for (i = 0; i < 4; i++)
+    {
+        clients[i] = snWebsocket_create(NULL, serverTestMessageCallback, NULL, NULL, NULL);
+        snWebsocket_connect(clients[i], url);
+    }
+    
+    SERVER_TEST_POLL_UNTIL(clients, 4, __atomic_load_n(&s.numOpened, __ATOMIC_SEQ_CST) == 4 &&
+                                       snWebsocket_getState(clients[0]) == SN_STATE_OPEN &&
+                                       snWebsocket_getState(clients[1]) == SN_STATE_OPEN &&
+                                       snWebsocket_getState(clients[2]) == SN_STATE_OPEN &&
+                                       snWebsocket_getState(clients[3]) == SN_STATE_OPEN);
+    sput_fail_unless(__atomic_load_n(&s.numOpened, __ATOMIC_SEQ_CST) == 4 &&
+                     snWebsocketServer_getNumAcceptedConnections(server) == 4,
+                     "The server should accept all connections");
+    
+    int numEchoed = 0;
+    for (i = 0; i < 4; i++)
+    {
+        serverTestMessageSize = 0;
+        snWebsocket_sendTextData(clients[i], message);
+        SERVER_TEST_POLL_UNTIL(&clients[i], 1, serverTestMessageSize > 0);
+        if (serverTestMessageSize == (int)strlen(message) &&
+            memcmp(serverTestMessage, message, serverTestMessageSize) == 0)
+        {
+            numEchoed++;
+        }
+    }
+    sput_fail_unless(numEchoed == 4 && __atomic_load_n(&s.numMessages, __ATOMIC_SEQ_CST) == 4,
+                     "The server should unmask messages and echo them unmasked");
+    
+    for (i = 0; i < 4; i++)
+    {
+        snWebsocket_disconnect(clients[i], 0);
+    }
+    SERVER_TEST_POLL_UNTIL(clients, 4, __atomic_load_n(&s.numClosed, __ATOMIC_SEQ_CST) == 4);
+    sput_fail_unless(__atomic_load_n(&s.numClosed, __ATOMIC_SEQ_CST) == 4,
+                     "Closed connections should be removed from the server");
+    
+    for (i = 0; i < 4; i++)
+    {
+        snWebsocket_delete(clients[i]);
+    }
+    snWebsocketServer_delete(server);
+}
+
+#else
+
+static void testWebsocketServerEcho()
+{
+    
+}
+
+#endif /*__linux__*/
+
+#endif /*SN_TEST_SERVER_H*/
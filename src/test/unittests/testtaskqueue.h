@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_TASK_QUEUE_H
+#define SN_TEST_TASK_QUEUE_H
+
+#include <pthread.h>
+#include <string.h>
+
+#include "sput.h"
+#include "taskqueue.h"
+
+#define NUM_TASK_QUEUE_TEST_PRODUCERS 4
+
+#define NUM_TASK_QUEUE_TEST_TASKS_PER_PRODUCER 100000
+
+typedef struct testTaskQueueProducer
+{
+    pthread_t thread;
+    snTaskQueue* queue;
+    int index;
+} testTaskQueueProducer;
+
+/** The number of tasks run per producer. */
+static int testTaskQueueCounts[NUM_TASK_QUEUE_TEST_PRODUCERS];
+
+static int numTaskQueueOrderErrors = 0;
+
+/**
+ * Task user data encodes the producer index and a per producer sequence number.
+ */
+static void testTaskQueueTask(void* userData)
+{
+    const long value = (long)userData;
+    const int producer = (int)(value % NUM_TASK_QUEUE_TEST_PRODUCERS);
+    const int sequenceNumber = (int)(value / NUM_TASK_QUEUE_TEST_PRODUCERS);
+    
+    if (sequenceNumber != testTaskQueueCounts[producer])
+    {
+        numTaskQueueOrderErrors++;
+    }
+    testTaskQueueCounts[producer]++;
+}
+
+static void* testTaskQueueProducerFunction(void* userData)
+{
+    testTaskQueueProducer* p = (testTaskQueueProducer*)userData;
+    long i;
+    
+    for (i = 0; i < NUM_TASK_QUEUE_TEST_TASKS_PER_PRODUCER; i++)
+    {
+        snTaskQueue_push(p->queue, testTaskQueueTask, (void*)(i * NUM_TASK_QUEUE_TEST_PRODUCERS + p->index));
+    }
+    
+    return NULL;
+}
+
+static void testTaskQueue()
+{
+    testTaskQueueProducer producers[NUM_TASK_QUEUE_TEST_PRODUCERS];
+    snTaskQueue queue;
+    int numTasks = 0;
+    int i;
+    
+    snTaskQueue_init(&queue);
+    sput_fail_unless(snTaskQueue_isEmpty(&queue), "A new task queue should be empty");
+    
+    memset(testTaskQueueCounts, 0, sizeof(testTaskQueueCounts));
+    numTaskQueueOrderErrors = 0;
+    
+    for (i = 0; i < NUM_TASK_QUEUE_TEST_PRODUCERS; i++)
+    {
+        producers[i].queue = &queue;
+        producers[i].index = i;
+        pthread_create(&producers[i].thread, NULL, testTaskQueueProducerFunction, &producers[i]);
+    }
+    
+    /*consume while the producers are pushing*/
+    while (numTasks < NUM_TASK_QUEUE_TEST_PRODUCERS * NUM_TASK_QUEUE_TEST_TASKS_PER_PRODUCER)
+    {
+        numTasks += snTaskQueue_run(&queue);
+    }
+    
+    for (i = 0; i < NUM_TASK_QUEUE_TEST_PRODUCERS; i++)
+    {
+        pthread_join(producers[i].thread, NULL);
+    }
+    
+    sput_fail_unless(numTasks == NUM_TASK_QUEUE_TEST_PRODUCERS * NUM_TASK_QUEUE_TEST_TASKS_PER_PRODUCER &&
+                     snTaskQueue_run(&queue) == 0,
+                     "Every pushed task should be run exactly once");
+    sput_fail_unless(numTaskQueueOrderErrors == 0,
+                     "Tasks pushed by the same thread should run in order");
+    sput_fail_unless(snTaskQueue_isEmpty(&queue), "A task queue should be empty after running all tasks");
+    
+    snTaskQueue_deinit(&queue);
+}
+
+#endif /*SN_TEST_TASK_QUEUE_H*/
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_THREADED_WEBSOCKET_H
+#define SN_TEST_THREADED_WEBSOCKET_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sput.h"
+#include "testeventloop.h"
+#include "threadedwebsocket.h"
+#include "timerwheel.h"
+
+#define NUM_THREADED_TEST_MESSAGES 1000
+
+/** The size of a masked client frame with a four byte payload. */
+#define THREADED_TEST_CLIENT_FRAME_SIZE 10
+
+/** The peer's end of the socket pair, published by the I/O thread when connecting. */
+static int threadedTestPeerDescriptor = -1;
+
+static int threadedTestNumDeinits = 0;
+
+typedef struct threadedTestState
+{
+    int numOpens;
+    int numCloses;
+    /** The number of messages received, which is also the next expected sequence number. */
+    int numMessages;
+    int numOrderErrors;
+} threadedTestState;
+
+static snError threadedTestConnect(void* ioObject, const char* host, int port)
+{
+    snError result = testSocketPairConnect(ioObject, host, port);
+    if (result == SN_NO_ERROR)
+    {
+        __atomic_store_n(&threadedTestPeerDescriptor, ((testSocketPair*)ioObject)->descriptors[1], __ATOMIC_RELEASE);
+    }
+    return result;
+}
+
+static snError threadedTestDeinit(void* ioObject)
+{
+    __atomic_add_fetch(&threadedTestNumDeinits, 1, __ATOMIC_SEQ_CST);
+    return testSocketPairDeinit(ioObject);
+}
+
+static void threadedTestOpenCallback(void* userData)
+{
+    ((threadedTestState*)userData)->numOpens++;
+}
+
+static void threadedTestCloseCallback(void* userData, snStatusCode status)
+{
+    ((threadedTestState*)userData)->numCloses++;
+}
+
+static void threadedTestMessageCallback(void* userData, snOpcode opcode, const char* data, int numBytes)
+{
+    threadedTestState* s = (threadedTestState*)userData;
+    int sequenceNumber = -1;
+    
+    if (opcode == SN_OPCODE_BINARY && numBytes == sizeof(int))
+    {
+        memcpy(&sequenceNumber, data, sizeof(int));
+    }
+    
+    if (sequenceNumber != s->numMessages)
+    {
+        s->numOrderErrors++;
+    }
+    s->numMessages++;
+}
+
+/** Polls the threaded websocket until a condition holds or a second has passed. */
+#define THREADED_TEST_POLL_UNTIL(tws, condition) \
+{ \
+    const long long startTime = snTimerWheel_getMonotonicTime(); \
+    while (!(condition) && snTimerWheel_getMonotonicTime() - startTime < 1000) \
+    { \
+        snThreadedWebsocket_wait(tws, 10); \
+        snThreadedWebsocket_poll(tws); \
+    } \
+}
+
+/**
+ * Messages should cross the thread boundary in order in both directions,
+ * and deleting the websocket should stop the I/O thread and release
+ * the I/O object.
+ */
+static void testThreadedWebsocket()
+{
+    snIOCallbacks ioc;
+    snWebsocketOptions wo;
+    snThreadedWebsocketOptions o;
+    threadedTestState state;
+    char* received = malloc(NUM_THREADED_TEST_MESSAGES * THREADED_TEST_CLIENT_FRAME_SIZE);
+    int numBytesReceived = 0;
+    int numSent = 0;
+    int numPeerOrderErrors = 0;
+    int i;
+    
+    memset(&ioc, 0, sizeof(snIOCallbacks));
+    ioc.initCallback = testSocketPairInit;
+    ioc.deinitCallback = threadedTestDeinit;
+    ioc.connectCallback = threadedTestConnect;
+    ioc.isOpenCallback = testSocketPairIsOpen;
+    ioc.disconnectCallback = testSocketPairDisconnect;
+    ioc.readCallback = testSocketPairRead;
+    ioc.writeCallback = testSocketPairWrite;
+    ioc.getDescriptorCallback = testSocketPairGetDescriptor;
+    
+    memset(&wo, 0, sizeof(snWebsocketOptions));
+    wo.ioCallbacks = &ioc;
+    
+    memset(&o, 0, sizeof(snThreadedWebsocketOptions));
+    o.websocketOptions = &wo;
+    o.waitStrategy = SN_WAIT_STRATEGY_FUTEX;
+    
+    memset(&state, 0, sizeof(threadedTestState));
+    numTestSocketPairs = 0;
+    threadedTestNumDeinits = 0;
+    threadedTestPeerDescriptor = -1;
+    
+    snThreadedWebsocket* tws = snThreadedWebsocket_create(threadedTestOpenCallback,
+                                                          threadedTestMessageCallback,
+                                                          threadedTestCloseCallback,
+                                                          NULL,
+                                                          &state,
+                                                          &o);
+    snThreadedWebsocket_connect(tws, "ws://localhost/");
+    
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    while (__atomic_load_n(&threadedTestPeerDescriptor, __ATOMIC_ACQUIRE) < 0 &&
+           snTimerWheel_getMonotonicTime() - startTime < 1000)
+    {
+        snThreadedWebsocket_wait(tws, 10);
+    }
+    const int peer = __atomic_load_n(&threadedTestPeerDescriptor, __ATOMIC_ACQUIRE);
+    if (peer < 0)
+    {
+        sput_fail_unless(0, "The I/O thread should connect the websocket");
+        snThreadedWebsocket_delete(tws);
+        free(received);
+        return;
+    }
+    
+    /*the handshake response followed by numbered messages*/
+    testSocketPairRespond(testSocketPairs[0], 0);
+    for (i = 0; i < NUM_THREADED_TEST_MESSAGES; i++)
+    {
+        char frame[2 + sizeof(int)];
+        frame[0] = (char)0x82;
+        frame[1] = sizeof(int);
+        memcpy(&frame[2], &i, sizeof(int));
+        if (write(peer, frame, sizeof(frame)) < 0)
+        {
+            break;
+        }
+    }
+    
+    THREADED_TEST_POLL_UNTIL(tws, state.numMessages == NUM_THREADED_TEST_MESSAGES);
+    
+    sput_fail_unless(state.numOpens == 1 &&
+                     state.numMessages == NUM_THREADED_TEST_MESSAGES &&
+                     state.numOrderErrors == 0,
+                     "Received messages should reach the application thread in order");
+    
+    /*discard the opening handshake request*/
+    char request[1024];
+    if (recv(peer, request, sizeof(request), MSG_DONTWAIT) < 0)
+    {
+        sput_fail_unless(0, "The opening handshake request should have been sent");
+    }
+    
+    while (numBytesReceived < NUM_THREADED_TEST_MESSAGES * THREADED_TEST_CLIENT_FRAME_SIZE &&
+           snTimerWheel_getMonotonicTime() - startTime < 3000)
+    {
+        if (numSent < NUM_THREADED_TEST_MESSAGES &&
+            snThreadedWebsocket_sendBinaryData(tws, sizeof(int), (const char*)&numSent) == SN_NO_ERROR)
+        {
+            numSent++;
+            continue;
+        }
+        
+        /*the send ring is full, or everything has been sent*/
+        const ssize_t n = recv(peer,
+                               &received[numBytesReceived],
+                               NUM_THREADED_TEST_MESSAGES * THREADED_TEST_CLIENT_FRAME_SIZE - numBytesReceived,
+                               MSG_DONTWAIT);
+        if (n > 0)
+        {
+            numBytesReceived += (int)n;
+        }
+        snThreadedWebsocket_poll(tws);
+    }
+    
+    for (i = 0; i < numBytesReceived / THREADED_TEST_CLIENT_FRAME_SIZE; i++)
+    {
+        const char* frame = &received[i * THREADED_TEST_CLIENT_FRAME_SIZE];
+        char payload[sizeof(int)];
+        int sequenceNumber;
+        int j;
+        for (j = 0; j < (int)sizeof(int); j++)
+        {
+            payload[j] = frame[6 + j] ^ frame[2 + j];
+        }
+        memcpy(&sequenceNumber, payload, sizeof(int));
+        
+        if ((unsigned char)frame[0] != 0x82 || sequenceNumber != i)
+        {
+            numPeerOrderErrors++;
+        }
+    }
+    
+    sput_fail_unless(numSent == NUM_THREADED_TEST_MESSAGES &&
+                     numBytesReceived == NUM_THREADED_TEST_MESSAGES * THREADED_TEST_CLIENT_FRAME_SIZE &&
+                     numPeerOrderErrors == 0,
+                     "Sent messages should reach the I/O thread and the peer in order");
+    
+    snThreadedWebsocket_disconnect(tws, 1);
+    THREADED_TEST_POLL_UNTIL(tws, state.numCloses > 0);
+    
+    sput_fail_unless(state.numCloses == 1 &&
+                     snThreadedWebsocket_getState(tws) == SN_STATE_CLOSED,
+                     "Disconnecting should be reported on the application thread");
+    
+    snThreadedWebsocket_delete(tws);
+    
+    sput_fail_unless(threadedTestNumDeinits == 1,
+                     "Deleting should join the I/O thread and release the I/O object");
+    
+    free(received);
+}
+
+#endif /*SN_TEST_THREADED_WEBSOCKET_H*/
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_TIMER_WHEEL_H
+#define SN_TEST_TIMER_WHEEL_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sput.h"
+#include "timerwheel.h"
+#include "websocket.h"
+
+#define NUM_TIMER_WHEEL_TEST_TIMERS 200
+
+/** Long enough to cross a few level 1 slots. */
+#define TIMER_WHEEL_TEST_MAX_DELAY 300
+
+typedef struct testTimer
+{
+    snTimer timer;
+    long long expiryTime;
+    long long fireTime;
+    int numFirings;
+    snTimerWheel* wheel;
+} testTimer;
+
+static long long testTimerLastExpiryTime = 0;
+
+static int numTestTimerOrderErrors = 0;
+
+static void testTimerCallback(void* userData)
+{
+    testTimer* t = (testTimer*)userData;
+    
+    t->fireTime = snTimerWheel_getMonotonicTime();
+    t->numFirings++;
+    
+    if (t->expiryTime < testTimerLastExpiryTime)
+    {
+        numTestTimerOrderErrors++;
+    }
+    testTimerLastExpiryTime = t->expiryTime;
+}
+
+/** Reschedules itself without delay every time it fires. */
+static void testTimerRescheduleCallback(void* userData)
+{
+    testTimer* t = (testTimer*)userData;
+    t->numFirings++;
+    snTimerWheel_schedule(t->wheel, &t->timer, 0);
+}
+
+static void testTimerSleep(int milliseconds)
+{
+    struct timespec sleepTime;
+    sleepTime.tv_sec = milliseconds / 1000;
+    sleepTime.tv_nsec = (milliseconds % 1000) * 1000000L;
+    nanosleep(&sleepTime, NULL);
+}
+
+static void testTimerWheel()
+{
+    static testTimer timers[NUM_TIMER_WHEEL_TEST_TIMERS];
+    testTimer farTimers[2];
+    testTimer rescheduledTimer;
+    snTimerWheel wheel;
+    int numEarlyFirings = 0;
+    int numMissedTimers = 0;
+    int numCancelledFirings = 0;
+    int i;
+    
+    snTimerWheel_init(&wheel);
+    sput_fail_unless(snTimerWheel_getTimeUntilNextTimer(&wheel) == -1,
+                     "An empty timer wheel should have no next timer");
+    
+    memset(timers, 0, sizeof(timers));
+    numTestTimerOrderErrors = 0;
+    testTimerLastExpiryTime = 0;
+    
+    for (i = 0; i < NUM_TIMER_WHEEL_TEST_TIMERS; i++)
+    {
+        const int delay = (i * 7919) % (TIMER_WHEEL_TEST_MAX_DELAY + 1);
+        snTimer_init(&timers[i].timer, testTimerCallback, &timers[i]);
+        snTimerWheel_schedule(&wheel, &timers[i].timer, delay);
+        timers[i].expiryTime = timers[i].timer.expiryTime;
+    }
+    
+    /*cancel every fifth timer*/
+    for (i = 0; i < NUM_TIMER_WHEEL_TEST_TIMERS; i += 5)
+    {
+        snTimer_cancel(&timers[i].timer);
+    }
+    
+    /*wait exactly as long as the wheel says*/
+    const long long deadline = snTimerWheel_getMonotonicTime() + TIMER_WHEEL_TEST_MAX_DELAY + 2000;
+    while (snTimerWheel_getMonotonicTime() < deadline)
+    {
+        const int timeUntilNextTimer = snTimerWheel_getTimeUntilNextTimer(&wheel);
+        if (timeUntilNextTimer < 0)
+        {
+            break;
+        }
+        testTimerSleep(timeUntilNextTimer);
+        snTimerWheel_advance(&wheel);
+    }
+    
+    for (i = 0; i < NUM_TIMER_WHEEL_TEST_TIMERS; i++)
+    {
+        if (i % 5 == 0)
+        {
+            numCancelledFirings += timers[i].numFirings;
+        }
+        else if (timers[i].numFirings != 1)
+        {
+            numMissedTimers++;
+        }
+        else if (timers[i].fireTime < timers[i].expiryTime)
+        {
+            numEarlyFirings++;
+        }
+    }
+    
+    sput_fail_unless(numMissedTimers == 0, "Every scheduled timer should fire exactly once");
+    sput_fail_unless(numCancelledFirings == 0, "Cancelled timers should not fire");
+    sput_fail_unless(numEarlyFirings == 0, "Timers should not fire before their expiry time");
+    sput_fail_unless(numTestTimerOrderErrors == 0, "Timers should fire in order of expiry");
+    
+    /*timers beyond the range of the lower levels, and of the wheel*/
+    snTimer_init(&farTimers[0].timer, testTimerCallback, &farTimers[0]);
+    snTimer_init(&farTimers[1].timer, testTimerCallback, &farTimers[1]);
+    farTimers[0].numFirings = 0;
+    farTimers[1].numFirings = 0;
+    snTimerWheel_schedule(&wheel, &farTimers[0].timer, 10 * 60 * 1000);
+    snTimerWheel_schedule(&wheel, &farTimers[1].timer, 5 * 60 * 60 * 1000);
+    
+    const int timeUntilFarTimer = snTimerWheel_getTimeUntilNextTimer(&wheel);
+    sput_fail_unless(timeUntilFarTimer > 0 && timeUntilFarTimer <= 10 * 60 * 1000 &&
+                     snTimerWheel_advance(&wheel) == 0 &&
+                     snTimer_isScheduled(&farTimers[0].timer) &&
+                     snTimer_isScheduled(&farTimers[1].timer),
+                     "Timers far ahead should stay scheduled and not be reported late");
+    
+    snTimer_cancel(&farTimers[0].timer);
+    snTimer_cancel(&farTimers[1].timer);
+    sput_fail_unless(snTimerWheel_getTimeUntilNextTimer(&wheel) == -1 &&
+                     !snTimer_isScheduled(&farTimers[0].timer),
+                     "A wheel with all timers cancelled should have no next timer");
+    
+    /*a timer rescheduled from its own callback fires once per advance*/
+    snTimer_init(&rescheduledTimer.timer, testTimerRescheduleCallback, &rescheduledTimer);
+    rescheduledTimer.numFirings = 0;
+    rescheduledTimer.wheel = &wheel;
+    snTimerWheel_schedule(&wheel, &rescheduledTimer.timer, 0);
+    testTimerSleep(2);
+    snTimerWheel_advance(&wheel);
+    sput_fail_unless(rescheduledTimer.numFirings == 1 && snTimer_isScheduled(&rescheduledTimer.timer),
+                     "A timer rescheduled by its callback should fire at a later advance");
+    
+    snTimerWheel_deinit(&wheel);
+    sput_fail_unless(!snTimer_isScheduled(&rescheduledTimer.timer),
+                     "Deinitializing a wheel should cancel its timers");
+}
+
+static snError testTimeoutError = SN_NO_ERROR;
+
+static void testTimeoutErrorCallback(void* userData, snError error)
+{
+    testTimeoutError = error;
+}
+
+/**
+ * Connects to a local socket that accepts connections but never
+ * answers the opening handshake.
+ */
+static void testOpeningHandshakeTimeout()
+{
+    struct sockaddr_in address;
+    socklen_t addressSize = sizeof(address);
+    snWebsocketOptions options;
+    char url[256];
+    
+    const int listenDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    
+    if (bind(listenDescriptor, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listenDescriptor, 4) != 0 ||
+        getsockname(listenDescriptor, (struct sockaddr*)&address, &addressSize) != 0)
+    {
+        close(listenDescriptor);
+        sput_fail_unless(0, "Failed to set up a local listening socket");
+        return;
+    }
+    
+    memset(&options, 0, sizeof(options));
+    options.openingHandshakeTimeout = 100;
+    testTimeoutError = SN_NO_ERROR;
+    
+    snWebsocket* ws = snWebsocket_createWithSettings(NULL, NULL, NULL, testTimeoutErrorCallback, NULL, &options);
+    sprintf(url, "ws://127.0.0.1:%d/", ntohs(address.sin_port));
+    snWebsocket_connect(ws, url);
+    
+    const long long startTime = snTimerWheel_getMonotonicTime();
+    while (snWebsocket_getState(ws) != SN_STATE_CLOSED &&
+           snTimerWheel_getMonotonicTime() - startTime < 5000)
+    {
+        snWebsocket_waitForEvents(ws, 1000);
+        snWebsocket_poll(ws);
+    }
+    const long long duration = snTimerWheel_getMonotonicTime() - startTime;
+    
+    sput_fail_unless(testTimeoutError == SN_OPENING_HANDSHAKE_TIMED_OUT &&
+                     snWebsocket_getState(ws) == SN_STATE_CLOSED,
+                     "An unanswered opening handshake should time out");
+    sput_fail_unless(duration >= 100 && duration < 1000,
+                     "Waiting for events should not outlast the opening handshake timeout");
+    sput_fail_unless(snWebsocket_getTimeUntilNextTimer(ws) == -1,
+                     "A closed websocket should have no pending timers");
+    
+    snWebsocket_delete(ws);
+    close(listenDescriptor);
+}
+
+#endif /*SN_TEST_TIMER_WHEEL_H*/
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2013 - 2014, Per Gantelius
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of the copyright holders.
+ */
+
+#ifndef SN_TEST_UTF8_H
+#define SN_TEST_UTF8_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sput.h"
+#include "utf8.h"
+
+static const snUTF8Kernel utf8Kernels[] =
+{
+    SN_UTF8_KERNEL_DFA,
+    SN_UTF8_KERNEL_SCALAR,
+    SN_UTF8_KERNEL_SSE41,
+    SN_UTF8_KERNEL_AVX2
+};
+
+#define NUM_UTF8_KERNELS (sizeof(utf8Kernels) / sizeof(utf8Kernels[0]))
+
+/**
+ * Validates a string in chunks of random size using a given kernel.
+ * @return Non-zero if the string is valid.
+ */
+static int validateUTF8Chunked(snUTF8Kernel kernel, uint8_t* bytes, int numBytes, int maxChunkSize)
+{
+    uint32_t state = 0;
+    int position = 0;
+    
+    while (position < numBytes)
+    {
+        int chunkSize = 1 + rand() % maxChunkSize;
+        if (position + chunkSize > numBytes)
+        {
+            chunkSize = numBytes - position;
+        }
+        
+        if (!snUTF8ValidateStringIncrementalWithKernel(kernel, &bytes[position], chunkSize, &state))
+        {
+            return 0;
+        }
+        position += chunkSize;
+    }
+    
+    return state == 0;
+}
+
+/**
+ * Writes a random, valid UTF-8 string of up to \c maxNumBytes bytes.
+ * @return The number of bytes written.
+ */
+static int generateValidUTF8(uint8_t* bytes, int maxNumBytes, int asciiPercentage)
+{
+    int numBytes = 0;
+    
+    while (1)
+    {
+        uint32_t codePoint;
+        int r = rand() % 100;
+        if (r < asciiPercentage)
+        {
+            codePoint = rand() % 0x80;
+        }
+        else
+        {
+            switch (rand() % 3)
+            {
+                case 0:
+                    codePoint = 0x80 + rand() % (0x800 - 0x80);
+                    break;
+                case 1:
+                    codePoint = 0x800 + rand() % (0x10000 - 0x800);
+                    if (codePoint >= 0xd800 && codePoint <= 0xdfff)
+                    {
+                        codePoint -= 0x800;
+                    }
+                    break;
+                default:
+                    codePoint = 0x10000 + rand() % (0x110000 - 0x10000);
+                    break;
+            }
+        }
+        
+        if (codePoint < 0x80)
+        {
+            if (numBytes + 1 > maxNumBytes) break;
+            bytes[numBytes++] = codePoint;
+        }
+        else if (codePoint < 0x800)
+        {
+            if (numBytes + 2 > maxNumBytes) break;
+            bytes[numBytes++] = 0xc0 | (codePoint >> 6);
+            bytes[numBytes++] = 0x80 | (codePoint & 0x3f);
+        }
+        else if (codePoint < 0x10000)
+        {
+            if (numBytes + 3 > maxNumBytes) break;
+            bytes[numBytes++] = 0xe0 | (codePoint >> 12);
+            bytes[numBytes++] = 0x80 | ((codePoint >> 6) & 0x3f);
+            bytes[numBytes++] = 0x80 | (codePoint & 0x3f);
+        }
+        else
+        {
+            if (numBytes + 4 > maxNumBytes) break;
+            bytes[numBytes++] = 0xf0 | (codePoint >> 18);
+            bytes[numBytes++] = 0x80 | ((codePoint >> 12) & 0x3f);
+            bytes[numBytes++] = 0x80 | ((codePoint >> 6) & 0x3f);
+            bytes[numBytes++] = 0x80 | (codePoint & 0x3f);
+        }
+    }
+    
+    return numBytes;
+}
+
+static void testUTF8KnownSequences()
+{
+    const char* valid[] =
+    {
+        "",
+        "hello",
+        "\xc2\x80",
+        "\xdf\xbf",
+        "\xe0\xa0\x80",
+        "\xed\x9f\xbf",
+        "\xee\x80\x80",
+        "\xef\xbf\xbf",
+        "\xf0\x90\x80\x80",
+        "\xf4\x8f\xbf\xbf",
+        "\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5"
+    };
+    
+    const char* invalid[] =
+    {
+        "\x80",
+        "\xbf",
+        "\xc0\x80",
+        "\xc1\xbf",
+        "\xe0\x80\x80",
+        "\xe0\x9f\xbf",
+        "\xed\xa0\x80",
+        "\xed\xbf\xbf",
+        "\xf0\x80\x80\x80",
+        "\xf0\x8f\xbf\xbf",
+        "\xf4\x90\x80\x80",
+        "\xf5\x80\x80\x80",
+        "\xff",
+        "\xc2",
+        "\xe0\xa0",
+        "\xf0\x90\x80",
+        "\xc2\x41",
+        "\xe0\xa0\x41"
+    };
+    
+    int numValidRejected = 0;
+    int numInvalidAccepted = 0;
+    int k, i, offset;
+    
+    for (k = 0; k < NUM_UTF8_KERNELS; k++)
+    {
+        /*embed each sequence at different offsets in ASCII to hit all block positions*/
+        for (offset = 0; offset < 70; offset++)
+        {
+            for (i = 0; i < sizeof(valid) / sizeof(valid[0]); i++)
+            {
+                uint8_t bytes[256];
+                memset(bytes, 'a', sizeof(bytes));
+                memcpy(&bytes[offset], valid[i], strlen(valid[i]));
+                if (!validateUTF8Chunked(utf8Kernels[k], bytes, 150, 150))
+                {
+                    numValidRejected++;
+                }
+            }
+            
+            for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+            {
+                uint8_t bytes[256];
+                const int length = (int)strlen(invalid[i]);
+                memset(bytes, 'a', sizeof(bytes));
+                memcpy(&bytes[offset], invalid[i], length);
+                if (validateUTF8Chunked(utf8Kernels[k], bytes, 150, 150))
+                {
+                    numInvalidAccepted++;
+                }
+                
+                /*the invalid sequence at the very end*/
+                if (validateUTF8Chunked(utf8Kernels[k], bytes, offset + length, 150))
+                {
+                    numInvalidAccepted++;
+                }
+            }
+        }
+    }
+    
+    sput_fail_unless(numValidRejected == 0, "Valid sequences should be accepted");
+    sput_fail_unless(numInvalidAccepted == 0, "Invalid sequences should be rejected");
+}
+
+static void testUTF8KernelAgreement()
+{
+    const int maxNumBytes = 1 << 12;
+    uint8_t* bytes = malloc(maxNumBytes);
+    int numMismatches = 0;
+    int numValidRejected = 0;
+    int i, k;
+    
+    srand(1234);
+    
+    for (i = 0; i < 500; i++)
+    {
+        const int numBytes = generateValidUTF8(bytes, 1 + rand() % maxNumBytes, rand() % 101);
+        const int maxChunkSize = 1 + rand() % 200;
+        int numCorruptions = i % 3;
+        int c;
+        
+        /*corrupt some of the strings*/
+        for (c = 0; c < numCorruptions && numBytes > 0; c++)
+        {
+            bytes[rand() % numBytes] = rand() % 256;
+        }
+        
+        const int reference = validateUTF8Chunked(SN_UTF8_KERNEL_DFA, bytes, numBytes, numBytes + 1);
+        if (numCorruptions == 0 && !reference)
+        {
+            numValidRejected++;
+        }
+        
+        for (k = 0; k < NUM_UTF8_KERNELS; k++)
+        {
+            if (validateUTF8Chunked(utf8Kernels[k], bytes, numBytes, maxChunkSize) != reference)
+            {
+                numMismatches++;
+            }
+        }
+        
+        if (validateUTF8Chunked(SN_UTF8_KERNEL_AUTO, bytes, numBytes, maxChunkSize) != reference)
+        {
+            numMismatches++;
+        }
+    }
+    
+    sput_fail_unless(numValidRejected == 0, "Valid strings should be accepted");
+    sput_fail_unless(numMismatches == 0, "All kernels should agree");
+    
+    free(bytes);
+}
+
+#endif /*SN_TEST_UTF8_H*/
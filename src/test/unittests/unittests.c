@@ -35,6 +35,26 @@
 #include "testframe.h"
 #include "testframeparser.h"
 #include "testopeninghandshakeparser.h"
+#include "testutf8.h"
+#include "testrandom.h"
+#include "testbase64.h"
+#include "testeventloop.h"
+#include "testeventlooppool.h"
+#include "testtaskqueue.h"
+#include "testringbuffer.h"
+#include "testdispatcher.h"
+#include "testtimerwheel.h"
+#include "testkeepalive.h"
+#include "testresolver.h"
+#include "testfailover.h"
+#include "testfastest.h"
+#include "testreconnect.h"
+#include "testfastopen.h"
+#include "testdeflate.h"
+#include "testsendqueue.h"
+#include "testreceivebuffer.h"
+#include "testthreadedwebsocket.h"
+#include "testserver.h"
 
 /**
  *
@@ -50,6 +70,10 @@ int main(int argc, const char * argv[])
     
     sput_enter_suite("snFrameParser tests");
     sput_run_test(testFrameParserHeaderEquality);
+    sput_run_test(testFrameParserChunking);
+    sput_run_test(testFrameParserInPlace);
+    sput_run_test(testFrameParserStreaming);
+    sput_run_test(testFrameParserMessageSize);
     
     sput_enter_suite("snOpeningHandshakeParser tests");
     sput_run_test(testWellFormedResponse);
@@ -57,6 +81,85 @@ int main(int argc, const char * argv[])
     sput_run_test(testMissingWebsocketKey);
     sput_run_test(testHeaderFollowedByFrames);
     
+    sput_enter_suite("UTF-8 validation tests");
+    sput_run_test(testUTF8KnownSequences);
+    sput_run_test(testUTF8KernelAgreement);
+    
+    sput_enter_suite("snRandom tests");
+    sput_run_test(testRandomKnownOutput);
+    sput_run_test(testRandomSequences);
+    
+    sput_enter_suite("Base64 tests");
+    sput_run_test(testBase64Encode);
+    
+    sput_enter_suite("snEventLoop tests");
+    sput_run_test(testEventLoop);
+    
+    sput_enter_suite("snEventLoopPool tests");
+    sput_run_test(testEventLoopPool);
+    
+    sput_enter_suite("snTaskQueue tests");
+    sput_run_test(testTaskQueue);
+    
+    sput_enter_suite("snRingBuffer tests");
+    sput_run_test(testRingBuffer);
+    
+    sput_enter_suite("snDispatcher tests");
+    sput_run_test(testDispatcher);
+    
+    sput_enter_suite("snTimerWheel tests");
+    sput_run_test(testTimerWheel);
+    sput_run_test(testOpeningHandshakeTimeout);
+    
+    sput_enter_suite("Keepalive tests");
+    sput_run_test(testKeepalive);
+    
+    sput_enter_suite("Send queue tests");
+    sput_run_test(testCloseDrain);
+    sput_run_test(testWantedEvents);
+    
+    sput_enter_suite("Receive buffer tests");
+    sput_run_test(testAdaptiveReceiveBuffer);
+    
+    sput_enter_suite("snThreadedWebsocket tests");
+    sput_run_test(testThreadedWebsocket);
+    
+    sput_enter_suite("snResolver tests");
+    sput_run_test(testResolver);
+    sput_run_test(testResolverCacheEviction);
+    sput_run_test(testResolvingConnect);
+    sput_run_test(testHappyEyeballs);
+    
+    sput_enter_suite("snFailoverWebsocket tests");
+    sput_run_test(testFailover);
+    sput_run_test(testFailoverStandbyOpensFirst);
+    
+    sput_enter_suite("snFastestWebsocket tests");
+    sput_run_test(testFastestEndpoint);
+    
+    sput_enter_suite("Reconnect tests");
+    sput_run_test(testAutoReconnect);
+    sput_run_test(testReconnectBackoff);
+    sput_run_test(testReconnectAfterRefusedConnect);
+    sput_run_test(testReconnectLimits);
+    
+    sput_enter_suite("TCP Fast Open tests");
+    sput_run_test(testFastOpenHandshake);
+    sput_run_test(testFastOpenLoopback);
+    
+    sput_enter_suite("permessage-deflate tests");
+    sput_run_test(testPerMessageDeflateNegotiation);
+    sput_run_test(testPerMessageDeflateCompression);
+    sput_run_test(testFrameParserDeflate);
+    sput_run_test(testWebsocketDeflate);
+    sput_run_test(testDeflateStreamPool);
+    
+    sput_enter_suite("Server tests");
+    sput_run_test(testSHA1);
+    sput_run_test(testOpeningHandshakeRequestParser);
+    sput_run_test(testFrameParserUnmasking);
+    sput_run_test(testWebsocketServerEcho);
+    
     sput_enter_suite("snWebsocket state tests");
     sput_run_test(testConnectionState);
     